@@ -0,0 +1,150 @@
+/*
+ * Shared parts of the effect benchmarks: the test pattern, the setup of
+ * Clutter and the loop that times every frame of the stage.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include "bench-common.h"
+
+/*
+ * A deterministic, high frequency test pattern. The blur's cost doesn't
+ * depend on the content, but a flat image would hide sampling mistakes
+ * when looking at the stage.
+ */
+ClutterContent *
+bench_create_source_image (gint width,
+                           gint height)
+{
+    ClutterContent *image = clutter_image_new ();
+    guint8 *pixels = g_malloc (width * height * 4);
+
+    for (gint y = 0; y < height; y++)
+      {
+        for (gint x = 0; x < width; x++)
+          {
+            guint8 *p = pixels + (y * width + x) * 4;
+            gboolean check = ((x / 16) + (y / 16)) % 2;
+
+            p[0] = check ? 255 : (x * 255) / width;
+            p[1] = check ? 255 : (y * 255) / height;
+            p[2] = ((x ^ y) & 0xff);
+            p[3] = 255;
+          }
+      }
+
+    clutter_image_set_data (CLUTTER_IMAGE (image),
+                            pixels,
+                            COGL_PIXEL_FORMAT_RGBA_8888,
+                            width,
+                            height,
+                            width * 4,
+                            NULL);
+    g_free (pixels);
+
+    return image;
+}
+
+/*
+ * Runs on llvmpipe unless hardware is set, and paints as fast as possible
+ * instead of waiting for the vertical blank.
+ */
+void
+bench_init (int      *argc,
+            char   ***argv,
+            gboolean  hardware)
+{
+    if (!hardware)
+        g_setenv ("LIBGL_ALWAYS_SOFTWARE", "1", FALSE);
+    g_setenv ("CLUTTER_VBLANK", "none", FALSE);
+    g_setenv ("CLUTTER_DEFAULT_FPS", "1000", FALSE);
+
+    if (clutter_init (argc, argv) != CLUTTER_INIT_SUCCESS)
+        g_error ("Unable to initialize Clutter");
+}
+
+/* The JSON report goes to stdout without --output */
+FILE *
+bench_open_output (const gchar *output)
+{
+    FILE *out;
+
+    if (output == NULL)
+        return stdout;
+
+    out = fopen (output, "w");
+    if (out == NULL)
+        g_error ("Unable to open %s for writing", output);
+
+    return out;
+}
+
+void
+bench_close_output (FILE *out)
+{
+    if (out != stdout)
+        fclose (out);
+}
+
+static void
+bench_loop_paint_begin (ClutterActor *stage,
+                        BenchLoop    *loop)
+{
+    loop->paint_start = g_get_monotonic_time ();
+}
+
+static void
+bench_loop_paint_end (ClutterActor *stage,
+                      BenchLoop    *loop)
+{
+    gdouble elapsed;
+
+    // Wait for the GPU, otherwise only submitting the frame is measured
+    cogl_framebuffer_finish (cogl_get_draw_framebuffer ());
+    elapsed = (g_get_monotonic_time () - loop->paint_start) / 1000.0;
+
+    if (!loop->frame_done (loop, elapsed, loop->user_data))
+        return;
+
+    loop->frame++;
+    if (loop->next_frame != NULL)
+        g_idle_add (loop->next_frame, loop->user_data);
+}
+
+/*
+ * Times every paint of the stage. The frame counter starts at 0, set it to
+ * the negative number of warm-up frames before the first one as needed.
+ */
+void
+bench_loop_init (BenchLoop      *loop,
+                 ClutterActor   *stage,
+                 BenchFrameFunc  frame_done,
+                 GSourceFunc     next_frame,
+                 gpointer        user_data)
+{
+    loop->stage = stage;
+    loop->frame = 0;
+    loop->paint_start = 0;
+    loop->frame_done = frame_done;
+    loop->next_frame = next_frame;
+    loop->user_data = user_data;
+
+    g_signal_connect (stage, "paint", G_CALLBACK (bench_loop_paint_begin), loop);
+    g_signal_connect_after (stage, "paint", G_CALLBACK (bench_loop_paint_end), loop);
+}
@@ -0,0 +1,74 @@
+/*
+ * Shared parts of the effect benchmarks: the test pattern, the setup of
+ * Clutter and the loop that times every frame of the stage.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __BENCH_COMMON_H__
+#define __BENCH_COMMON_H__
+
+#include <stdio.h>
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+typedef struct _BenchLoop BenchLoop;
+
+/*
+ * Called from the end of every paint of the stage with the time the frame
+ * took, including the GPU. loop->frame is the number of the frame.
+ * Returning FALSE leaves the frame out: the number stays the same and
+ * next_frame isn't scheduled.
+ */
+typedef gboolean (* BenchFrameFunc) (BenchLoop *loop,
+                                     gdouble    elapsed_ms,
+                                     gpointer   user_data);
+
+struct _BenchLoop {
+    ClutterActor *stage;
+    /* negative while warming up */
+    gint frame;
+    gint64 paint_start;
+
+    BenchFrameFunc frame_done;
+    /* scheduled from an idle after every frame, outside of the paint cycle */
+    GSourceFunc next_frame;
+    gpointer user_data;
+};
+
+ClutterContent *bench_create_source_image (gint width,
+                                           gint height);
+
+void bench_init (int      *argc,
+                 char   ***argv,
+                 gboolean  hardware);
+
+FILE *bench_open_output (const gchar *output);
+void bench_close_output (FILE *out);
+
+void bench_loop_init (BenchLoop      *loop,
+                      ClutterActor   *stage,
+                      BenchFrameFunc  frame_done,
+                      GSourceFunc     next_frame,
+                      gpointer        user_data);
+
+G_END_DECLS
+
+#endif /* __BENCH_COMMON_H__ */
@@ -0,0 +1,251 @@
+/*
+ * Dual Kawase Blur Adaptive Quality Benchmark.
+ *
+ * Blurs content that changes on every frame, once at full quality and once
+ * with the adaptive quality enabled, and reports the time per frame, how
+ * many frames exceeded the budget and which qualities the effect settled
+ * on. On llvmpipe the full chain is far over any sensible budget, so the
+ * adaptive run shows how far the quality has to go down.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+/* one more than the full quality of the effect */
+#define N_QUALITIES 6
+
+static gint n_frames = 240;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gint strength = 14;
+static gdouble budget = 8.0;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred content, the height is 9/16 of it", "PIXELS" },
+    { "strength", 0, 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength", "STRENGTH" },
+    { "budget", 'b', 0, G_OPTION_ARG_DOUBLE, &budget,
+      "Frame budget of the adaptive quality", "MS" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+
+    gboolean adaptive;
+    gdouble total_ms;
+    gint over_budget;
+    gint quality_frames[N_QUALITIES];
+    guint quality_changes;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+static void
+effective_quality_changed (GObject    *effect,
+                           GParamSpec *pspec,
+                           Bench      *bench)
+{
+    if (bench->loop.frame >= 0)
+        bench->quality_changes++;
+}
+
+static void
+bench_setup (Bench *bench)
+{
+    if (bench->effect != NULL)
+        clutter_actor_remove_effect (bench->actor, CLUTTER_EFFECT (bench->effect));
+
+    bench->effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_update_blur_strength (bench->effect, strength);
+    clutter_kawase_blur_effect_set_frame_budget (bench->effect, budget);
+    clutter_kawase_blur_effect_set_adaptive_quality (bench->effect, bench->adaptive);
+    g_signal_connect (bench->effect, "notify::effective-quality",
+                      G_CALLBACK (effective_quality_changed), bench);
+    clutter_actor_add_effect_with_name (bench->actor, "blur", CLUTTER_EFFECT (bench->effect));
+
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+    bench->over_budget = 0;
+    bench->quality_changes = 0;
+    memset (bench->quality_frames, 0, sizeof (bench->quality_frames));
+}
+
+static void
+bench_report (Bench *bench)
+{
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"adaptive\": %s, \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"frames_over_budget\": %d, "
+                            "\"quality_changes\": %u, \"final_quality\": %d, "
+                            "\"frames_per_quality\": [",
+                            bench->adaptive ? "true" : "false",
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            bench->over_budget,
+                            bench->quality_changes,
+                            clutter_kawase_blur_effect_get_effective_quality (bench->effect));
+
+    for (gint i = 0; i < N_QUALITIES; i++)
+        g_string_append_printf (bench->json, "%s%d", i > 0 ? ", " : "", bench->quality_frames[i]);
+
+    g_string_append (bench->json, "] }");
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // The content changes on every frame
+        clutter_kawase_blur_effect_invalidate (bench->effect);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (bench->adaptive)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    bench->adaptive = TRUE;
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame >= 0)
+      {
+        gint quality = clutter_kawase_blur_effect_get_effective_quality (bench->effect);
+
+        bench->total_ms += elapsed_ms;
+        if (elapsed_ms > budget)
+            bench->over_budget++;
+        bench->quality_frames[CLAMP (quality, 0, N_QUALITIES - 1)]++;
+      }
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the adaptive quality");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 16);
+    budget = MAX (budget, 0.01);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    image = bench_create_source_image (size, size * 9 / 16);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_content (bench.actor, image);
+    clutter_actor_set_size (bench.actor, size, size * 9 / 16);
+    clutter_actor_add_child (bench.stage, bench.actor);
+    g_object_unref (image);
+
+    clutter_actor_set_size (bench.stage, size, size * 9 / 16);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_adaptive_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"budget_ms\": %.4f,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             size * 9 / 16,
+             strength,
+             budget,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+/*
+ * Dual Kawase Blur Behind Benchmark.
+ *
+ * Blurs the background of a translucent panel in two ways: with the effect
+ * on the background, limited to the panel by a clip rectangle, which
+ * renders the background into an offscreen texture, and with the effect
+ * on the panel in blur-behind mode (see
+ * clutter_kawase_blur_effect_set_blur_behind()), which copies the
+ * backdrop from the stage instead. The background is redrawn on every
+ * frame. Reports the time, the pixels rendered offscreen or copied and
+ * the passes per frame of both.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+static gint size = 1920;
+static gint n_frames = 60;
+static gint n_warmup = 5;
+static gint strength = 10;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the stage, the height is 9/16 of it and the panel a third of both", "PIXELS" },
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per mode", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "strength", 0, 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength, 0 to 14", "STRENGTH" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef enum {
+    MODE_OFFSCREEN,
+    MODE_BEHIND,
+    N_MODES
+} Mode;
+
+static const gchar *mode_names[N_MODES] = { "offscreen", "behind" };
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *background;
+    ClutterActor *panel;
+    ClutterKawaseBlurEffect *effects[N_MODES];
+
+    Mode mode;
+    gdouble total_ms[N_MODES];
+    gdouble passes[N_MODES];
+    gdouble copied_pixels[N_MODES];
+    gdouble readbacks[N_MODES];
+} Bench;
+
+/* Only the effect of the measured mode is enabled */
+static void
+bench_setup (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+
+    for (gint i = 0; i < N_MODES; i++)
+        clutter_actor_meta_set_enabled (CLUTTER_ACTOR_META (bench->effects[i]),
+                                        i == (gint) bench->mode);
+}
+
+static void
+bench_record (Bench *bench)
+{
+    ClutterKawaseBlurEffectStats stats;
+
+    clutter_kawase_blur_effect_get_stats (bench->effects[bench->mode], &stats);
+
+    bench->passes[bench->mode] = (gdouble) stats.passes_executed / n_frames;
+    bench->copied_pixels[bench->mode] =
+        (gdouble) (stats.offscreen_pixels + stats.backdrop_pixels) / n_frames;
+    bench->readbacks[bench->mode] = (gdouble) stats.backdrop_readbacks / n_frames;
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // The background changes on every frame, so both modes blur it again
+        clutter_actor_queue_redraw (bench->background);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_record (bench);
+
+    if (++bench->mode == N_MODES)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (bench->effects[bench->mode]);
+    else if (loop->frame >= 0)
+        bench->total_ms[bench->mode] += elapsed_ms;
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    ClutterColor panel_color = { 0xff, 0xff, 0xff, 0x40 };
+    cairo_rectangle_int_t panel_rect;
+    FILE *out;
+    gint width, height;
+
+    context = g_option_context_new ("- compare blurring the backdrop offscreen and behind the panel");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    size = MAX (size, 48);
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    strength = CLAMP (strength, 0, 14);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    // Keep the shader compilation out of the measurement
+    clutter_kawase_blur_effect_class_warm_up ();
+
+    width = size;
+    height = size * 9 / 16;
+    panel_rect.x = width / 3;
+    panel_rect.y = height / 3;
+    panel_rect.width = width / 3;
+    panel_rect.height = height / 3;
+
+    bench.stage = clutter_stage_new ();
+
+    image = bench_create_source_image (width, height);
+    bench.background = clutter_actor_new ();
+    clutter_actor_set_content (bench.background, image);
+    clutter_actor_set_size (bench.background, width, height);
+    clutter_actor_add_child (bench.stage, bench.background);
+    g_object_unref (image);
+
+    bench.panel = clutter_actor_new ();
+    clutter_actor_set_background_color (bench.panel, &panel_color);
+    clutter_actor_set_position (bench.panel, panel_rect.x, panel_rect.y);
+    clutter_actor_set_size (bench.panel, panel_rect.width, panel_rect.height);
+    clutter_actor_add_child (bench.stage, bench.panel);
+
+    // The usual way: render the background offscreen and blur the panel's part of it
+    bench.effects[MODE_OFFSCREEN] = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_set_clip_rects (bench.effects[MODE_OFFSCREEN], &panel_rect, 1);
+    clutter_actor_add_effect_with_name (bench.background, "blur",
+                                        CLUTTER_EFFECT (bench.effects[MODE_OFFSCREEN]));
+
+    bench.effects[MODE_BEHIND] = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_set_blur_behind (bench.effects[MODE_BEHIND], TRUE);
+    clutter_actor_add_effect_with_name (bench.panel, "blur",
+                                        CLUTTER_EFFECT (bench.effects[MODE_BEHIND]));
+
+    for (gint i = 0; i < N_MODES; i++)
+        clutter_kawase_blur_effect_update_blur_strength (bench.effects[i], strength);
+
+    clutter_actor_set_size (bench.stage, width, height);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_behind_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"stage_width\": %d,\n"
+             "  \"stage_height\": %d,\n"
+             "  \"panel_width\": %d,\n"
+             "  \"panel_height\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"frames\": %d,\n"
+             "  \"modes\": [\n",
+             hardware ? "false" : "true",
+             width,
+             height,
+             panel_rect.width,
+             panel_rect.height,
+             strength,
+             n_frames);
+
+    for (gint i = 0; i < N_MODES; i++)
+        fprintf (out,
+                 "    { \"mode\": \"%s\", \"mean_ms\": %.4f, \"passes_per_frame\": %.2f, "
+                 "\"source_pixels_per_frame\": %.0f, \"readbacks_per_frame\": %.2f }%s\n",
+                 mode_names[i],
+                 bench.total_ms[i] / n_frames,
+                 bench.passes[i],
+                 bench.copied_pixels[i],
+                 bench.readbacks[i],
+                 i + 1 < N_MODES ? "," : "");
+
+    fprintf (out,
+             "  ],\n"
+             "  \"speedup\": %.3f\n"
+             "}\n",
+             bench.total_ms[MODE_BEHIND] > 0.0
+             ? bench.total_ms[MODE_OFFSCREEN] / bench.total_ms[MODE_BEHIND]
+             : 0.0);
+
+    bench_close_output (out);
+
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
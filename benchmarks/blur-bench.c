@@ -0,0 +1,336 @@
+/*
+ * Dual Kawase Blur Benchmark.
+ *
+ * Headless benchmark measuring the per-frame cost of the Clutter Kawase
+ * blur effect for a range of source sizes and blur strengths.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define N_STRENGTHS 15
+
+typedef struct {
+    gint width;
+    gint height;
+} BenchSize;
+
+static const BenchSize bench_sizes[] = {
+    {  512,  512 },
+    { 1024, 1024 },
+    { 1920, 1080 },
+    { 2560, 1440 },
+    { 3840, 2160 },
+};
+
+static gint n_frames = 60;
+static gint n_warmup = 5;
+static gint max_width = 0;
+static gint roi = 0;
+static gboolean specialized = FALSE;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+static gchar *trace = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "max-width", 's', 0, G_OPTION_ARG_INT, &max_width,
+      "Skip sources wider than this", "PIXELS" },
+    { "roi", 'r', 0, G_OPTION_ARG_INT, &roi,
+      "Only blur a centered rectangle of PERCENT of the width and height", "PERCENT" },
+    { "specialized", 0, 0, G_OPTION_ARG_NONE, &specialized,
+      "Use the shaders specialized for every strength", NULL },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { "trace", 't', 0, G_OPTION_ARG_FILENAME, &trace,
+      "Record a Chrome trace of the blur passes into FILE", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+
+    guint size_index;
+    gint strength;
+    gdouble *samples;
+
+    /* allocations before the measured frames started */
+    guint textures_total;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+static void
+bench_setup_size (Bench *bench)
+{
+    const BenchSize *size = &bench_sizes[bench->size_index];
+    ClutterContent *image;
+
+    if (bench->actor != NULL)
+        clutter_actor_destroy (bench->actor);
+
+    image = bench_create_source_image (size->width, size->height);
+    bench->actor = clutter_actor_new ();
+    clutter_actor_set_content (bench->actor, image);
+    clutter_actor_set_size (bench->actor, size->width, size->height);
+    g_object_unref (image);
+
+    bench->effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    bench->textures_total = 0;
+    clutter_kawase_blur_effect_set_specialized_shaders (bench->effect, specialized);
+    clutter_actor_add_effect_with_name (bench->actor, "blur", CLUTTER_EFFECT (bench->effect));
+
+    if (roi > 0)
+      {
+        cairo_rectangle_int_t rect;
+
+        rect.width = size->width * roi / 100;
+        rect.height = size->height * roi / 100;
+        rect.x = (size->width - rect.width) / 2;
+        rect.y = (size->height - rect.height) / 2;
+        clutter_kawase_blur_effect_set_clip_rects (bench->effect, &rect, 1);
+      }
+
+    clutter_actor_set_size (bench->stage, size->width, size->height);
+    clutter_actor_add_child (bench->stage, bench->actor);
+}
+
+static void
+bench_setup_strength (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+    clutter_kawase_blur_effect_update_blur_strength (bench->effect, bench->strength);
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+    gdouble da = *(const gdouble *) a;
+    gdouble db = *(const gdouble *) b;
+
+    return (da > db) - (da < db);
+}
+
+static gdouble
+percentile (const gdouble *sorted,
+            gint           n,
+            gdouble        p)
+{
+    gint index = (gint) ceil (p * n) - 1;
+
+    return sorted[CLAMP (index, 0, n - 1)];
+}
+
+static void
+bench_report (Bench *bench)
+{
+    const BenchSize *size = &bench_sizes[bench->size_index];
+    ClutterKawaseBlurEffectStats stats;
+    gdouble mean = 0.0;
+
+    clutter_kawase_blur_effect_get_stats (bench->effect, &stats);
+
+    for (gint i = 0; i < n_frames; i++)
+        mean += bench->samples[i];
+    mean /= n_frames;
+
+    qsort (bench->samples, n_frames, sizeof (gdouble), compare_samples);
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"width\": %d, \"height\": %d, \"strength\": %d, "
+                            "\"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+                            "\"cpu_ms\": %.4f, "
+                            "\"passes_per_frame\": %.2f, "
+                            "\"pixels_per_frame\": %.0f, "
+                            "\"texture_allocations\": %u, "
+                            "\"framebuffer_allocations\": %u, "
+                            "\"total_texture_allocations\": %u, "
+                            "\"pyramid_bytes\": %" G_GUINT64_FORMAT " }",
+                            size->width, size->height, bench->strength,
+                            n_frames,
+                            mean,
+                            percentile (bench->samples, n_frames, 0.50),
+                            percentile (bench->samples, n_frames, 0.99),
+                            (stats.pre_paint_time + stats.paint_target_time) / 1000.0 / n_frames,
+                            (gdouble) stats.passes_executed / n_frames,
+                            (gdouble) stats.pixels_rasterized / n_frames,
+                            stats.textures_allocated,
+                            stats.framebuffers_allocated,
+                            bench->textures_total + stats.textures_allocated,
+                            stats.pyramid_bytes);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // Throw away the cached blur so that every frame runs the full chain
+        clutter_kawase_blur_effect_invalidate (bench->effect);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (++bench->strength == N_STRENGTHS)
+      {
+        bench->strength = 0;
+
+        do
+            bench->size_index++;
+        while (bench->size_index < G_N_ELEMENTS (bench_sizes) &&
+               max_width > 0 &&
+               bench_sizes[bench->size_index].width > max_width);
+
+        if (bench->size_index == G_N_ELEMENTS (bench_sizes))
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+
+        bench_setup_size (bench);
+      }
+
+    bench_setup_strength (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+      {
+        bench->textures_total += clutter_kawase_blur_effect_get_texture_allocations (bench->effect);
+        clutter_kawase_blur_effect_reset_stats (bench->effect);
+      }
+    else if (loop->frame >= 0)
+      {
+        bench->samples[loop->frame] = elapsed_ms;
+      }
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    const gchar *debug;
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the Kawase blur effect");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    roi = CLAMP (roi, 0, 100);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.samples = g_new0 (gdouble, n_frames);
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    while (max_width > 0 &&
+           bench.size_index < G_N_ELEMENTS (bench_sizes) &&
+           bench_sizes[bench.size_index].width > max_width)
+        bench.size_index++;
+    if (bench.size_index == G_N_ELEMENTS (bench_sizes))
+        g_error ("No source size is smaller than %d pixels", max_width);
+
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup_size (&bench);
+    bench_setup_strength (&bench);
+    clutter_actor_show (bench.stage);
+
+    if (trace != NULL)
+        clutter_kawase_blur_effect_class_start_trace ();
+
+    clutter_main ();
+
+    if (trace != NULL &&
+        !clutter_kawase_blur_effect_class_stop_trace (trace, &error))
+        g_error ("Unable to write the trace: %s", error->message);
+
+    debug = g_getenv ("CLUTTER_KAWASE_BLUR_DEBUG");
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"sync_passes\": %s,\n"
+             "  \"roi_percent\": %d,\n"
+             "  \"specialized\": %s,\n"
+             "  \"traced\": %s,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             (debug != NULL && strstr (debug, "sync-passes") != NULL) ? "true" : "false",
+             roi,
+             specialized ? "true" : "false",
+             trace != NULL ? "true" : "false",
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    g_free (bench.samples);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
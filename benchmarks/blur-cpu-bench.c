@@ -0,0 +1,280 @@
+/*
+ * Dual Kawase Blur CPU Benchmark.
+ *
+ * Measures the throughput of the scalar, SSE2 and AVX2 kernels of the CPU
+ * blur engine in megapixels per second, and checks that all of them
+ * produce the same image. Doesn't need a display. With --width and
+ * --height only that size is measured, which the blur_cpu_kernels test
+ * uses to run the check quickly.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "clutter-kawase-blur-cpu.h"
+
+typedef struct {
+    gint width;
+    gint height;
+} BenchSize;
+
+static const BenchSize bench_sizes[] = {
+    {  512,  512 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+static const ClutterKawaseBlurCpuKernel bench_kernels[] = {
+    CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR,
+    CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2,
+    CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2,
+};
+
+/* The strongest offset of every iteration count, see the blur_offsets table
+ * of the effect */
+static const gfloat chain_offsets[] = { 2.0f, 3.0f, 5.0f, 8.0f, 10.0f };
+
+typedef enum {
+    BENCH_DOWNSAMPLE,
+    BENCH_UPSAMPLE,
+    BENCH_CHAIN
+} BenchOp;
+
+static gint n_runs = 10;
+static gint width_arg = 0;
+static gint height_arg = 0;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "runs", 'n', 0, G_OPTION_ARG_INT, &n_runs,
+      "Number of measured runs per configuration", "N" },
+    { "width", 0, 0, G_OPTION_ARG_INT, &width_arg,
+      "Only measure source images of this width (needs --height)", "PIXELS" },
+    { "height", 0, 0, G_OPTION_ARG_INT, &height_arg,
+      "Only measure source images of this height (needs --width)", "PIXELS" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+static void
+image_init (ClutterKawaseBlurCpuImage *image,
+            gint                       width,
+            gint                       height)
+{
+    image->width = width;
+    image->height = height;
+    image->rowstride = width * 4;
+    image->data = g_malloc0 (image->rowstride * height);
+}
+
+/* Same test pattern as blur_bench */
+static void
+image_fill_pattern (ClutterKawaseBlurCpuImage *image)
+{
+    for (gint y = 0; y < image->height; y++)
+      {
+        for (gint x = 0; x < image->width; x++)
+          {
+            guint8 *p = image->data + y * image->rowstride + x * 4;
+            gboolean check = ((x / 16) + (y / 16)) % 2;
+
+            p[0] = check ? 255 : (x * 255) / image->width;
+            p[1] = check ? 255 : (y * 255) / image->height;
+            p[2] = ((x ^ y) & 0xff);
+            p[3] = 255;
+          }
+      }
+}
+
+static void
+bench_op (ClutterKawaseBlurCpu            *cpu,
+          BenchOp                          op,
+          gint                             iterations,
+          const ClutterKawaseBlurCpuImage *src,
+          ClutterKawaseBlurCpuImage       *half,
+          ClutterKawaseBlurCpuImage       *full)
+{
+    gfloat halfpixel_x = 0.5f / src->width;
+    gfloat halfpixel_y = 0.5f / src->height;
+
+    switch (op)
+      {
+      case BENCH_DOWNSAMPLE:
+        clutter_kawase_blur_cpu_downsample (cpu, src, half, halfpixel_x, halfpixel_y, 2.0f);
+        break;
+
+      case BENCH_UPSAMPLE:
+        clutter_kawase_blur_cpu_upsample (cpu, half, full, halfpixel_x, halfpixel_y, 2.0f);
+        break;
+
+      case BENCH_CHAIN:
+        clutter_kawase_blur_cpu_run (cpu, src, full, iterations, chain_offsets[iterations - 1]);
+        break;
+      }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    static const gchar *op_names[] = { "downsample", "upsample", "chain" };
+    GOptionContext *context;
+    GError *error = NULL;
+    GString *json = g_string_new (NULL);
+    const BenchSize *sizes = bench_sizes;
+    guint n_sizes = G_N_ELEMENTS (bench_sizes);
+    BenchSize custom_size;
+    gboolean identical = TRUE;
+    FILE *out = stdout;
+
+    context = g_option_context_new ("- benchmark the CPU Kawase blur kernels");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_runs = MAX (n_runs, 1);
+
+    if (width_arg > 0 && height_arg > 0)
+      {
+        custom_size.width = width_arg;
+        custom_size.height = height_arg;
+        sizes = &custom_size;
+        n_sizes = 1;
+      }
+
+    if (output != NULL)
+      {
+        out = fopen (output, "w");
+        if (out == NULL)
+            g_error ("Unable to open %s for writing", output);
+      }
+
+    for (guint s = 0; s < n_sizes; s++)
+      {
+        const BenchSize *size = &sizes[s];
+        ClutterKawaseBlurCpuImage src, half, full, reference;
+
+        image_init (&src, size->width, size->height);
+        image_init (&half, MAX (size->width >> 1, 1), MAX (size->height >> 1, 1));
+        image_init (&full, size->width, size->height);
+        image_init (&reference, size->width, size->height);
+        image_fill_pattern (&src);
+
+        for (BenchOp op = BENCH_DOWNSAMPLE; op <= BENCH_CHAIN; op++)
+          {
+            gint max_iterations = op == BENCH_CHAIN ? G_N_ELEMENTS (chain_offsets) : 1;
+
+            for (gint iterations = 1; iterations <= max_iterations; iterations++)
+              {
+                for (guint k = 0; k < G_N_ELEMENTS (bench_kernels); k++)
+                  {
+                    ClutterKawaseBlurCpuKernel kernel = bench_kernels[k];
+                    ClutterKawaseBlurCpu *cpu;
+                    ClutterKawaseBlurCpuImage *result;
+                    gboolean matches;
+                    gint64 start, elapsed;
+                    gdouble megapixels;
+
+                    if (!clutter_kawase_blur_cpu_kernel_supported (kernel))
+                        continue;
+
+                    cpu = clutter_kawase_blur_cpu_new ();
+                    clutter_kawase_blur_cpu_set_kernel (cpu, kernel);
+
+                    // Warm up, this also allocates the pyramid
+                    bench_op (cpu, op, iterations, &src, &half, &full);
+
+                    start = g_get_monotonic_time ();
+                    for (gint run = 0; run < n_runs; run++)
+                        bench_op (cpu, op, iterations, &src, &half, &full);
+                    elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+                    clutter_kawase_blur_cpu_free (cpu);
+
+                    // The scalar kernel is the reference for the vector ones
+                    result = op == BENCH_DOWNSAMPLE ? &half : &full;
+                    if (kernel == CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR)
+                      {
+                        memcpy (reference.data, result->data, result->rowstride * result->height);
+                        matches = TRUE;
+                      }
+                    else
+                      {
+                        matches = memcmp (reference.data, result->data,
+                                          result->rowstride * result->height) == 0;
+                        identical &= matches;
+                      }
+
+                    // Throughput is given in megapixels of the full size image
+                    megapixels = (gdouble) size->width * size->height * n_runs / 1e6;
+
+                    if (json->len > 0)
+                        g_string_append (json, ",\n");
+                    g_string_append_printf (json,
+                                            "    { \"width\": %d, \"height\": %d, "
+                                            "\"op\": \"%s\", \"iterations\": %d, "
+                                            "\"kernel\": \"%s\", "
+                                            "\"ms\": %.4f, \"megapixels_per_s\": %.2f, "
+                                            "\"matches_scalar\": %s }",
+                                            size->width, size->height,
+                                            op_names[op], iterations,
+                                            clutter_kawase_blur_cpu_kernel_get_name (kernel),
+                                            elapsed / 1000.0 / n_runs,
+                                            megapixels / (elapsed / 1e6),
+                                            matches ? "true" : "false");
+                  }
+              }
+          }
+
+        g_free (src.data);
+        g_free (half.data);
+        g_free (full.data);
+        g_free (reference.data);
+      }
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_cpu_bench\",\n"
+             "  \"identical\": %s,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             identical ? "true" : "false",
+             json->str);
+
+    if (out != stdout)
+        fclose (out);
+
+    g_string_free (json, TRUE);
+
+    if (!identical)
+      {
+        g_printerr ("The vector kernels don't match the scalar kernel\n");
+        return EXIT_FAILURE;
+      }
+
+    return EXIT_SUCCESS;
+}
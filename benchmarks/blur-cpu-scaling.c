@@ -0,0 +1,205 @@
+/*
+ * Dual Kawase Blur CPU Scaling Benchmark.
+ *
+ * Measures how the multithreaded CPU blur engine scales with the number
+ * of threads for every blur strength of the effect, and checks that
+ * splitting the passes into bands doesn't change the result. Doesn't need
+ * a display.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clutter-kawase-blur-effect.h"
+#include "clutter-kawase-blur-cpu.h"
+
+#define N_STRENGTHS 15
+
+static const gint bench_threads[] = { 1, 2, 4, 8, 16 };
+
+static gint n_runs = 5;
+static gint width = 3840;
+static gint height = 2160;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "runs", 'n', 0, G_OPTION_ARG_INT, &n_runs,
+      "Number of measured runs per configuration", "N" },
+    { "width", 0, 0, G_OPTION_ARG_INT, &width,
+      "Width of the source image", "PIXELS" },
+    { "height", 0, 0, G_OPTION_ARG_INT, &height,
+      "Height of the source image", "PIXELS" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+static void
+image_init (ClutterKawaseBlurCpuImage *image)
+{
+    image->width = width;
+    image->height = height;
+    image->rowstride = width * 4;
+    image->data = g_malloc0 (image->rowstride * height);
+}
+
+/* Same test pattern as blur_bench */
+static void
+image_fill_pattern (ClutterKawaseBlurCpuImage *image)
+{
+    for (gint y = 0; y < image->height; y++)
+      {
+        for (gint x = 0; x < image->width; x++)
+          {
+            guint8 *p = image->data + y * image->rowstride + x * 4;
+            gboolean check = ((x / 16) + (y / 16)) % 2;
+
+            p[0] = check ? 255 : (x * 255) / image->width;
+            p[1] = check ? 255 : (y * 255) / image->height;
+            p[2] = ((x ^ y) & 0xff);
+            p[3] = 255;
+          }
+      }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GString *json = g_string_new (NULL);
+    ClutterKawaseBlurCpuImage src, dst, reference;
+    ClutterKawaseBlurCpu *cpu;
+    gboolean identical = TRUE;
+    FILE *out = stdout;
+
+    context = g_option_context_new ("- measure the thread scaling of the CPU Kawase blur");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_runs = MAX (n_runs, 1);
+    width = MAX (width, 1);
+    height = MAX (height, 1);
+
+    if (output != NULL)
+      {
+        out = fopen (output, "w");
+        if (out == NULL)
+            g_error ("Unable to open %s for writing", output);
+      }
+
+    image_init (&src);
+    image_init (&dst);
+    image_init (&reference);
+    image_fill_pattern (&src);
+
+    cpu = clutter_kawase_blur_cpu_new ();
+
+    for (gint strength = 0; strength < N_STRENGTHS; strength++)
+      {
+        gint iterations;
+        gfloat offset;
+        gdouble single_ms = 0.0;
+
+        clutter_kawase_blur_effect_get_strength_parameters (strength, &iterations, &offset);
+
+        for (guint t = 0; t < G_N_ELEMENTS (bench_threads); t++)
+          {
+            gint64 start, elapsed;
+            gdouble ms;
+            gboolean matches;
+
+            clutter_kawase_blur_cpu_set_n_threads (cpu, bench_threads[t]);
+
+            // Warm up, this also spawns the threads
+            clutter_kawase_blur_cpu_run (cpu, &src, &dst, iterations, offset);
+
+            start = g_get_monotonic_time ();
+            for (gint run = 0; run < n_runs; run++)
+                clutter_kawase_blur_cpu_run (cpu, &src, &dst, iterations, offset);
+            elapsed = MAX (g_get_monotonic_time () - start, 1);
+            ms = elapsed / 1000.0 / n_runs;
+
+            // Splitting the passes into bands must not change the result
+            if (t == 0)
+              {
+                single_ms = ms;
+                memcpy (reference.data, dst.data, dst.rowstride * dst.height);
+                matches = TRUE;
+              }
+            else
+              {
+                matches = memcmp (reference.data, dst.data, dst.rowstride * dst.height) == 0;
+                identical &= matches;
+              }
+
+            if (json->len > 0)
+                g_string_append (json, ",\n");
+            g_string_append_printf (json,
+                                    "    { \"strength\": %d, \"iterations\": %d, "
+                                    "\"offset\": %.4f, \"threads\": %d, "
+                                    "\"ms\": %.4f, \"speedup\": %.2f, "
+                                    "\"matches_single_thread\": %s }",
+                                    strength, iterations, offset,
+                                    bench_threads[t], ms, single_ms / ms,
+                                    matches ? "true" : "false");
+          }
+      }
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_cpu_scaling\",\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"kernel\": \"%s\",\n"
+             "  \"processors\": %u,\n"
+             "  \"identical\": %s,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             width, height,
+             clutter_kawase_blur_cpu_kernel_get_name (clutter_kawase_blur_cpu_get_kernel (cpu)),
+             g_get_num_processors (),
+             identical ? "true" : "false",
+             json->str);
+
+    if (out != stdout)
+        fclose (out);
+
+    clutter_kawase_blur_cpu_free (cpu);
+    g_string_free (json, TRUE);
+    g_free (src.data);
+    g_free (dst.data);
+    g_free (reference.data);
+
+    if (!identical)
+      {
+        g_printerr ("The multithreaded results don't match the single threaded one\n");
+        return EXIT_FAILURE;
+      }
+
+    return EXIT_SUCCESS;
+}
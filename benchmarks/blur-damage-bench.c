@@ -0,0 +1,247 @@
+/*
+ * Dual Kawase Blur Damage Benchmark.
+ *
+ * Blurs a static background with a small square on top whose color changes
+ * on every frame, like a clock or a cursor on a blurred panel. Every square
+ * size is measured once with the whole chain recomputed on every frame and
+ * once with the square reported as damage (see
+ * clutter_kawase_blur_effect_add_damage()), and the report compares the
+ * time and the pixels written per frame.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+static const gint damage_sizes[] = { 16, 64, 256 };
+
+static gint n_frames = 60;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gint strength = 14;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred actor, the height is 9/16 of it", "PIXELS" },
+    { "strength", 0, 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength", "STRENGTH" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterActor *square;
+    ClutterKawaseBlurEffect *effect;
+
+    guint size_index;
+    gboolean incremental;
+    gdouble total_ms;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+static void
+bench_setup (Bench *bench)
+{
+    gint square = damage_sizes[bench->size_index];
+
+    clutter_actor_set_size (bench->square, square, square);
+    clutter_actor_set_position (bench->square,
+                                (size - square) / 2,
+                                (size * 9 / 16 - square) / 2);
+
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+}
+
+static void
+bench_report (Bench *bench)
+{
+    ClutterKawaseBlurEffectStats stats;
+
+    clutter_kawase_blur_effect_get_stats (bench->effect, &stats);
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"damage_size\": %d, \"incremental\": %s, \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"pixels_per_frame\": %.0f, "
+                            "\"incremental_frames\": %" G_GUINT64_FORMAT " }",
+                            damage_sizes[bench->size_index],
+                            bench->incremental ? "true" : "false",
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            (gdouble) stats.pixels_rasterized / n_frames,
+                            stats.incremental_frames);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        ClutterColor color = { bench->loop.frame * 37, 128, 255 - bench->loop.frame * 37, 255 };
+
+        // Changing the color queues a redraw of the blurred actor
+        clutter_actor_set_background_color (bench->square, &color);
+
+        if (bench->incremental)
+          {
+            cairo_rectangle_int_t rect = {
+                (gint) clutter_actor_get_x (bench->square),
+                (gint) clutter_actor_get_y (bench->square),
+                (gint) clutter_actor_get_width (bench->square),
+                (gint) clutter_actor_get_height (bench->square),
+            };
+
+            clutter_kawase_blur_effect_add_damage (bench->effect, &rect, 1);
+          }
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (bench->incremental)
+      {
+        bench->incremental = FALSE;
+        if (++bench->size_index == G_N_ELEMENTS (damage_sizes))
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+    else
+        bench->incremental = TRUE;
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (bench->effect);
+    else if (loop->frame >= 0)
+        bench->total_ms += elapsed_ms;
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the incremental update of damaged regions");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 512);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    image = bench_create_source_image (size, size * 9 / 16);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_content (bench.actor, image);
+    clutter_actor_set_size (bench.actor, size, size * 9 / 16);
+    clutter_actor_add_child (bench.stage, bench.actor);
+    g_object_unref (image);
+
+    bench.square = clutter_actor_new ();
+    clutter_actor_add_child (bench.actor, bench.square);
+
+    bench.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_update_blur_strength (bench.effect, strength);
+    clutter_actor_add_effect_with_name (bench.actor, "blur", CLUTTER_EFFECT (bench.effect));
+
+    clutter_actor_set_size (bench.stage, size, size * 9 / 16);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_damage_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             size * 9 / 16,
+             strength,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/*
+ * Dual Kawase Blur Offscreen Downscale Benchmark.
+ *
+ * Blurs an actor whose content is redrawn on every frame at all 15 blur
+ * strengths, with the actor rendered at full, half and quarter resolution
+ * (see clutter_kawase_blur_effect_set_offscreen_downscale()), and reports
+ * the time, the pixels written and the video memory per configuration,
+ * together with the savings over full resolution at the same strength.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define N_STRENGTHS 15
+#define N_DOWNSCALES 3
+
+static gint n_frames = 30;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred actor, the height is 9/16 of it", "PIXELS" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+
+    gint strength;
+    gint downscale;
+    gdouble total_ms;
+
+    /* full resolution results of the current strength */
+    gdouble full_pixels;
+    guint64 full_bytes;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+static void
+bench_setup (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+
+    clutter_kawase_blur_effect_update_blur_strength (bench->effect, bench->strength);
+    clutter_kawase_blur_effect_set_offscreen_downscale (bench->effect, bench->downscale);
+}
+
+static void
+bench_report (Bench *bench)
+{
+    ClutterKawaseBlurEffectStats stats;
+    gdouble pixels;
+    guint64 bytes;
+
+    clutter_kawase_blur_effect_get_stats (bench->effect, &stats);
+
+    // The actor itself is part of the fill rate the downscale saves
+    pixels = (gdouble) (stats.offscreen_pixels + stats.pixels_rasterized) / n_frames;
+    bytes = stats.offscreen_bytes + stats.pyramid_bytes;
+
+    if (bench->downscale == 0)
+      {
+        bench->full_pixels = pixels;
+        bench->full_bytes = bytes;
+      }
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"strength\": %d, \"downscale\": %d, \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"passes_per_frame\": %.2f, "
+                            "\"pixels_per_frame\": %.0f, \"bytes\": %" G_GUINT64_FORMAT ", "
+                            "\"pixels_saved\": %.3f, \"bytes_saved\": %.3f }",
+                            bench->strength,
+                            bench->downscale,
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            (gdouble) stats.passes_executed / n_frames,
+                            pixels,
+                            bytes,
+                            bench->full_pixels > 0.0 ? 1.0 - pixels / bench->full_pixels : 0.0,
+                            bench->full_bytes > 0 ? 1.0 - (gdouble) bytes / bench->full_bytes : 0.0);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // Redraw the actor, not only the blur, so that its fill rate counts
+        clutter_actor_queue_redraw (bench->actor);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (++bench->downscale == N_DOWNSCALES)
+      {
+        bench->downscale = 0;
+        if (++bench->strength == N_STRENGTHS)
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (bench->effect);
+    else if (loop->frame >= 0)
+        bench->total_ms += elapsed_ms;
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the downscaled offscreen rendering");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 16);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    image = bench_create_source_image (size, size * 9 / 16);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_content (bench.actor, image);
+    clutter_actor_set_size (bench.actor, size, size * 9 / 16);
+    clutter_actor_add_child (bench.stage, bench.actor);
+    g_object_unref (image);
+
+    bench.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_actor_add_effect_with_name (bench.actor, "blur", CLUTTER_EFFECT (bench.effect));
+
+    clutter_actor_set_size (bench.stage, size, size * 9 / 16);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_downscale_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             size * 9 / 16,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+/*
+ * Dual Kawase Blur Engine Benchmark.
+ *
+ * Blurs an actor whose content is redrawn on every frame at all 15 blur
+ * strengths with every blur algorithm (see
+ * clutter_kawase_blur_effect_set_mode()), and reports the time, the passes,
+ * the pixels written and the estimated memory traffic per frame. After the
+ * measured frames, every configuration blurs a black image with a white
+ * vertical bar in its center once; the horizontal spread of the blurred
+ * bar gives the blur radius the time was spent on, as the standard
+ * deviation of the kernel in pixels.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define N_STRENGTHS 15
+#define N_MODES 2
+
+/* Width of the bar the radius is measured with */
+#define BAR_WIDTH 64
+
+/* Rows around the center the profile of the bar is averaged over */
+#define PROFILE_ROWS 16
+
+static gint n_frames = 30;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred actor, the height is 9/16 of it", "PIXELS" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+static const struct {
+    ClutterKawaseBlurMode mode;
+    const gchar *name;
+} modes[N_MODES] = {
+    { CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE, "dual-kawase" },
+    { CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN, "gaussian" },
+};
+
+typedef struct {
+    /* loop.frame is n_frames for the frame with the bar */
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+    ClutterContent *pattern;
+    ClutterContent *bar;
+    gint width;
+    gint height;
+
+    gint strength;
+    gint mode;
+    gdouble total_ms;
+    ClutterKawaseBlurEffectStats stats;
+
+    /* the stage contents after the frame with the bar */
+    guint8 *result;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+/* Black, with a white bar of BAR_WIDTH pixels in the center */
+static ClutterContent *
+create_bar_image (gint width,
+                  gint height)
+{
+    ClutterContent *image = clutter_image_new ();
+    guint8 *pixels = g_malloc (width * height * 4);
+    gint bar_start = (width - BAR_WIDTH) / 2;
+
+    for (gint y = 0; y < height; y++)
+      {
+        for (gint x = 0; x < width; x++)
+          {
+            guint8 *p = pixels + (y * width + x) * 4;
+            guint8 value = (x >= bar_start && x < bar_start + BAR_WIDTH) ? 255 : 0;
+
+            p[0] = value;
+            p[1] = value;
+            p[2] = value;
+            p[3] = 255;
+          }
+      }
+
+    clutter_image_set_data (CLUTTER_IMAGE (image),
+                            pixels,
+                            COGL_PIXEL_FORMAT_RGBA_8888,
+                            width,
+                            height,
+                            width * 4,
+                            NULL);
+    g_free (pixels);
+
+    return image;
+}
+
+/*
+ * Standard deviation of the blur in pixels. Blurring adds the variance of
+ * the kernel to that of the bar's horizontal profile, which is
+ * BAR_WIDTH² / 12 before blurring.
+ */
+static gdouble
+measure_sigma (Bench *bench)
+{
+    gdouble sum = 0.0, mean = 0.0, variance = 0.0;
+    gint first_row = (bench->height - PROFILE_ROWS) / 2;
+
+    for (gint pass = 0; pass < 2; pass++)
+      {
+        for (gint y = first_row; y < first_row + PROFILE_ROWS; y++)
+          {
+            for (gint x = 0; x < bench->width; x++)
+              {
+                gdouble value = bench->result[(y * bench->width + x) * 4];
+
+                if (pass == 0)
+                  {
+                    sum += value;
+                    mean += value * x;
+                  }
+                else
+                    variance += value * (x - mean) * (x - mean);
+              }
+          }
+
+        if (sum == 0.0)
+            return 0.0;
+        if (pass == 0)
+            mean /= sum;
+      }
+
+    variance = variance / sum - BAR_WIDTH * BAR_WIDTH / 12.0;
+
+    return sqrt (MAX (variance, 0.0));
+}
+
+static void
+bench_setup (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+
+    clutter_actor_set_content (bench->actor, bench->pattern);
+    clutter_kawase_blur_effect_update_blur_strength (bench->effect, bench->strength);
+    clutter_kawase_blur_effect_set_mode (bench->effect, modes[bench->mode].mode);
+}
+
+static void
+bench_report (Bench *bench)
+{
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"strength\": %d, \"mode\": \"%s\", \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"passes_per_frame\": %.2f, "
+                            "\"pixels_per_frame\": %.0f, \"bytes_moved_per_frame\": %.0f, "
+                            "\"pyramid_bytes\": %" G_GUINT64_FORMAT ", \"sigma\": %.2f }",
+                            bench->strength,
+                            modes[bench->mode].name,
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            (gdouble) bench->stats.passes_executed / n_frames,
+                            (gdouble) bench->stats.pixels_rasterized / n_frames,
+                            (gdouble) bench->stats.bytes_moved / n_frames,
+                            bench->stats.pyramid_bytes,
+                            measure_sigma (bench));
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // Redraw the actor, so that every frame runs the whole chain
+        clutter_actor_queue_redraw (bench->actor);
+        return G_SOURCE_REMOVE;
+      }
+
+    if (bench->loop.frame == n_frames)
+      {
+        clutter_actor_set_content (bench->actor, bench->bar);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (++bench->mode == N_MODES)
+      {
+        bench->mode = 0;
+        if (++bench->strength == N_STRENGTHS)
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+    CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (bench->effect);
+    else if (loop->frame >= 0 && loop->frame < n_frames)
+        bench->total_ms += elapsed_ms;
+
+    // The frame with the bar stays out of the statistics
+    if (loop->frame == n_frames - 1)
+        clutter_kawase_blur_effect_get_stats (bench->effect, &bench->stats);
+    else if (loop->frame == n_frames)
+        cogl_framebuffer_read_pixels (framebuffer,
+                                      0, 0,
+                                      bench->width, bench->height,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      bench->result);
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the blur algorithms against their radius");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 4 * BAR_WIDTH);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.width = size;
+    bench.height = size * 9 / 16;
+    bench.result = g_malloc (bench.width * bench.height * 4);
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    bench.pattern = bench_create_source_image (bench.width, bench.height);
+    bench.bar = create_bar_image (bench.width, bench.height);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_size (bench.actor, bench.width, bench.height);
+    clutter_actor_add_child (bench.stage, bench.actor);
+
+    bench.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_actor_add_effect_with_name (bench.actor, "blur", CLUTTER_EFFECT (bench.effect));
+
+    clutter_actor_set_size (bench.stage, bench.width, bench.height);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_engine_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             bench.width,
+             bench.height,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    g_free (bench.result);
+    clutter_actor_destroy (bench.stage);
+    g_object_unref (bench.pattern);
+    g_object_unref (bench.bar);
+
+    return EXIT_SUCCESS;
+}
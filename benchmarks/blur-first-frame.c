@@ -0,0 +1,198 @@
+/*
+ * Dual Kawase Blur First Frame Benchmark.
+ *
+ * Measures the time it takes to paint the first blurred frame, which
+ * includes compiling the shaders unless they have been warmed up with
+ * clutter_kawase_blur_effect_class_warm_up(). Every run can only measure
+ * one first frame, so the benchmark is registered once with and once
+ * without --warm-up.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+static gint size = 1024;
+static gint strength = 14;
+static gboolean warm_up = FALSE;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width and height of the blurred actor", "PIXELS" },
+    { "strength", 0, 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength", "STRENGTH" },
+    { "warm-up", 0, 0, G_OPTION_ARG_NONE, &warm_up,
+      "Compile the shaders before the actor is shown", NULL },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    /* the first frame only paints the stage, the second one the blur */
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+
+    gdouble empty_frame_ms;
+    gdouble first_frame_ms;
+    gdouble second_frame_ms;
+} Bench;
+
+/*
+ * The actor only appears once the stage has been painted, so that the
+ * first blurred frame doesn't include setting up the stage itself.
+ */
+static gboolean
+bench_show_actor (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    clutter_actor_add_child (bench->stage, bench->actor);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_repaint (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    clutter_kawase_blur_effect_invalidate (CLUTTER_KAWASE_BLUR_EFFECT (clutter_actor_get_effect (bench->actor, "blur")));
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Every frame schedules the next step itself */
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    switch (loop->frame)
+      {
+      case 0:
+        bench->empty_frame_ms = elapsed_ms;
+        g_idle_add (bench_show_actor, bench);
+        break;
+
+      case 1:
+        bench->first_frame_ms = elapsed_ms;
+        g_idle_add (bench_repaint, bench);
+        break;
+
+      default:
+        bench->second_frame_ms = elapsed_ms;
+        clutter_main_quit ();
+        break;
+      }
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    ClutterEffect *effect;
+    gdouble warm_up_ms = 0.0;
+    FILE *out;
+
+    context = g_option_context_new ("- measure the time to the first blurred frame");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    size = MAX (size, 1);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    clutter_actor_set_size (bench.stage, size, size);
+
+    if (warm_up)
+      {
+        gint64 start = g_get_monotonic_time ();
+
+        clutter_kawase_blur_effect_class_warm_up ();
+        warm_up_ms = (g_get_monotonic_time () - start) / 1000.0;
+      }
+
+    image = bench_create_source_image (size, size);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_content (bench.actor, image);
+    clutter_actor_set_size (bench.actor, size, size);
+    g_object_unref (image);
+
+    effect = clutter_kawase_blur_effect_new ();
+    clutter_kawase_blur_effect_update_blur_strength (CLUTTER_KAWASE_BLUR_EFFECT (effect), strength);
+    clutter_actor_add_effect_with_name (bench.actor, "blur", effect);
+
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, NULL, &bench);
+
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_first_frame\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"size\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"warm_up\": %s,\n"
+             "  \"warm_up_ms\": %.4f,\n"
+             "  \"empty_frame_ms\": %.4f,\n"
+             "  \"first_frame_ms\": %.4f,\n"
+             "  \"second_frame_ms\": %.4f\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             strength,
+             warm_up ? "true" : "false",
+             warm_up_ms,
+             bench.empty_frame_ms,
+             bench.first_frame_ms,
+             bench.second_frame_ms);
+
+    bench_close_output (out);
+
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/*
+ * Dual Kawase Blur Intermediate Format Benchmark.
+ *
+ * Blurs an actor whose content is redrawn on every frame at all 15 blur
+ * strengths with every intermediate texture format (see
+ * clutter_kawase_blur_effect_set_intermediate_format()), and reports the
+ * time, the estimated memory traffic per frame and the memory held by the
+ * pyramid per configuration. The last frame of every configuration is
+ * read back and its PSNR against the RGBA8888 result of the same strength
+ * reported next to the cost; the blur_format test checks the quality.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define N_STRENGTHS 15
+#define N_FORMATS 4
+
+/* Reported instead of an infinite PSNR for identical images */
+#define PSNR_IDENTICAL 99.0
+
+static gint n_frames = 30;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred actor, the height is 9/16 of it", "PIXELS" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* RGBA8888 comes first, it is the reference for the others */
+static const struct {
+    ClutterKawaseBlurFormat format;
+    const gchar *name;
+} formats[N_FORMATS] = {
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888, "rgba8888" },
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGB888, "rgb888" },
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGB565, "rgb565" },
+    { CLUTTER_KAWASE_BLUR_FORMAT_AUTO, "auto" },
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+    gint width;
+    gint height;
+
+    gint strength;
+    gint format;
+    gdouble total_ms;
+
+    /* the stage contents after the last frame, and those of RGBA8888 */
+    guint8 *result;
+    guint8 *reference;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+/* Peak signal-to-noise ratio of the color channels, in dB */
+static gdouble
+compute_psnr (const guint8 *a,
+              const guint8 *b,
+              gint          n_pixels)
+{
+    gdouble sum = 0.0;
+    gdouble mse;
+
+    for (gint i = 0; i < n_pixels; i++)
+      {
+        for (gint c = 0; c < 3; c++)
+          {
+            gdouble d = (gdouble) a[i * 4 + c] - b[i * 4 + c];
+
+            sum += d * d;
+          }
+      }
+
+    mse = sum / (n_pixels * 3.0);
+    if (mse == 0.0)
+        return PSNR_IDENTICAL;
+
+    return MIN (10.0 * log10 (255.0 * 255.0 / mse), PSNR_IDENTICAL);
+}
+
+static void
+bench_setup (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+
+    clutter_kawase_blur_effect_update_blur_strength (bench->effect, bench->strength);
+    clutter_kawase_blur_effect_set_intermediate_format (bench->effect,
+                                                        formats[bench->format].format);
+}
+
+static void
+bench_report (Bench *bench)
+{
+    ClutterKawaseBlurEffectStats stats;
+    gdouble psnr;
+
+    clutter_kawase_blur_effect_get_stats (bench->effect, &stats);
+
+    if (bench->format == 0)
+      {
+        guint8 *swap = bench->reference;
+
+        bench->reference = bench->result;
+        bench->result = swap;
+        psnr = PSNR_IDENTICAL;
+      }
+    else
+        psnr = compute_psnr (bench->result, bench->reference, bench->width * bench->height);
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"strength\": %d, \"format\": \"%s\", \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"bytes_moved_per_frame\": %.0f, "
+                            "\"pyramid_bytes\": %" G_GUINT64_FORMAT ", "
+                            "\"psnr\": %.2f }",
+                            bench->strength,
+                            formats[bench->format].name,
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            (gdouble) stats.bytes_moved / n_frames,
+                            stats.pyramid_bytes,
+                            psnr);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // Redraw the actor, so that every frame runs the whole chain
+        clutter_actor_queue_redraw (bench->actor);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (++bench->format == N_FORMATS)
+      {
+        bench->format = 0;
+        if (++bench->strength == N_STRENGTHS)
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+    CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (bench->effect);
+    else if (loop->frame >= 0)
+        bench->total_ms += elapsed_ms;
+
+    // The read back stays out of the measured time
+    if (loop->frame == n_frames - 1)
+        cogl_framebuffer_read_pixels (framebuffer,
+                                      0, 0,
+                                      bench->width, bench->height,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      bench->result);
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the intermediate texture formats");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 16);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.width = size;
+    bench.height = size * 9 / 16;
+    bench.result = g_malloc (bench.width * bench.height * 4);
+    bench.reference = g_malloc (bench.width * bench.height * 4);
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    image = bench_create_source_image (bench.width, bench.height);
+    bench.actor = clutter_actor_new ();
+    clutter_actor_set_content (bench.actor, image);
+    clutter_actor_set_size (bench.actor, bench.width, bench.height);
+    clutter_actor_add_child (bench.stage, bench.actor);
+    g_object_unref (image);
+
+    bench.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_actor_add_effect_with_name (bench.actor, "blur", CLUTTER_EFFECT (bench.effect));
+
+    clutter_actor_set_size (bench.stage, bench.width, bench.height);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_format_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             bench.width,
+             bench.height,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    g_free (bench.result);
+    g_free (bench.reference);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,314 @@
+/*
+ * Dual Kawase Blur Isolated Rectangles Benchmark.
+ *
+ * Blurs a grid of surfaces in two ways: with an effect on every surface,
+ * and with a single effect on their parent that blurs every surface's
+ * rectangle on its own (see clutter_kawase_blur_effect_set_isolate_rects()).
+ * Every frame redraws all surfaces, so both run their whole chains. Reports
+ * the time, the passes, i.e. draw calls of the chain, and the rasterized
+ * pixels per frame of both.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define COLUMNS 4
+#define SURFACE_WIDTH 320
+#define SURFACE_HEIGHT 200
+/* wider than a texel of the deepest level, so the surfaces can't share one */
+#define GAP 48
+
+static gint n_surfaces = 16;
+static gint n_frames = 60;
+static gint n_warmup = 5;
+static gint strength = 10;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "surfaces", 'n', 0, G_OPTION_ARG_INT, &n_surfaces,
+      "Number of blurred surfaces", "N" },
+    { "frames", 'f', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per mode", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "strength", 's', 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength, 0 to 14", "STRENGTH" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef enum {
+    MODE_SEPARATE,
+    MODE_ISOLATED,
+    N_MODES
+} Mode;
+
+static const gchar *mode_names[N_MODES] = { "separate", "isolated" };
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    /* one container per mode, only the measured one is visible */
+    ClutterActor *containers[N_MODES];
+    ClutterActor **surfaces[N_MODES];
+    GPtrArray *effects[N_MODES];
+
+    Mode mode;
+    gdouble total_ms[N_MODES];
+    gdouble passes[N_MODES];
+    gdouble pixels[N_MODES];
+} Bench;
+
+static ClutterKawaseBlurEffect *
+bench_add_effect (Bench        *bench,
+                  Mode          mode,
+                  ClutterActor *actor)
+{
+    ClutterKawaseBlurEffect *effect =
+        CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+
+    clutter_kawase_blur_effect_update_blur_strength (effect, strength);
+    clutter_actor_add_effect_with_name (actor, "blur", CLUTTER_EFFECT (effect));
+    g_ptr_array_add (bench->effects[mode], effect);
+
+    return effect;
+}
+
+static void
+bench_create_mode (Bench          *bench,
+                   Mode            mode,
+                   ClutterContent *image)
+{
+    cairo_rectangle_int_t *rects = g_new (cairo_rectangle_int_t, n_surfaces);
+
+    bench->containers[mode] = clutter_actor_new ();
+    bench->surfaces[mode] = g_new (ClutterActor *, n_surfaces);
+    bench->effects[mode] = g_ptr_array_new ();
+
+    for (gint i = 0; i < n_surfaces; i++)
+      {
+        ClutterActor *surface = clutter_actor_new ();
+
+        rects[i].x = GAP + (i % COLUMNS) * (SURFACE_WIDTH + GAP);
+        rects[i].y = GAP + (i / COLUMNS) * (SURFACE_HEIGHT + GAP);
+        rects[i].width = SURFACE_WIDTH;
+        rects[i].height = SURFACE_HEIGHT;
+
+        clutter_actor_set_content (surface, image);
+        clutter_actor_set_size (surface, SURFACE_WIDTH, SURFACE_HEIGHT);
+        clutter_actor_set_position (surface, rects[i].x, rects[i].y);
+        clutter_actor_add_child (bench->containers[mode], surface);
+        bench->surfaces[mode][i] = surface;
+
+        if (mode == MODE_SEPARATE)
+            bench_add_effect (bench, mode, surface);
+      }
+
+    if (mode == MODE_ISOLATED)
+      {
+        ClutterKawaseBlurEffect *effect =
+            bench_add_effect (bench, mode, bench->containers[mode]);
+
+        clutter_kawase_blur_effect_set_clip_rects (effect, rects, n_surfaces);
+        clutter_kawase_blur_effect_set_isolate_rects (effect, TRUE);
+      }
+
+    clutter_actor_add_child (bench->stage, bench->containers[mode]);
+    g_free (rects);
+}
+
+static void
+bench_setup (Bench *bench)
+{
+    bench->loop.frame = -n_warmup;
+
+    for (gint i = 0; i < N_MODES; i++)
+        clutter_actor_set_visible (bench->containers[i], i == (gint) bench->mode);
+}
+
+static void
+bench_reset_stats (Bench *bench)
+{
+    for (guint i = 0; i < bench->effects[bench->mode]->len; i++)
+        clutter_kawase_blur_effect_reset_stats (g_ptr_array_index (bench->effects[bench->mode], i));
+}
+
+static void
+bench_record (Bench *bench)
+{
+    guint64 passes = 0, pixels = 0;
+
+    for (guint i = 0; i < bench->effects[bench->mode]->len; i++)
+      {
+        ClutterKawaseBlurEffectStats stats;
+
+        clutter_kawase_blur_effect_get_stats (g_ptr_array_index (bench->effects[bench->mode], i), &stats);
+        passes += stats.passes_executed;
+        pixels += stats.pixels_rasterized;
+      }
+
+    bench->passes[bench->mode] = (gdouble) passes / n_frames;
+    bench->pixels[bench->mode] = (gdouble) pixels / n_frames;
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // Redraw every surface, so that every frame runs the whole chain
+        for (gint i = 0; i < n_surfaces; i++)
+            clutter_actor_queue_redraw (bench->surfaces[bench->mode][i]);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_record (bench);
+
+    if (++bench->mode == N_MODES)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+        bench_reset_stats (bench);
+    else if (loop->frame >= 0)
+        bench->total_ms[bench->mode] += elapsed_ms;
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+    gint rows;
+
+    context = g_option_context_new ("- compare separate effects with isolated clip rectangles");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_surfaces = MAX (n_surfaces, 1);
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    strength = CLAMP (strength, 0, 14);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    // Keep the shader compilation out of the measurement
+    clutter_kawase_blur_effect_class_warm_up ();
+
+    image = bench_create_source_image (SURFACE_WIDTH, SURFACE_HEIGHT);
+    bench.stage = clutter_stage_new ();
+    for (gint i = 0; i < N_MODES; i++)
+        bench_create_mode (&bench, i, image);
+    g_object_unref (image);
+
+    rows = (n_surfaces + COLUMNS - 1) / COLUMNS;
+    clutter_actor_set_size (bench.stage,
+                            GAP + COLUMNS * (SURFACE_WIDTH + GAP),
+                            GAP + rows * (SURFACE_HEIGHT + GAP));
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_isolate_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"surfaces\": %d,\n"
+             "  \"surface_width\": %d,\n"
+             "  \"surface_height\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"frames\": %d,\n"
+             "  \"modes\": [\n",
+             hardware ? "false" : "true",
+             n_surfaces,
+             SURFACE_WIDTH,
+             SURFACE_HEIGHT,
+             strength,
+             n_frames);
+
+    for (gint i = 0; i < N_MODES; i++)
+        fprintf (out,
+                 "    { \"mode\": \"%s\", \"mean_ms\": %.4f, \"passes_per_frame\": %.2f, "
+                 "\"pixels_per_frame\": %.0f }%s\n",
+                 mode_names[i],
+                 bench.total_ms[i] / n_frames,
+                 bench.passes[i],
+                 bench.pixels[i],
+                 i + 1 < N_MODES ? "," : "");
+
+    fprintf (out,
+             "  ],\n"
+             "  \"speedup\": %.3f\n"
+             "}\n",
+             bench.total_ms[MODE_ISOLATED] > 0.0
+             ? bench.total_ms[MODE_SEPARATE] / bench.total_ms[MODE_ISOLATED]
+             : 0.0);
+
+    bench_close_output (out);
+
+    clutter_actor_destroy (bench.stage);
+    for (gint i = 0; i < N_MODES; i++)
+      {
+        g_free (bench.surfaces[i]);
+        g_ptr_array_unref (bench.effects[i]);
+      }
+
+    return EXIT_SUCCESS;
+}
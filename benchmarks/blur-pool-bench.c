@@ -0,0 +1,271 @@
+/*
+ * Dual Kawase Blur Texture Pool Benchmark.
+ *
+ * Blurs a growing number of actors of the same size, once with a texture
+ * pyramid per effect and once with the pyramid shared between all of them,
+ * and compares the peak video memory of the intermediate textures. Fails
+ * when the shared pool needs noticeably more memory for many actors than
+ * for a single one.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+static const gint bench_actors[] = { 1, 2, 4, 8, 16, 32 };
+
+static gint n_frames = 10;
+static gint size = 512;
+static gint strength = 14;
+static gdouble tolerance = 1.1;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of frames per configuration", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width and height of every actor", "PIXELS" },
+    { "strength", 0, 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength", "STRENGTH" },
+    { "tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance,
+      "Allowed ratio between the shared peak memory of N actors and of one", "RATIO" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    GPtrArray *effects;
+
+    guint actors_index;
+    gboolean shared;
+
+    /* peak over all the frames of a configuration */
+    guint64 peak_bytes;
+    /* shared peak of a single actor, the reference for the check */
+    guint64 single_bytes;
+    gboolean failed;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+static void
+bench_setup (Bench *bench)
+{
+    ClutterContent *image = bench_create_source_image (size, size);
+    gint n_actors = bench_actors[bench->actors_index];
+
+    clutter_actor_destroy_all_children (bench->stage);
+    g_ptr_array_set_size (bench->effects, 0);
+    clutter_kawase_blur_effect_class_trim_pool ();
+
+    // The actors overlap, Clutter paints every one of them anyway
+    for (gint i = 0; i < n_actors; i++)
+      {
+        ClutterActor *actor = clutter_actor_new ();
+        ClutterEffect *effect = clutter_kawase_blur_effect_new ();
+
+        clutter_actor_set_content (actor, image);
+        clutter_actor_set_size (actor, size, size);
+        clutter_actor_set_position (actor, i % 8, i / 8);
+
+        clutter_kawase_blur_effect_update_blur_strength (CLUTTER_KAWASE_BLUR_EFFECT (effect), strength);
+        clutter_kawase_blur_effect_set_shared_pyramid (CLUTTER_KAWASE_BLUR_EFFECT (effect), bench->shared);
+        clutter_actor_add_effect_with_name (actor, "blur", effect);
+        g_ptr_array_add (bench->effects, effect);
+
+        clutter_actor_add_child (bench->stage, actor);
+      }
+
+    g_object_unref (image);
+
+    bench->loop.frame = 0;
+    bench->peak_bytes = 0;
+}
+
+/* Memory of the intermediate textures after a frame */
+static guint64
+bench_measure (Bench *bench)
+{
+    ClutterKawaseBlurPoolStats pool_stats;
+    guint64 bytes = 0;
+
+    if (bench->shared)
+      {
+        clutter_kawase_blur_effect_class_get_pool_stats (&pool_stats);
+        return pool_stats.peak_bytes;
+      }
+
+    for (guint i = 0; i < bench->effects->len; i++)
+      {
+        ClutterKawaseBlurEffectStats stats;
+
+        clutter_kawase_blur_effect_get_stats (g_ptr_array_index (bench->effects, i), &stats);
+        bytes += stats.pyramid_bytes;
+      }
+
+    return bytes;
+}
+
+static void
+bench_report (Bench *bench)
+{
+    gint n_actors = bench_actors[bench->actors_index];
+
+    if (bench->shared && n_actors == 1)
+        bench->single_bytes = bench->peak_bytes;
+
+    if (bench->shared && bench->peak_bytes > bench->single_bytes * tolerance)
+      {
+        g_printerr ("Shared pool peak for %d actors is %" G_GUINT64_FORMAT
+                    " bytes, one actor needs %" G_GUINT64_FORMAT "\n",
+                    n_actors, bench->peak_bytes, bench->single_bytes);
+        bench->failed = TRUE;
+      }
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"actors\": %d, \"shared\": %s, "
+                            "\"peak_bytes\": %" G_GUINT64_FORMAT ", "
+                            "\"ratio_to_single\": %.3f }",
+                            n_actors,
+                            bench->shared ? "true" : "false",
+                            bench->peak_bytes,
+                            bench->single_bytes > 0
+                            ? (gdouble) bench->peak_bytes / bench->single_bytes
+                            : 1.0);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        for (guint i = 0; i < bench->effects->len; i++)
+            clutter_kawase_blur_effect_invalidate (g_ptr_array_index (bench->effects, i));
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    // Every actor count runs shared first, to get the single actor reference
+    if (bench->shared)
+        bench->shared = FALSE;
+    else
+      {
+        bench->shared = TRUE;
+        if (++bench->actors_index == G_N_ELEMENTS (bench_actors))
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    bench->peak_bytes = MAX (bench->peak_bytes, bench_measure (bench));
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    FILE *out;
+
+    context = g_option_context_new ("- measure the memory of the shared texture pool");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    size = MAX (size, 1);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.effects = g_ptr_array_new ();
+    bench.shared = TRUE;
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    clutter_actor_set_size (bench.stage, size + 8, size + 8);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_pool_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"size\": %d,\n"
+             "  \"strength\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             strength,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    g_ptr_array_unref (bench.effects);
+    clutter_actor_destroy (bench.stage);
+
+    return bench.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
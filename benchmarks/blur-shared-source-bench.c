@@ -0,0 +1,261 @@
+/*
+ * Dual Kawase Blur Shared Downsample Benchmark.
+ *
+ * Blurs the same content at several strengths, e.g. a dock and a modal
+ * dialog on top of the same backdrop, once with an independent chain per
+ * effect and once with all effects reusing the downsample chain of the
+ * first one, and compares the passes and the time per frame.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+static gint n_frames = 60;
+static gint n_warmup = 5;
+static gint size = 1920;
+static gchar *strengths_arg = NULL;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per configuration", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the blurred content, the height is 9/16 of it", "PIXELS" },
+    { "strengths", 0, 0, G_OPTION_ARG_STRING, &strengths_arg,
+      "Comma separated strengths, the first effect is the source (default 5,14)", "LIST" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterContent *image;
+    GArray *strengths;
+    GPtrArray *effects;
+
+    gboolean shared;
+    gdouble total_ms;
+
+    GString *json;
+    gboolean first_result;
+} Bench;
+
+/*
+ * Every effect sits on its own actor showing the same image. They are
+ * added in order, so the source is painted first.
+ */
+static void
+bench_setup (Bench *bench)
+{
+    ClutterKawaseBlurEffect *source = NULL;
+
+    clutter_actor_destroy_all_children (bench->stage);
+    g_ptr_array_set_size (bench->effects, 0);
+
+    for (guint i = 0; i < bench->strengths->len; i++)
+      {
+        ClutterActor *actor = clutter_actor_new ();
+        ClutterKawaseBlurEffect *effect =
+          CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+
+        clutter_actor_set_content (actor, bench->image);
+        clutter_actor_set_size (actor, size, size * 9 / 16);
+
+        clutter_kawase_blur_effect_update_blur_strength (effect, g_array_index (bench->strengths, gint, i));
+        if (bench->shared && source != NULL)
+            clutter_kawase_blur_effect_set_downsample_source (effect, source);
+        if (source == NULL)
+            source = effect;
+
+        clutter_actor_add_effect_with_name (actor, "blur", CLUTTER_EFFECT (effect));
+        g_ptr_array_add (bench->effects, effect);
+
+        clutter_actor_add_child (bench->stage, actor);
+      }
+
+    bench->loop.frame = -n_warmup;
+    bench->total_ms = 0.0;
+}
+
+static void
+bench_report (Bench *bench)
+{
+    guint64 passes = 0;
+
+    for (guint i = 0; i < bench->effects->len; i++)
+        passes += clutter_kawase_blur_effect_get_passes (g_ptr_array_index (bench->effects, i));
+
+    if (!bench->first_result)
+        g_string_append (bench->json, ",\n");
+    bench->first_result = FALSE;
+
+    g_string_append_printf (bench->json,
+                            "    { \"shared\": %s, \"effects\": %u, \"frames\": %d, "
+                            "\"mean_ms\": %.4f, \"passes_per_frame\": %.2f }",
+                            bench->shared ? "true" : "false",
+                            bench->effects->len,
+                            n_frames,
+                            bench->total_ms / n_frames,
+                            (gdouble) passes / n_frames);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        // The content of the source changes on every frame
+        for (guint i = 0; i < bench->effects->len; i++)
+            clutter_kawase_blur_effect_invalidate (g_ptr_array_index (bench->effects, i));
+        return G_SOURCE_REMOVE;
+      }
+
+    bench_report (bench);
+
+    if (bench->shared)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    bench->shared = TRUE;
+    bench_setup (bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (loop->frame == -1)
+      {
+        for (guint i = 0; i < bench->effects->len; i++)
+            clutter_kawase_blur_effect_reset_stats (g_ptr_array_index (bench->effects, i));
+      }
+    else if (loop->frame >= 0)
+      {
+        bench->total_ms += elapsed_ms;
+      }
+
+    return TRUE;
+}
+
+static GArray *
+parse_strengths (const gchar *list)
+{
+    GArray *strengths = g_array_new (FALSE, FALSE, sizeof (gint));
+    gchar **parts = g_strsplit (list, ",", -1);
+
+    for (gint i = 0; parts[i] != NULL; i++)
+      {
+        gint strength = atoi (parts[i]);
+
+        g_array_append_val (strengths, strength);
+      }
+
+    g_strfreev (parts);
+
+    return strengths;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    FILE *out;
+
+    context = g_option_context_new ("- benchmark the shared downsample chain");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+    size = MAX (size, 16);
+
+    bench.strengths = parse_strengths (strengths_arg != NULL ? strengths_arg : "5,14");
+    if (bench.strengths->len < 2)
+        g_error ("At least two strengths are needed");
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    bench.stage = clutter_stage_new ();
+    bench.image = bench_create_source_image (size, size * 9 / 16);
+    bench.effects = g_ptr_array_new ();
+    bench.first_result = TRUE;
+    bench.json = g_string_new (NULL);
+
+    clutter_actor_set_size (bench.stage, size, size * 9 / 16);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+
+    bench_setup (&bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_shared_source_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"width\": %d,\n"
+             "  \"height\": %d,\n"
+             "  \"results\": [\n%s\n  ]\n"
+             "}\n",
+             hardware ? "false" : "true",
+             size,
+             size * 9 / 16,
+             bench.json->str);
+
+    bench_close_output (out);
+
+    g_string_free (bench.json, TRUE);
+    g_ptr_array_unref (bench.effects);
+    g_array_unref (bench.strengths);
+    g_object_unref (bench.image);
+    clutter_actor_destroy (bench.stage);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,307 @@
+/*
+ * Dual Kawase Blur Trimming Benchmark.
+ *
+ * Blurs a grid of actors, leaves them unchanged for longer than the trim
+ * timeout (see clutter_kawase_blur_effect_set_trim_timeout()), hides all
+ * of them until it has freed their intermediate textures, shows them
+ * again and finally calls clutter_kawase_blur_effect_class_trim_memory().
+ * Reports the memory held and reclaimed at every step, and what the first
+ * frame after trimming costs compared to the first frame ever. Fails when
+ * visible effects lose memory, hidden effects keep any or the memory
+ * pressure call frees less than was held.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "bench-common.h"
+
+#define GRID 4
+
+static gint n_frames = 30;
+static gint size = 1920;
+static gint trim_timeout = 100;
+static gboolean hardware = FALSE;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of frames painted while the actors are visible", "N" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size,
+      "Width of the grid of actors, the height is 9/16 of it", "PIXELS" },
+    { "trim-timeout", 't', 0, G_OPTION_ARG_INT, &trim_timeout,
+      "Milliseconds after hiding an actor until its effect is trimmed", "MS" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the JSON report to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+typedef enum {
+    PHASE_VISIBLE,
+    /* visible, but nothing is painted */
+    PHASE_STATIC,
+    PHASE_HIDDEN,
+    PHASE_REBUILD,
+} Phase;
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *stage;
+    ClutterActor *actors[GRID * GRID];
+    ClutterKawaseBlurEffect *effects[GRID * GRID];
+
+    Phase phase;
+
+    gdouble first_frame_ms;
+    gdouble rebuild_frame_ms;
+    guint64 held_bytes;
+    guint64 static_bytes;
+    guint64 hidden_bytes;
+    guint64 trimmed_bytes;
+    guint trims;
+    guint64 pressure_bytes;
+    guint64 remaining_bytes;
+} Bench;
+
+/* Sums the pyramid memory, and the reclaimed memory and trims if asked for */
+static guint64
+bench_pyramid_bytes (Bench   *bench,
+                     guint64 *reclaimed,
+                     guint   *trims)
+{
+    guint64 bytes = 0;
+
+    for (gint i = 0; i < GRID * GRID; i++)
+      {
+        ClutterKawaseBlurEffectStats stats;
+
+        clutter_kawase_blur_effect_get_stats (bench->effects[i], &stats);
+        bytes += stats.pyramid_bytes;
+        if (reclaimed != NULL)
+            *reclaimed += stats.bytes_reclaimed;
+        if (trims != NULL)
+            *trims += stats.trims;
+      }
+
+    return bytes;
+}
+
+static void
+bench_set_visible (Bench    *bench,
+                   gboolean  visible)
+{
+    for (gint i = 0; i < GRID * GRID; i++)
+        clutter_actor_set_visible (bench->actors[i], visible);
+}
+
+static gboolean
+bench_after_hidden (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    bench->hidden_bytes = bench_pyramid_bytes (bench, &bench->trimmed_bytes, &bench->trims);
+
+    bench->phase = PHASE_REBUILD;
+    bench->loop.frame = 0;
+    bench_set_visible (bench, TRUE);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bench_after_static (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    bench->static_bytes = bench_pyramid_bytes (bench, NULL, NULL);
+
+    // Nothing can paint the effects anymore, so their timers run out
+    bench->phase = PHASE_HIDDEN;
+    bench_set_visible (bench, FALSE);
+    g_timeout_add (trim_timeout * 3, bench_after_hidden, bench);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+bench_next_frame (gpointer user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->loop.frame < n_frames)
+      {
+        clutter_actor_queue_redraw (bench->stage);
+        return G_SOURCE_REMOVE;
+      }
+
+    if (bench->phase == PHASE_VISIBLE)
+      {
+        bench->held_bytes = bench_pyramid_bytes (bench, NULL, NULL);
+
+        // Visible effects keep their levels, however long they aren't painted
+        bench->phase = PHASE_STATIC;
+        g_timeout_add (trim_timeout * 3, bench_after_static, bench);
+        return G_SOURCE_REMOVE;
+      }
+
+    bench->pressure_bytes = clutter_kawase_blur_effect_class_trim_memory ();
+    bench->remaining_bytes = bench_pyramid_bytes (bench, NULL, NULL);
+
+    clutter_main_quit ();
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Paints of the stage while waiting for the timers don't count */
+static gboolean
+bench_frame_done (BenchLoop *loop,
+                  gdouble    elapsed_ms,
+                  gpointer   user_data)
+{
+    Bench *bench = user_data;
+
+    if (bench->phase == PHASE_STATIC || bench->phase == PHASE_HIDDEN)
+        return FALSE;
+
+    if (loop->frame == 0)
+      {
+        if (bench->phase == PHASE_VISIBLE)
+            bench->first_frame_ms = elapsed_ms;
+        else
+            bench->rebuild_frame_ms = elapsed_ms;
+      }
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Bench bench = { 0, };
+    ClutterContent *image;
+    FILE *out;
+    gint width, height;
+    gboolean pass;
+
+    context = g_option_context_new ("- benchmark the trimming of hidden effects");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    n_frames = MAX (n_frames, 1);
+    size = MAX (size, 16 * GRID);
+    trim_timeout = MAX (trim_timeout, 1);
+
+    bench_init (&argc, &argv, hardware);
+    out = bench_open_output (output);
+
+    // Keep the shader compilation out of the first frame
+    clutter_kawase_blur_effect_class_warm_up ();
+
+    width = size / GRID;
+    height = size * 9 / 16 / GRID;
+    image = bench_create_source_image (width, height);
+
+    bench.stage = clutter_stage_new ();
+    for (gint i = 0; i < GRID * GRID; i++)
+      {
+        bench.actors[i] = clutter_actor_new ();
+        clutter_actor_set_content (bench.actors[i], image);
+        clutter_actor_set_size (bench.actors[i], width, height);
+        clutter_actor_set_position (bench.actors[i], (i % GRID) * width, (i / GRID) * height);
+        clutter_actor_add_child (bench.stage, bench.actors[i]);
+
+        bench.effects[i] = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+        clutter_kawase_blur_effect_set_trim_timeout (bench.effects[i], trim_timeout);
+        clutter_actor_add_effect_with_name (bench.actors[i], "blur", CLUTTER_EFFECT (bench.effects[i]));
+      }
+    g_object_unref (image);
+
+    clutter_actor_set_size (bench.stage, width * GRID, height * GRID);
+    bench_loop_init (&bench.loop, bench.stage, bench_frame_done, bench_next_frame, &bench);
+    clutter_actor_show (bench.stage);
+
+    clutter_main ();
+
+    pass = bench.static_bytes == bench.held_bytes &&
+           bench.hidden_bytes == 0 &&
+           bench.pressure_bytes >= bench.held_bytes;
+    if (bench.static_bytes != bench.held_bytes)
+        g_printerr ("Visible effects went from %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT " bytes\n",
+                    bench.held_bytes, bench.static_bytes);
+    if (bench.hidden_bytes != 0)
+        g_printerr ("Hidden effects still hold %" G_GUINT64_FORMAT " bytes\n", bench.hidden_bytes);
+    if (bench.pressure_bytes < bench.held_bytes)
+        g_printerr ("trim_memory freed %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes\n",
+                    bench.pressure_bytes, bench.held_bytes);
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_trim_bench\",\n"
+             "  \"software_gl\": %s,\n"
+             "  \"actors\": %d,\n"
+             "  \"actor_width\": %d,\n"
+             "  \"actor_height\": %d,\n"
+             "  \"trim_timeout_ms\": %d,\n"
+             "  \"held_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"static_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"hidden_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"trims\": %u,\n"
+             "  \"trimmed_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"pressure_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"remaining_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"first_frame_ms\": %.4f,\n"
+             "  \"rebuild_frame_ms\": %.4f,\n"
+             "  \"pass\": %s\n"
+             "}\n",
+             hardware ? "false" : "true",
+             GRID * GRID,
+             width,
+             height,
+             trim_timeout,
+             bench.held_bytes,
+             bench.static_bytes,
+             bench.hidden_bytes,
+             bench.trims,
+             bench.trimmed_bytes,
+             bench.pressure_bytes,
+             bench.remaining_bytes,
+             bench.first_frame_ms,
+             bench.rebuild_frame_ms,
+             pass ? "true" : "false");
+
+    bench_close_output (out);
+
+    clutter_actor_destroy (bench.stage);
+
+    return pass ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,687 @@
+/*
+ * Dual Kawase Blur Batch Tool.
+ *
+ * Blurs a list of images and writes the results to a directory, e.g. to
+ * pre-render blurred wallpapers and thumbnails. Decoding, blurring and
+ * encoding run in a pipeline: decoder threads load the images, the blur
+ * works on one image while the next ones are being decoded and the
+ * previous ones encoded by encoder threads. The queues between the
+ * stages are bounded, so only a few images are in memory at any time.
+ *
+ * The blur either runs through the effect on a Clutter stage (the gpu
+ * engine), which needs an X display but works fine with llvmpipe and
+ * xvfb-run, or with the CPU engine of the effect, which needs no display
+ * at all. Both produce the same image.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <clutter/clutter.h>
+#include "clutter-kawase-blur-effect.h"
+#include "clutter-kawase-blur-cpu.h"
+
+static gint strength = 7;
+static gchar *engine = NULL;
+static gchar *output_dir = NULL;
+static gchar *format = NULL;
+static gchar *list = NULL;
+static gint repeat = 1;
+static gint n_decoders = 2;
+static gint n_encoders = 2;
+static gint queue_size = 4;
+static gchar *report = NULL;
+static gchar **inputs = NULL;
+
+/* Frames to wait for the window of the stage to grow to the size of an image */
+#define GPU_MAX_RETRIES 60
+
+static GOptionEntry entries[] = {
+    { "strength", 's', 0, G_OPTION_ARG_INT, &strength,
+      "Blur strength, between 0 and 14", "N" },
+    { "engine", 'e', 0, G_OPTION_ARG_STRING, &engine,
+      "Blur on the GPU through Clutter (gpu) or with the CPU engine (cpu)", "ENGINE" },
+    { "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir,
+      "Directory to write the blurred images to", "DIR" },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, &format,
+      "Image format of the results, e.g. png or jpeg", "FORMAT" },
+    { "list", 'l', 0, G_OPTION_ARG_FILENAME, &list,
+      "Read the input files from FILE, one per line, - for stdin", "FILE" },
+    { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+      "Process every input N times, for throughput measurements", "N" },
+    { "decoders", 0, 0, G_OPTION_ARG_INT, &n_decoders,
+      "Number of decoder threads", "N" },
+    { "encoders", 0, 0, G_OPTION_ARG_INT, &n_encoders,
+      "Number of encoder threads", "N" },
+    { "queue", 'q', 0, G_OPTION_ARG_INT, &queue_size,
+      "Number of images each queue between the stages holds", "N" },
+    { "report", 0, 0, G_OPTION_ARG_FILENAME, &report,
+      "Write a JSON report to FILE", "FILE" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &inputs,
+      NULL, "FILE..." },
+    { NULL }
+};
+
+/*
+ * A queue between two stages of the pipeline. Pushing blocks while it is
+ * full, popping while it is empty; once it is closed, popping from an
+ * empty queue returns NULL.
+ */
+typedef struct {
+    GQueue items;
+    guint capacity;
+    gboolean closed;
+    GMutex lock;
+    GCond cond;
+} BatchQueue;
+
+typedef struct {
+    gint index;
+    /* how often the input has been processed before, see --repeat */
+    gint round;
+    const gchar *path;
+    GdkPixbuf *pixbuf;
+    /* the blurred pixels, RGBA 8888 without padding */
+    guint8 *result;
+} BatchItem;
+
+typedef struct {
+    GPtrArray *paths;
+    gint n_items;
+    gint next_item;
+    gint running_decoders;
+
+    BatchQueue decoded;
+    BatchQueue blurred;
+
+    /* gpu engine */
+    ClutterActor *stage;
+    ClutterActor *actor;
+    BatchItem *current;
+    gint64 blur_start;
+    gint retries;
+
+    /* totals of all threads, protected by lock */
+    GMutex lock;
+    gint images;
+    gint failed;
+    guint64 pixel_bytes;
+    guint64 output_bytes;
+    gint64 decode_time;
+    gint64 blur_time;
+    gint64 encode_time;
+} Batch;
+
+static void
+batch_queue_init (BatchQueue *queue,
+                  guint       capacity)
+{
+    g_queue_init (&queue->items);
+    queue->capacity = capacity;
+    queue->closed = FALSE;
+    g_mutex_init (&queue->lock);
+    g_cond_init (&queue->cond);
+}
+
+static void
+batch_queue_clear (BatchQueue *queue)
+{
+    g_mutex_clear (&queue->lock);
+    g_cond_clear (&queue->cond);
+}
+
+static void
+batch_queue_push (BatchQueue *queue,
+                  BatchItem  *item)
+{
+    g_mutex_lock (&queue->lock);
+    while (queue->items.length >= queue->capacity)
+        g_cond_wait (&queue->cond, &queue->lock);
+    g_queue_push_tail (&queue->items, item);
+    g_cond_broadcast (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+}
+
+static BatchItem *
+batch_queue_pop (BatchQueue *queue)
+{
+    BatchItem *item;
+
+    g_mutex_lock (&queue->lock);
+    while (g_queue_is_empty (&queue->items) && !queue->closed)
+        g_cond_wait (&queue->cond, &queue->lock);
+    item = g_queue_pop_head (&queue->items);
+    g_cond_broadcast (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+
+    return item;
+}
+
+static void
+batch_queue_close (BatchQueue *queue)
+{
+    g_mutex_lock (&queue->lock);
+    queue->closed = TRUE;
+    g_cond_broadcast (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+}
+
+static void
+batch_item_free (BatchItem *item)
+{
+    g_clear_object (&item->pixbuf);
+    g_free (item->result);
+    g_slice_free (BatchItem, item);
+}
+
+static void
+batch_add_time (Batch  *batch,
+                gint64 *total,
+                gint64  start)
+{
+    gint64 elapsed = g_get_monotonic_time () - start;
+
+    g_mutex_lock (&batch->lock);
+    *total += elapsed;
+    g_mutex_unlock (&batch->lock);
+}
+
+static gpointer
+decode_thread (gpointer user_data)
+{
+    Batch *batch = user_data;
+
+    for (;;)
+      {
+        gint index = g_atomic_int_add (&batch->next_item, 1);
+        gint64 start = g_get_monotonic_time ();
+        BatchItem *item;
+        GdkPixbuf *pixbuf;
+        GError *error = NULL;
+
+        if (index >= batch->n_items)
+            break;
+
+        item = g_slice_new0 (BatchItem);
+        item->index = index;
+        item->path = g_ptr_array_index (batch->paths, index % batch->paths->len);
+        item->round = index / batch->paths->len;
+
+        pixbuf = gdk_pixbuf_new_from_file (item->path, &error);
+        if (pixbuf == NULL)
+          {
+            g_printerr ("Unable to load %s: %s\n", item->path, error->message);
+            g_error_free (error);
+            batch_item_free (item);
+
+            g_mutex_lock (&batch->lock);
+            batch->failed++;
+            g_mutex_unlock (&batch->lock);
+            continue;
+          }
+
+        // Both engines work on RGBA 8888
+        item->pixbuf = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+        g_object_unref (pixbuf);
+
+        batch_add_time (batch, &batch->decode_time, start);
+        batch_queue_push (&batch->decoded, item);
+      }
+
+    if (g_atomic_int_dec_and_test (&batch->running_decoders))
+        batch_queue_close (&batch->decoded);
+
+    return NULL;
+}
+
+static gchar *
+get_output_path (BatchItem *item)
+{
+    gchar *basename = g_path_get_basename (item->path);
+    gchar *dot = strrchr (basename, '.');
+    gchar *filename, *path;
+
+    if (dot != NULL && dot != basename)
+        *dot = '\0';
+
+    // Repeated inputs get a number each, so that they don't overwrite each other
+    if (repeat > 1)
+        filename = g_strdup_printf ("%s-%d.%s", basename, item->round, format);
+    else
+        filename = g_strdup_printf ("%s.%s", basename, format);
+
+    path = g_build_filename (output_dir, filename, NULL);
+    g_free (filename);
+    g_free (basename);
+
+    return path;
+}
+
+static gpointer
+encode_thread (gpointer user_data)
+{
+    Batch *batch = user_data;
+    BatchItem *item;
+
+    while ((item = batch_queue_pop (&batch->blurred)) != NULL)
+      {
+        gint64 start = g_get_monotonic_time ();
+        gint width = gdk_pixbuf_get_width (item->pixbuf);
+        gint height = gdk_pixbuf_get_height (item->pixbuf);
+        gchar *path = get_output_path (item);
+        GdkPixbuf *result;
+        GError *error = NULL;
+        GStatBuf stat_buf;
+        gboolean saved;
+
+        result = gdk_pixbuf_new_from_data (item->result, GDK_COLORSPACE_RGB, TRUE, 8,
+                                           width, height, width * 4,
+                                           NULL, NULL);
+        saved = gdk_pixbuf_save (result, path, format, &error, NULL);
+        g_object_unref (result);
+
+        g_mutex_lock (&batch->lock);
+        if (saved)
+          {
+            batch->images++;
+            batch->pixel_bytes += (guint64) width * height * 4;
+            if (g_stat (path, &stat_buf) == 0)
+                batch->output_bytes += stat_buf.st_size;
+          }
+        else
+            batch->failed++;
+        g_mutex_unlock (&batch->lock);
+
+        if (!saved)
+          {
+            g_printerr ("Unable to write %s: %s\n", path, error->message);
+            g_error_free (error);
+          }
+
+        batch_add_time (batch, &batch->encode_time, start);
+        g_free (path);
+        batch_item_free (item);
+      }
+
+    return NULL;
+}
+
+static void
+run_cpu_engine (Batch *batch)
+{
+    ClutterKawaseBlurCpu *cpu = clutter_kawase_blur_cpu_new ();
+    BatchItem *item;
+    gint iterations;
+    gfloat offset;
+
+    clutter_kawase_blur_effect_get_strength_parameters (strength, &iterations, &offset);
+
+    while ((item = batch_queue_pop (&batch->decoded)) != NULL)
+      {
+        gint64 start = g_get_monotonic_time ();
+        ClutterKawaseBlurCpuImage source, result;
+
+        source.data = gdk_pixbuf_get_pixels (item->pixbuf);
+        source.width = gdk_pixbuf_get_width (item->pixbuf);
+        source.height = gdk_pixbuf_get_height (item->pixbuf);
+        source.rowstride = gdk_pixbuf_get_rowstride (item->pixbuf);
+
+        result.width = source.width;
+        result.height = source.height;
+        result.rowstride = source.width * 4;
+        result.data = item->result = g_malloc ((gsize) result.rowstride * result.height);
+
+        clutter_kawase_blur_cpu_run (cpu, &source, &result, iterations, offset);
+
+        batch_add_time (batch, &batch->blur_time, start);
+        batch_queue_push (&batch->blurred, item);
+      }
+
+    clutter_kawase_blur_cpu_free (cpu);
+}
+
+/* Hands the next decoded image to the actor, from outside of the paint cycle */
+static gboolean
+gpu_next_image (gpointer user_data)
+{
+    Batch *batch = user_data;
+    BatchItem *item = batch_queue_pop (&batch->decoded);
+    ClutterContent *image;
+    gint width, height;
+
+    if (item == NULL)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    batch->current = item;
+    batch->blur_start = g_get_monotonic_time ();
+    batch->retries = 0;
+
+    width = gdk_pixbuf_get_width (item->pixbuf);
+    height = gdk_pixbuf_get_height (item->pixbuf);
+
+    image = clutter_image_new ();
+    clutter_image_set_data (CLUTTER_IMAGE (image),
+                            gdk_pixbuf_get_pixels (item->pixbuf),
+                            COGL_PIXEL_FORMAT_RGBA_8888,
+                            width,
+                            height,
+                            gdk_pixbuf_get_rowstride (item->pixbuf),
+                            NULL);
+    clutter_actor_set_content (batch->actor, image);
+    clutter_actor_set_size (batch->actor, width, height);
+    g_object_unref (image);
+
+    // The stage only ever grows, so that its window is resized as rarely as possible
+    if (width > clutter_actor_get_width (batch->stage) ||
+        height > clutter_actor_get_height (batch->stage))
+        clutter_actor_set_size (batch->stage,
+                                MAX (width, clutter_actor_get_width (batch->stage)),
+                                MAX (height, clutter_actor_get_height (batch->stage)));
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+gpu_retry (gpointer user_data)
+{
+    Batch *batch = user_data;
+
+    clutter_actor_queue_redraw (batch->stage);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+stage_paint_end (ClutterActor *stage,
+                 Batch        *batch)
+{
+    CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+    BatchItem *item = batch->current;
+    gint width, height;
+
+    if (item == NULL)
+        return;
+
+    width = gdk_pixbuf_get_width (item->pixbuf);
+    height = gdk_pixbuf_get_height (item->pixbuf);
+
+    // The window of the stage may not have caught up with a resize yet
+    if (cogl_framebuffer_get_width (framebuffer) < width ||
+        cogl_framebuffer_get_height (framebuffer) < height)
+      {
+        if (batch->retries++ < GPU_MAX_RETRIES)
+          {
+            g_idle_add (gpu_retry, batch);
+            return;
+          }
+
+        // E.g. larger than the window manager lets the window become
+        g_printerr ("Unable to blur %s: the stage is %dx%d, the image %dx%d\n",
+                    item->path,
+                    cogl_framebuffer_get_width (framebuffer),
+                    cogl_framebuffer_get_height (framebuffer),
+                    width,
+                    height);
+        batch->current = NULL;
+        batch_item_free (item);
+
+        g_mutex_lock (&batch->lock);
+        batch->failed++;
+        g_mutex_unlock (&batch->lock);
+
+        g_idle_add (gpu_next_image, batch);
+        return;
+      }
+
+    item->result = g_malloc ((gsize) width * height * 4);
+    cogl_framebuffer_read_pixels (framebuffer,
+                                  0, 0,
+                                  width, height,
+                                  COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                  item->result);
+    batch_add_time (batch, &batch->blur_time, batch->blur_start);
+
+    // Blocks while the encoders are behind, which keeps the memory bounded
+    batch->current = NULL;
+    batch_queue_push (&batch->blurred, item);
+
+    g_idle_add (gpu_next_image, batch);
+}
+
+static void
+run_gpu_engine (Batch *batch)
+{
+    ClutterEffect *effect;
+    ClutterColor black = { 0, 0, 0, 255 };
+
+    batch->stage = clutter_stage_new ();
+    clutter_stage_set_title (CLUTTER_STAGE (batch->stage), "Dual Kawase Blur Batch");
+    clutter_actor_set_background_color (batch->stage, &black);
+    clutter_actor_set_size (batch->stage, 1, 1);
+
+    batch->actor = clutter_actor_new ();
+    clutter_actor_add_child (batch->stage, batch->actor);
+
+    effect = clutter_kawase_blur_effect_new ();
+    clutter_kawase_blur_effect_update_blur_strength (CLUTTER_KAWASE_BLUR_EFFECT (effect), strength);
+    clutter_actor_add_effect_with_name (batch->actor, "blur", effect);
+
+    g_signal_connect_after (batch->stage, "paint", G_CALLBACK (stage_paint_end), batch);
+
+    clutter_actor_show (batch->stage);
+    g_idle_add (gpu_next_image, batch);
+
+    clutter_main ();
+
+    clutter_actor_destroy (batch->stage);
+}
+
+static void
+add_inputs_from_list (GPtrArray *paths)
+{
+    GIOChannel *channel;
+    GError *error = NULL;
+    gchar *line;
+    gsize terminator;
+
+    if (g_strcmp0 (list, "-") == 0)
+        channel = g_io_channel_unix_new (0);
+    else
+        channel = g_io_channel_new_file (list, "r", &error);
+
+    if (channel == NULL)
+        g_error ("Unable to read %s: %s", list, error->message);
+
+    while (g_io_channel_read_line (channel, &line, NULL, &terminator, NULL) == G_IO_STATUS_NORMAL)
+      {
+        line[terminator] = '\0';
+        if (line[0] != '\0')
+            g_ptr_array_add (paths, line);
+        else
+            g_free (line);
+      }
+
+    g_io_channel_unref (channel);
+}
+
+static void
+write_report (Batch  *batch,
+              gint64  wall_time)
+{
+    gdouble seconds = wall_time / 1000000.0;
+    FILE *out = stdout;
+
+    if (report != NULL)
+      {
+        out = fopen (report, "w");
+        if (out == NULL)
+            g_error ("Unable to open %s for writing", report);
+      }
+
+    fprintf (out,
+             "{\n"
+             "  \"benchmark\": \"blur_batch\",\n"
+             "  \"engine\": \"%s\",\n"
+             "  \"strength\": %d,\n"
+             "  \"format\": \"%s\",\n"
+             "  \"decoders\": %d,\n"
+             "  \"encoders\": %d,\n"
+             "  \"queue\": %d,\n"
+             "  \"images\": %d,\n"
+             "  \"failed\": %d,\n"
+             "  \"seconds\": %.3f,\n"
+             "  \"images_per_second\": %.3f,\n"
+             "  \"megabytes_per_second\": %.3f,\n"
+             "  \"output_bytes\": %" G_GUINT64_FORMAT ",\n"
+             "  \"decode_seconds\": %.3f,\n"
+             "  \"blur_seconds\": %.3f,\n"
+             "  \"encode_seconds\": %.3f\n"
+             "}\n",
+             engine,
+             strength,
+             format,
+             n_decoders,
+             n_encoders,
+             queue_size,
+             batch->images,
+             batch->failed,
+             seconds,
+             batch->images / seconds,
+             batch->pixel_bytes / (1024.0 * 1024.0) / seconds,
+             batch->output_bytes,
+             batch->decode_time / 1000000.0,
+             batch->blur_time / 1000000.0,
+             batch->encode_time / 1000000.0);
+
+    if (out != stdout)
+        fclose (out);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Batch batch = { 0, };
+    GThread **decoders, **encoders;
+    gint64 start;
+
+    context = g_option_context_new ("- blur images in a batch");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    if (engine == NULL)
+        engine = g_strdup ("gpu");
+    if (format == NULL)
+        format = g_strdup ("png");
+
+    if (g_strcmp0 (engine, "gpu") != 0 && g_strcmp0 (engine, "cpu") != 0)
+      {
+        g_printerr ("Unknown engine %s, use gpu or cpu\n", engine);
+        return EXIT_FAILURE;
+      }
+    if (output_dir == NULL)
+      {
+        g_printerr ("No output directory given, use --output-dir\n");
+        return EXIT_FAILURE;
+      }
+
+    strength = CLAMP (strength, 0, 14);
+    repeat = MAX (repeat, 1);
+    n_decoders = MAX (n_decoders, 1);
+    n_encoders = MAX (n_encoders, 1);
+    queue_size = MAX (queue_size, 1);
+
+    batch.paths = g_ptr_array_new_with_free_func (g_free);
+    for (gint i = 0; inputs != NULL && inputs[i] != NULL; i++)
+        g_ptr_array_add (batch.paths, g_strdup (inputs[i]));
+    if (list != NULL)
+        add_inputs_from_list (batch.paths);
+
+    if (batch.paths->len == 0)
+      {
+        g_printerr ("No input images given\n");
+        return EXIT_FAILURE;
+      }
+
+    if (g_mkdir_with_parents (output_dir, 0755) != 0)
+        g_error ("Unable to create %s", output_dir);
+
+    // The CPU engine doesn't touch Clutter, so it runs without a display
+    if (g_strcmp0 (engine, "gpu") == 0)
+      {
+        g_setenv ("CLUTTER_VBLANK", "none", FALSE);
+        g_setenv ("CLUTTER_DEFAULT_FPS", "1000", FALSE);
+
+        if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+            g_error ("Unable to initialize Clutter");
+      }
+
+    batch.n_items = batch.paths->len * repeat;
+    batch.running_decoders = n_decoders;
+    batch_queue_init (&batch.decoded, queue_size);
+    batch_queue_init (&batch.blurred, queue_size);
+    g_mutex_init (&batch.lock);
+
+    start = g_get_monotonic_time ();
+
+    decoders = g_new (GThread *, n_decoders);
+    for (gint i = 0; i < n_decoders; i++)
+        decoders[i] = g_thread_new ("decoder", decode_thread, &batch);
+
+    encoders = g_new (GThread *, n_encoders);
+    for (gint i = 0; i < n_encoders; i++)
+        encoders[i] = g_thread_new ("encoder", encode_thread, &batch);
+
+    if (g_strcmp0 (engine, "gpu") == 0)
+        run_gpu_engine (&batch);
+    else
+        run_cpu_engine (&batch);
+
+    batch_queue_close (&batch.blurred);
+
+    for (gint i = 0; i < n_decoders; i++)
+        g_thread_join (decoders[i]);
+    for (gint i = 0; i < n_encoders; i++)
+        g_thread_join (encoders[i]);
+
+    write_report (&batch, g_get_monotonic_time () - start);
+
+    g_free (decoders);
+    g_free (encoders);
+    batch_queue_clear (&batch.decoded);
+    batch_queue_clear (&batch.blurred);
+    g_mutex_clear (&batch.lock);
+    g_ptr_array_free (batch.paths, TRUE);
+
+    return batch.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
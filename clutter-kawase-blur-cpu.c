@@ -0,0 +1,951 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * CPU implementation of the dual Kawase blur.
+ *
+ * This mirrors glsl_downsample_shader and glsl_upsample_shader from
+ * clutter-kawase-blur-effect.c: every destination pixel is sampled at the
+ * center of its texel, the taps are displaced by halfpixel * offset in
+ * texture coordinates, and every tap is a bilinear lookup with clamp to
+ * edge wrapping, just like texture2D() on the intermediate textures. The
+ * alpha channel is forced to 255 and the result is rounded to the nearest
+ * 8 bit value, which is what the GPU does when writing to a RGBA 8888
+ * framebuffer.
+ *
+ * It serves as the software fallback of the effect when GLSL isn't
+ * available and as the reference the GPU output can be checked against.
+ *
+ * Every pass is split into bands of destination rows which are handed out
+ * to a thread pool. The threads claim bands from a shared counter until
+ * none are left, so fast threads take over the work of slow ones, and the
+ * next pass only starts once all bands of the current one are done.
+ */
+
+#include "clutter-kawase-blur-cpu.h"
+#include "clutter-kawase-blur-trace.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KAWASE_BLUR_CPU_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  /* displacement in multiples of halfpixel * offset */
+  gint dx;
+  gint dy;
+  gfloat weight;
+} KawaseTap;
+
+static const KawaseTap downsample_taps[] = {
+  {  0,  0, 4.0f },
+  { -1, -1, 1.0f },
+  {  1,  1, 1.0f },
+  {  1, -1, 1.0f },
+  { -1,  1, 1.0f },
+};
+
+static const KawaseTap upsample_taps[] = {
+  { -2,  0, 1.0f },
+  { -1,  1, 2.0f },
+  {  0,  2, 1.0f },
+  {  1,  1, 2.0f },
+  {  2,  0, 1.0f },
+  {  1, -1, 2.0f },
+  {  0, -2, 1.0f },
+  { -1, -1, 2.0f },
+};
+
+/*
+ * The bilinear lookups only depend on the column for the horizontal part
+ * and on the row for the vertical part, so they are computed once per pass
+ * and tap. x0/x1/fx hold n_taps * dst->width entries, y0/y1/fy hold
+ * n_taps * dst->height entries.
+ */
+typedef struct {
+  const KawaseTap *taps;
+  gint n_taps;
+  gfloat divisor;
+
+  gint *x0;
+  gint *x1;
+  gfloat *fx;
+
+  gint *y0;
+  gint *y1;
+  gfloat *fy;
+} KawasePass;
+
+/* the maximum vertical tap displacement, in multiples of halfpixel * offset */
+#define KAWASE_MAX_TAP_DISTANCE 2
+
+/* bands per thread, more bands balance the load better between threads */
+#define KAWASE_BANDS_PER_THREAD 4
+
+/* lower bound for the band height, in destination rows */
+#define KAWASE_MIN_BAND_ROWS 8
+
+typedef void (* KawasePassRowsFunc) (const KawasePass               *pass,
+                                     const ClutterKawaseBlurCpuImage *src,
+                                     ClutterKawaseBlurCpuImage       *dst,
+                                     gint                             y_begin,
+                                     gint                             y_end);
+
+/*
+ * The pass currently distributed over the thread pool. Bands are claimed
+ * by incrementing next_band, the dispatching thread waits until every
+ * worker it pushed has checked out again before touching the pass tables.
+ */
+typedef struct {
+  const ClutterKawaseBlurCpuImage *src;
+  ClutterKawaseBlurCpuImage *dst;
+  gint band_rows;
+  gint n_bands;
+
+  gint next_band;
+  gint workers_left;
+} KawaseJob;
+
+struct _ClutterKawaseBlurCpu
+{
+  ClutterKawaseBlurCpuKernel kernel;
+  KawasePassRowsFunc pass_rows;
+
+  /* 0 means one thread per processor */
+  gint n_threads;
+  GThreadPool *pool;
+  KawaseJob job;
+  GMutex lock;
+  GCond done;
+
+  KawasePass pass;
+  gint pass_columns;
+  gint pass_rows_allocated;
+
+  /* same layout as the GPU pyramid: levels 1..n of the down- and upsample
+   * chain, level 0 being the source respectively the destination */
+  ClutterKawaseBlurCpuImage *down;
+  ClutterKawaseBlurCpuImage *up;
+  gint n_levels;
+  gint pyramid_width;
+  gint pyramid_height;
+};
+
+static void
+kawase_pass_setup_axis (gint    dst_size,
+                        gint    src_size,
+                        gfloat  shift,
+                        gint   *i0,
+                        gint   *i1,
+                        gfloat *f)
+{
+  for (gint i = 0; i < dst_size; i++)
+    {
+      /* texel center of the destination, in texels of the source */
+      gfloat coord = (((i + 0.5f) / dst_size) + shift) * src_size - 0.5f;
+      gfloat base = floorf (coord);
+      gint index = (gint) base;
+
+      f[i] = coord - base;
+      i0[i] = CLAMP (index, 0, src_size - 1);
+      i1[i] = CLAMP (index + 1, 0, src_size - 1);
+    }
+}
+
+static void
+kawase_pass_setup (ClutterKawaseBlurCpu            *cpu,
+                   const KawaseTap                 *taps,
+                   gint                             n_taps,
+                   gfloat                           divisor,
+                   const ClutterKawaseBlurCpuImage *src,
+                   const ClutterKawaseBlurCpuImage *dst,
+                   gfloat                           halfpixel_x,
+                   gfloat                           halfpixel_y,
+                   gfloat                           offset)
+{
+  KawasePass *pass = &cpu->pass;
+  gint columns = n_taps * dst->width;
+  gint rows = n_taps * dst->height;
+
+  if (columns > cpu->pass_columns)
+    {
+      pass->x0 = g_renew (gint, pass->x0, columns);
+      pass->x1 = g_renew (gint, pass->x1, columns);
+      pass->fx = g_renew (gfloat, pass->fx, columns);
+      cpu->pass_columns = columns;
+    }
+
+  if (rows > cpu->pass_rows_allocated)
+    {
+      pass->y0 = g_renew (gint, pass->y0, rows);
+      pass->y1 = g_renew (gint, pass->y1, rows);
+      pass->fy = g_renew (gfloat, pass->fy, rows);
+      cpu->pass_rows_allocated = rows;
+    }
+
+  pass->taps = taps;
+  pass->n_taps = n_taps;
+  pass->divisor = divisor;
+
+  for (gint t = 0; t < n_taps; t++)
+    {
+      gfloat shift_x = taps[t].dx * halfpixel_x * offset;
+      gfloat shift_y = taps[t].dy * halfpixel_y * offset;
+
+      kawase_pass_setup_axis (dst->width, src->width, shift_x,
+                              pass->x0 + t * dst->width,
+                              pass->x1 + t * dst->width,
+                              pass->fx + t * dst->width);
+      kawase_pass_setup_axis (dst->height, src->height, shift_y,
+                              pass->y0 + t * dst->height,
+                              pass->y1 + t * dst->height,
+                              pass->fy + t * dst->height);
+    }
+}
+
+/*
+ * The kernels below have to perform the floating point operations in
+ * exactly the same order, so that they stay bit-identical to each other.
+ */
+
+static void
+kawase_pass_rows_scalar (const KawasePass                *pass,
+                         const ClutterKawaseBlurCpuImage *src,
+                         ClutterKawaseBlurCpuImage       *dst,
+                         gint                             y_begin,
+                         gint                             y_end)
+{
+  for (gint y = y_begin; y < y_end; y++)
+    {
+      guint8 *out = dst->data + y * dst->rowstride;
+
+      for (gint x = 0; x < dst->width; x++)
+        {
+          gfloat acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+          for (gint t = 0; t < pass->n_taps; t++)
+            {
+              gint tx = t * dst->width + x;
+              gint ty = t * dst->height + y;
+              const guint8 *row0 = src->data + pass->y0[ty] * src->rowstride;
+              const guint8 *row1 = src->data + pass->y1[ty] * src->rowstride;
+              const guint8 *p00 = row0 + pass->x0[tx] * 4;
+              const guint8 *p10 = row0 + pass->x1[tx] * 4;
+              const guint8 *p01 = row1 + pass->x0[tx] * 4;
+              const guint8 *p11 = row1 + pass->x1[tx] * 4;
+              gfloat fx = pass->fx[tx];
+              gfloat fy = pass->fy[ty];
+              gfloat weight = pass->taps[t].weight;
+
+              for (gint c = 0; c < 4; c++)
+                {
+                  gfloat top = (gfloat) p00[c] + ((gfloat) p10[c] - (gfloat) p00[c]) * fx;
+                  gfloat bottom = (gfloat) p01[c] + ((gfloat) p11[c] - (gfloat) p01[c]) * fx;
+                  gfloat value = top + (bottom - top) * fy;
+
+                  acc[c] = acc[c] + value * weight;
+                }
+            }
+
+          for (gint c = 0; c < 3; c++)
+            {
+              glong v = lrintf (acc[c] / pass->divisor);
+
+              out[x * 4 + c] = (guint8) CLAMP (v, 0, 255);
+            }
+          out[x * 4 + 3] = 255;
+        }
+    }
+}
+
+#ifdef KAWASE_BLUR_CPU_X86
+
+__attribute__ ((target ("sse2")))
+static inline __m128
+kawase_load_pixel_sse2 (const guint8 *p)
+{
+  __m128i zero = _mm_setzero_si128 ();
+  guint32 v;
+  __m128i px;
+
+  memcpy (&v, p, sizeof (guint32));
+  px = _mm_cvtsi32_si128 ((gint) v);
+  px = _mm_unpacklo_epi8 (px, zero);
+  px = _mm_unpacklo_epi16 (px, zero);
+
+  return _mm_cvtepi32_ps (px);
+}
+
+__attribute__ ((target ("sse2")))
+static inline void
+kawase_pixel_sse2 (const KawasePass                *pass,
+                   const ClutterKawaseBlurCpuImage *src,
+                   const ClutterKawaseBlurCpuImage *dst,
+                   gint                             x,
+                   gint                             y,
+                   guint8                          *out)
+{
+  __m128 acc = _mm_setzero_ps ();
+  __m128i result;
+  guint32 v;
+
+  for (gint t = 0; t < pass->n_taps; t++)
+    {
+      gint tx = t * dst->width + x;
+      gint ty = t * dst->height + y;
+      const guint8 *row0 = src->data + pass->y0[ty] * src->rowstride;
+      const guint8 *row1 = src->data + pass->y1[ty] * src->rowstride;
+      __m128 p00 = kawase_load_pixel_sse2 (row0 + pass->x0[tx] * 4);
+      __m128 p10 = kawase_load_pixel_sse2 (row0 + pass->x1[tx] * 4);
+      __m128 p01 = kawase_load_pixel_sse2 (row1 + pass->x0[tx] * 4);
+      __m128 p11 = kawase_load_pixel_sse2 (row1 + pass->x1[tx] * 4);
+      __m128 fx = _mm_set1_ps (pass->fx[tx]);
+      __m128 fy = _mm_set1_ps (pass->fy[ty]);
+      __m128 top = _mm_add_ps (p00, _mm_mul_ps (_mm_sub_ps (p10, p00), fx));
+      __m128 bottom = _mm_add_ps (p01, _mm_mul_ps (_mm_sub_ps (p11, p01), fx));
+      __m128 value = _mm_add_ps (top, _mm_mul_ps (_mm_sub_ps (bottom, top), fy));
+
+      acc = _mm_add_ps (acc, _mm_mul_ps (value, _mm_set1_ps (pass->taps[t].weight)));
+    }
+
+  acc = _mm_div_ps (acc, _mm_set1_ps (pass->divisor));
+
+  /* round to nearest even, like lrintf(), then saturate to 8 bits */
+  result = _mm_cvtps_epi32 (acc);
+  result = _mm_packs_epi32 (result, result);
+  result = _mm_packus_epi16 (result, result);
+
+  v = (guint32) _mm_cvtsi128_si32 (result);
+  memcpy (out, &v, sizeof (guint32));
+  out[3] = 255;
+}
+
+__attribute__ ((target ("sse2")))
+static void
+kawase_pass_rows_sse2 (const KawasePass                *pass,
+                       const ClutterKawaseBlurCpuImage *src,
+                       ClutterKawaseBlurCpuImage       *dst,
+                       gint                             y_begin,
+                       gint                             y_end)
+{
+  for (gint y = y_begin; y < y_end; y++)
+    {
+      guint8 *out = dst->data + y * dst->rowstride;
+
+      for (gint x = 0; x < dst->width; x++)
+        kawase_pixel_sse2 (pass, src, dst, x, y, out + x * 4);
+    }
+}
+
+/*
+ * The AVX2 kernel works on eight destination pixels at once, one color
+ * channel per register. The column tables are contiguous for neighbouring
+ * pixels, so indices and weights are plain loads, and the four texels of
+ * every tap are fetched with gathers. Alpha is never computed since it is
+ * forced to 255 anyway.
+ */
+__attribute__ ((target ("avx2")))
+static inline void
+kawase_unpack_avx2 (__m256i  texels,
+                    __m256  *r,
+                    __m256  *g,
+                    __m256  *b)
+{
+  __m256i mask = _mm256_set1_epi32 (0xff);
+
+  *r = _mm256_cvtepi32_ps (_mm256_and_si256 (texels, mask));
+  *g = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (texels, 8), mask));
+  *b = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (texels, 16), mask));
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256
+kawase_bilinear_avx2 (__m256 p00,
+                      __m256 p10,
+                      __m256 p01,
+                      __m256 p11,
+                      __m256 fx,
+                      __m256 fy)
+{
+  __m256 top = _mm256_add_ps (p00, _mm256_mul_ps (_mm256_sub_ps (p10, p00), fx));
+  __m256 bottom = _mm256_add_ps (p01, _mm256_mul_ps (_mm256_sub_ps (p11, p01), fx));
+
+  return _mm256_add_ps (top, _mm256_mul_ps (_mm256_sub_ps (bottom, top), fy));
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+kawase_round_avx2 (__m256 acc,
+                   __m256 divisor)
+{
+  __m256i v = _mm256_cvtps_epi32 (_mm256_div_ps (acc, divisor));
+
+  return _mm256_min_epi32 (_mm256_max_epi32 (v, _mm256_setzero_si256 ()),
+                           _mm256_set1_epi32 (255));
+}
+
+__attribute__ ((target ("avx2")))
+static void
+kawase_pass_rows_avx2 (const KawasePass                *pass,
+                       const ClutterKawaseBlurCpuImage *src,
+                       ClutterKawaseBlurCpuImage       *dst,
+                       gint                             y_begin,
+                       gint                             y_end)
+{
+  __m256 divisor = _mm256_set1_ps (pass->divisor);
+  __m256i alpha = _mm256_set1_epi32 ((gint) 0xff000000);
+
+  for (gint y = y_begin; y < y_end; y++)
+    {
+      guint8 *out = dst->data + y * dst->rowstride;
+      gint x = 0;
+
+      for (; x + 8 <= dst->width; x += 8)
+        {
+          __m256 acc_r = _mm256_setzero_ps ();
+          __m256 acc_g = _mm256_setzero_ps ();
+          __m256 acc_b = _mm256_setzero_ps ();
+          __m256i result;
+
+          for (gint t = 0; t < pass->n_taps; t++)
+            {
+              gint tx = t * dst->width + x;
+              gint ty = t * dst->height + y;
+              const gint *row0 = (const gint *) (src->data + pass->y0[ty] * src->rowstride);
+              const gint *row1 = (const gint *) (src->data + pass->y1[ty] * src->rowstride);
+              __m256i x0 = _mm256_loadu_si256 ((const __m256i *) (pass->x0 + tx));
+              __m256i x1 = _mm256_loadu_si256 ((const __m256i *) (pass->x1 + tx));
+              __m256 fx = _mm256_loadu_ps (pass->fx + tx);
+              __m256 fy = _mm256_set1_ps (pass->fy[ty]);
+              __m256 weight = _mm256_set1_ps (pass->taps[t].weight);
+              __m256 r00, g00, b00, r10, g10, b10, r01, g01, b01, r11, g11, b11;
+
+              kawase_unpack_avx2 (_mm256_i32gather_epi32 (row0, x0, 4), &r00, &g00, &b00);
+              kawase_unpack_avx2 (_mm256_i32gather_epi32 (row0, x1, 4), &r10, &g10, &b10);
+              kawase_unpack_avx2 (_mm256_i32gather_epi32 (row1, x0, 4), &r01, &g01, &b01);
+              kawase_unpack_avx2 (_mm256_i32gather_epi32 (row1, x1, 4), &r11, &g11, &b11);
+
+              acc_r = _mm256_add_ps (acc_r, _mm256_mul_ps (kawase_bilinear_avx2 (r00, r10, r01, r11, fx, fy), weight));
+              acc_g = _mm256_add_ps (acc_g, _mm256_mul_ps (kawase_bilinear_avx2 (g00, g10, g01, g11, fx, fy), weight));
+              acc_b = _mm256_add_ps (acc_b, _mm256_mul_ps (kawase_bilinear_avx2 (b00, b10, b01, b11, fx, fy), weight));
+            }
+
+          result = _mm256_or_si256 (alpha,
+                   _mm256_or_si256 (kawase_round_avx2 (acc_r, divisor),
+                   _mm256_or_si256 (_mm256_slli_epi32 (kawase_round_avx2 (acc_g, divisor), 8),
+                                    _mm256_slli_epi32 (kawase_round_avx2 (acc_b, divisor), 16))));
+
+          _mm256_storeu_si256 ((__m256i *) (out + x * 4), result);
+        }
+
+      for (; x < dst->width; x++)
+        kawase_pixel_sse2 (pass, src, dst, x, y, out + x * 4);
+    }
+}
+
+#endif /* KAWASE_BLUR_CPU_X86 */
+
+/**
+ * clutter_kawase_blur_cpu_kernel_supported:
+ * @kernel: a #ClutterKawaseBlurCpuKernel
+ *
+ * Checks whether @kernel can run on this machine.
+ *
+ * Return value: %TRUE if the kernel is supported
+ */
+gboolean
+clutter_kawase_blur_cpu_kernel_supported (ClutterKawaseBlurCpuKernel kernel)
+{
+  switch (kernel)
+    {
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO:
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR:
+      return TRUE;
+
+#ifdef KAWASE_BLUR_CPU_X86
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2") != 0;
+
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2") != 0;
+#endif
+
+    default:
+      return FALSE;
+    }
+}
+
+/**
+ * clutter_kawase_blur_cpu_kernel_get_name:
+ * @kernel: a #ClutterKawaseBlurCpuKernel
+ *
+ * Return value: a short, human readable name of @kernel
+ */
+const gchar *
+clutter_kawase_blur_cpu_kernel_get_name (ClutterKawaseBlurCpuKernel kernel)
+{
+  switch (kernel)
+    {
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO:
+      return "auto";
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR:
+      return "scalar";
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2:
+      return "sse2";
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2:
+      return "avx2";
+    }
+
+  return "unknown";
+}
+
+/**
+ * clutter_kawase_blur_cpu_new:
+ *
+ * Creates a new CPU blur context. The context keeps its intermediate
+ * buffers between runs, just like the effect keeps its texture pyramid.
+ * It uses the fastest kernel supported by the CPU and one thread per
+ * processor.
+ *
+ * Return value: (transfer full): a new #ClutterKawaseBlurCpu
+ */
+ClutterKawaseBlurCpu *
+clutter_kawase_blur_cpu_new (void)
+{
+  ClutterKawaseBlurCpu *cpu = g_new0 (ClutterKawaseBlurCpu, 1);
+
+  clutter_kawase_blur_cpu_set_kernel (cpu, CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO);
+  g_mutex_init (&cpu->lock);
+  g_cond_init (&cpu->done);
+
+  return cpu;
+}
+
+static void
+clutter_kawase_blur_cpu_clear_pyramid (ClutterKawaseBlurCpu *cpu)
+{
+  for (gint i = 0; i < cpu->n_levels; i++)
+    {
+      g_free (cpu->down[i].data);
+      g_free (cpu->up[i].data);
+    }
+
+  g_free (cpu->down);
+  g_free (cpu->up);
+  cpu->down = NULL;
+  cpu->up = NULL;
+  cpu->n_levels = 0;
+}
+
+/**
+ * clutter_kawase_blur_cpu_free:
+ * @cpu: a #ClutterKawaseBlurCpu
+ *
+ * Frees @cpu and all of its buffers.
+ */
+void
+clutter_kawase_blur_cpu_free (ClutterKawaseBlurCpu *cpu)
+{
+  if (cpu == NULL)
+    return;
+
+  if (cpu->pool != NULL)
+    g_thread_pool_free (cpu->pool, FALSE, TRUE);
+  g_mutex_clear (&cpu->lock);
+  g_cond_clear (&cpu->done);
+
+  clutter_kawase_blur_cpu_clear_pyramid (cpu);
+
+  g_free (cpu->pass.x0);
+  g_free (cpu->pass.x1);
+  g_free (cpu->pass.fx);
+  g_free (cpu->pass.y0);
+  g_free (cpu->pass.y1);
+  g_free (cpu->pass.fy);
+  g_free (cpu);
+}
+
+/**
+ * clutter_kawase_blur_cpu_set_kernel:
+ * @cpu: a #ClutterKawaseBlurCpu
+ * @kernel: the kernel to use
+ *
+ * Selects the implementation of the passes. Unsupported kernels fall
+ * back to the fastest supported one.
+ */
+void
+clutter_kawase_blur_cpu_set_kernel (ClutterKawaseBlurCpu       *cpu,
+                                    ClutterKawaseBlurCpuKernel  kernel)
+{
+  g_return_if_fail (cpu != NULL);
+
+  if (!clutter_kawase_blur_cpu_kernel_supported (kernel))
+    kernel = CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO;
+
+  if (kernel == CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO)
+    {
+      if (clutter_kawase_blur_cpu_kernel_supported (CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2))
+        kernel = CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2;
+      else if (clutter_kawase_blur_cpu_kernel_supported (CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2))
+        kernel = CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2;
+      else
+        kernel = CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR;
+    }
+
+  cpu->kernel = kernel;
+
+  switch (kernel)
+    {
+#ifdef KAWASE_BLUR_CPU_X86
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2:
+      cpu->pass_rows = kawase_pass_rows_sse2;
+      break;
+
+    case CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2:
+      cpu->pass_rows = kawase_pass_rows_avx2;
+      break;
+#endif
+
+    default:
+      cpu->pass_rows = kawase_pass_rows_scalar;
+      break;
+    }
+}
+
+/**
+ * clutter_kawase_blur_cpu_get_kernel:
+ * @cpu: a #ClutterKawaseBlurCpu
+ *
+ * Return value: the kernel actually in use, never
+ *   %CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO
+ */
+ClutterKawaseBlurCpuKernel
+clutter_kawase_blur_cpu_get_kernel (ClutterKawaseBlurCpu *cpu)
+{
+  g_return_val_if_fail (cpu != NULL, CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR);
+
+  return cpu->kernel;
+}
+
+/**
+ * clutter_kawase_blur_cpu_set_n_threads:
+ * @cpu: a #ClutterKawaseBlurCpu
+ * @n_threads: the number of threads, or 0 for one per processor
+ *
+ * Sets the number of threads every pass is distributed over, including
+ * the calling thread. With a single thread no thread pool is used.
+ */
+void
+clutter_kawase_blur_cpu_set_n_threads (ClutterKawaseBlurCpu *cpu,
+                                       gint                  n_threads)
+{
+  g_return_if_fail (cpu != NULL);
+  g_return_if_fail (n_threads >= 0);
+
+  cpu->n_threads = n_threads;
+}
+
+/**
+ * clutter_kawase_blur_cpu_get_n_threads:
+ * @cpu: a #ClutterKawaseBlurCpu
+ *
+ * Return value: the number of threads actually used for every pass
+ */
+gint
+clutter_kawase_blur_cpu_get_n_threads (ClutterKawaseBlurCpu *cpu)
+{
+  g_return_val_if_fail (cpu != NULL, 1);
+
+  if (cpu->n_threads == 0)
+    return MAX ((gint) g_get_num_processors (), 1);
+
+  return cpu->n_threads;
+}
+
+/*
+ * A band of destination rows reads its source directly from the previous
+ * level, which is shared between all threads. Besides the rows covered by
+ * the band itself it reads a halo of rows on either side, reaching as far
+ * as the most distant tap plus one row for the bilinear lookup. Neighbouring
+ * bands both read their common halo, so bands are kept at least twice as
+ * high as the halo to bound the redundant reads, and otherwise sized so
+ * that every thread gets a few of them to balance the load.
+ */
+static gint
+kawase_pass_get_band_rows (const ClutterKawaseBlurCpuImage *src,
+                           const ClutterKawaseBlurCpuImage *dst,
+                           gfloat                           halfpixel_y,
+                           gfloat                           offset,
+                           gint                             n_threads)
+{
+  gfloat halo = ceilf (KAWASE_MAX_TAP_DISTANCE * halfpixel_y * fabsf (offset) * src->height) + 1.0f;
+  gint halo_rows = (gint) ceilf (halo * dst->height / src->height);
+  gint n_bands = n_threads * KAWASE_BANDS_PER_THREAD;
+  gint band_rows = (dst->height + n_bands - 1) / n_bands;
+
+  band_rows = MAX (band_rows, 2 * halo_rows);
+  band_rows = MAX (band_rows, KAWASE_MIN_BAND_ROWS);
+
+  return MIN (band_rows, dst->height);
+}
+
+static void
+kawase_job_run_bands (ClutterKawaseBlurCpu *cpu)
+{
+  KawaseJob *job = &cpu->job;
+  ClutterKawaseBlurTraceSpan span = clutter_kawase_blur_trace_begin ("cpu_bands");
+  gint band;
+
+  while ((band = g_atomic_int_add (&job->next_band, 1)) < job->n_bands)
+    {
+      gint y_begin = band * job->band_rows;
+      gint y_end = MIN (y_begin + job->band_rows, job->dst->height);
+
+      cpu->pass_rows (&cpu->pass, job->src, job->dst, y_begin, y_end);
+    }
+
+  clutter_kawase_blur_trace_end (span, -1, job->dst->width, job->dst->height, -1.0f);
+}
+
+static void
+kawase_worker (gpointer data,
+               gpointer user_data)
+{
+  ClutterKawaseBlurCpu *cpu = data;
+
+  kawase_job_run_bands (cpu);
+
+  g_mutex_lock (&cpu->lock);
+  if (--cpu->job.workers_left == 0)
+    g_cond_signal (&cpu->done);
+  g_mutex_unlock (&cpu->lock);
+}
+
+static void
+clutter_kawase_blur_cpu_pass (ClutterKawaseBlurCpu            *cpu,
+                              const KawaseTap                 *taps,
+                              gint                             n_taps,
+                              gfloat                           divisor,
+                              const ClutterKawaseBlurCpuImage *src,
+                              ClutterKawaseBlurCpuImage       *dst,
+                              gfloat                           halfpixel_x,
+                              gfloat                           halfpixel_y,
+                              gfloat                           offset)
+{
+  KawaseJob *job = &cpu->job;
+  gint n_threads = clutter_kawase_blur_cpu_get_n_threads (cpu);
+  gint n_workers;
+
+  kawase_pass_setup (cpu, taps, n_taps, divisor,
+                     src, dst,
+                     halfpixel_x, halfpixel_y, offset);
+
+  job->src = src;
+  job->dst = dst;
+  job->band_rows = kawase_pass_get_band_rows (src, dst, halfpixel_y, offset, n_threads);
+  job->n_bands = (dst->height + job->band_rows - 1) / job->band_rows;
+  job->next_band = 0;
+
+  // The calling thread works on the bands as well
+  n_workers = MIN (n_threads, job->n_bands) - 1;
+  if (n_workers <= 0)
+    {
+      ClutterKawaseBlurTraceSpan span = clutter_kawase_blur_trace_begin ("cpu_bands");
+
+      cpu->pass_rows (&cpu->pass, src, dst, 0, dst->height);
+
+      clutter_kawase_blur_trace_end (span, -1, dst->width, dst->height, -1.0f);
+      return;
+    }
+
+  if (cpu->pool == NULL)
+    cpu->pool = g_thread_pool_new (kawase_worker, NULL, n_threads - 1, FALSE, NULL);
+  else if (g_thread_pool_get_max_threads (cpu->pool) != n_threads - 1)
+    g_thread_pool_set_max_threads (cpu->pool, n_threads - 1, NULL);
+
+  job->workers_left = n_workers;
+  for (gint i = 0; i < n_workers; i++)
+    g_thread_pool_push (cpu->pool, cpu, NULL);
+
+  kawase_job_run_bands (cpu);
+
+  // Barrier: the next pass reads what this one writes, and reuses the tables
+  g_mutex_lock (&cpu->lock);
+  while (cpu->job.workers_left > 0)
+    g_cond_wait (&cpu->done, &cpu->lock);
+  g_mutex_unlock (&cpu->lock);
+}
+
+/**
+ * clutter_kawase_blur_cpu_downsample:
+ * @cpu: a #ClutterKawaseBlurCpu
+ * @src: the image to sample from
+ * @dst: the image to write to
+ * @halfpixel_x: the horizontal halfpixel uniform
+ * @halfpixel_y: the vertical halfpixel uniform
+ * @offset: the offset uniform
+ *
+ * Runs a single downsample pass, with the same semantics as drawing @dst
+ * with the downsample pipeline of the effect.
+ */
+void
+clutter_kawase_blur_cpu_downsample (ClutterKawaseBlurCpu            *cpu,
+                                    const ClutterKawaseBlurCpuImage *src,
+                                    ClutterKawaseBlurCpuImage       *dst,
+                                    gfloat                           halfpixel_x,
+                                    gfloat                           halfpixel_y,
+                                    gfloat                           offset)
+{
+  g_return_if_fail (cpu != NULL);
+  g_return_if_fail (src != NULL && dst != NULL);
+
+  clutter_kawase_blur_cpu_pass (cpu,
+                                downsample_taps, G_N_ELEMENTS (downsample_taps), 8.0f,
+                                src, dst,
+                                halfpixel_x, halfpixel_y, offset);
+}
+
+/**
+ * clutter_kawase_blur_cpu_upsample:
+ * @cpu: a #ClutterKawaseBlurCpu
+ * @src: the image to sample from
+ * @dst: the image to write to
+ * @halfpixel_x: the horizontal halfpixel uniform
+ * @halfpixel_y: the vertical halfpixel uniform
+ * @offset: the offset uniform
+ *
+ * Runs a single upsample pass, with the same semantics as drawing @dst
+ * with the upsample pipeline of the effect.
+ */
+void
+clutter_kawase_blur_cpu_upsample (ClutterKawaseBlurCpu            *cpu,
+                                  const ClutterKawaseBlurCpuImage *src,
+                                  ClutterKawaseBlurCpuImage       *dst,
+                                  gfloat                           halfpixel_x,
+                                  gfloat                           halfpixel_y,
+                                  gfloat                           offset)
+{
+  g_return_if_fail (cpu != NULL);
+  g_return_if_fail (src != NULL && dst != NULL);
+
+  clutter_kawase_blur_cpu_pass (cpu,
+                                upsample_taps, G_N_ELEMENTS (upsample_taps), 12.0f,
+                                src, dst,
+                                halfpixel_x, halfpixel_y, offset);
+}
+
+static void
+clutter_kawase_blur_cpu_init_level (ClutterKawaseBlurCpuImage *image,
+                                    gint                       width,
+                                    gint                       height,
+                                    gint                       level)
+{
+  image->width = MAX (width >> level, 1);
+  image->height = MAX (height >> level, 1);
+  image->rowstride = image->width * 4;
+  image->data = g_malloc (image->rowstride * image->height);
+}
+
+static void
+clutter_kawase_blur_cpu_ensure_pyramid (ClutterKawaseBlurCpu *cpu,
+                                        gint                  width,
+                                        gint                  height,
+                                        gint                  iterations)
+{
+  if (cpu->pyramid_width != width || cpu->pyramid_height != height)
+    {
+      clutter_kawase_blur_cpu_clear_pyramid (cpu);
+      cpu->pyramid_width = width;
+      cpu->pyramid_height = height;
+    }
+
+  if (cpu->n_levels >= iterations)
+    return;
+
+  cpu->down = g_renew (ClutterKawaseBlurCpuImage, cpu->down, iterations);
+  cpu->up = g_renew (ClutterKawaseBlurCpuImage, cpu->up, iterations);
+
+  for (gint i = cpu->n_levels; i < iterations; i++)
+    {
+      clutter_kawase_blur_cpu_init_level (&cpu->down[i], width, height, i + 1);
+      clutter_kawase_blur_cpu_init_level (&cpu->up[i], width, height, i + 1);
+    }
+
+  cpu->n_levels = iterations;
+}
+
+/**
+ * clutter_kawase_blur_cpu_run:
+ * @cpu: a #ClutterKawaseBlurCpu
+ * @src: the image to blur
+ * @dst: the image receiving the result, with the same size as @src
+ * @iterations: the number of downsample iterations
+ * @offset: the offset uniform
+ *
+ * Runs the whole dual Kawase chain on @src, like the effect does for a
+ * blur strength with the given @iterations and @offset.
+ */
+void
+clutter_kawase_blur_cpu_run (ClutterKawaseBlurCpu            *cpu,
+                             const ClutterKawaseBlurCpuImage *src,
+                             ClutterKawaseBlurCpuImage       *dst,
+                             gint                             iterations,
+                             gfloat                           offset)
+{
+  const ClutterKawaseBlurCpuImage *previous = src;
+  gfloat halfpixel_x, halfpixel_y;
+
+  g_return_if_fail (cpu != NULL);
+  g_return_if_fail (src != NULL && dst != NULL);
+  g_return_if_fail (src->width == dst->width && src->height == dst->height);
+  g_return_if_fail (iterations > 0);
+
+  // The effect derives halfpixel from the size of the source for all passes
+  halfpixel_x = 0.5f / src->width;
+  halfpixel_y = 0.5f / src->height;
+
+  clutter_kawase_blur_cpu_ensure_pyramid (cpu, src->width, src->height, iterations);
+
+  for (gint level = 1; level <= iterations; level++)
+    {
+      clutter_kawase_blur_cpu_downsample (cpu, previous, &cpu->down[level - 1],
+                                          halfpixel_x, halfpixel_y, offset);
+      previous = &cpu->down[level - 1];
+    }
+
+  for (gint level = iterations - 1; level >= 1; level--)
+    {
+      clutter_kawase_blur_cpu_upsample (cpu, previous, &cpu->up[level - 1],
+                                        halfpixel_x, halfpixel_y, offset);
+      previous = &cpu->up[level - 1];
+    }
+
+  clutter_kawase_blur_cpu_upsample (cpu, previous, dst,
+                                    halfpixel_x, halfpixel_y, offset);
+}
@@ -0,0 +1,105 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __CLUTTER_KAWASE_BLUR_CPU_H__
+#define __CLUTTER_KAWASE_BLUR_CPU_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ClutterKawaseBlurCpuKernel:
+ * @CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO: pick the fastest kernel supported
+ *   by the CPU at runtime
+ * @CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR: portable C implementation
+ * @CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2: one pixel per SSE2 register
+ * @CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2: eight pixels at once using AVX2 gathers
+ *
+ * The implementations of the down- and upsample passes. All kernels
+ * produce bit-identical results.
+ */
+typedef enum {
+  CLUTTER_KAWASE_BLUR_CPU_KERNEL_AUTO,
+  CLUTTER_KAWASE_BLUR_CPU_KERNEL_SCALAR,
+  CLUTTER_KAWASE_BLUR_CPU_KERNEL_SSE2,
+  CLUTTER_KAWASE_BLUR_CPU_KERNEL_AVX2
+} ClutterKawaseBlurCpuKernel;
+
+typedef struct _ClutterKawaseBlurCpu       ClutterKawaseBlurCpu;
+typedef struct _ClutterKawaseBlurCpuImage  ClutterKawaseBlurCpuImage;
+
+/**
+ * ClutterKawaseBlurCpuImage:
+ * @data: the RGBA 8888 pixels, top row first
+ * @width: the width of the image
+ * @height: the height of the image
+ * @rowstride: the number of bytes between two rows
+ *
+ * A view on a RGBA 8888 pixel buffer. The memory is owned by the caller.
+ */
+struct _ClutterKawaseBlurCpuImage
+{
+  guint8 *data;
+  gint width;
+  gint height;
+  gint rowstride;
+};
+
+gboolean clutter_kawase_blur_cpu_kernel_supported (ClutterKawaseBlurCpuKernel kernel);
+const gchar *clutter_kawase_blur_cpu_kernel_get_name (ClutterKawaseBlurCpuKernel kernel);
+
+ClutterKawaseBlurCpu *clutter_kawase_blur_cpu_new (void);
+void clutter_kawase_blur_cpu_free (ClutterKawaseBlurCpu *cpu);
+
+void clutter_kawase_blur_cpu_set_kernel (ClutterKawaseBlurCpu       *cpu,
+                                         ClutterKawaseBlurCpuKernel  kernel);
+ClutterKawaseBlurCpuKernel clutter_kawase_blur_cpu_get_kernel (ClutterKawaseBlurCpu *cpu);
+
+void clutter_kawase_blur_cpu_set_n_threads (ClutterKawaseBlurCpu *cpu,
+                                            gint                  n_threads);
+gint clutter_kawase_blur_cpu_get_n_threads (ClutterKawaseBlurCpu *cpu);
+
+void clutter_kawase_blur_cpu_downsample (ClutterKawaseBlurCpu            *cpu,
+                                         const ClutterKawaseBlurCpuImage *src,
+                                         ClutterKawaseBlurCpuImage       *dst,
+                                         gfloat                           halfpixel_x,
+                                         gfloat                           halfpixel_y,
+                                         gfloat                           offset);
+void clutter_kawase_blur_cpu_upsample (ClutterKawaseBlurCpu            *cpu,
+                                       const ClutterKawaseBlurCpuImage *src,
+                                       ClutterKawaseBlurCpuImage       *dst,
+                                       gfloat                           halfpixel_x,
+                                       gfloat                           halfpixel_y,
+                                       gfloat                           offset);
+
+void clutter_kawase_blur_cpu_run (ClutterKawaseBlurCpu            *cpu,
+                                  const ClutterKawaseBlurCpuImage *src,
+                                  ClutterKawaseBlurCpuImage       *dst,
+                                  gint                             iterations,
+                                  gfloat                           offset);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_KAWASE_BLUR_CPU_H__ */
@@ -0,0 +1,1170 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * The dual Kawase engine: the texture pyramid, the down- and upsample
+ * passes through it and the regions of the levels they have to render,
+ * see clutter_kawase_blur_effect_kawase_run().
+ */
+
+#include "clutter-kawase-blur-effect-private.h"
+
+#include <math.h>
+
+static void
+clutter_kawase_blur_effect_set_uniforms (KawaseBlurPipelineStack *stack,
+                                         gint                     pipeline,
+                                         const gfloat            *offset,
+                                         const gfloat            *halfpixel)
+{
+  if (stack->offset_uniforms[pipeline] > -1)
+    cogl_pipeline_set_uniform_float (stack->pipelines[pipeline],
+                                    stack->offset_uniforms[pipeline],
+                                    2, /* n_components */
+                                    1, /* count */
+                                    offset);
+
+  if (stack->halfpixel_uniforms[pipeline] > -1)
+    cogl_pipeline_set_uniform_float (stack->pipelines[pipeline],
+                                    stack->halfpixel_uniforms[pipeline],
+                                    2, /* n_components */
+                                    1, /* count */
+                                    halfpixel);
+}
+
+/*
+ * Bumps the version of the downsample levels. Consumers that were painted
+ * earlier in the frame, or whose actors aren't redrawn at all, would keep
+ * showing the blur of the old levels, so they are repainted.
+ */
+static void
+clutter_kawase_blur_effect_levels_changed (ClutterKawaseBlurEffect *self)
+{
+  self->downsample_serial++;
+
+  if (self->downsample_consumers == NULL)
+    return;
+
+  for(guint i=0; i<self->downsample_consumers->len; i++)
+    clutter_effect_queue_repaint (g_ptr_array_index (self->downsample_consumers, i));
+}
+
+void
+clutter_kawase_blur_effect_clear_pyramid (ClutterKawaseBlurEffect *self)
+{
+  KawaseBlurTexturePool *pool =
+    &CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self)->texture_pool;
+
+  for(int i=0; i<2*DOWNSAMPLE_STEPS-1; i++)
+    {
+      if (self->pool_entries[i] != NULL)
+        {
+          kawase_blur_pool_release (pool, self->pool_entries[i]);
+          self->pool_entries[i] = NULL;
+        }
+      if (self->offscreenbuffers[i] != NULL)
+        {
+          cogl_object_unref (self->offscreenbuffers[i]);
+          self->offscreenbuffers[i] = NULL;
+        }
+      if (self->offscreen_textures[i] != NULL)
+        {
+          cogl_object_unref (self->offscreen_textures[i]);
+          self->offscreen_textures[i] = NULL;
+        }
+    }
+
+  self->pyramid_width = 0;
+  self->pyramid_height = 0;
+
+  // Consumers must not sample the levels anymore
+  self->downsampled_levels = 0;
+  clutter_kawase_blur_effect_levels_changed (self);
+
+  self->chain_complete = FALSE;
+}
+
+/*
+ * Every level halves both dimensions of the previous one. At reduced
+ * quality the levels start one step further down, see level_shift.
+ */
+static inline gint
+clutter_kawase_blur_effect_level_width (ClutterKawaseBlurEffect *self,
+                                        gint                     level)
+{
+  if (level == 0)
+    return self->tex_width;
+
+  return MAX (self->tex_width >> (level + self->level_shift), 1);
+}
+
+static inline gint
+clutter_kawase_blur_effect_level_height (ClutterKawaseBlurEffect *self,
+                                         gint                     level)
+{
+  if (level == 0)
+    return self->tex_height;
+
+  return MAX (self->tex_height >> (level + self->level_shift), 1);
+}
+
+/*
+ * The format a level is requested in. With CLUTTER_KAWASE_BLUR_FORMAT_AUTO
+ * the downsample levels use RGB565: their banding is smeared out by the
+ * passes that follow, while the upsample levels end up on screen.
+ */
+static ClutterKawaseBlurFormat
+clutter_kawase_blur_effect_get_level_format (ClutterKawaseBlurEffect *self,
+                                             gint                     index)
+{
+  if (self->intermediate_format != CLUTTER_KAWASE_BLUR_FORMAT_AUTO)
+    return self->intermediate_format;
+
+  return index < DOWNSAMPLE_STEPS
+       ? CLUTTER_KAWASE_BLUR_FORMAT_RGB565
+       : CLUTTER_KAWASE_BLUR_FORMAT_RGB888;
+}
+
+static void
+clutter_kawase_blur_effect_ensure_level (ClutterKawaseBlurEffect *self,
+                                         CoglContext             *ctx,
+                                         gint                     index,
+                                         gint                     level)
+{
+  ClutterKawaseBlurFormat format;
+  ClutterKawaseBlurTraceSpan span;
+
+  if (self->offscreen_textures[index] != NULL)
+    return;
+
+  format = clutter_kawase_blur_effect_get_level_format (self, index);
+
+  span = clutter_kawase_blur_trace_begin ("allocate");
+
+  if (self->shared_pyramid)
+    {
+      KawaseBlurTexturePool *pool =
+        &CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self)->texture_pool;
+      KawaseBlurPoolEntry *entry;
+      gboolean allocated;
+
+      entry = kawase_blur_pool_borrow (pool, ctx,
+                                       clutter_kawase_blur_effect_level_width (self, level),
+                                       clutter_kawase_blur_effect_level_height (self, level),
+                                       format,
+                                       &allocated);
+      if (allocated)
+        {
+          self->stats.textures_allocated++;
+          self->stats.framebuffers_allocated++;
+        }
+
+      // Our references are dropped by clear_pyramid, like for own levels
+      self->pool_entries[index] = entry;
+      self->offscreen_textures[index] = cogl_object_ref (entry->texture);
+      self->offscreenbuffers[index] = cogl_object_ref (entry->framebuffer);
+      self->level_formats[index] = entry->format;
+
+      clutter_kawase_blur_trace_end (span, level, entry->width, entry->height, self->strength);
+      return;
+    }
+
+  /*
+   * cogl_offscreen_new_with_texture creates a buffer tightly bound to the 
+   * texture it is based on. So any change to the buffer directly changes
+   * the content of the texture. This is handy for chaining the pipelines,
+   * because cogl_framebuffer_draw_rectangle only wants to output to
+   * framebuffers but the cogl pipelines only work with textures. Using
+   * the aforementioned cogl_offscreen_new_with_texture call ties those two 
+   * objects together. The framebuffer lives as long as its texture, so the
+   * completeness check only happens once per level.
+   */
+  self->offscreenbuffers[index] =
+    kawase_blur_level_new (ctx,
+                           clutter_kawase_blur_effect_level_width (self, level),
+                           clutter_kawase_blur_effect_level_height (self, level),
+                           &format,
+                           &self->offscreen_textures[index]);
+  self->level_formats[index] = format;
+  self->stats.textures_allocated++;
+  self->stats.framebuffers_allocated++;
+
+  clutter_kawase_blur_trace_end (span, level,
+                                 clutter_kawase_blur_effect_level_width (self, level),
+                                 clutter_kawase_blur_effect_level_height (self, level),
+                                 self->strength);
+}
+
+/*
+ * Makes sure that all levels needed for the current iteration count exist,
+ * and down_levels downsample levels, except for those the offscreen texture
+ * stands in for. The pyramid is only thrown away when
+ * the source texture changes its size or the levels change their scale
+ * with the adaptive quality, lowering the iteration count keeps
+ * the deeper levels around so that changing the blur strength back and
+ * forth doesn't reallocate anything.
+ */
+static void
+clutter_kawase_blur_effect_ensure_pyramid (ClutterKawaseBlurEffect *self,
+                                           gint                     down_levels)
+{
+  CoglContext *ctx =
+    clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+  if (self->pyramid_width != self->tex_width ||
+      self->pyramid_height != self->tex_height ||
+      self->pyramid_shift != self->level_shift)
+    {
+      clutter_kawase_blur_effect_clear_pyramid (self);
+      self->pyramid_width = self->tex_width;
+      self->pyramid_height = self->tex_height;
+      self->pyramid_shift = self->level_shift;
+    }
+
+  for(int level=self->entry_level+1; level<=down_levels; level++)
+    clutter_kawase_blur_effect_ensure_level (self, ctx, DOWN_TEXTURE (level), level);
+
+  for(int level=1; level<self->iterations; level++)
+    clutter_kawase_blur_effect_ensure_level (self, ctx, UP_TEXTURE (level), level);
+}
+
+/*
+ * The clip rectangles can only be blurred separately by the dual Kawase
+ * engine on the GPU, and only as long as no consumer samples the
+ * downsample levels, which then don't hold the whole image.
+ */
+gboolean
+clutter_kawase_blur_effect_can_isolate (ClutterKawaseBlurEffect *self)
+{
+  return self->isolate_rects &&
+         self->clip_rects != NULL &&
+         !clutter_kawase_blur_effect_is_transformed (self) &&
+         self->mode == CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE &&
+         !self->software &&
+         (self->downsample_consumers == NULL || self->downsample_consumers->len == 0);
+}
+
+/*
+ * The specialized shaders only exist for the strength steps of the table,
+ * strengths in between them use the shaders reading the offset uniform.
+ * Isolated clip rectangles need the clamped shaders, which only exist in
+ * the variant reading the uniforms.
+ */
+static KawaseBlurPipelineStack *
+clutter_kawase_blur_effect_get_class_stack (ClutterKawaseBlurEffect *self)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+
+  if (self->isolated)
+    return &klass->clamped_stack;
+
+  if (self->specialized_shaders && self->strength == floorf (self->strength))
+    return clutter_kawase_blur_effect_class_get_specialized_stack (klass,
+                                                                   (gint) self->strength);
+
+  return &klass->pipeline_stack;
+}
+
+static void
+kawase_blur_pipeline_stack_free (gpointer data)
+{
+  KawaseBlurPipelineStack *stack = data;
+
+  for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
+    cogl_object_unref (stack->pipelines[i]);
+
+  g_free (stack);
+}
+
+/*
+ * Returns the effect's copy of the class stack it currently draws with.
+ * When several effects shared the class' pipelines, every change of a
+ * uniform or texture hit a pipeline that the previous effect's draws
+ * still referenced in the journal, which made Cogl copy the pipeline or
+ * flush the journal first.
+ */
+static KawaseBlurPipelineStack *
+clutter_kawase_blur_effect_get_stack (ClutterKawaseBlurEffect *self)
+{
+  KawaseBlurPipelineStack *parent = clutter_kawase_blur_effect_get_class_stack (self);
+  KawaseBlurPipelineStack *stack;
+
+  if (self->pipeline_stacks == NULL)
+    self->pipeline_stacks = g_hash_table_new_full (NULL, NULL, NULL,
+                                                   kawase_blur_pipeline_stack_free);
+
+  stack = g_hash_table_lookup (self->pipeline_stacks, parent);
+  if (stack == NULL)
+    {
+      stack = g_new0 (KawaseBlurPipelineStack, 1);
+      for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
+        {
+          stack->pipelines[i] = cogl_pipeline_copy (parent->pipelines[i]);
+          stack->offset_uniforms[i] = parent->offset_uniforms[i];
+          stack->halfpixel_uniforms[i] = parent->halfpixel_uniforms[i];
+        }
+      g_hash_table_insert (self->pipeline_stacks, parent, stack);
+    }
+
+  return stack;
+}
+
+static inline void
+clutter_kawase_blur_effect_get_uniform_values (ClutterKawaseBlurEffect *self,
+                                               gfloat                  *offset,
+                                               gfloat                  *halfpixel)
+{
+  halfpixel[0] = 0.5f / self->tex_width;
+  halfpixel[1] = 0.5f / self->tex_height;
+
+  offset[0] = self->offset;
+  offset[1] = self->offset;
+}
+
+/*
+ * Returns the texture holding the given downsample level. Level 0 is the
+ * actor's image, and with a downscaled offscreen texture the image already
+ * is level entry_level.
+ */
+static inline CoglHandle
+clutter_kawase_blur_effect_get_down_texture (ClutterKawaseBlurEffect *self,
+                                             gint                     level)
+{
+  if (level <= self->entry_level)
+    return clutter_kawase_blur_effect_get_source_texture (self);
+
+  return self->offscreen_textures[DOWN_TEXTURE (level)];
+}
+
+/* Bytes per texel of the texture get_down_texture returns */
+static inline gint
+clutter_kawase_blur_effect_get_down_bpp (ClutterKawaseBlurEffect *self,
+                                         gint                     level)
+{
+  if (level <= self->entry_level)
+    return FRAMEBUFFER_BPP;
+
+  return kawase_blur_format_get_bpp (self->level_formats[DOWN_TEXTURE (level)]);
+}
+
+/*
+ * A source downsamples as deep as the deepest of its consumers needs.
+ */
+static gint
+clutter_kawase_blur_effect_get_downsample_levels (ClutterKawaseBlurEffect *self)
+{
+  gint levels = self->iterations;
+
+  if (self->downsample_consumers == NULL)
+    return levels;
+
+  for(guint i=0; i<self->downsample_consumers->len; i++)
+    {
+      ClutterKawaseBlurEffect *consumer =
+        g_ptr_array_index (self->downsample_consumers, i);
+
+      levels = MAX (levels, consumer->iterations);
+    }
+
+  return levels;
+}
+
+/*
+ * Returns the effect whose downsample levels the upsample chain starts
+ * from: the downsample source if its levels can be used, otherwise the
+ * effect itself. The source's levels can only be used if they were made
+ * for a texture of the same size and scale and are deep enough. When they
+ * aren't deep enough, e.g. because the strength of this consumer just went
+ * up, the source is made to render them again. Isolated clip rectangles
+ * need their own downsample passes.
+ *
+ * A consumer whose actor was redrawn in this frame, while the source
+ * hasn't rendered its levels yet, is painted before the source. The levels
+ * are then most likely those of the old content, so the consumer runs its
+ * own chain.
+ */
+static ClutterKawaseBlurEffect *
+clutter_kawase_blur_effect_get_down_owner (ClutterKawaseBlurEffect *self)
+{
+  ClutterKawaseBlurEffect *source = self->downsample_source;
+  guint frame = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self)->frame;
+
+  if (source == NULL ||
+      (self->redraw_frame == frame && source->downsample_frame != frame) ||
+      self->isolated ||
+      source->pyramid_width != self->tex_width ||
+      source->pyramid_height != self->tex_height ||
+      source->pyramid_shift != self->level_shift ||
+      source->entry_level > self->iterations ||
+      source->downsampled_levels == 0)
+    return self;
+
+  if (source->downsampled_levels < self->iterations)
+    {
+      clutter_kawase_blur_effect_invalidate (source);
+      return self;
+    }
+
+  return source;
+}
+
+/*
+ * Updates the uniforms and layer textures of the pipelines rendering into
+ * the pyramid and makes sure the pyramid has all needed levels. The final
+ * pass is set up separately by prepare_final, since it also runs when the
+ * cached result is reused.
+ */
+static void
+clutter_kawase_blur_effect_prepare_passes (ClutterKawaseBlurEffect *self,
+                                           CoglHandle               texture,
+                                           ClutterKawaseBlurEffect *down,
+                                           gint                     down_levels)
+{
+  KawaseBlurPipelineStack *stack = clutter_kawase_blur_effect_get_stack (self);
+  gfloat offset[2], halfpixel[2];
+
+  clutter_kawase_blur_effect_get_uniform_values (self, offset, halfpixel);
+
+  for(int level=1; level<=down_levels; level++)
+    clutter_kawase_blur_effect_set_uniforms (stack,
+                                             DOWN_PIPELINE (level),
+                                             offset,
+                                             halfpixel);
+
+  for(int level=1; level<self->iterations; level++)
+    clutter_kawase_blur_effect_set_uniforms (stack,
+                                             UP_PIPELINE (level),
+                                             offset,
+                                             halfpixel);
+
+  clutter_kawase_blur_effect_ensure_pyramid (self, down_levels);
+
+  // The first pipeline receives the original texture derived from the clutter
+  // actor. All subsequent pipelines receive the texture of the previous level as
+  // their input, so that we can chain the output of one to the input of the next
+  // pipeline. Levels the offscreen texture stands in for are skipped.
+  for(int level=self->entry_level+1; level<=down_levels; level++)
+    {
+      cogl_pipeline_set_layer_texture (stack->pipelines[DOWN_PIPELINE (level)], 0,
+                                       (level-1 == self->entry_level)
+                                       ? texture
+                                       : self->offscreen_textures[DOWN_TEXTURE (level-1)]);
+    }
+  // The upsample chain starts at the deepest downsample level, which may
+  // belong to the downsample source
+  for(int level=self->iterations-1; level>=1; level--)
+    {
+      CoglHandle source = (level+1 == self->iterations)
+                        ? clutter_kawase_blur_effect_get_down_texture (down, level+1)
+                        : self->offscreen_textures[UP_TEXTURE (level+1)];
+
+      cogl_pipeline_set_layer_texture (stack->pipelines[UP_PIPELINE (level)], 0, source);
+    }
+}
+
+/*
+ * Points the final upsample pass at this effect's level 1. The level may
+ * belong to the downsample source or change with the strength, so this is
+ * needed on every paint.
+ */
+static void
+clutter_kawase_blur_effect_prepare_final (ClutterKawaseBlurEffect *self)
+{
+  ClutterKawaseBlurEffect *down = self->chain_uses_source ? self->downsample_source : self;
+  KawaseBlurPipelineStack *stack = clutter_kawase_blur_effect_get_stack (self);
+  gfloat offset[2], halfpixel[2];
+  CoglHandle source;
+
+  clutter_kawase_blur_effect_get_uniform_values (self, offset, halfpixel);
+  clutter_kawase_blur_effect_set_uniforms (stack, UP_PIPELINE (0), offset, halfpixel);
+
+  source = (self->iterations == 1)
+         ? clutter_kawase_blur_effect_get_down_texture (down, 1)
+         : self->offscreen_textures[UP_TEXTURE (1)];
+  cogl_pipeline_set_layer_texture (stack->pipelines[UP_PIPELINE (0)], 0, source);
+}
+
+/*
+ * Scales a region from one level to another, grown by the given reach in
+ * pixels of the target level plus one pixel, and clamped to the target.
+ * Every pass flips the image vertically (which is why the final draw in
+ * paint_target swaps the y coordinates), so the rows are mirrored when
+ * the region crosses a pass.
+ */
+static cairo_region_t *
+clutter_kawase_blur_effect_map_region (const cairo_region_t *from_region,
+                                       gint                  from_width,
+                                       gint                  from_height,
+                                       gint                  to_width,
+                                       gint                  to_height,
+                                       gfloat                reach_x,
+                                       gfloat                reach_y,
+                                       gboolean              flip)
+{
+  cairo_region_t *region = cairo_region_create ();
+  cairo_rectangle_int_t bounds = { 0, 0, to_width, to_height };
+
+  for(gint i=0; i<cairo_region_num_rectangles (from_region); i++)
+    {
+      cairo_rectangle_int_t rect, mapped;
+      gfloat x1, y1, x2, y2;
+
+      cairo_region_get_rectangle (from_region, i, &rect);
+
+      if (flip)
+        rect.y = from_height - rect.y - rect.height;
+
+      x1 = (gfloat) rect.x * to_width / from_width - reach_x;
+      x2 = (gfloat) (rect.x + rect.width) * to_width / from_width + reach_x;
+      y1 = (gfloat) rect.y * to_height / from_height - reach_y;
+      y2 = (gfloat) (rect.y + rect.height) * to_height / from_height + reach_y;
+
+      mapped.x = (gint) floorf (x1) - 1;
+      mapped.y = (gint) floorf (y1) - 1;
+      mapped.width = (gint) ceilf (x2) + 1 - mapped.x;
+      mapped.height = (gint) ceilf (y2) + 1 - mapped.y;
+      cairo_region_union_rectangle (region, &mapped);
+    }
+
+  cairo_region_intersect_rectangle (region, &bounds);
+
+  return region;
+}
+
+/*
+ * Computes the part of a pass' source that gets sampled when rasterizing
+ * dst_region. The taps reach up to distance * halfpixel * offset in texture
+ * coordinates, plus one texel for the bilinear lookup.
+ */
+static cairo_region_t *
+clutter_kawase_blur_effect_source_region (ClutterKawaseBlurEffect *self,
+                                          const cairo_region_t    *dst_region,
+                                          gint                     dst_width,
+                                          gint                     dst_height,
+                                          gint                     src_width,
+                                          gint                     src_height,
+                                          gint                     distance)
+{
+  gfloat reach_x = distance * (0.5f / self->tex_width) * self->offset * src_width;
+  gfloat reach_y = distance * (0.5f / self->tex_height) * self->offset * src_height;
+
+  return clutter_kawase_blur_effect_map_region (dst_region,
+                                                dst_width, dst_height,
+                                                src_width, src_height,
+                                                reach_x, reach_y,
+                                                TRUE);
+}
+
+/*
+ * The other way round: computes the part of a pass' destination whose
+ * taps read from src_region. A source texel reaches as far as the taps
+ * do, plus the size of a source texel in destination pixels for the
+ * bilinear lookup.
+ */
+static cairo_region_t *
+clutter_kawase_blur_effect_damage_region (ClutterKawaseBlurEffect *self,
+                                          const cairo_region_t    *src_region,
+                                          gint                     src_width,
+                                          gint                     src_height,
+                                          gint                     dst_width,
+                                          gint                     dst_height,
+                                          gint                     distance)
+{
+  gfloat reach_x = distance * (0.5f / self->tex_width) * self->offset * dst_width
+                 + (gfloat) dst_width / src_width;
+  gfloat reach_y = distance * (0.5f / self->tex_height) * self->offset * dst_height
+                 + (gfloat) dst_height / src_height;
+
+  return clutter_kawase_blur_effect_map_region (src_region,
+                                                src_width, src_height,
+                                                dst_width, dst_height,
+                                                reach_x, reach_y,
+                                                TRUE);
+}
+
+/*
+ * Walks the chain backwards from the clip region of the final draw and
+ * computes which part of every level is needed, indexed like the
+ * pipeline_stack.
+ */
+static void
+clutter_kawase_blur_effect_compute_regions (ClutterKawaseBlurEffect *self,
+                                            cairo_region_t          *regions[])
+{
+  regions[UP_PIPELINE (0)] = cairo_region_reference (self->clip_region);
+
+  for(int level=1; level<self->iterations; level++)
+    {
+      regions[UP_PIPELINE (level)] =
+        clutter_kawase_blur_effect_source_region (self,
+                                                  regions[UP_PIPELINE (level-1)],
+                                                  clutter_kawase_blur_effect_level_width (self, level-1),
+                                                  clutter_kawase_blur_effect_level_height (self, level-1),
+                                                  clutter_kawase_blur_effect_level_width (self, level),
+                                                  clutter_kawase_blur_effect_level_height (self, level),
+                                                  2);
+    }
+
+  regions[DOWN_PIPELINE (self->iterations)] =
+    clutter_kawase_blur_effect_source_region (self,
+                                              regions[UP_PIPELINE (self->iterations-1)],
+                                              clutter_kawase_blur_effect_level_width (self, self->iterations-1),
+                                              clutter_kawase_blur_effect_level_height (self, self->iterations-1),
+                                              clutter_kawase_blur_effect_level_width (self, self->iterations),
+                                              clutter_kawase_blur_effect_level_height (self, self->iterations),
+                                              2);
+
+  for(int level=self->iterations-1; level>=1; level--)
+    {
+      regions[DOWN_PIPELINE (level)] =
+        clutter_kawase_blur_effect_source_region (self,
+                                                  regions[DOWN_PIPELINE (level+1)],
+                                                  clutter_kawase_blur_effect_level_width (self, level+1),
+                                                  clutter_kawase_blur_effect_level_height (self, level+1),
+                                                  clutter_kawase_blur_effect_level_width (self, level),
+                                                  clutter_kawase_blur_effect_level_height (self, level),
+                                                  1);
+    }
+}
+
+/*
+ * Walks the chain forwards from the damage of the offscreen texture and
+ * computes which part of every level has to be rendered again, indexed
+ * like compute_regions. The down levels are followed as deep as
+ * down_levels, the up levels start from this effect's deepest level.
+ */
+static void
+clutter_kawase_blur_effect_compute_damage_regions (ClutterKawaseBlurEffect *self,
+                                                   const cairo_region_t    *damage,
+                                                   gint                     down_levels,
+                                                   cairo_region_t          *regions[])
+{
+  const cairo_region_t *previous;
+  cairo_region_t *entry;
+
+  // A downscaled offscreen texture holds the same upright image, only smaller
+  entry = clutter_kawase_blur_effect_map_region (damage,
+                                                 self->tex_width,
+                                                 self->tex_height,
+                                                 clutter_kawase_blur_effect_level_width (self, self->entry_level),
+                                                 clutter_kawase_blur_effect_level_height (self, self->entry_level),
+                                                 0.0f, 0.0f,
+                                                 FALSE);
+
+  previous = entry;
+  for(int level=self->entry_level+1; level<=down_levels; level++)
+    {
+      regions[DOWN_PIPELINE (level)] =
+        clutter_kawase_blur_effect_damage_region (self,
+                                                  previous,
+                                                  clutter_kawase_blur_effect_level_width (self, level-1),
+                                                  clutter_kawase_blur_effect_level_height (self, level-1),
+                                                  clutter_kawase_blur_effect_level_width (self, level),
+                                                  clutter_kawase_blur_effect_level_height (self, level),
+                                                  1);
+      previous = regions[DOWN_PIPELINE (level)];
+    }
+
+  previous = (self->iterations == self->entry_level)
+           ? entry
+           : regions[DOWN_PIPELINE (self->iterations)];
+  for(int level=self->iterations-1; level>=1; level--)
+    {
+      regions[UP_PIPELINE (level)] =
+        clutter_kawase_blur_effect_damage_region (self,
+                                                  previous,
+                                                  clutter_kawase_blur_effect_level_width (self, level+1),
+                                                  clutter_kawase_blur_effect_level_height (self, level+1),
+                                                  clutter_kawase_blur_effect_level_width (self, level),
+                                                  clutter_kawase_blur_effect_level_height (self, level),
+                                                  2);
+      previous = regions[UP_PIPELINE (level)];
+    }
+
+  cairo_region_destroy (entry);
+}
+
+typedef struct {
+  gfloat x, y;
+  gfloat s, t;
+  /* the rectangle the taps are clamped to, in texture coordinates of the source */
+  gfloat clamp[4];
+} KawaseBlurIsolatedVertex;
+
+/*
+ * Extent of a rectangle of the offscreen texture in texture coordinates of
+ * a level. Since every pass flips the image and level 1 ends up upside
+ * down, the odd levels hold it upside down.
+ */
+static inline void
+kawase_blur_isolated_extent (gfloat  x1,
+                             gfloat  y1,
+                             gfloat  x2,
+                             gfloat  y2,
+                             gint    tex_width,
+                             gint    tex_height,
+                             gint    level,
+                             gfloat *extent)
+{
+  extent[0] = x1 / tex_width;
+  extent[2] = x2 / tex_width;
+
+  if (level % 2 == 1)
+    {
+      extent[1] = 1.0f - y2 / tex_height;
+      extent[3] = 1.0f - y1 / tex_height;
+    }
+  else
+    {
+      extent[1] = y1 / tex_height;
+      extent[3] = y2 / tex_height;
+    }
+}
+
+static inline void
+kawase_blur_append_isolated_quad (GArray       *vertices,
+                                  const gfloat *position,
+                                  const gfloat *tex_coords,
+                                  const gfloat *clamp)
+{
+  static const gint corners[6][2] = {
+    { 0, 1 }, { 2, 1 }, { 2, 3 },
+    { 0, 1 }, { 2, 3 }, { 0, 3 },
+  };
+
+  for(gint i=0; i<6; i++)
+    {
+      KawaseBlurIsolatedVertex vertex;
+
+      vertex.x = position[corners[i][0]];
+      vertex.y = position[corners[i][1]];
+      vertex.s = tex_coords[corners[i][0]];
+      vertex.t = tex_coords[corners[i][1]];
+      memcpy (vertex.clamp, clamp, sizeof (vertex.clamp));
+
+      g_array_append_val (vertices, vertex);
+    }
+}
+
+/*
+ * Draws a pass of isolated clip rectangles: one quad per rectangle, all of
+ * them in a single draw call, whose taps are clamped to the rectangle's
+ * part of source_level. Level 0 stands for the final draw onto the
+ * actor's framebuffer, which covers exactly the rectangles; the passes
+ * into the levels cover them rounded out to whole texels.
+ */
+static void
+clutter_kawase_blur_effect_draw_isolated (ClutterKawaseBlurEffect *self,
+                                          CoglFramebuffer         *target,
+                                          CoglPipeline            *pipeline,
+                                          gint                     level,
+                                          gint                     source_level)
+{
+  CoglContext *ctx =
+    clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  gint origin_x = (gint) floorf (self->volume_x);
+  gint origin_y = (gint) floorf (self->volume_y);
+  gint width = clutter_kawase_blur_effect_level_width (self, level);
+  gint height = clutter_kawase_blur_effect_level_height (self, level);
+  gint source_width = clutter_kawase_blur_effect_level_width (self, source_level);
+  gint source_height = clutter_kawase_blur_effect_level_height (self, source_level);
+  GArray *vertices;
+  CoglAttributeBuffer *buffer;
+  CoglAttribute *attributes[3];
+  CoglPrimitive *primitive;
+
+  vertices = g_array_sized_new (FALSE, FALSE, sizeof (KawaseBlurIsolatedVertex),
+                                6 * self->clip_rects->len);
+
+  for(guint i=0; i<self->clip_rects->len; i++)
+    {
+      cairo_rectangle_int_t *rect =
+        &g_array_index (self->clip_rects, cairo_rectangle_int_t, i);
+      gfloat x1 = MAX (rect->x - origin_x, 0);
+      gfloat y1 = MAX (rect->y - origin_y, 0);
+      gfloat x2 = MIN (rect->x - origin_x + rect->width, self->tex_width);
+      gfloat y2 = MIN (rect->y - origin_y + rect->height, self->tex_height);
+      gfloat position[4], tex_coords[4], clamp[4];
+
+      if (x2 <= x1 || y2 <= y1)
+        continue;
+
+      // Keep the bilinear lookups half a texel inside, off the neighbours
+      kawase_blur_isolated_extent (x1, y1, x2, y2,
+                                   self->tex_width, self->tex_height,
+                                   source_level, clamp);
+      clamp[0] += 0.5f / source_width;
+      clamp[1] += 0.5f / source_height;
+      clamp[2] -= 0.5f / source_width;
+      clamp[3] -= 0.5f / source_height;
+      if (clamp[0] > clamp[2])
+        clamp[0] = clamp[2] = (clamp[0] + clamp[2]) / 2.0f;
+      if (clamp[1] > clamp[3])
+        clamp[1] = clamp[3] = (clamp[1] + clamp[3]) / 2.0f;
+
+      if (level == 0)
+        {
+          // Same mapping as draw_final with a flipped texture
+          position[0] = x1;
+          position[1] = y1;
+          position[2] = x2;
+          position[3] = y2;
+          tex_coords[0] = x1 / self->tex_width;
+          tex_coords[1] = 1.0f - y1 / self->tex_height;
+          tex_coords[2] = x2 / self->tex_width;
+          tex_coords[3] = 1.0f - y2 / self->tex_height;
+
+          self->stats.pixels_rasterized += (guint64) ((x2 - x1) * (y2 - y1));
+        }
+      else
+        {
+          gfloat extent[4];
+          gint px1, py1, px2, py2;
+
+          kawase_blur_isolated_extent (x1, y1, x2, y2,
+                                       self->tex_width, self->tex_height,
+                                       level, extent);
+          px1 = MAX ((gint) floorf (extent[0] * width), 0);
+          py1 = MAX ((gint) floorf (extent[1] * height), 0);
+          px2 = MIN ((gint) ceilf (extent[2] * width), width);
+          py2 = MIN ((gint) ceilf (extent[3] * height), height);
+
+          // Same mapping as draw_pass
+          position[0] = -1.0f + 2.0f * px1 / width;
+          position[1] = 1.0f - 2.0f * py1 / height;
+          position[2] = -1.0f + 2.0f * px2 / width;
+          position[3] = 1.0f - 2.0f * py2 / height;
+          for(gint j=0; j<4; j++)
+            tex_coords[j] = (1.0f + position[j]) / 2.0f;
+
+          self->stats.pixels_rasterized += (guint64) (px2 - px1) * (py2 - py1);
+        }
+
+      kawase_blur_append_isolated_quad (vertices, position, tex_coords, clamp);
+    }
+
+  if (vertices->len == 0)
+    {
+      g_array_unref (vertices);
+      return;
+    }
+
+  buffer = cogl_attribute_buffer_new (ctx,
+                                      vertices->len * sizeof (KawaseBlurIsolatedVertex),
+                                      vertices->data);
+  attributes[0] = cogl_attribute_new (buffer, "cogl_position_in",
+                                      sizeof (KawaseBlurIsolatedVertex),
+                                      G_STRUCT_OFFSET (KawaseBlurIsolatedVertex, x),
+                                      2, COGL_ATTRIBUTE_TYPE_FLOAT);
+  attributes[1] = cogl_attribute_new (buffer, "cogl_tex_coord0_in",
+                                      sizeof (KawaseBlurIsolatedVertex),
+                                      G_STRUCT_OFFSET (KawaseBlurIsolatedVertex, s),
+                                      2, COGL_ATTRIBUTE_TYPE_FLOAT);
+  attributes[2] = cogl_attribute_new (buffer, "cogl_color_in",
+                                      sizeof (KawaseBlurIsolatedVertex),
+                                      G_STRUCT_OFFSET (KawaseBlurIsolatedVertex, clamp),
+                                      4, COGL_ATTRIBUTE_TYPE_FLOAT);
+  primitive = cogl_primitive_new_with_attributes (COGL_VERTICES_MODE_TRIANGLES,
+                                                  vertices->len,
+                                                  attributes, 3);
+
+  cogl_primitive_draw (primitive, target, pipeline);
+
+  cogl_object_unref (primitive);
+  for(gint i=0; i<3; i++)
+    cogl_object_unref (attributes[i]);
+  cogl_object_unref (buffer);
+  g_array_unref (vertices);
+}
+
+static void
+clutter_kawase_blur_effect_run_passes (ClutterKawaseBlurEffect *self,
+                                       ClutterKawaseBlurEffect *down,
+                                       gint                     down_levels,
+                                       const cairo_region_t    *damage)
+{
+  KawaseBlurPipelineStack *stack = clutter_kawase_blur_effect_get_stack (self);
+
+  // Set the basic color of the pipelines
+  // guint8 paint_opacity;
+  // paint_opacity = clutter_actor_get_paint_opacity (self->actor);
+  // for(int i=0; i<2*self->iterations; i++)
+  //   {
+  //     cogl_pipeline_set_color4ub (stack->pipelines[i],
+  //                                 paint_opacity,
+  //                                 paint_opacity,
+  //                                 paint_opacity,
+  //                                 paint_opacity);
+  //   }
+
+  cairo_region_t *regions[2*DOWNSAMPLE_STEPS] = { NULL, };
+
+  // Only render what changed since the last frame, or what the clip
+  // rectangles need, if there are any
+  if (damage != NULL)
+    clutter_kawase_blur_effect_compute_damage_regions (self, damage, down_levels, regions);
+  else if (self->clip_region != NULL && !self->isolated)
+    {
+      clutter_kawase_blur_effect_compute_regions (self, regions);
+
+      // Consumers may sample any part of the downsample levels
+      if (self->downsample_consumers != NULL && self->downsample_consumers->len > 0)
+        {
+          for(int level=1; level<=DOWNSAMPLE_STEPS; level++)
+            g_clear_pointer (&regions[DOWN_PIPELINE (level)], cairo_region_destroy);
+        }
+    }
+
+  // Downsampling
+  for(int level=self->entry_level+1; level<=down_levels; level++)
+    {
+      CoglFramebuffer *target = self->offscreenbuffers[DOWN_TEXTURE (level)];
+      gint width = clutter_kawase_blur_effect_level_width (self, level);
+      gint height = clutter_kawase_blur_effect_level_height (self, level);
+      guint64 pixels = self->stats.pixels_rasterized;
+      KawaseBlurGpuSpan span;
+
+      kawase_blur_gpu_span_begin (&span, "downsample");
+
+      if (self->isolated)
+        clutter_kawase_blur_effect_draw_isolated (self,
+                                                  target,
+                                                  stack->pipelines[DOWN_PIPELINE (level)],
+                                                  level,
+                                                  level-1);
+      else
+        clutter_kawase_blur_effect_draw_pass (self,
+                                              target,
+                                              stack->pipelines[DOWN_PIPELINE (level)],
+                                              regions[DOWN_PIPELINE (level)],
+                                              width,
+                                              height);
+      clutter_kawase_blur_effect_count_traffic (self,
+                                                self->stats.pixels_rasterized - pixels,
+                                                width, height,
+                                                clutter_kawase_blur_effect_get_down_bpp (self, level),
+                                                clutter_kawase_blur_effect_level_width (self, level-1),
+                                                clutter_kawase_blur_effect_level_height (self, level-1),
+                                                clutter_kawase_blur_effect_get_down_bpp (self, level-1));
+
+      clutter_kawase_blur_effect_end_pass (target);
+      kawase_blur_gpu_span_end (&span, level, width, height, self->strength);
+    }
+
+  // Upsampling
+  for(int level=self->iterations-1; level>=1; level--)
+    {
+      CoglFramebuffer *target = self->offscreenbuffers[UP_TEXTURE (level)];
+      gint width = clutter_kawase_blur_effect_level_width (self, level);
+      gint height = clutter_kawase_blur_effect_level_height (self, level);
+      guint64 pixels = self->stats.pixels_rasterized;
+      gint source_bpp = (level+1 == self->iterations)
+                      ? clutter_kawase_blur_effect_get_down_bpp (down, level+1)
+                      : kawase_blur_format_get_bpp (self->level_formats[UP_TEXTURE (level+1)]);
+      KawaseBlurGpuSpan span;
+
+      kawase_blur_gpu_span_begin (&span, "upsample");
+
+      if (self->isolated)
+        clutter_kawase_blur_effect_draw_isolated (self,
+                                                  target,
+                                                  stack->pipelines[UP_PIPELINE (level)],
+                                                  level,
+                                                  level+1);
+      else
+        clutter_kawase_blur_effect_draw_pass (self,
+                                              target,
+                                              stack->pipelines[UP_PIPELINE (level)],
+                                              regions[UP_PIPELINE (level)],
+                                              width,
+                                              height);
+      clutter_kawase_blur_effect_count_traffic (self,
+                                                self->stats.pixels_rasterized - pixels,
+                                                width, height,
+                                                kawase_blur_format_get_bpp (self->level_formats[UP_TEXTURE (level)]),
+                                                clutter_kawase_blur_effect_level_width (self, level+1),
+                                                clutter_kawase_blur_effect_level_height (self, level+1),
+                                                source_bpp);
+
+      clutter_kawase_blur_effect_end_pass (target);
+      kawase_blur_gpu_span_end (&span, level, width, height, self->strength);
+    }
+
+  for(int i=0; i<2*DOWNSAMPLE_STEPS; i++)
+    g_clear_pointer (&regions[i], cairo_region_destroy);
+
+  self->stats.passes_executed += MAX (down_levels - self->entry_level, 0) + self->iterations-1;
+}
+
+/*
+ * Whether the damage of this frame can be patched into the pyramid
+ * instead of running the whole chain. That needs the levels of the
+ * previous frame, rendered completely and with the same parameters, and
+ * the damage must stay small enough that updating it is cheaper.
+ */
+static gboolean
+clutter_kawase_blur_effect_can_update (ClutterKawaseBlurEffect *self,
+                                       gint                     down_levels)
+{
+  guint64 area;
+
+  if (self->frame_damage == NULL || !self->chain_complete)
+    return FALSE;
+
+  if (self->clip_region != NULL || self->shared_pyramid)
+    return FALSE;
+
+  if (self->pyramid_width != self->tex_width ||
+      self->pyramid_height != self->tex_height ||
+      self->pyramid_shift != self->level_shift)
+    return FALSE;
+
+  if (self->chain_offset != self->offset ||
+      self->chain_iterations != self->iterations ||
+      self->chain_down_levels != down_levels ||
+      self->chain_entry_level != self->entry_level ||
+      self->chain_stack != clutter_kawase_blur_effect_get_class_stack (self))
+    return FALSE;
+
+  area = clutter_kawase_blur_effect_region_area (self->frame_damage);
+
+  return area <= self->damage_threshold * self->tex_width * self->tex_height;
+}
+
+/*
+ * The dual Kawase engine: downsamples the actor's image through the
+ * pyramid, or starts from the levels of the downsample source, and
+ * upsamples it back to level 1. Only the damaged or clipped parts of the
+ * levels are rendered where possible.
+ */
+static void
+clutter_kawase_blur_effect_kawase_run (ClutterKawaseBlurEffect *self,
+                                       CoglHandle               texture)
+{
+  ClutterKawaseBlurEffect *down;
+  gint down_levels;
+  const cairo_region_t *damage = NULL;
+
+  // Picks the pipeline stack and the downsample levels, so it comes first
+  self->isolated = clutter_kawase_blur_effect_can_isolate (self);
+
+  down = clutter_kawase_blur_effect_get_down_owner (self);
+  down_levels = (down == self)
+              ? clutter_kawase_blur_effect_get_downsample_levels (self)
+              : 0;
+
+  // Decided before prepare_passes, which may reallocate the pyramid
+  if (down == self && clutter_kawase_blur_effect_can_update (self, down_levels))
+    {
+      damage = self->frame_damage;
+      self->stats.incremental_frames++;
+    }
+
+  clutter_kawase_blur_effect_prepare_passes (self, texture, down, down_levels);
+  clutter_kawase_blur_effect_run_passes (self, down, down_levels, damage);
+
+  self->chain_uses_source = (down != self);
+  if (self->chain_uses_source)
+    self->source_serial = down->downsample_serial;
+  else
+    {
+      self->downsampled_levels = down_levels;
+      self->downsample_frame = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self)->frame;
+      clutter_kawase_blur_effect_levels_changed (self);
+    }
+
+  // Remember what the levels hold, for the next damaged frame
+  self->chain_complete = !self->chain_uses_source &&
+                         self->clip_region == NULL &&
+                         !self->shared_pyramid;
+  self->chain_offset = self->offset;
+  self->chain_iterations = self->iterations;
+  self->chain_down_levels = down_levels;
+  self->chain_entry_level = self->entry_level;
+  self->chain_stack = clutter_kawase_blur_effect_get_class_stack (self);
+}
+
+/*
+ * Draws the final image on the actor's framebuffer. Every pass flips the
+ * image vertically and the chain has an odd number of them, hence the
+ * swapped y coordinates to get an upright image.
+ */
+static void
+clutter_kawase_blur_effect_kawase_composite (ClutterKawaseBlurEffect *self,
+                                             CoglFramebuffer         *framebuffer)
+{
+  ClutterKawaseBlurEffect *down = self->chain_uses_source ? self->downsample_source : self;
+  guint64 pixels = self->stats.pixels_rasterized;
+  KawaseBlurGpuSpan composite;
+  gint source_bpp;
+
+  clutter_kawase_blur_effect_prepare_final (self);
+  kawase_blur_gpu_span_begin (&composite, "composite");
+  if (self->isolated)
+    clutter_kawase_blur_effect_draw_isolated (self,
+                                              framebuffer,
+                                              clutter_kawase_blur_effect_get_stack (self)->pipelines[UP_PIPELINE (0)],
+                                              0,
+                                              1);
+  else
+    clutter_kawase_blur_effect_draw_final (self,
+                                           framebuffer,
+                                           clutter_kawase_blur_effect_get_stack (self)->pipelines[UP_PIPELINE (0)],
+                                           TRUE);
+  kawase_blur_gpu_span_end (&composite, 0,
+                            self->tex_width, self->tex_height,
+                            self->strength);
+  self->stats.passes_executed++;
+
+  source_bpp = (self->iterations == 1)
+             ? clutter_kawase_blur_effect_get_down_bpp (down, 1)
+             : kawase_blur_format_get_bpp (self->level_formats[UP_TEXTURE (1)]);
+  clutter_kawase_blur_effect_count_traffic (self,
+                                            self->stats.pixels_rasterized - pixels,
+                                            self->tex_width, self->tex_height,
+                                            FRAMEBUFFER_BPP,
+                                            clutter_kawase_blur_effect_level_width (self, 1),
+                                            clutter_kawase_blur_effect_level_height (self, 1),
+                                            source_bpp);
+
+  /*
+   * A shared pyramid goes back to the pool right away. The final draw
+   * still sits in the journal of the actor's framebuffer, so it is flushed
+   * before the next effect can render into the same textures. The result
+   * is gone with the textures, which rules out the cache.
+   */
+  if (self->shared_pyramid)
+    {
+      cogl_flush ();
+      clutter_kawase_blur_effect_clear_pyramid (self);
+      self->blur_valid = FALSE;
+    }
+}
+
+const KawaseBlurEngine kawase_blur_dual_kawase_engine = {
+  TRUE,
+  clutter_kawase_blur_effect_kawase_run,
+  clutter_kawase_blur_effect_kawase_composite,
+  clutter_kawase_blur_effect_clear_pyramid
+};
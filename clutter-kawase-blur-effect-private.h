@@ -0,0 +1,460 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __CLUTTER_KAWASE_BLUR_EFFECT_PRIVATE_H__
+#define __CLUTTER_KAWASE_BLUR_EFFECT_PRIVATE_H__
+
+/* 
+ * These defines are very important to enable the cogl pipeline and 
+ * clutter backend functionality required for this effect to work.
+ * They have to be called before the clutter library is included.
+ * Otherwise we get a lot of segfaults.
+ */
+#define COGL_ENABLE_EXPERIMENTAL_API
+#define CLUTTER_ENABLE_EXPERIMENTAL_API
+
+#include "clutter-kawase-blur-effect.h"
+#include "clutter-kawase-blur-cpu.h"
+#include "clutter-kawase-blur-gl.h"
+#include "clutter-kawase-blur-pool.h"
+#include "clutter-kawase-blur-trace.h"
+
+G_BEGIN_DECLS
+
+#define CLUTTER_KAWASE_BLUR_EFFECT_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), CLUTTER_TYPE_KAWASE_BLUR_EFFECT, ClutterKawaseBlurEffectClass))
+#define CLUTTER_IS_KAWASE_BLUR_EFFECT_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), CLUTTER_TYPE_KAWASE_BLUR_EFFECT))
+#define CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), CLUTTER_TYPE_KAWASE_BLUR_EFFECT, ClutterKawaseBlurEffectClass))
+
+#define BLUR_STEPS 15
+// When changing DOWNSAMPLE_STEPS you also have to update the blur_offsets array
+// in the clutter_kawase_blur_effect_class_init function, so that the array's
+// length matches the number of DOWNSAMPLE_STEPS.
+#define DOWNSAMPLE_STEPS 5
+
+// Index of the texture holding the given downsample/upsample level (1-based)
+// inside the offscreen_textures and offscreenbuffers arrays.
+#define DOWN_TEXTURE(level) ((level) - 1)
+#define UP_TEXTURE(level) (DOWNSAMPLE_STEPS + (level) - 1)
+// Index of the pipeline rendering into the given level. Upsample level 0 is
+// the final pass onto the actor's framebuffer.
+#define DOWN_PIPELINE(level) ((level) - 1)
+#define UP_PIPELINE(level) (DOWNSAMPLE_STEPS + (level))
+
+/* The actor's offscreen texture and the stage are always RGBA8888 */
+#define FRAMEBUFFER_BPP 4
+
+/*
+ * Gaussian engine, see clutter_kawase_blur_effect_gaussian_run(). The
+ * image is halved until the remaining blur has a sigma of at most
+ * GAUSSIAN_MAX_SIGMA texels, or GAUSSIAN_MAX_LEVEL halvings were done.
+ * The separable kernel has GAUSSIAN_TAPS bilinear taps per side, the
+ * center one included; every other tap covers two texels of the discrete
+ * kernel, so it reaches 2 * (GAUSSIAN_TAPS - 1) texels, three times the
+ * largest sigma. GAUSSIAN_TAPS must match the arrays of
+ * glsl_gaussian_shader.
+ */
+#define GAUSSIAN_TAPS 8
+#define GAUSSIAN_MAX_SIGMA 4.0f
+#define GAUSSIAN_MAX_LEVEL 7
+// Indices of the passes after the halvings, which use the indices 0..level-1
+#define GAUSSIAN_HORIZONTAL GAUSSIAN_MAX_LEVEL
+#define GAUSSIAN_VERTICAL (GAUSSIAN_MAX_LEVEL + 1)
+#define GAUSSIAN_COMPOSITE (GAUSSIAN_MAX_LEVEL + 2)
+
+/*
+ * Debug flags, parsed from the CLUTTER_KAWASE_BLUR_DEBUG environment
+ * variable in the same way CLUTTER_DEBUG works, e.g.
+ * CLUTTER_KAWASE_BLUR_DEBUG=sync-passes
+ */
+typedef enum {
+  KAWASE_BLUR_DEBUG_SYNC_PASSES = 1 << 0
+} KawaseBlurDebugFlag;
+
+extern guint kawase_blur_debug_flags;
+
+/*
+ * The pipelines of one chain, indexed by DOWN_PIPELINE and UP_PIPELINE.
+ * A uniform location is -1 when the program doesn't use that uniform.
+ */
+typedef struct {
+  CoglPipeline *pipelines[2*DOWNSAMPLE_STEPS];
+  gint offset_uniforms[2*DOWNSAMPLE_STEPS];
+  gint halfpixel_uniforms[2*DOWNSAMPLE_STEPS];
+} KawaseBlurPipelineStack;
+
+struct _ClutterKawaseBlurEffect
+{
+  ClutterOffscreenEffect parent_instance;
+
+  /* a back pointer to our actor, so that we can query it */
+  ClutterActor *actor;
+
+  gfloat strength;
+
+  gfloat offset;
+  gint iterations;
+
+  /*
+   * The iteration count the strength asks for. iterations is lower than
+   * that when the adaptive quality had to drop iterations, and level_shift
+   * is 1 when the levels are rendered at half their size.
+   */
+  gint strength_iterations;
+  gint level_shift;
+
+  /*
+   * Downscaled offscreen rendering. The actor is rendered into a texture
+   * that is halved downscale times, which then stands in for the pyramid
+   * level of the same size, entry_level; the chain starts right below it.
+   * source_downscale is what the current offscreen texture was created
+   * with, target_width and target_height the size it would have at full
+   * resolution.
+   */
+  gint downscale;
+  gint source_downscale;
+  gint target_width;
+  gint target_height;
+  gint entry_level;
+
+  /* adaptive quality state, see QUALITY_FULL */
+  gboolean adaptive_quality;
+  gfloat frame_budget;
+  gint quality;
+  gdouble average_cost;
+  guint sample_countdown;
+  guint headroom_samples;
+  /*
+   * The sample in flight: its timer queries, 0 while none is pending, or
+   * its start on the CPU without them, and the quality it was taken at.
+   */
+  guint sample_queries[2];
+  gint64 sample_start;
+  gint sample_quality;
+  gint64 last_blur_time;
+  guint idle_timeout_id;
+
+  /*
+   * Idle trimming, see clutter_kawase_blur_effect_set_trim_timeout(). The
+   * timer only runs while the actor is unmapped or the effect disabled.
+   */
+  guint trim_timeout;
+  guint trim_timeout_id;
+  gulong actor_mapped_id;
+
+  /*
+   * The texture pyramid is kept across frames. The first DOWNSAMPLE_STEPS
+   * entries hold the downsample levels 1..DOWNSAMPLE_STEPS, the remaining
+   * ones the upsample levels 1..DOWNSAMPLE_STEPS-1 (see DOWN_TEXTURE and
+   * UP_TEXTURE). Levels are allocated lazily and only dropped when the size
+   * of the source texture changes.
+   */
+  CoglHandle offscreen_textures[2*DOWNSAMPLE_STEPS-1];
+  CoglFramebuffer *offscreenbuffers[2*DOWNSAMPLE_STEPS-1];
+
+  /*
+   * Storage format of the levels, see
+   * clutter_kawase_blur_effect_set_intermediate_format(). level_formats
+   * holds the format every allocated level actually got, which differs
+   * from the requested one when the driver can't render into it.
+   */
+  ClutterKawaseBlurFormat intermediate_format;
+  ClutterKawaseBlurFormat level_formats[2*DOWNSAMPLE_STEPS-1];
+
+  /* the blur algorithm, see kawase_blur_engines */
+  ClutterKawaseBlurMode mode;
+
+  /*
+   * Gaussian engine state. The halved images of level 1..gaussian_level
+   * are held at index level-1, the horizontal and vertical passes at
+   * GAUSSIAN_HORIZONTAL and GAUSSIAN_VERTICAL, the latter holding the
+   * result. The pipelines are indexed the same way, by the texture they
+   * render into, plus the one for GAUSSIAN_COMPOSITE.
+   */
+  CoglHandle gaussian_textures[GAUSSIAN_MAX_LEVEL+2];
+  CoglFramebuffer *gaussian_framebuffers[GAUSSIAN_MAX_LEVEL+2];
+  CoglPipeline *gaussian_pipelines[GAUSSIAN_MAX_LEVEL+3];
+  gint gaussian_width;
+  gint gaussian_height;
+  gint gaussian_level;
+  gint gaussian_passes;
+
+  /*
+   * With a shared pyramid the levels are borrowed from the class' texture
+   * pool for the duration of paint_target. pool_entries holds the borrowed
+   * entries, indexed like offscreen_textures.
+   */
+  gboolean shared_pyramid;
+  KawaseBlurPoolEntry *pool_entries[2*DOWNSAMPLE_STEPS-1];
+
+  /* whether to use the specialized shaders at integer strengths */
+  gboolean specialized_shaders;
+
+  /*
+   * Shared downsample chain. A consumer runs only its upsample passes, on
+   * the downsample levels of its downsample_source; the source keeps a list
+   * of its consumers and downsamples deep enough for all of them.
+   * downsampled_levels is the number of down levels that have been
+   * rendered, downsample_serial changes whenever they are rendered again.
+   * A consumer remembers in source_serial which version its upsample chain
+   * is based on, if chain_uses_source is set. downsample_frame and
+   * redraw_frame hold the frame, see ClutterKawaseBlurEffectClass.frame,
+   * in which the levels were rendered and the actor was last redrawn.
+   */
+  ClutterKawaseBlurEffect *downsample_source;
+  GPtrArray *downsample_consumers;
+  gint downsampled_levels;
+  guint downsample_serial;
+  guint source_serial;
+  gboolean chain_uses_source;
+  guint downsample_frame;
+  guint redraw_frame;
+
+  gint tex_width;
+  gint tex_height;
+
+  /* whether the pyramid holds the blurred image of the current content */
+  gboolean blur_valid;
+
+  /*
+   * Optional clip rectangles in actor coordinates. When set, only the parts
+   * of every level that end up being sampled for these rectangles are
+   * rendered. clip_region holds the rectangles in pixels of the offscreen
+   * texture, whose top left corner lies at volume_x, volume_y in actor
+   * coordinates. The origin is taken from the actor's paint box in
+   * pre_paint.
+   */
+  GArray *clip_rects;
+  cairo_region_t *clip_region;
+  gfloat volume_x;
+  gfloat volume_y;
+
+  /*
+   * Whether the clip rectangles are blurred separately, see
+   * clutter_kawase_blur_effect_set_isolate_rects(). isolated tells whether
+   * the current chain was actually run that way.
+   */
+  gboolean isolate_rects;
+  gboolean isolated;
+
+  /*
+   * Blur-behind mode, see clutter_kawase_blur_effect_set_blur_behind().
+   * The part of the framebuffer behind the actor, grown by the reach of
+   * the chain, is blitted into backdrop_texture through backdrop_fbo, a GL
+   * framebuffer object, or read back through backdrop_bitmap where that
+   * isn't possible. The texture stands in for the offscreen texture while
+   * painting_behind is set. backdrop_rect is the copied part and
+   * backdrop_footprint the actor's, both in framebuffer pixels.
+   */
+  gboolean blur_behind;
+  gboolean painting_behind;
+  CoglHandle backdrop_texture;
+  guint backdrop_fbo;
+  CoglBitmap *backdrop_bitmap;
+  cairo_rectangle_int_t backdrop_rect;
+  cairo_rectangle_int_t backdrop_footprint;
+  guint backdrop_redraw_id;
+
+  /*
+   * Incremental updates. damage collects the rectangles reported with
+   * clutter_kawase_blur_effect_add_damage() in actor coordinates until
+   * the actor is redrawn, frame_damage is what applies to the current
+   * paint in pixels of the offscreen texture. The pyramid can only be
+   * patched up in place if it was completely rendered with the same
+   * parameters, which the chain_* fields remember.
+   */
+  cairo_region_t *damage;
+  cairo_region_t *frame_damage;
+  gfloat damage_threshold;
+  gboolean chain_complete;
+  gfloat chain_offset;
+  gint chain_iterations;
+  gint chain_down_levels;
+  gint chain_entry_level;
+  KawaseBlurPipelineStack *chain_stack;
+
+  /*
+   * The effect's own copies of the class' pipeline stacks, keyed by the
+   * class stack they were copied from. They share its GLSL program, but
+   * setting uniforms and textures on them doesn't touch pipelines that
+   * other effects still have queued in the journal.
+   */
+  GHashTable *pipeline_stacks;
+
+  /* size of the source texture and level shift the pyramid was allocated for */
+  gint pyramid_width;
+  gint pyramid_height;
+  gint pyramid_shift;
+
+  /*
+   * Software fallback, used when the driver doesn't support GLSL. The
+   * offscreen texture is read back, blurred by the CPU engine and uploaded
+   * into cpu_texture, which is then drawn by the plain cpu_pipeline.
+   */
+  gboolean software;
+  ClutterKawaseBlurCpu *cpu;
+  guint8 *cpu_source;
+  guint8 *cpu_result;
+  CoglHandle cpu_texture;
+  CoglPipeline *cpu_pipeline;
+  gint cpu_threads;
+  gint cpu_width;
+  gint cpu_height;
+
+  /* counters since creation or the last clutter_kawase_blur_effect_reset_stats();
+   * pyramid_bytes is computed on demand */
+  ClutterKawaseBlurEffectStats stats;
+};
+
+struct _ClutterKawaseBlurEffectClass
+{
+  ClutterOffscreenEffectClass parent_class;
+
+  gfloat offsets[BLUR_STEPS];
+  gint iterations[BLUR_STEPS];
+  /* the smallest offset of the iteration band a strength belongs to */
+  gfloat min_offsets[BLUR_STEPS];
+  /* indexed by the iteration count - 1 */
+  gint expand_sizes[DOWNSAMPLE_STEPS];
+
+  CoglPipeline *downsample_base_pipeline;
+  CoglPipeline *upsample_base_pipeline;
+
+  /*
+   * The pipelines of the chain. Every effect draws with its own copies,
+   * see clutter_kawase_blur_effect_get_stack(), which only differ in their
+   * uniforms and layer textures.
+   */
+  KawaseBlurPipelineStack pipeline_stack;
+
+  /* the same with every tap clamped to its clip rectangle */
+  KawaseBlurPipelineStack clamped_stack;
+
+  /*
+   * Shaders with the offset of every strength step baked in, generated in
+   * class_init. Their pipeline stacks are created on first use.
+   */
+  gchar *specialized_downsample_shaders[BLUR_STEPS];
+  gchar *specialized_upsample_shaders[BLUR_STEPS];
+  KawaseBlurPipelineStack *specialized_stacks[BLUR_STEPS];
+
+  KawaseBlurTexturePool texture_pool;
+
+  /* all live instances, for clutter_kawase_blur_effect_class_trim_memory() */
+  GList *instances;
+
+  /* counts the frames of the master clock, from the first instance on */
+  guint frame;
+  guint frame_counter_id;
+
+  /*
+   * Gaussian engine. The sigma of every strength step is chosen to reach
+   * about as far as the dual Kawase chain, see class_init. The copy
+   * pipeline halves the image and composites the result.
+   */
+  gfloat gaussian_sigmas[BLUR_STEPS];
+  CoglPipeline *gaussian_base_pipeline;
+  CoglPipeline *copy_base_pipeline;
+  gint direction_uniform;
+  gint tap_offsets_uniform;
+  gint tap_weights_uniform;
+};
+
+/*
+ * The blur algorithms, indexed by ClutterKawaseBlurMode. run renders the
+ * blurred image of the actor's offscreen texture whenever the actor or the
+ * blur parameters changed, composite draws it onto the actor's framebuffer
+ * on every paint, and clear frees whatever run allocated. adaptive is set
+ * for engines that follow the level shift of the adaptive quality. The
+ * software fallback always runs the dual Kawase chain on the CPU.
+ */
+typedef struct {
+  gboolean adaptive;
+  void (* run) (ClutterKawaseBlurEffect *self,
+                CoglHandle               texture);
+  void (* composite) (ClutterKawaseBlurEffect *self,
+                      CoglFramebuffer         *framebuffer);
+  void (* clear) (ClutterKawaseBlurEffect *self);
+} KawaseBlurEngine;
+
+extern const KawaseBlurEngine kawase_blur_dual_kawase_engine;
+extern const KawaseBlurEngine kawase_blur_gaussian_engine;
+
+/*
+ * The image the chain starts from: the actor rendered into the offscreen
+ * texture, or in blur-behind mode the copy of what is behind it.
+ */
+static inline CoglHandle
+clutter_kawase_blur_effect_get_source_texture (ClutterKawaseBlurEffect *self)
+{
+  if (self->painting_behind)
+    return self->backdrop_texture;
+
+  return clutter_offscreen_effect_get_texture (CLUTTER_OFFSCREEN_EFFECT (self));
+}
+
+/*
+ * The passes are submitted without waiting for the GPU: Cogl flushes the
+ * journal of an offscreen framebuffer before its texture is sampled by
+ * the next pass, so the dependency order of the chain is kept by Cogl
+ * itself. Waiting after each pass is only useful to attribute GPU time
+ * to individual passes while debugging.
+ */
+static inline void
+clutter_kawase_blur_effect_end_pass (CoglFramebuffer *target)
+{
+  if (G_UNLIKELY (kawase_blur_debug_flags & KAWASE_BLUR_DEBUG_SYNC_PASSES))
+    cogl_framebuffer_finish (target);
+}
+
+/* Helpers of clutter-kawase-blur-effect.c the engines share */
+gboolean clutter_kawase_blur_effect_is_transformed (ClutterKawaseBlurEffect *self);
+KawaseBlurPipelineStack *clutter_kawase_blur_effect_class_get_specialized_stack (ClutterKawaseBlurEffectClass *klass,
+                                                                                 gint                          strength);
+guint64 clutter_kawase_blur_effect_region_area (const cairo_region_t *region);
+void clutter_kawase_blur_effect_count_traffic (ClutterKawaseBlurEffect *self,
+                                               guint64                  written,
+                                               gint                     width,
+                                               gint                     height,
+                                               gint                     bpp,
+                                               gint                     source_width,
+                                               gint                     source_height,
+                                               gint                     source_bpp);
+void clutter_kawase_blur_effect_draw_pass (ClutterKawaseBlurEffect *self,
+                                           CoglFramebuffer         *target,
+                                           CoglPipeline            *pipeline,
+                                           const cairo_region_t    *region,
+                                           gint                     width,
+                                           gint                     height);
+void clutter_kawase_blur_effect_draw_final (ClutterKawaseBlurEffect *self,
+                                            CoglFramebuffer         *framebuffer,
+                                            CoglPipeline            *pipeline,
+                                            gboolean                 flipped);
+
+/* Used by the effect outside of the dual Kawase engine */
+void clutter_kawase_blur_effect_clear_pyramid (ClutterKawaseBlurEffect *self);
+gboolean clutter_kawase_blur_effect_can_isolate (ClutterKawaseBlurEffect *self);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_KAWASE_BLUR_EFFECT_PRIVATE_H__ */
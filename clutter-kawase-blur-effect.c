@@ -35,31 +35,76 @@
  * #ClutterKawaseBlurEffect is available since Clutter 1.4
  */
 
-#define CLUTTER_KAWASE_BLUR_EFFECT_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), CLUTTER_TYPE_KAWASE_BLUR_EFFECT, ClutterKawaseBlurEffectClass))
-#define CLUTTER_IS_KAWASE_BLUR_EFFECT_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), CLUTTER_TYPE_KAWASE_BLUR_EFFECT))
-#define CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), CLUTTER_TYPE_KAWASE_BLUR_EFFECT, ClutterKawaseBlurEffectClass))
+#include "clutter-kawase-blur-effect-private.h"
 
-/* 
- * These defines are very important to enable the cogl pipeline and 
- * clutter backend functionality required for this effect to work.
- * They have to be called before the clutter library is included.
- * Otherwise we get a lot of segfaults.
- */
-#define COGL_ENABLE_EXPERIMENTAL_API
-#define CLUTTER_ENABLE_EXPERIMENTAL_API
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const GDebugKey kawase_blur_debug_keys[] = {
+  { "sync-passes", KAWASE_BLUR_DEBUG_SYNC_PASSES },
+};
+
+guint kawase_blur_debug_flags = 0;
 
-#include "clutter-kawase-blur-effect.h"
+/* File the trace requested through CLUTTER_KAWASE_BLUR_TRACE is written to on exit */
+static gchar *kawase_blur_trace_filename = NULL;
 
-#define BLUR_STEPS 15
-// When changing DOWNSAMPLE_STEPS you also have to update the blur_offsets array
-// in the clutter_kawase_blur_effect_class_init function, so that the array's
-// length matches the number of DOWNSAMPLE_STEPS.
-#define DOWNSAMPLE_STEPS 5
+/*
+ * Adaptive quality, see clutter_kawase_blur_effect_set_adaptive_quality().
+ * The quality goes from 0 up to QUALITY_FULL; the first step down renders
+ * the levels at half their size, every further step drops one iteration.
+ * The cost of the chain is sampled every GOVERNOR_SAMPLE_INTERVAL blurred
+ * frames, with GPU timer queries where available, and smoothed. The quality
+ * drops as soon as the average is over the
+ * budget, and only goes up again after GOVERNOR_RECOVER_SAMPLES samples in
+ * a row below GOVERNOR_RECOVER_RATIO of the budget, or once the content
+ * stopped changing for GOVERNOR_IDLE_TIMEOUT milliseconds.
+ */
+#define QUALITY_FULL DOWNSAMPLE_STEPS
+#define DEFAULT_FRAME_BUDGET 2.0f
+#define GOVERNOR_SAMPLE_INTERVAL 8
+#define GOVERNOR_SMOOTHING 0.3
+#define GOVERNOR_RECOVER_RATIO 0.5
+#define GOVERNOR_RECOVER_SAMPLES 4
+#define GOVERNOR_IDLE_TIMEOUT 250
+
+/* Deepest level the actor can be rendered at directly, see
+ * clutter_kawase_blur_effect_set_offscreen_downscale() */
+#define MAX_OFFSCREEN_DOWNSCALE 2
+
+/* Default share of the actor's area up to which damage is updated
+ * incrementally, see clutter_kawase_blur_effect_add_damage() */
+#define DEFAULT_DAMAGE_THRESHOLD 0.5f
+
+/* Default memory cap of the shared texture pool, see
+ * clutter_kawase_blur_effect_class_set_pool_limit() */
+#define DEFAULT_POOL_LIMIT (64 * 1024 * 1024)
 
 static const gchar *glsl_declarations =
 "uniform vec2 halfpixel;\n"
 "uniform vec2 offset;\n";
 
+static const gchar *glsl_specialized_declarations =
+"uniform vec2 halfpixel;\n";
+
+static const gchar *glsl_gaussian_declarations =
+"uniform vec2 direction;\n"
+"uniform float tap_offsets[8];\n"
+"uniform float tap_weights[8];\n";
+
+/* One direction of the separable Gaussian, direction is one texel along it */
+static const gchar *glsl_gaussian_shader =
+"vec2 uv = cogl_tex_coord.xy;\n"
+"cogl_texel = texture2D(cogl_sampler, uv) * tap_weights[0];\n"
+"for (int i = 1; i < 8; i++)\n"
+"  {\n"
+"    cogl_texel += texture2D(cogl_sampler, uv + direction * tap_offsets[i]) * tap_weights[i];\n"
+"    cogl_texel += texture2D(cogl_sampler, uv - direction * tap_offsets[i]) * tap_weights[i];\n"
+"  }\n"
+"cogl_texel.a = 1.0;\n";
+
 static const gchar *glsl_downsample_shader =
 "vec2 uv = cogl_tex_coord.xy;\n"
 "cogl_texel = texture2D(cogl_sampler, uv) * 4.0;\n"
@@ -83,266 +128,3092 @@ static const gchar *glsl_upsample_shader =
 "cogl_texel /= 12.0;\n"
 "cogl_texel.a = 1.0;\n";
 
-struct _ClutterKawaseBlurEffect
-{
-  ClutterOffscreenEffect parent_instance;
+/*
+ * Variants of the down- and upsample shaders for isolated clip rectangles.
+ * Every tap is clamped to the rectangle of the source level the fragment
+ * belongs to, which the vertices pass in the color attribute as
+ * (x1, y1, x2, y2) in texture coordinates.
+ */
+static const gchar *glsl_clamped_declarations =
+"uniform vec2 halfpixel;\n"
+"uniform vec2 offset;\n"
+"vec2 kawase_clamp (vec2 uv)\n"
+"{\n"
+"  return clamp (uv, cogl_color_in.xy, cogl_color_in.zw);\n"
+"}\n";
+
+static const gchar *glsl_clamped_downsample_shader =
+"vec2 uv = cogl_tex_coord.xy;\n"
+"cogl_texel = texture2D(cogl_sampler, kawase_clamp (uv)) * 4.0;\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv - halfpixel.xy * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + halfpixel.xy * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(halfpixel.x, -halfpixel.y) * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv - vec2(halfpixel.x, -halfpixel.y) * offset));\n"
+"cogl_texel /= 8.0;\n"
+"cogl_texel.a = 1.0;\n";
+
+static const gchar *glsl_clamped_upsample_shader =
+"vec2 uv = cogl_tex_coord.xy;\n"
+"cogl_texel = texture2D(cogl_sampler, kawase_clamp (uv + vec2(-halfpixel.x * 2.0, 0.0) * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(-halfpixel.x, halfpixel.y) * offset)) * 2.0;\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(0.0, halfpixel.y * 2.0) * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(halfpixel.x, halfpixel.y) * offset)) * 2.0;\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(halfpixel.x * 2.0, 0.0) * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(halfpixel.x, -halfpixel.y) * offset)) * 2.0;\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(0.0, -halfpixel.y * 2.0) * offset));\n"
+"cogl_texel += texture2D(cogl_sampler, kawase_clamp (uv + vec2(-halfpixel.x, -halfpixel.y) * offset)) * 2.0;\n"
+"cogl_texel /= 12.0;\n"
+"cogl_texel.a = 1.0;\n";
+
+static void
+kawase_blur_append_tap (GString     *shader,
+                        const gchar *op,
+                        gfloat       x,
+                        gfloat       y,
+                        const gchar *weight)
+{
+  gchar x_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar y_str[G_ASCII_DTOSTR_BUF_SIZE];
+
+  // GLSL wants a dot as the decimal separator, whatever the locale says
+  g_ascii_formatd (x_str, sizeof (x_str), "%.6f", x);
+  g_ascii_formatd (y_str, sizeof (y_str), "%.6f", y);
+
+  g_string_append_printf (shader,
+                          "cogl_texel %s texture2D(cogl_sampler, uv + halfpixel * vec2(%s, %s)) * %s;\n",
+                          op, x_str, y_str, weight);
+}
+
+/*
+ * Same as glsl_downsample_shader, with the tap offsets for the given
+ * offset folded into constants and the weights normalized up front.
+ */
+static gchar *
+kawase_blur_generate_downsample_shader (gfloat offset)
+{
+  GString *shader = g_string_new ("vec2 uv = cogl_tex_coord.xy;\n"
+                                  "cogl_texel = texture2D(cogl_sampler, uv) * 0.5;\n");
+
+  kawase_blur_append_tap (shader, "+=", -offset, -offset, "0.125");
+  kawase_blur_append_tap (shader, "+=", offset, offset, "0.125");
+  kawase_blur_append_tap (shader, "+=", offset, -offset, "0.125");
+  kawase_blur_append_tap (shader, "+=", -offset, offset, "0.125");
+  g_string_append (shader, "cogl_texel.a = 1.0;\n");
+
+  return g_string_free (shader, FALSE);
+}
+
+/*
+ * The upsample kernel of glsl_upsample_shader weighs four edge taps with
+ * 1 and four diagonal taps with 2. Every edge tap is merged with the
+ * neighbouring diagonal tap into a single lookup at their weighted center,
+ * where the bilinear filter blends the two. That halves the number of
+ * lookups; the result only differs from the 8 tap kernel where the image
+ * isn't smooth across the footprint of a tap pair, and the difference
+ * fades as the levels get coarser.
+ */
+static gchar *
+kawase_blur_generate_upsample_shader (gfloat offset)
+{
+  GString *shader = g_string_new ("vec2 uv = cogl_tex_coord.xy;\n");
+  gfloat inner = offset * 2.0f / 3.0f;
+  gfloat outer = offset * 4.0f / 3.0f;
+
+  kawase_blur_append_tap (shader, "=", -outer, inner, "0.25");
+  kawase_blur_append_tap (shader, "+=", inner, outer, "0.25");
+  kawase_blur_append_tap (shader, "+=", outer, -inner, "0.25");
+  kawase_blur_append_tap (shader, "+=", -inner, -outer, "0.25");
+  g_string_append (shader, "cogl_texel.a = 1.0;\n");
+
+  return g_string_free (shader, FALSE);
+}
+
+enum
+{
+  PROP_0,
+
+  PROP_STRENGTH,
+  PROP_SHARED_PYRAMID,
+  PROP_SPECIALIZED_SHADERS,
+  PROP_DOWNSAMPLE_SOURCE,
+  PROP_ADAPTIVE_QUALITY,
+  PROP_FRAME_BUDGET,
+  PROP_EFFECTIVE_QUALITY,
+  PROP_OFFSCREEN_DOWNSCALE,
+  PROP_DAMAGE_THRESHOLD,
+  PROP_INTERMEDIATE_FORMAT,
+  PROP_MODE,
+  PROP_TRIM_TIMEOUT,
+  PROP_ISOLATE_RECTS,
+  PROP_BLUR_BEHIND,
+
+  PROP_FRAMES_BLURRED,
+  PROP_PASSES_EXECUTED,
+  PROP_PIXELS_RASTERIZED,
+  PROP_CACHE_HITS,
+  PROP_INCREMENTAL_FRAMES,
+  PROP_TEXTURES_ALLOCATED,
+  PROP_FRAMEBUFFERS_ALLOCATED,
+  PROP_PYRAMID_BYTES,
+  PROP_OFFSCREEN_BYTES,
+  PROP_OFFSCREEN_PIXELS,
+  PROP_BACKDROP_PIXELS,
+  PROP_BACKDROP_READBACKS,
+  PROP_BYTES_MOVED,
+  PROP_BYTES_RECLAIMED,
+  PROP_TRIMS,
+  PROP_PRE_PAINT_TIME,
+  PROP_PAINT_TARGET_TIME,
+
+  PROP_LAST
+};
+
+static GParamSpec *obj_props[PROP_LAST];
+
+G_DEFINE_TYPE (ClutterKawaseBlurEffect,
+               clutter_kawase_blur_effect,
+               CLUTTER_TYPE_OFFSCREEN_EFFECT);
+
+GType
+clutter_kawase_blur_format_get_type (void)
+{
+  static volatile gsize type_id = 0;
+
+  if (g_once_init_enter (&type_id))
+    {
+      static const GEnumValue values[] = {
+        { CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888, "CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888", "rgba8888" },
+        { CLUTTER_KAWASE_BLUR_FORMAT_RGB888, "CLUTTER_KAWASE_BLUR_FORMAT_RGB888", "rgb888" },
+        { CLUTTER_KAWASE_BLUR_FORMAT_RGB565, "CLUTTER_KAWASE_BLUR_FORMAT_RGB565", "rgb565" },
+        { CLUTTER_KAWASE_BLUR_FORMAT_AUTO, "CLUTTER_KAWASE_BLUR_FORMAT_AUTO", "auto" },
+        { 0, NULL, NULL }
+      };
+      GType id = g_enum_register_static ("ClutterKawaseBlurFormat", values);
+
+      g_once_init_leave (&type_id, id);
+    }
+
+  return type_id;
+}
+
+GType
+clutter_kawase_blur_mode_get_type (void)
+{
+  static volatile gsize type_id = 0;
+
+  if (g_once_init_enter (&type_id))
+    {
+      static const GEnumValue values[] = {
+        { CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE, "CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE", "dual-kawase" },
+        { CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN, "CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN", "gaussian" },
+        { 0, NULL, NULL }
+      };
+      GType id = g_enum_register_static ("ClutterKawaseBlurMode", values);
+
+      g_once_init_leave (&type_id, id);
+    }
+
+  return type_id;
+}
+
+/*
+ * Whether the actor or one of its ancestors is scaled or rotated. The
+ * offscreen texture then holds the transformed actor, so rectangles in
+ * actor coordinates don't map to rectangles of texture pixels anymore.
+ */
+gboolean
+clutter_kawase_blur_effect_is_transformed (ClutterKawaseBlurEffect *self)
+{
+  ClutterActor *actor;
+
+  for (actor = self->actor; actor != NULL; actor = clutter_actor_get_parent (actor))
+    {
+      if (clutter_actor_is_scaled (actor) || clutter_actor_is_rotated (actor))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Finds where the offscreen texture starts in actor coordinates. The
+ * parent places the texture at the top left corner of the actor's paint
+ * box on the stage.
+ */
+static void
+clutter_kawase_blur_effect_update_origin (ClutterKawaseBlurEffect *self)
+{
+  ClutterActorBox box;
+  gfloat x, y;
+
+  if (!clutter_actor_get_paint_box (self->actor, &box) ||
+      !clutter_actor_transform_stage_point (self->actor, box.x1, box.y1, &x, &y))
+    {
+      self->volume_x = 0.0f;
+      self->volume_y = 0.0f;
+      return;
+    }
+
+  // Don't let the inverse transform turn 10 into 9.99998
+  self->volume_x = floorf (x + 0.5f);
+  self->volume_y = floorf (y + 0.5f);
+}
+
+/*
+ * Translates the clip rectangles into pixels of the offscreen texture. This
+ * only works for actors that aren't scaled or rotated, transformed actors
+ * are blurred as a whole instead, without clip rectangles and damage.
+ */
+static void
+clutter_kawase_blur_effect_update_clip_region (ClutterKawaseBlurEffect *self)
+{
+  cairo_rectangle_int_t bounds = { 0, 0, self->tex_width, self->tex_height };
+  gint origin_x = (gint) floorf (self->volume_x);
+  gint origin_y = (gint) floorf (self->volume_y);
+  gboolean transformed = clutter_kawase_blur_effect_is_transformed (self);
+
+  g_clear_pointer (&self->clip_region, cairo_region_destroy);
+
+  // Damage reported since the last redraw belongs to this frame
+  g_clear_pointer (&self->frame_damage, cairo_region_destroy);
+  if (self->damage != NULL && transformed)
+    g_clear_pointer (&self->damage, cairo_region_destroy);
+  else if (self->damage != NULL)
+    {
+      self->frame_damage = self->damage;
+      self->damage = NULL;
+      cairo_region_translate (self->frame_damage, -origin_x, -origin_y);
+      cairo_region_intersect_rectangle (self->frame_damage, &bounds);
+    }
+
+  if (self->clip_rects == NULL || transformed)
+    return;
+
+  self->clip_region = cairo_region_create ();
+  for(guint i=0; i<self->clip_rects->len; i++)
+    {
+      cairo_rectangle_int_t rect =
+        g_array_index (self->clip_rects, cairo_rectangle_int_t, i);
+
+      rect.x -= origin_x;
+      rect.y -= origin_y;
+      cairo_region_union_rectangle (self->clip_region, &rect);
+    }
+  cairo_region_intersect_rectangle (self->clip_region, &bounds);
+}
+
+static gboolean
+clutter_kawase_blur_effect_apply_quality (ClutterKawaseBlurEffect *self);
+
+static void
+clutter_kawase_blur_effect_check_glsl (ClutterKawaseBlurEffect *self)
+{
+  if (!self->software && !clutter_feature_available (CLUTTER_FEATURE_SHADERS_GLSL))
+    {
+      /* if we don't have support for GLSL shaders then we
+       * blur on the CPU instead
+       */
+      g_message ("The graphics hardware or the current GL driver does not "
+                 "implement support for the GLSL shading language, the "
+                 "blur is computed on the CPU.");
+      self->software = TRUE;
+    }
+}
+
+static gboolean
+clutter_kawase_blur_effect_pre_paint (ClutterEffect *effect)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
+  ClutterEffectClass *parent_class;
+  ClutterKawaseBlurTraceSpan span;
+  gint64 start;
+
+  if (!clutter_actor_meta_get_enabled (CLUTTER_ACTOR_META (effect)))
+    return FALSE;
+
+  self->actor = clutter_actor_meta_get_actor (CLUTTER_ACTOR_META (effect));
+  if (self->actor == NULL)
+    return FALSE;
+
+  clutter_kawase_blur_effect_check_glsl (self);
+
+  start = g_get_monotonic_time ();
+  span = clutter_kawase_blur_trace_begin ("pre_paint");
+
+  parent_class = CLUTTER_EFFECT_CLASS (clutter_kawase_blur_effect_parent_class);
+  if (parent_class->pre_paint (effect))
+    {
+      ClutterOffscreenEffect *offscreen_effect =
+        CLUTTER_OFFSCREEN_EFFECT (effect);
+      CoglHandle texture;
+
+      texture = clutter_offscreen_effect_get_texture (offscreen_effect);
+
+      // The chain works in pixels of the full resolution image
+      self->tex_width = self->target_width;
+      self->tex_height = self->target_height;
+      self->stats.offscreen_pixels += (guint64) cogl_texture_get_width (texture)
+                                    * cogl_texture_get_height (texture);
+
+      /*
+       * The parent set up the viewport of the offscreen framebuffer for a
+       * texture at full resolution. Scaling it down makes the actor cover
+       * the smaller texture instead of being cut off.
+       */
+      if (self->source_downscale > 0)
+        {
+          CoglFramebuffer *offscreen = cogl_get_draw_framebuffer ();
+          gfloat scale = 1.0f / (1 << self->source_downscale);
+          gfloat viewport[4];
+
+          cogl_framebuffer_get_viewport4fv (offscreen, viewport);
+          cogl_framebuffer_set_viewport (offscreen,
+                                         viewport[0] * scale,
+                                         viewport[1] * scale,
+                                         viewport[2] * scale,
+                                         viewport[3] * scale);
+        }
+
+      clutter_kawase_blur_effect_apply_quality (self);
+
+      // The actor has been redrawn, so whatever the pyramid holds is stale
+      self->blur_valid = FALSE;
+      self->redraw_frame = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self)->frame;
+
+      clutter_kawase_blur_effect_update_origin (self);
+      clutter_kawase_blur_effect_update_clip_region (self);
+
+      clutter_kawase_blur_trace_end (span, self->entry_level,
+                                     self->tex_width, self->tex_height,
+                                     self->strength);
+      self->stats.pre_paint_time += g_get_monotonic_time () - start;
+      return TRUE;
+    }
+  else
+    {
+      clutter_kawase_blur_trace_end (span, -1, 0, 0, self->strength);
+      self->stats.pre_paint_time += g_get_monotonic_time () - start;
+      return FALSE;
+    }
+}
+
+/*
+ * Creates the texture the actor is rendered into, shrunk by the requested
+ * downscale. The software fallback reads the texture back at full size, so
+ * it always gets a full resolution one.
+ */
+static CoglHandle
+clutter_kawase_blur_effect_create_texture (ClutterOffscreenEffect *effect,
+                                           gfloat                  width,
+                                           gfloat                  height)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
+  CoglContext *ctx =
+    clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  ClutterKawaseBlurTraceSpan span = clutter_kawase_blur_trace_begin ("allocate");
+  CoglHandle texture;
+  gint texture_width, texture_height;
+
+  self->target_width = MAX ((gint) width, 1);
+  self->target_height = MAX ((gint) height, 1);
+  self->source_downscale = self->software ? 0 : self->downscale;
+
+  texture_width = MAX (self->target_width >> self->source_downscale, 1);
+  texture_height = MAX (self->target_height >> self->source_downscale, 1);
+  texture = cogl_texture_2d_new_with_size (ctx, texture_width, texture_height);
+
+  clutter_kawase_blur_trace_end (span, self->source_downscale,
+                                 texture_width, texture_height,
+                                 self->strength);
+
+  return texture;
+}
+
+guint64
+clutter_kawase_blur_effect_region_area (const cairo_region_t *region)
+{
+  guint64 area = 0;
+
+  for(gint i=0; i<cairo_region_num_rectangles (region); i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      area += (guint64) rect.width * rect.height;
+    }
+
+  return area;
+}
+
+/*
+ * Estimates the memory traffic of a pass that wrote written pixels into a
+ * target of the given size: every written pixel is stored once, and the
+ * texture cache fetches the matching part of the source about once, so the
+ * reads scale with the size ratio of source and target.
+ */
+void
+clutter_kawase_blur_effect_count_traffic (ClutterKawaseBlurEffect *self,
+                                          guint64                  written,
+                                          gint                     width,
+                                          gint                     height,
+                                          gint                     bpp,
+                                          gint                     source_width,
+                                          gint                     source_height,
+                                          gint                     source_bpp)
+{
+  gdouble read = (gdouble) written * source_width * source_height / ((gdouble) width * height);
+
+  self->stats.bytes_moved += written * bpp + (guint64) (read * source_bpp);
+}
+
+/*
+ * Draws a down- or upsample pass into a level of the given size. Without a
+ * region the whole level is drawn, otherwise only the rectangles of the
+ * region, with the texture coordinates the full draw would use there.
+ */
+void
+clutter_kawase_blur_effect_draw_pass (ClutterKawaseBlurEffect *self,
+                                      CoglFramebuffer         *target,
+                                      CoglPipeline            *pipeline,
+                                      const cairo_region_t    *region,
+                                      gint                     width,
+                                      gint                     height)
+{
+  gint n_rects;
+  gfloat *coords;
+
+  if (region == NULL)
+    {
+      cogl_framebuffer_draw_rectangle (target,
+                                      pipeline,
+                                      -1.0, -1.0,
+                                      1.0, 1.0);
+      self->stats.pixels_rasterized += (guint64) width * height;
+      return;
+    }
+
+  n_rects = cairo_region_num_rectangles (region);
+  if (n_rects == 0)
+    return;
+
+  coords = g_new (gfloat, 8 * n_rects);
+  for(gint i=0; i<n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      gfloat *c = coords + 8 * i;
+
+      cairo_region_get_rectangle (region, i, &rect);
+
+      // Vertices in normalized device coordinates, rows flipped like the full draw
+      c[0] = -1.0f + 2.0f * rect.x / width;
+      c[1] = 1.0f - 2.0f * rect.y / height;
+      c[2] = -1.0f + 2.0f * (rect.x + rect.width) / width;
+      c[3] = 1.0f - 2.0f * (rect.y + rect.height) / height;
+      // The full draw maps -1..1 onto 0..1
+      c[4] = (1.0f + c[0]) / 2.0f;
+      c[5] = (1.0f + c[1]) / 2.0f;
+      c[6] = (1.0f + c[2]) / 2.0f;
+      c[7] = (1.0f + c[3]) / 2.0f;
+    }
+
+  cogl_framebuffer_draw_textured_rectangles (target, pipeline, coords, n_rects);
+  self->stats.pixels_rasterized += clutter_kawase_blur_effect_region_area (region);
+
+  g_free (coords);
+}
+
+/*
+ * Writes the trace requested through CLUTTER_KAWASE_BLUR_TRACE. The GL
+ * context may be gone by now, so spans whose GPU times haven't been
+ * collected yet only have their CPU times.
+ */
+static void
+clutter_kawase_blur_effect_write_trace_at_exit (void)
+{
+  GError *error = NULL;
+
+  clutter_kawase_blur_trace_stop ();
+
+  if (!clutter_kawase_blur_trace_write (kawase_blur_trace_filename, &error))
+    {
+      g_warning ("Unable to write the blur trace: %s", error->message);
+      g_error_free (error);
+    }
+}
+
+/*
+ * Draws the final image onto the actor's framebuffer, limited to the clip
+ * rectangles if there are any. The blurred texture is upside down unless
+ * it was computed on the CPU.
+ */
+void
+clutter_kawase_blur_effect_draw_final (ClutterKawaseBlurEffect *self,
+                                       CoglFramebuffer         *framebuffer,
+                                       CoglPipeline            *pipeline,
+                                       gboolean                 flipped)
+{
+  gint n_rects;
+  gfloat *coords;
+
+  if (self->clip_region == NULL)
+    {
+      cogl_framebuffer_draw_rectangle (framebuffer,
+                                      pipeline,
+                                      0, flipped ? self->tex_height : 0,
+                                      self->tex_width, flipped ? 0 : self->tex_height);
+      self->stats.pixels_rasterized += (guint64) self->tex_width * self->tex_height;
+      return;
+    }
+
+  n_rects = cairo_region_num_rectangles (self->clip_region);
+  if (n_rects == 0)
+    return;
+
+  coords = g_new (gfloat, 8 * n_rects);
+  for(gint i=0; i<n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      gfloat *c = coords + 8 * i;
+
+      cairo_region_get_rectangle (self->clip_region, i, &rect);
+
+      c[0] = rect.x;
+      c[1] = rect.y;
+      c[2] = rect.x + rect.width;
+      c[3] = rect.y + rect.height;
+      c[4] = c[0] / self->tex_width;
+      c[5] = c[1] / self->tex_height;
+      c[6] = c[2] / self->tex_width;
+      c[7] = c[3] / self->tex_height;
+
+      if (flipped)
+        {
+          c[5] = 1.0f - c[5];
+          c[7] = 1.0f - c[7];
+        }
+    }
+
+  cogl_framebuffer_draw_textured_rectangles (framebuffer, pipeline, coords, n_rects);
+  self->stats.pixels_rasterized += clutter_kawase_blur_effect_region_area (self->clip_region);
+
+  g_free (coords);
+}
+
+static void
+clutter_kawase_blur_effect_clear_software (ClutterKawaseBlurEffect *self)
+{
+  if (self->cpu_texture != NULL)
+    {
+      cogl_object_unref (self->cpu_texture);
+      self->cpu_texture = NULL;
+    }
+
+  g_clear_pointer (&self->cpu_source, g_free);
+  g_clear_pointer (&self->cpu_result, g_free);
+
+  self->cpu_width = 0;
+  self->cpu_height = 0;
+}
+
+static void
+clutter_kawase_blur_effect_clear_backdrop (ClutterKawaseBlurEffect *self)
+{
+  if (self->backdrop_texture != NULL)
+    {
+      cogl_object_unref (self->backdrop_texture);
+      self->backdrop_texture = NULL;
+    }
+
+  if (self->backdrop_bitmap != NULL)
+    {
+      cogl_object_unref (self->backdrop_bitmap);
+      self->backdrop_bitmap = NULL;
+    }
+
+  if (self->backdrop_fbo != 0)
+    {
+      kawase_blur_gl_blit.DeleteFramebuffers (1, &self->backdrop_fbo);
+      self->backdrop_fbo = 0;
+    }
+
+  memset (&self->backdrop_rect, 0, sizeof (self->backdrop_rect));
+  memset (&self->backdrop_footprint, 0, sizeof (self->backdrop_footprint));
+}
+
+/*
+ * Software version of prepare_passes and run_passes: the whole chain runs
+ * on the CPU, so the only texture involved is the one holding the result.
+ */
+static void
+clutter_kawase_blur_effect_run_software (ClutterKawaseBlurEffect *self,
+                                         CoglHandle               texture)
+{
+  ClutterKawaseBlurCpuImage source, result;
+  ClutterKawaseBlurTraceSpan span;
+  gint rowstride = self->tex_width * 4;
+
+  if (self->cpu == NULL)
+    {
+      CoglContext *ctx =
+        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+      self->cpu = clutter_kawase_blur_cpu_new ();
+      clutter_kawase_blur_cpu_set_n_threads (self->cpu, self->cpu_threads);
+      self->cpu_pipeline = cogl_pipeline_new (ctx);
+    }
+
+  if (self->cpu_width != self->tex_width || self->cpu_height != self->tex_height)
+    {
+      CoglContext *ctx =
+        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+      clutter_kawase_blur_effect_clear_software (self);
+
+      self->cpu_source = g_malloc (rowstride * self->tex_height);
+      self->cpu_result = g_malloc (rowstride * self->tex_height);
+      self->cpu_texture = cogl_texture_2d_new_with_size (ctx,
+                                                         self->tex_width,
+                                                         self->tex_height);
+      self->stats.textures_allocated++;
+      self->cpu_width = self->tex_width;
+      self->cpu_height = self->tex_height;
+
+      cogl_pipeline_set_layer_texture (self->cpu_pipeline, 0, self->cpu_texture);
+    }
+
+  // The readback is the expensive part, it waits for the actor to be rendered
+  cogl_texture_get_data (texture,
+                         COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                         rowstride,
+                         self->cpu_source);
+
+  source.data = self->cpu_source;
+  source.width = self->tex_width;
+  source.height = self->tex_height;
+  source.rowstride = rowstride;
+
+  result = source;
+  result.data = self->cpu_result;
+
+  span = clutter_kawase_blur_trace_begin ("cpu_blur");
+  clutter_kawase_blur_cpu_run (self->cpu, &source, &result,
+                               self->iterations, self->offset);
+  clutter_kawase_blur_trace_end (span, self->iterations,
+                                 self->tex_width, self->tex_height,
+                                 self->strength);
+
+  cogl_texture_set_data (self->cpu_texture,
+                         COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                         rowstride,
+                         self->cpu_result,
+                         0, /* level */
+                         NULL);
+
+  self->stats.passes_executed += 2*self->iterations-1;
+}
+
+/*
+ * Invalidating the blur only reruns the chain on the next paint. When the
+ * paint volume changes, e.g. with the clip rectangles or the blur behind
+ * mode, the actor has to be rendered again, into a texture of the new
+ * size.
+ */
+static void
+clutter_kawase_blur_effect_queue_actor_redraw (ClutterKawaseBlurEffect *self)
+{
+  ClutterActor *actor = clutter_actor_meta_get_actor (CLUTTER_ACTOR_META (self));
+
+  if (actor != NULL)
+    clutter_actor_queue_redraw (actor);
+}
+
+/*
+ * With clip rectangles the paint volume grows by the reach of the chain,
+ * so it depends on the iteration count.
+ */
+static void
+clutter_kawase_blur_effect_iterations_changed (ClutterKawaseBlurEffect *self)
+{
+  if (self->clip_rects != NULL)
+    clutter_kawase_blur_effect_queue_actor_redraw (self);
+}
+
+/*
+ * Derives the iteration count and the level scale from the strength, the
+ * current quality and the scale of the offscreen texture. Returns whether
+ * the iteration count changed.
+ */
+static gboolean
+clutter_kawase_blur_effect_apply_quality (ClutterKawaseBlurEffect *self)
+{
+  gint reduction = QUALITY_FULL - self->quality;
+  gint old_iterations = self->iterations;
+
+  self->level_shift = (reduction > 0) ? 1 : 0;
+  self->iterations = MAX (self->strength_iterations - MAX (reduction - 1, 0), 1);
+
+  // The chain can't end above the level the offscreen texture stands in for
+  self->entry_level = MAX (self->source_downscale - self->level_shift, 0);
+  self->iterations = MAX (self->iterations, self->entry_level);
+
+  return old_iterations != self->iterations;
+}
+
+/*
+ * Changes the quality without queueing a repaint, so that the governor can
+ * call it from paint_target. The next blurred frame uses the new quality.
+ */
+static void
+clutter_kawase_blur_effect_set_quality (ClutterKawaseBlurEffect *self,
+                                        gint                     quality)
+{
+  quality = CLAMP (quality, 0, QUALITY_FULL);
+  if (self->quality == quality)
+    return;
+
+  self->quality = quality;
+  clutter_kawase_blur_effect_apply_quality (self);
+  self->blur_valid = FALSE;
+
+  // Samples of the old quality say nothing about the new one
+  self->average_cost = -1.0;
+  self->headroom_samples = 0;
+  self->sample_countdown = GOVERNOR_SAMPLE_INTERVAL;
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_EFFECTIVE_QUALITY]);
+}
+
+/*
+ * Once the content stopped changing, the blur isn't recomputed anymore and
+ * costs nothing per frame, so it is worth running the chain one more time
+ * at full quality.
+ */
+static gboolean
+clutter_kawase_blur_effect_idle_timeout (gpointer user_data)
+{
+  ClutterKawaseBlurEffect *self = user_data;
+
+  if (g_get_monotonic_time () - self->last_blur_time < GOVERNOR_IDLE_TIMEOUT * 1000)
+    return G_SOURCE_CONTINUE;
+
+  self->idle_timeout_id = 0;
+
+  clutter_kawase_blur_effect_set_quality (self, QUALITY_FULL);
+  clutter_kawase_blur_effect_invalidate (self);
+  clutter_kawase_blur_effect_iterations_changed (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Feeds a sample of the chain's cost, in milliseconds, into the governor.
+ */
+static void
+clutter_kawase_blur_effect_update_quality (ClutterKawaseBlurEffect *self,
+                                           gdouble                  cost)
+{
+  // The quality changed while the sample was in flight
+  if (self->sample_quality != self->quality)
+    return;
+
+  if (self->average_cost < 0.0)
+    self->average_cost = cost;
+  else
+    self->average_cost += (cost - self->average_cost) * GOVERNOR_SMOOTHING;
+
+  if (self->average_cost > self->frame_budget)
+    {
+      self->headroom_samples = 0;
+      if (self->quality > 0)
+        clutter_kawase_blur_effect_set_quality (self, self->quality - 1);
+    }
+  else if (self->average_cost < self->frame_budget * GOVERNOR_RECOVER_RATIO &&
+           self->quality < QUALITY_FULL)
+    {
+      if (++self->headroom_samples >= GOVERNOR_RECOVER_SAMPLES)
+        clutter_kawase_blur_effect_set_quality (self, self->quality + 1);
+    }
+  else
+    self->headroom_samples = 0;
+}
+
+/*
+ * Starts a sample of the chain's cost. cogl_flush pushes out the journals
+ * of all framebuffers, which keeps the work queued so far, e.g. the actor
+ * itself, out of the sample. With timer queries a timestamp is written
+ * into the GL command stream; end_sample writes the second one and a
+ * later paint collects them once the GPU got there, so nothing waits for
+ * the GPU. Without them, the sample waits for the GPU before and after the
+ * chain, which stalls the frame it is taken in.
+ */
+static void
+clutter_kawase_blur_effect_begin_sample (ClutterKawaseBlurEffect *self,
+                                         CoglFramebuffer         *framebuffer)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+
+  if (!timer->probed)
+    kawase_blur_gpu_timer_probe (timer);
+
+  cogl_flush ();
+
+  if (timer->available)
+    {
+      timer->GenQueries (2, self->sample_queries);
+      timer->QueryCounter (self->sample_queries[0], KAWASE_GL_TIMESTAMP);
+    }
+  else
+    {
+      cogl_framebuffer_finish (framebuffer);
+      self->sample_start = g_get_monotonic_time ();
+    }
+
+  self->sample_quality = self->quality;
+  self->sample_countdown = GOVERNOR_SAMPLE_INTERVAL;
+}
+
+static void
+clutter_kawase_blur_effect_end_sample (ClutterKawaseBlurEffect *self,
+                                       CoglFramebuffer         *framebuffer)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+
+  cogl_flush ();
+
+  if (self->sample_queries[0] != 0)
+    {
+      timer->QueryCounter (self->sample_queries[1], KAWASE_GL_TIMESTAMP);
+      return;
+    }
+
+  cogl_framebuffer_finish (framebuffer);
+  clutter_kawase_blur_effect_update_quality (self,
+                                             (g_get_monotonic_time () - self->sample_start) / 1000.0);
+}
+
+/* Deletes the queries of the sample in flight without reading them */
+static void
+clutter_kawase_blur_effect_drop_sample (ClutterKawaseBlurEffect *self)
+{
+  if (self->sample_queries[0] == 0)
+    return;
+
+  kawase_blur_gpu_timer.DeleteQueries (2, self->sample_queries);
+  self->sample_queries[0] = 0;
+  self->sample_queries[1] = 0;
+}
+
+/*
+ * Hands the sample in flight to the governor once the GPU executed it.
+ * It returns right away if the GPU isn't done yet.
+ */
+static void
+clutter_kawase_blur_effect_collect_sample (ClutterKawaseBlurEffect *self)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+  gint available = 0;
+  guint64 begin, end;
+
+  if (self->sample_queries[0] == 0)
+    return;
+
+  timer->GetQueryObjectiv (self->sample_queries[1], KAWASE_GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return;
+
+  timer->GetQueryObjectui64v (self->sample_queries[0], KAWASE_GL_QUERY_RESULT, &begin);
+  timer->GetQueryObjectui64v (self->sample_queries[1], KAWASE_GL_QUERY_RESULT, &end);
+  clutter_kawase_blur_effect_drop_sample (self);
+
+  clutter_kawase_blur_effect_update_quality (self, (end - begin) / 1000000.0);
+}
+
+/*
+ * Pipelines keep the textures they sampled last alive, a trimmed effect
+ * must not leave its levels behind in them. Every pass sets its texture
+ * right before drawing, so dropping them is always safe.
+ */
+static void
+kawase_blur_pipeline_stack_release (KawaseBlurPipelineStack *stack)
+{
+  for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
+    cogl_pipeline_set_layer_null_texture (stack->pipelines[i],
+                                          0, /* layer number */
+                                          COGL_TEXTURE_TYPE_2D);
+}
+
+/* The engines, indexed by ClutterKawaseBlurMode, see KawaseBlurEngine */
+static const KawaseBlurEngine *kawase_blur_engines[] = {
+  [CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE] = &kawase_blur_dual_kawase_engine,
+  [CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN] = &kawase_blur_gaussian_engine,
+};
+
+static guint64 clutter_kawase_blur_effect_get_pyramid_bytes (ClutterKawaseBlurEffect *self);
+
+/*
+ * Frees whatever the engines allocated, which is rebuilt by the next paint.
+ * Returns the number of bytes freed. The pipelines of the consumers sample
+ * this effect's levels as well, so their copies go too.
+ */
+static guint64
+clutter_kawase_blur_effect_drop_levels (ClutterKawaseBlurEffect *self)
+{
+  guint64 bytes = clutter_kawase_blur_effect_get_pyramid_bytes (self);
+
+  if (bytes == 0)
+    return 0;
+
+  // Draws that sample the levels may still be queued
+  cogl_flush ();
+
+  for(guint i=0; i<G_N_ELEMENTS (kawase_blur_engines); i++)
+    kawase_blur_engines[i]->clear (self);
+  clutter_kawase_blur_effect_clear_software (self);
+  clutter_kawase_blur_effect_clear_backdrop (self);
+  if (self->cpu_pipeline != NULL)
+    cogl_pipeline_set_layer_null_texture (self->cpu_pipeline, 0, COGL_TEXTURE_TYPE_2D);
+
+  if (self->pipeline_stacks != NULL)
+    g_hash_table_remove_all (self->pipeline_stacks);
+  for(guint i=0; self->downsample_consumers!=NULL && i<self->downsample_consumers->len; i++)
+    {
+      ClutterKawaseBlurEffect *consumer = g_ptr_array_index (self->downsample_consumers, i);
+
+      if (consumer->pipeline_stacks != NULL)
+        g_hash_table_remove_all (consumer->pipeline_stacks);
+    }
+
+  self->blur_valid = FALSE;
+  self->chain_complete = FALSE;
+
+  self->stats.bytes_reclaimed += bytes;
+  self->stats.trims++;
+
+  return bytes;
+}
+
+/*
+ * Whether the effect can be painted: its actor is mapped and it is
+ * enabled. An actor that is covered by others stays mapped, Clutter 1.x
+ * doesn't tell when that happens.
+ */
+static gboolean
+clutter_kawase_blur_effect_is_active (ClutterKawaseBlurEffect *self)
+{
+  ClutterActorMeta *meta = CLUTTER_ACTOR_META (self);
+  ClutterActor *actor = clutter_actor_meta_get_actor (meta);
+
+  return actor != NULL &&
+         CLUTTER_ACTOR_IS_MAPPED (actor) &&
+         clutter_actor_meta_get_enabled (meta);
+}
+
+static gboolean
+clutter_kawase_blur_effect_trim_timeout (gpointer user_data)
+{
+  ClutterKawaseBlurEffect *self = user_data;
+
+  self->trim_timeout_id = 0;
+
+  clutter_kawase_blur_effect_drop_levels (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * An effect that can't be painted anymore, because its actor was hidden
+ * or the effect disabled, drops its levels trim_timeout milliseconds
+ * later, unless it becomes active again before. Visible actors keep them,
+ * however long they don't change.
+ */
+static void
+clutter_kawase_blur_effect_update_trim_timeout (ClutterKawaseBlurEffect *self)
+{
+  if (self->trim_timeout_id != 0)
+    {
+      g_source_remove (self->trim_timeout_id);
+      self->trim_timeout_id = 0;
+    }
+
+  if (self->trim_timeout == 0 || clutter_kawase_blur_effect_is_active (self))
+    return;
+
+  self->trim_timeout_id =
+    g_timeout_add (self->trim_timeout,
+                   clutter_kawase_blur_effect_trim_timeout,
+                   self);
+}
+
+/* notify::mapped of the actor and notify::enabled of the effect */
+static void
+clutter_kawase_blur_effect_active_changed (GObject    *gobject,
+                                           GParamSpec *pspec,
+                                           gpointer    user_data)
+{
+  clutter_kawase_blur_effect_update_trim_timeout (CLUTTER_KAWASE_BLUR_EFFECT (user_data));
+}
+
+static void
+clutter_kawase_blur_effect_disconnect_actor (ClutterKawaseBlurEffect *self)
+{
+  ClutterActor *actor = clutter_actor_meta_get_actor (CLUTTER_ACTOR_META (self));
+
+  // A destroyed actor has dropped the handler already
+  if (self->actor_mapped_id != 0 && actor != NULL)
+    g_signal_handler_disconnect (actor, self->actor_mapped_id);
+  self->actor_mapped_id = 0;
+}
+
+static void
+clutter_kawase_blur_effect_set_actor (ClutterActorMeta *meta,
+                                      ClutterActor     *actor)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (meta);
+
+  clutter_kawase_blur_effect_disconnect_actor (self);
+
+  CLUTTER_ACTOR_META_CLASS (clutter_kawase_blur_effect_parent_class)->set_actor (meta, actor);
+
+  if (actor != NULL)
+    self->actor_mapped_id =
+      g_signal_connect (actor, "notify::mapped",
+                        G_CALLBACK (clutter_kawase_blur_effect_active_changed),
+                        self);
+
+  clutter_kawase_blur_effect_update_trim_timeout (self);
+}
+
+static void
+clutter_kawase_blur_effect_paint_target (ClutterOffscreenEffect *effect)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
+  const KawaseBlurEngine *engine = kawase_blur_engines[self->mode];
+  CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+  gint64 start = g_get_monotonic_time ();
+  gboolean sampling = FALSE;
+  KawaseBlurGpuSpan composite;
+
+  // Collect the GPU times of earlier frames, this also drains them after the trace stopped
+  if (G_UNLIKELY (kawase_blur_gpu_timer.available && kawase_blur_gpu_timer.pending->len > 0))
+    kawase_blur_gpu_resolve_spans (FALSE);
+
+  clutter_kawase_blur_effect_collect_sample (self);
+
+  // An upsample chain based on the source's levels is stale once they change
+  if (self->chain_uses_source &&
+      (self->downsample_source == NULL ||
+       self->source_serial != self->downsample_source->downsample_serial))
+    self->blur_valid = FALSE;
+
+  /*
+   * As long as neither the actor's content nor the blur parameters changed,
+   * the engine still holds the blurred image and repainting boils down to
+   * the final draw below.
+   */
+  if (!self->blur_valid)
+    {
+      CoglHandle texture =
+        clutter_kawase_blur_effect_get_source_texture (self);
+
+      if (self->adaptive_quality && !self->software && engine->adaptive)
+        {
+          self->last_blur_time = start;
+          if (self->sample_countdown > 0)
+            self->sample_countdown--;
+          else if (self->sample_queries[0] == 0)
+            {
+              clutter_kawase_blur_effect_begin_sample (self, framebuffer);
+              sampling = TRUE;
+            }
+
+          if (self->quality < QUALITY_FULL && self->idle_timeout_id == 0)
+            self->idle_timeout_id =
+              g_timeout_add (GOVERNOR_IDLE_TIMEOUT,
+                             clutter_kawase_blur_effect_idle_timeout,
+                             self);
+        }
+
+      if (self->software)
+        clutter_kawase_blur_effect_run_software (self, texture);
+      else
+        engine->run (self, texture);
+
+      self->blur_valid = TRUE;
+      self->stats.frames_blurred++;
+    }
+  else
+    self->stats.cache_hits++;
+
+  g_clear_pointer (&self->frame_damage, cairo_region_destroy);
+
+  if (self->software)
+    {
+      // The CPU result is stored top row first, so no flipping is needed here
+      kawase_blur_gpu_span_begin (&composite, "composite");
+      clutter_kawase_blur_effect_draw_final (self, framebuffer, self->cpu_pipeline, FALSE);
+      kawase_blur_gpu_span_end (&composite, 0,
+                                self->tex_width, self->tex_height,
+                                self->strength);
+      self->stats.passes_executed++;
+
+      self->stats.paint_target_time += g_get_monotonic_time () - start;
+      return;
+    }
+
+  engine->composite (self, framebuffer);
+
+  if (sampling)
+    clutter_kawase_blur_effect_end_sample (self, framebuffer);
+
+  self->stats.paint_target_time += g_get_monotonic_time () - start;
+}
+
+static inline gboolean
+kawase_blur_rect_intersect (const cairo_rectangle_int_t *a,
+                            const cairo_rectangle_int_t *b,
+                            cairo_rectangle_int_t       *result)
+{
+  gint x1 = MAX (a->x, b->x);
+  gint y1 = MAX (a->y, b->y);
+  gint x2 = MIN (a->x + a->width, b->x + b->width);
+  gint y2 = MIN (a->y + a->height, b->y + b->height);
+
+  result->x = x1;
+  result->y = y1;
+  result->width = MAX (x2 - x1, 0);
+  result->height = MAX (y2 - y1, 0);
+
+  return result->width > 0 && result->height > 0;
+}
+
+static gboolean
+clutter_kawase_blur_effect_backdrop_redraw (gpointer user_data)
+{
+  ClutterKawaseBlurEffect *self = user_data;
+
+  self->backdrop_redraw_id = 0;
+
+  if (self->actor != NULL)
+    clutter_actor_queue_redraw (self->actor);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Blits the given rectangle of the onscreen framebuffer, GL framebuffer 0,
+ * into the backdrop texture, with the rows swapped since GL counts them
+ * from the bottom. The copy stays on the GPU. Returns FALSE if the driver
+ * can't do it, e.g. because the framebuffer is multisampled.
+ */
+static gboolean
+clutter_kawase_blur_effect_blit_backdrop (ClutterKawaseBlurEffect     *self,
+                                          CoglFramebuffer             *framebuffer,
+                                          const cairo_rectangle_int_t *copy)
+{
+  KawaseBlurGlBlit *blit = &kawase_blur_gl_blit;
+  gint height = cogl_framebuffer_get_height (framebuffer);
+  gint read_binding = 0, draw_binding = 0;
+  gboolean scissor;
+  gboolean success;
+
+  if (!blit->probed)
+    kawase_blur_gl_blit_probe (blit);
+  if (!blit->available)
+    return FALSE;
+
+  // The blit happens right away, what has been painted so far must come first
+  cogl_flush ();
+
+  // Errors of earlier GL calls aren't ours to report
+  for(gint i=0; i<16 && blit->GetError () != KAWASE_GL_NO_ERROR; i++)
+    ;
+
+  blit->GetIntegerv (KAWASE_GL_READ_FRAMEBUFFER_BINDING, &read_binding);
+  blit->GetIntegerv (KAWASE_GL_DRAW_FRAMEBUFFER_BINDING, &draw_binding);
+  scissor = blit->IsEnabled (KAWASE_GL_SCISSOR_TEST);
+
+  if (self->backdrop_fbo == 0)
+    {
+      guint gl_texture, gl_target;
+
+      cogl_texture_allocate (self->backdrop_texture, NULL);
+      if (!cogl_texture_get_gl_texture (self->backdrop_texture, &gl_texture, &gl_target) ||
+          gl_target != KAWASE_GL_TEXTURE_2D)
+        return FALSE;
+
+      blit->GenFramebuffers (1, &self->backdrop_fbo);
+      blit->BindFramebuffer (KAWASE_GL_DRAW_FRAMEBUFFER, self->backdrop_fbo);
+      blit->FramebufferTexture2D (KAWASE_GL_DRAW_FRAMEBUFFER,
+                                  KAWASE_GL_COLOR_ATTACHMENT0,
+                                  gl_target,
+                                  gl_texture,
+                                  0);
+    }
+  else
+    blit->BindFramebuffer (KAWASE_GL_DRAW_FRAMEBUFFER, self->backdrop_fbo);
+
+  success = blit->CheckFramebufferStatus (KAWASE_GL_DRAW_FRAMEBUFFER) == KAWASE_GL_FRAMEBUFFER_COMPLETE;
+  if (success)
+    {
+      blit->BindFramebuffer (KAWASE_GL_READ_FRAMEBUFFER, 0);
+      // The scissor of a clipped redraw would cut the blit off
+      if (scissor)
+        blit->Disable (KAWASE_GL_SCISSOR_TEST);
+
+      blit->BlitFramebuffer (copy->x, height - copy->y - copy->height,
+                             copy->x + copy->width, height - copy->y,
+                             0, copy->height,
+                             copy->width, 0,
+                             KAWASE_GL_COLOR_BUFFER_BIT,
+                             KAWASE_GL_NEAREST);
+      success = blit->GetError () == KAWASE_GL_NO_ERROR;
+
+      if (scissor)
+        blit->Enable (KAWASE_GL_SCISSOR_TEST);
+    }
+
+  blit->BindFramebuffer (KAWASE_GL_READ_FRAMEBUFFER, read_binding);
+  blit->BindFramebuffer (KAWASE_GL_DRAW_FRAMEBUFFER, draw_binding);
+
+  // It won't work any better next time
+  if (!success)
+    blit->available = FALSE;
+
+  return success;
+}
+
+/*
+ * Copies the part of the framebuffer behind the actor, grown by the reach
+ * of the chain, and returns the copied rectangle, or FALSE if there is
+ * nothing to copy. The copy is blitted on the GPU where the driver can,
+ * otherwise it is read back into system memory and uploaded again, which
+ * waits for the GPU; that is counted in backdrop_readbacks and traced.
+ *
+ * With a clipped redraw, the framebuffer outside of the clip still holds
+ * the previous frame, this actor included. Blurring that would feed the
+ * actor back into its own backdrop, so the previous result is reused
+ * instead as long as the actor didn't move, and a redraw of the whole
+ * paint volume, which includes the reach, is queued for the next frame.
+ */
+static gboolean
+clutter_kawase_blur_effect_copy_backdrop (ClutterKawaseBlurEffect *self,
+                                          CoglFramebuffer         *framebuffer,
+                                          ClutterActor            *stage,
+                                          cairo_rectangle_int_t   *copy)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+  cairo_rectangle_int_t bounds, footprint, clip, visible;
+  ClutterVertex verts[4];
+  gfloat x1 = G_MAXFLOAT, y1 = G_MAXFLOAT;
+  gfloat x2 = -G_MAXFLOAT, y2 = -G_MAXFLOAT;
+  gfloat scale_x, scale_y;
+  gint margin;
+
+  bounds.x = 0;
+  bounds.y = 0;
+  bounds.width = cogl_framebuffer_get_width (framebuffer);
+  bounds.height = cogl_framebuffer_get_height (framebuffer);
+  scale_x = bounds.width / MAX (clutter_actor_get_width (stage), 1.0f);
+  scale_y = bounds.height / MAX (clutter_actor_get_height (stage), 1.0f);
+
+  // The bounding box of the transformed actor, in framebuffer pixels
+  clutter_actor_get_abs_allocation_vertices (self->actor, verts);
+  for(gint i=0; i<4; i++)
+    {
+      x1 = MIN (x1, verts[i].x * scale_x);
+      y1 = MIN (y1, verts[i].y * scale_y);
+      x2 = MAX (x2, verts[i].x * scale_x);
+      y2 = MAX (y2, verts[i].y * scale_y);
+    }
+  footprint.x = (gint) floorf (x1);
+  footprint.y = (gint) floorf (y1);
+  footprint.width = (gint) ceilf (x2) - footprint.x;
+  footprint.height = (gint) ceilf (y2) - footprint.y;
+  if (!kawase_blur_rect_intersect (&footprint, &bounds, &footprint))
+    return FALSE;
+
+  self->source_downscale = 0;
+  clutter_kawase_blur_effect_apply_quality (self);
+
+  margin = klass->expand_sizes[self->iterations-1];
+  copy->x = footprint.x - margin;
+  copy->y = footprint.y - margin;
+  copy->width = footprint.width + 2 * margin;
+  copy->height = footprint.height + 2 * margin;
+  kawase_blur_rect_intersect (copy, &bounds, copy);
+
+  clutter_stage_get_redraw_clip_bounds (CLUTTER_STAGE (stage), &clip);
+  clip.x = (gint) floorf (clip.x * scale_x);
+  clip.y = (gint) floorf (clip.y * scale_y);
+  clip.width = (gint) ceilf (clip.width * scale_x);
+  clip.height = (gint) ceilf (clip.height * scale_y);
+  kawase_blur_rect_intersect (copy, &clip, &visible);
+
+  if (visible.width != copy->width || visible.height != copy->height)
+    {
+      if (self->backdrop_redraw_id == 0)
+        self->backdrop_redraw_id =
+          g_idle_add (clutter_kawase_blur_effect_backdrop_redraw, self);
+
+      if (self->blur_valid &&
+          memcmp (copy, &self->backdrop_rect, sizeof (*copy)) == 0 &&
+          memcmp (&footprint, &self->backdrop_footprint, sizeof (footprint)) == 0)
+        return TRUE;
+    }
+
+  if (self->backdrop_texture == NULL ||
+      self->backdrop_rect.width != copy->width ||
+      self->backdrop_rect.height != copy->height)
+    {
+      CoglContext *ctx =
+        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+      clutter_kawase_blur_effect_clear_backdrop (self);
+
+      self->backdrop_texture = cogl_texture_2d_new_with_size (ctx,
+                                                              copy->width,
+                                                              copy->height);
+      self->stats.textures_allocated++;
+    }
+
+  if (!clutter_kawase_blur_effect_blit_backdrop (self, framebuffer, copy))
+    {
+      ClutterKawaseBlurTraceSpan readback = clutter_kawase_blur_trace_begin ("backdrop_readback");
+
+      if (self->backdrop_bitmap == NULL)
+        {
+          CoglContext *ctx =
+            clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+          self->backdrop_bitmap = cogl_bitmap_new_with_size (ctx,
+                                                             copy->width,
+                                                             copy->height,
+                                                             COGL_PIXEL_FORMAT_RGBA_8888_PRE);
+        }
+
+      cogl_framebuffer_read_pixels_into_bitmap (framebuffer,
+                                                copy->x, copy->y,
+                                                COGL_READ_PIXELS_COLOR_BUFFER,
+                                                self->backdrop_bitmap);
+      cogl_texture_set_region_from_bitmap (self->backdrop_texture,
+                                           0, 0,
+                                           0, 0,
+                                           copy->width, copy->height,
+                                           self->backdrop_bitmap);
+
+      clutter_kawase_blur_trace_end (readback, 0, copy->width, copy->height, self->strength);
+      self->stats.backdrop_readbacks++;
+    }
+
+  self->backdrop_rect = *copy;
+  self->backdrop_footprint = footprint;
+  self->blur_valid = FALSE;
+
+  // Read from the framebuffer and written into the texture
+  self->stats.backdrop_pixels += (guint64) copy->width * copy->height;
+  self->stats.bytes_moved += 2 * (guint64) copy->width * copy->height * FRAMEBUFFER_BPP;
+
+  return TRUE;
+}
+
+/*
+ * Blur-behind painting: blurs what has been painted behind the actor so
+ * far and draws it over the actor's footprint, before the actor paints
+ * itself on top. Nothing is redirected, so the actor is painted once,
+ * straight onto the stage.
+ */
+static void
+clutter_kawase_blur_effect_paint_behind (ClutterKawaseBlurEffect *self)
+{
+  CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+  ClutterActor *stage = clutter_actor_get_stage (self->actor);
+  cairo_rectangle_int_t copy;
+  ClutterKawaseBlurTraceSpan span;
+  CoglMatrix projection;
+  gint64 start;
+
+  // Only the stage's own framebuffer holds the backdrop in screen space
+  if (stage == NULL || !cogl_is_onscreen (framebuffer))
+    return;
+
+  start = g_get_monotonic_time ();
+  span = clutter_kawase_blur_trace_begin ("copy_backdrop");
+
+  if (!clutter_kawase_blur_effect_copy_backdrop (self, framebuffer, stage, &copy))
+    {
+      clutter_kawase_blur_trace_end (span, -1, 0, 0, self->strength);
+      self->stats.pre_paint_time += g_get_monotonic_time () - start;
+      return;
+    }
+
+  self->tex_width = copy.width;
+  self->tex_height = copy.height;
+
+  /*
+   * The backdrop is only drawn over the footprint, or the clip rectangles,
+   * which are relative to its top left corner. For a scaled or rotated
+   * actor there are none, see update_clip_region, so the whole footprint
+   * is drawn.
+   */
+  self->volume_x = copy.x - self->backdrop_footprint.x;
+  self->volume_y = copy.y - self->backdrop_footprint.y;
+  clutter_kawase_blur_effect_update_clip_region (self);
+  if (self->clip_region == NULL)
+    {
+      cairo_rectangle_int_t footprint = self->backdrop_footprint;
+
+      footprint.x -= copy.x;
+      footprint.y -= copy.y;
+      self->clip_region = cairo_region_create_rectangle (&footprint);
+    }
+
+  clutter_kawase_blur_trace_end (span, 0, self->tex_width, self->tex_height, self->strength);
+  self->stats.pre_paint_time += g_get_monotonic_time () - start;
+
+  // paint_target draws in pixels of the texture, which starts at the copy
+  cogl_framebuffer_get_projection_matrix (framebuffer, &projection);
+  cogl_framebuffer_push_matrix (framebuffer);
+  cogl_framebuffer_orthographic (framebuffer,
+                                 0, 0,
+                                 cogl_framebuffer_get_width (framebuffer),
+                                 cogl_framebuffer_get_height (framebuffer),
+                                 -1, 1);
+  cogl_framebuffer_identity_matrix (framebuffer);
+  cogl_framebuffer_translate (framebuffer, copy.x, copy.y, 0);
+
+  self->painting_behind = TRUE;
+  clutter_kawase_blur_effect_paint_target (CLUTTER_OFFSCREEN_EFFECT (self));
+  self->painting_behind = FALSE;
+
+  cogl_framebuffer_pop_matrix (framebuffer);
+  cogl_framebuffer_set_projection_matrix (framebuffer, &projection);
+}
+
+/*
+ * In blur-behind mode the offscreen redirection of the parent, including
+ * its reuse of the actor's last image, is bypassed altogether.
+ */
+static void
+clutter_kawase_blur_effect_paint (ClutterEffect           *effect,
+                                  ClutterEffectPaintFlags  flags)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
+  ClutterEffectClass *parent_class =
+    CLUTTER_EFFECT_CLASS (clutter_kawase_blur_effect_parent_class);
+
+  if (!self->blur_behind)
+    {
+      parent_class->paint (effect, flags);
+      return;
+    }
+
+  self->actor = clutter_actor_meta_get_actor (CLUTTER_ACTOR_META (effect));
+  if (self->actor == NULL)
+    return;
+
+  if (clutter_actor_meta_get_enabled (CLUTTER_ACTOR_META (effect)))
+    {
+      clutter_kawase_blur_effect_check_glsl (self);
+      clutter_kawase_blur_effect_paint_behind (self);
+    }
+
+  clutter_actor_continue_paint (self->actor);
+}
+
+/*
+ * Maps a continuous strength onto the table built in class_init. Between
+ * two steps of the same iteration band the offset is interpolated linearly.
+ * Between two bands the iteration count switches as soon as the strength
+ * leaves the lower step, and the offset starts from the min_offset of the
+ * new band, so the amount of blur still grows continuously.
+ */
+static void
+clutter_kawase_blur_effect_class_get_parameters (ClutterKawaseBlurEffectClass *klass,
+                                                 gfloat                        strength,
+                                                 gint                         *iterations,
+                                                 gfloat                       *offset)
+{
+  gint lower, upper;
+  gfloat t;
+
+  strength = CLAMP (strength, 0.0f, BLUR_STEPS - 1);
+  lower = (gint) floorf (strength);
+  upper = MIN (lower + 1, BLUR_STEPS - 1);
+  t = strength - lower;
+
+  if (t == 0.0f || lower == upper)
+    {
+      *iterations = klass->iterations[lower];
+      *offset = klass->offsets[lower];
+    }
+  else if (klass->iterations[lower] == klass->iterations[upper])
+    {
+      *iterations = klass->iterations[lower];
+      *offset = klass->offsets[lower] + (klass->offsets[upper] - klass->offsets[lower]) * t;
+    }
+  else
+    {
+      *iterations = klass->iterations[upper];
+      *offset = klass->min_offsets[upper] + (klass->offsets[upper] - klass->min_offsets[upper]) * t;
+    }
+}
+
+/**
+ * clutter_kawase_blur_effect_update_blur_strength:
+ * @self: a #ClutterKawaseBlurEffect
+ * @strength: the blur strength, between 0 and 14
+ *
+ * Sets the strength of the blur. Values outside of the supported range
+ * are clamped. See also #ClutterKawaseBlurEffect:strength, which allows
+ * values in between the steps.
+ */
+void
+clutter_kawase_blur_effect_update_blur_strength(ClutterKawaseBlurEffect *self, gint strength) 
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  clutter_kawase_blur_effect_set_strength (self, (gfloat) strength);
+}
+
+/**
+ * clutter_kawase_blur_effect_set_strength:
+ * @self: a #ClutterKawaseBlurEffect
+ * @strength: the blur strength, between 0.0 and 14.0
+ *
+ * Sets the strength of the blur. Values outside of the supported range
+ * are clamped.
+ *
+ * Changing the strength only updates the uniforms of the passes: the
+ * pyramid is kept as long as the size of the actor doesn't change, so
+ * animating the strength costs no more per frame than a static blur.
+ */
+void
+clutter_kawase_blur_effect_set_strength (ClutterKawaseBlurEffect *self,
+                                         gfloat                   strength)
+{
+  ClutterKawaseBlurEffectClass *klass;
+  gboolean iterations_changed;
+
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  strength = CLAMP (strength, 0.0f, BLUR_STEPS - 1);
+  if (self->strength == strength)
+    return;
+
+  klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+
+  self->strength = strength;
+  clutter_kawase_blur_effect_class_get_parameters (klass, strength,
+                                                   &self->strength_iterations,
+                                                   &self->offset);
+  iterations_changed = clutter_kawase_blur_effect_apply_quality (self);
+
+  clutter_kawase_blur_effect_invalidate (self);
+  if (iterations_changed)
+    clutter_kawase_blur_effect_iterations_changed (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_STRENGTH]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_strength:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the strength of the blur.
+ *
+ * Return value: the blur strength
+ */
+gfloat
+clutter_kawase_blur_effect_get_strength (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0.0f);
+
+  return self->strength;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_offscreen_downscale:
+ * @self: a #ClutterKawaseBlurEffect
+ * @downscale: how often to halve the size of the actor's offscreen image,
+ *   0, 1 or 2
+ *
+ * Renders the actor into an offscreen texture of half (1) or a quarter (2)
+ * of its size, instead of rendering it at full resolution and halving it
+ * right away in the first downsample passes. The texture then takes the
+ * place of the pyramid level of the same size, which saves the fill rate
+ * and the memory of the full resolution image and of the skipped passes.
+ *
+ * The actor's content is sampled more coarsely, so this is only worth it
+ * for strong blurs, which would hide the difference anyway. The blur runs
+ * at least as many iterations as levels were skipped, so weak strengths
+ * blur somewhat more than without downscaling. The software fallback
+ * always renders at full resolution.
+ */
+void
+clutter_kawase_blur_effect_set_offscreen_downscale (ClutterKawaseBlurEffect *self,
+                                                    gint                     downscale)
+{
+  ClutterActorMeta *meta;
+  ClutterActor *actor;
+
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (downscale >= 0 && downscale <= MAX_OFFSCREEN_DOWNSCALE);
+
+  if (self->downscale == downscale)
+    return;
+
+  self->downscale = downscale;
+  self->chain_complete = FALSE;
+
+  /*
+   * ClutterOffscreenEffect only creates a new texture when the size of the
+   * actor changes, but it drops its framebuffer whenever the actor is set,
+   * so setting the same actor again makes it call create_texture.
+   */
+  meta = CLUTTER_ACTOR_META (self);
+  actor = clutter_actor_meta_get_actor (meta);
+  if (actor != NULL)
+    {
+      CLUTTER_ACTOR_META_CLASS (clutter_kawase_blur_effect_parent_class)->set_actor (meta, actor);
+      clutter_actor_queue_redraw (actor);
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_OFFSCREEN_DOWNSCALE]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_offscreen_downscale:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves how often the actor's offscreen image is halved.
+ *
+ * Return value: the downscale, 0, 1 or 2
+ */
+gint
+clutter_kawase_blur_effect_get_offscreen_downscale (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return self->downscale;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_adaptive_quality:
+ * @self: a #ClutterKawaseBlurEffect
+ * @adaptive: whether to adapt the quality to the frame budget
+ *
+ * Sets whether the effect trades blur quality for time. Every few frames
+ * that recompute the blur, the effect measures what the chain costs on the
+ * GPU, and lowers its quality while the cost is above
+ * #ClutterKawaseBlurEffect:frame-budget: first the levels are rendered at
+ * half their size, which keeps the amount of blur but makes it blockier,
+ * then iterations are dropped, which makes the blur weaker. The quality
+ * goes back up, one step at a time, when there is plenty of headroom, or
+ * at once when the content stops changing.
+ *
+ * The cost is measured with GPU timer queries, read back a few frames
+ * later. Drivers without GL_ARB_timer_query wait for the GPU in the
+ * sampled frames instead.
+ *
+ * The current quality is available through
+ * #ClutterKawaseBlurEffect:effective-quality. The software fallback
+ * always runs at full quality.
+ */
+void
+clutter_kawase_blur_effect_set_adaptive_quality (ClutterKawaseBlurEffect *self,
+                                                 gboolean                 adaptive)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  adaptive = !!adaptive;
+  if (self->adaptive_quality == adaptive)
+    return;
+
+  self->adaptive_quality = adaptive;
+  self->average_cost = -1.0;
+  self->headroom_samples = 0;
+  // The first frames allocate the pyramid and compile shaders, don't sample them
+  self->sample_countdown = GOVERNOR_SAMPLE_INTERVAL;
+
+  if (!adaptive)
+    {
+      if (self->idle_timeout_id != 0)
+        {
+          g_source_remove (self->idle_timeout_id);
+          self->idle_timeout_id = 0;
+        }
+
+      if (self->quality != QUALITY_FULL)
+        {
+          clutter_kawase_blur_effect_set_quality (self, QUALITY_FULL);
+          clutter_kawase_blur_effect_invalidate (self);
+          clutter_kawase_blur_effect_iterations_changed (self);
+        }
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_ADAPTIVE_QUALITY]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_adaptive_quality:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves whether the effect adapts its quality to the frame budget.
+ *
+ * Return value: %TRUE if the adaptive quality is enabled
+ */
+gboolean
+clutter_kawase_blur_effect_get_adaptive_quality (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), FALSE);
+
+  return self->adaptive_quality;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_frame_budget:
+ * @self: a #ClutterKawaseBlurEffect
+ * @budget: the time the blur may take per frame, in milliseconds
+ *
+ * Sets how much GPU time recomputing the blur may take per frame when the
+ * adaptive quality is enabled. The budget covers the down- and upsample
+ * passes and the final draw, not the rendering of the actor itself.
+ */
+void
+clutter_kawase_blur_effect_set_frame_budget (ClutterKawaseBlurEffect *self,
+                                             gfloat                   budget)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (budget > 0.0f);
+
+  if (self->frame_budget == budget)
+    return;
+
+  self->frame_budget = budget;
+  self->headroom_samples = 0;
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_FRAME_BUDGET]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_frame_budget:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the frame budget of the adaptive quality.
+ *
+ * Return value: the budget, in milliseconds
+ */
+gfloat
+clutter_kawase_blur_effect_get_frame_budget (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0.0f);
+
+  return self->frame_budget;
+}
+
+/**
+ * clutter_kawase_blur_effect_get_effective_quality:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the quality the effect currently blurs with. The full quality
+ * is 5; at 4 the levels are rendered at half their size, and every step
+ * below drops one more iteration, down to a single one.
+ *
+ * Return value: the effective quality, between 0 and 5
+ */
+gint
+clutter_kawase_blur_effect_get_effective_quality (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), QUALITY_FULL);
+
+  return self->quality;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_shared_pyramid:
+ * @self: a #ClutterKawaseBlurEffect
+ * @shared: whether to borrow the intermediate textures from the shared pool
+ *
+ * Sets whether the effect keeps its own texture pyramid or borrows the
+ * intermediate textures from a pool shared by all the effects while it
+ * paints. Sharing keeps the memory of many blurred actors of the same size
+ * close to that of a single one, but the blur has to be recomputed on every
+ * paint since the cached result is given back to the pool.
+ */
+void
+clutter_kawase_blur_effect_set_shared_pyramid (ClutterKawaseBlurEffect *self,
+                                               gboolean                 shared)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  shared = !!shared;
+  if (self->shared_pyramid == shared)
+    return;
+
+  // Own levels are freed, borrowed ones are only held while painting
+  clutter_kawase_blur_effect_clear_pyramid (self);
+  self->shared_pyramid = shared;
+
+  clutter_kawase_blur_effect_invalidate (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_SHARED_PYRAMID]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_shared_pyramid:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves whether the effect uses the shared texture pool.
+ *
+ * Return value: %TRUE if the intermediate textures are shared
+ */
+gboolean
+clutter_kawase_blur_effect_get_shared_pyramid (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), FALSE);
+
+  return self->shared_pyramid;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_specialized_shaders:
+ * @self: a #ClutterKawaseBlurEffect
+ * @specialized: whether to use the specialized shaders
+ *
+ * Sets whether the effect uses shaders generated for its strength. They
+ * have the sampling offset baked in and take half as many texture lookups
+ * in the upsample passes by letting the bilinear filter merge pairs of
+ * taps, which slightly changes the result. They only exist for the integer
+ * strengths; in between them, e.g. while the strength is animated, the
+ * regular shaders are used.
+ */
+void
+clutter_kawase_blur_effect_set_specialized_shaders (ClutterKawaseBlurEffect *self,
+                                                    gboolean                 specialized)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  specialized = !!specialized;
+  if (self->specialized_shaders == specialized)
+    return;
+
+  self->specialized_shaders = specialized;
+
+  clutter_kawase_blur_effect_invalidate (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_SPECIALIZED_SHADERS]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_specialized_shaders:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves whether the effect uses the specialized shaders.
+ *
+ * Return value: %TRUE if the specialized shaders are used
+ */
+gboolean
+clutter_kawase_blur_effect_get_specialized_shaders (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), FALSE);
+
+  return self->specialized_shaders;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_downsample_source:
+ * @self: a #ClutterKawaseBlurEffect
+ * @source: (allow-none): the effect to take the downsample levels from,
+ *   or %NULL
+ *
+ * Makes the effect reuse the downsample chain of @source, for overlays
+ * that blur the same content at different strengths. @source then
+ * downsamples as deep as the strongest of its consumers needs, and every
+ * consumer only runs its own upsample passes, with its own offset, on top
+ * of those levels. The downsample passes use the offset of @source.
+ *
+ * Both effects have to blur content of the same size. Whenever @source
+ * renders its levels again, its consumers are repainted. A consumer whose
+ * actor is redrawn before @source in the same frame can't use the levels
+ * yet and runs its own downsample chain for that frame, so paint @source
+ * first. A source can't have a source itself.
+ */
+void
+clutter_kawase_blur_effect_set_downsample_source (ClutterKawaseBlurEffect *self,
+                                                  ClutterKawaseBlurEffect *source)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (source == NULL || CLUTTER_IS_KAWASE_BLUR_EFFECT (source));
+  g_return_if_fail (source != self);
+  g_return_if_fail (source == NULL || source->downsample_source == NULL);
+  g_return_if_fail (source == NULL ||
+                    self->downsample_consumers == NULL ||
+                    self->downsample_consumers->len == 0);
+
+  if (self->downsample_source == source)
+    return;
+
+  if (self->downsample_source != NULL)
+    {
+      if (self->downsample_source->downsample_consumers != NULL)
+        g_ptr_array_remove (self->downsample_source->downsample_consumers, self);
+      g_clear_object (&self->downsample_source);
+    }
+
+  if (source != NULL)
+    {
+      self->downsample_source = g_object_ref (source);
+
+      if (source->downsample_consumers == NULL)
+        source->downsample_consumers = g_ptr_array_new ();
+      g_ptr_array_add (source->downsample_consumers, self);
+
+      // The source may have to go deeper now
+      clutter_kawase_blur_effect_invalidate (source);
+    }
+
+  self->chain_uses_source = FALSE;
+  clutter_kawase_blur_effect_invalidate (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_DOWNSAMPLE_SOURCE]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_downsample_source:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the effect whose downsample chain this effect reuses.
+ *
+ * Return value: (transfer none): the downsample source, or %NULL
+ */
+ClutterKawaseBlurEffect *
+clutter_kawase_blur_effect_get_downsample_source (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), NULL);
+
+  return self->downsample_source;
+}
+
+/**
+ * clutter_kawase_blur_effect_class_set_pool_limit:
+ * @max_bytes: the memory cap of the pool, in bytes
+ *
+ * Sets how much video memory the texture pool shared by all the effects
+ * may keep. Idle textures are evicted in least recently used order when
+ * the pool grows beyond this limit; textures that are in use are never
+ * evicted. The default is 64 MiB.
+ */
+void
+clutter_kawase_blur_effect_class_set_pool_limit (guint64 max_bytes)
+{
+  ClutterKawaseBlurEffectClass *klass;
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+  klass->texture_pool.limit = max_bytes;
+  kawase_blur_pool_trim (&klass->texture_pool, max_bytes);
+  g_type_class_unref (klass);
+}
+
+/**
+ * clutter_kawase_blur_effect_class_trim_pool:
+ *
+ * Frees all the idle textures of the shared pool and resets its peak
+ * memory usage to the memory still in use.
+ */
+void
+clutter_kawase_blur_effect_class_trim_pool (void)
+{
+  ClutterKawaseBlurEffectClass *klass;
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+  kawase_blur_pool_trim (&klass->texture_pool, 0);
+  klass->texture_pool.peak_bytes = klass->texture_pool.bytes;
+  g_type_class_unref (klass);
+}
+
+/**
+ * clutter_kawase_blur_effect_class_trim_memory:
+ *
+ * Frees the intermediate textures of all the effects and the idle textures
+ * of the shared pool, e.g. when the system runs low on memory. Visible
+ * effects allocate their textures again and rerun the whole chain on
+ * their next paint. Must not be called while the stage is painting.
+ *
+ * Return value: the number of bytes freed
+ */
+guint64
+clutter_kawase_blur_effect_class_trim_memory (void)
+{
+  ClutterKawaseBlurEffectClass *klass;
+  guint64 pool_bytes;
+  guint64 bytes = 0;
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+
+  for(GList *l=klass->instances; l!=NULL; l=l->next)
+    bytes += clutter_kawase_blur_effect_drop_levels (l->data);
+
+  pool_bytes = klass->texture_pool.bytes;
+  kawase_blur_pool_trim (&klass->texture_pool, 0);
+  bytes += pool_bytes - klass->texture_pool.bytes;
+
+  g_type_class_unref (klass);
+
+  return bytes;
+}
+
+/**
+ * clutter_kawase_blur_effect_class_get_pool_stats:
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Retrieves the state of the texture pool shared by all the effects.
+ */
+void
+clutter_kawase_blur_effect_class_get_pool_stats (ClutterKawaseBlurPoolStats *stats)
+{
+  ClutterKawaseBlurEffectClass *klass;
+  KawaseBlurTexturePool *pool;
+
+  g_return_if_fail (stats != NULL);
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+  pool = &klass->texture_pool;
+
+  stats->bytes = pool->bytes;
+  stats->peak_bytes = pool->peak_bytes;
+  stats->limit = pool->limit;
+  stats->idle_textures = g_queue_get_length (&pool->idle);
+  stats->textures_allocated = pool->textures_allocated;
+  stats->borrows = pool->borrows;
+  stats->evictions = pool->evictions;
+
+  g_type_class_unref (klass);
+}
+
+/**
+ * clutter_kawase_blur_effect_class_start_trace:
+ *
+ * Starts recording a timeline of all blur effects: pre_paint, every down-
+ * and upsample pass, the allocation of textures and framebuffers, the
+ * final composite and, for the software fallback, the work of every CPU
+ * thread. The passes and the composite are also timed on the GPU when the
+ * driver supports timer queries. Each span records the pyramid level, the
+ * size it worked on and the blur strength.
+ *
+ * Recording costs little, every thread writes into a ring buffer of its
+ * own that keeps its last 16384 spans. To timestamp the GPU work, Cogl's
+ * batches are flushed around each pass, which makes traced frames a bit
+ * slower. Setting the CLUTTER_KAWASE_BLUR_TRACE environment variable to a
+ * file name traces the whole run and writes the file on exit.
+ */
+void
+clutter_kawase_blur_effect_class_start_trace (void)
+{
+  clutter_kawase_blur_trace_start ();
+}
+
+/**
+ * clutter_kawase_blur_effect_class_stop_trace:
+ * @filename: (allow-none): the file to write the trace to, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Stops recording and writes the spans recorded since
+ * clutter_kawase_blur_effect_class_start_trace() to @filename, as Chrome
+ * trace-event JSON that chrome://tracing and Perfetto can open. GPU times
+ * are shown on a track of their own. Waits for the GPU to finish the
+ * traced work, so call it outside of a paint, from the thread Clutter
+ * paints with.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+clutter_kawase_blur_effect_class_stop_trace (const gchar  *filename,
+                                             GError      **error)
+{
+  clutter_kawase_blur_trace_stop ();
+  kawase_blur_gpu_resolve_spans (TRUE);
+
+  if (filename == NULL)
+    return TRUE;
+
+  return clutter_kawase_blur_trace_write (filename, error);
+}
+
+/**
+ * clutter_kawase_blur_effect_set_clip_rects:
+ * @self: a #ClutterKawaseBlurEffect
+ * @rects: (array length=n_rects) (allow-none): the rectangles to blur, in
+ *   actor coordinates
+ * @n_rects: the number of rectangles in @rects
+ *
+ * Limits the blur to the given rectangles, e.g. the parts of a background
+ * that are visible through translucent panels. Only what is needed for
+ * these rectangles is rendered on every level of the chain, so the cost
+ * scales with the visible area instead of the size of the actor. Pass
+ * %NULL to blur the whole actor again.
+ *
+ * The rectangles are in actor coordinates. While the actor or one of its
+ * ancestors is scaled or rotated they only limit what is rendered
+ * offscreen, the chain then blurs all of it.
+ */
+void
+clutter_kawase_blur_effect_set_clip_rects (ClutterKawaseBlurEffect     *self,
+                                           const cairo_rectangle_int_t *rects,
+                                           gint                         n_rects)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (n_rects >= 0);
+  g_return_if_fail (n_rects == 0 || rects != NULL);
+
+  g_clear_pointer (&self->clip_rects, g_array_unref);
+
+  if (n_rects > 0)
+    {
+      self->clip_rects = g_array_sized_new (FALSE, FALSE,
+                                            sizeof (cairo_rectangle_int_t),
+                                            n_rects);
+      g_array_append_vals (self->clip_rects, rects, n_rects);
+    }
+
+  self->blur_valid = FALSE;
+  clutter_kawase_blur_effect_queue_actor_redraw (self);
+}
+
+/**
+ * clutter_kawase_blur_effect_set_isolate_rects:
+ * @self: a #ClutterKawaseBlurEffect
+ * @isolate: whether to blur every clip rectangle on its own
+ *
+ * Sets whether the clip rectangles are blurred separately, as if each of
+ * them was an actor with an effect of its own. This blurs many surfaces,
+ * e.g. the windows or panels of a shell, with a single effect on their
+ * common parent: its offscreen texture holds all of them and every pass
+ * of the chain draws the rectangles with one draw call, so the number of
+ * draw calls doesn't grow with the number of surfaces. The taps of every
+ * rectangle are clamped to it, so its edges are blurred as if the image
+ * continued with its border, and neither the content between the
+ * rectangles nor the other rectangles bleed in.
+ *
+ * The deeper levels are coarse, rectangles that are less than a texel of
+ * the deepest level apart (32 pixels at the highest strengths) may still
+ * share a texel at their edges. The rectangles are only isolated by the
+ * dual Kawase engine on the GPU and while the effect isn't the downsample
+ * source of other effects, otherwise they are blurred together as
+ * described in clutter_kawase_blur_effect_set_clip_rects(). The
+ * specialized shaders aren't used for isolated rectangles.
+ */
+void
+clutter_kawase_blur_effect_set_isolate_rects (ClutterKawaseBlurEffect *self,
+                                              gboolean                 isolate)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  isolate = !!isolate;
+  if (self->isolate_rects == isolate)
+    return;
+
+  self->isolate_rects = isolate;
+  self->blur_valid = FALSE;
+  clutter_kawase_blur_effect_queue_actor_redraw (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_ISOLATE_RECTS]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_isolate_rects:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves whether the clip rectangles are blurred separately.
+ *
+ * Return value: %TRUE if every clip rectangle is blurred on its own
+ */
+gboolean
+clutter_kawase_blur_effect_get_isolate_rects (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), FALSE);
+
+  return self->isolate_rects;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_blur_behind:
+ * @self: a #ClutterKawaseBlurEffect
+ * @behind: whether to blur what is behind the actor
+ *
+ * Sets whether the effect blurs the backdrop of its actor, e.g. of a
+ * translucent panel, instead of the actor itself. The actor is then
+ * painted straight onto the stage, without being rendered into an
+ * offscreen texture first. Right before that, the part of the stage
+ * behind the actor, grown by the reach of the blur, is copied from the
+ * framebuffer, blurred and drawn over the actor's bounding box, or over
+ * the clip rectangles if there are any.
+ *
+ * The backdrop is only available when the actor is painted onto the
+ * stage itself; inside of another offscreen effect, e.g. the blur of a
+ * parent, the actor is painted without it. When Clutter only redraws a
+ * part of the stage that doesn't cover the whole backdrop, the previous
+ * blur is reused for that frame and the rest is redrawn in the next one.
+ *
+ * The copy is blitted on the GPU. Drivers that can't blit from the
+ * stage's framebuffer read it back into system memory instead, which
+ * waits for the GPU, see
+ * #ClutterKawaseBlurEffectStats.backdrop_readbacks.
+ */
+void
+clutter_kawase_blur_effect_set_blur_behind (ClutterKawaseBlurEffect *self,
+                                            gboolean                 behind)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  behind = !!behind;
+  if (self->blur_behind == behind)
+    return;
+
+  self->blur_behind = behind;
+  self->blur_valid = FALSE;
+  self->chain_complete = FALSE;
+
+  if (!behind)
+    clutter_kawase_blur_effect_clear_backdrop (self);
+  clutter_kawase_blur_effect_queue_actor_redraw (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_BLUR_BEHIND]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_blur_behind:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves whether the effect blurs what is behind the actor.
+ *
+ * Return value: %TRUE if the backdrop of the actor is blurred
+ */
+gboolean
+clutter_kawase_blur_effect_get_blur_behind (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), FALSE);
+
+  return self->blur_behind;
+}
+
+/**
+ * clutter_kawase_blur_effect_add_damage:
+ * @self: a #ClutterKawaseBlurEffect
+ * @rects: (array length=n_rects): the rectangles that changed
+ * @n_rects: the number of rectangles
+ *
+ * Tells the effect that only the given rectangles of the actor change
+ * with its next redraw, e.g. a clock or a cursor on top of an otherwise
+ * static background. Instead of running the whole chain, the effect then
+ * renders only the parts of every level the change reaches, which grow
+ * with every pass by the footprint of the blur kernel. Damage adds up
+ * until the actor is redrawn; a redraw without reported damage still
+ * recomputes everything.
+ *
+ * When the damaged area exceeds #ClutterKawaseBlurEffect:damage-threshold,
+ * or the pyramid of the previous frame can't be reused, e.g. because the
+ * strength changed or clip rectangles are set, the whole chain is run.
+ *
+ * The rectangles are expected to be in the coordinate space of an actor
+ * that isn't scaled or rotated. The caller still has to queue a redraw of
+ * the actor, which Clutter does by itself for changes of its children.
+ */
+void
+clutter_kawase_blur_effect_add_damage (ClutterKawaseBlurEffect     *self,
+                                       const cairo_rectangle_int_t *rects,
+                                       gint                         n_rects)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (n_rects >= 0);
+  g_return_if_fail (n_rects == 0 || rects != NULL);
+
+  if (self->damage == NULL)
+    self->damage = cairo_region_create ();
+
+  for(gint i=0; i<n_rects; i++)
+    cairo_region_union_rectangle (self->damage, &rects[i]);
+}
+
+/**
+ * clutter_kawase_blur_effect_set_damage_threshold:
+ * @self: a #ClutterKawaseBlurEffect
+ * @threshold: a fraction of the actor's area, between 0 and 1
+ *
+ * Sets up to which part of the actor's area reported damage is updated
+ * incrementally, see clutter_kawase_blur_effect_add_damage(). Larger
+ * damage recomputes the whole chain, which is cheaper than many separate
+ * rectangles that cover most of the levels anyway.
+ */
+void
+clutter_kawase_blur_effect_set_damage_threshold (ClutterKawaseBlurEffect *self,
+                                                 gfloat                   threshold)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (threshold >= 0.0f && threshold <= 1.0f);
+
+  if (self->damage_threshold == threshold)
+    return;
+
+  self->damage_threshold = threshold;
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_DAMAGE_THRESHOLD]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_damage_threshold:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves up to which part of the actor's area damage is updated
+ * incrementally.
+ *
+ * Return value: the threshold, between 0 and 1
+ */
+gfloat
+clutter_kawase_blur_effect_get_damage_threshold (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0.0f);
+
+  return self->damage_threshold;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_intermediate_format:
+ * @self: a #ClutterKawaseBlurEffect
+ * @format: the storage format of the pyramid levels
+ *
+ * Sets the format of the intermediate textures. The blur ignores the alpha
+ * channel, so dropping it costs nothing, and every byte saved per texel is
+ * saved on each read and write of the chain. RGB565 halves the traffic of
+ * RGBA8888 at the price of visible banding in smooth gradients, which
+ * %CLUTTER_KAWASE_BLUR_FORMAT_AUTO avoids by only using it for the
+ * downsample levels.
+ *
+ * Formats the driver can't render into fall back to RGBA8888, with a
+ * warning. The pyramid is reallocated on the next paint.
+ */
+void
+clutter_kawase_blur_effect_set_intermediate_format (ClutterKawaseBlurEffect *self,
+                                                    ClutterKawaseBlurFormat  format)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (format >= CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888 &&
+                    format <= CLUTTER_KAWASE_BLUR_FORMAT_AUTO);
+
+  if (self->intermediate_format == format)
+    return;
+
+  self->intermediate_format = format;
+
+  // A shared pyramid is only held during paint_target
+  if (!self->shared_pyramid)
+    clutter_kawase_blur_effect_clear_pyramid (self);
+
+  self->blur_valid = FALSE;
+  clutter_effect_queue_repaint (CLUTTER_EFFECT (self));
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_INTERMEDIATE_FORMAT]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_intermediate_format:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the format of the intermediate textures.
+ *
+ * Return value: the format
+ */
+ClutterKawaseBlurFormat
+clutter_kawase_blur_effect_get_intermediate_format (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self),
+                        CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888);
+
+  return self->intermediate_format;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_mode:
+ * @self: a #ClutterKawaseBlurEffect
+ * @mode: the blur algorithm
+ *
+ * Selects the blur algorithm. %CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN blurs
+ * about as far as the dual Kawase chain at every strength, with a true
+ * Gaussian falloff, and is meant for comparing the two, especially at the
+ * strong end. The shared pyramid, the downsample source, the adaptive
+ * quality, the intermediate format and partial updates of damaged or
+ * clipped levels only apply to the dual Kawase chain, which is also what
+ * the software fallback runs.
+ */
+void
+clutter_kawase_blur_effect_set_mode (ClutterKawaseBlurEffect *self,
+                                     ClutterKawaseBlurMode    mode)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (mode >= CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE &&
+                    mode <= CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN);
+
+  if (self->mode == mode)
+    return;
+
+  // The textures of the old engine aren't needed anymore
+  kawase_blur_engines[self->mode]->clear (self);
+  self->mode = mode;
+  self->chain_uses_source = FALSE;
+
+  self->blur_valid = FALSE;
+  clutter_effect_queue_repaint (CLUTTER_EFFECT (self));
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_MODE]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_mode:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the blur algorithm.
+ *
+ * Return value: the mode
+ */
+ClutterKawaseBlurMode
+clutter_kawase_blur_effect_get_mode (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self),
+                        CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE);
+
+  return self->mode;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_trim_timeout:
+ * @self: a #ClutterKawaseBlurEffect
+ * @timeout: the idle time in milliseconds, or 0 to keep the levels
+ *
+ * Sets how long after its actor was unmapped, e.g. hidden, or the effect
+ * was disabled the effect frees its intermediate textures. They are kept
+ * while the actor is mapped, also when it is covered by other actors. The
+ * next paint allocates them again and runs the whole chain. The actor's own offscreen texture belongs to
+ * #ClutterOffscreenEffect and is kept. By default the levels are kept for
+ * the lifetime of the effect.
+ */
+void
+clutter_kawase_blur_effect_set_trim_timeout (ClutterKawaseBlurEffect *self,
+                                             guint                    timeout)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  if (self->trim_timeout == timeout)
+    return;
+
+  self->trim_timeout = timeout;
+
+  // Restarts the timer with the new timeout if the effect is inactive already
+  clutter_kawase_blur_effect_update_trim_timeout (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), obj_props[PROP_TRIM_TIMEOUT]);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_trim_timeout:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves after how many milliseconds of its actor being unmapped or the
+ * effect being disabled the effect frees its intermediate textures.
+ *
+ * Return value: the timeout, 0 if the textures are kept
+ */
+guint
+clutter_kawase_blur_effect_get_trim_timeout (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return self->trim_timeout;
+}
+
+/**
+ * clutter_kawase_blur_effect_trim:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Frees the intermediate textures of the effect right away, regardless of
+ * the trim timeout. They are allocated again by the next paint. Must not
+ * be called while the stage is painting.
+ *
+ * Return value: the number of bytes freed
+ */
+guint64
+clutter_kawase_blur_effect_trim (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return clutter_kawase_blur_effect_drop_levels (self);
+}
+
+/**
+ * clutter_kawase_blur_effect_get_strength_parameters:
+ * @strength: the blur strength, between 0 and 14
+ * @iterations: (out) (allow-none): return location for the number of
+ *   downsample iterations
+ * @offset: (out) (allow-none): return location for the sampling offset
+ *
+ * Retrieves the parameters the effect uses for the given blur strength.
+ * Values outside of the supported range are clamped.
+ */
+void
+clutter_kawase_blur_effect_get_strength_parameters (gint    strength,
+                                                    gint   *iterations,
+                                                    gfloat *offset)
+{
+  ClutterKawaseBlurEffectClass *klass;
+
+  gint class_iterations;
+  gfloat class_offset;
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+  clutter_kawase_blur_effect_class_get_parameters (klass, (gfloat) strength,
+                                                   &class_iterations,
+                                                   &class_offset);
+  g_type_class_unref (klass);
+
+  if (iterations != NULL)
+    *iterations = class_iterations;
+  if (offset != NULL)
+    *offset = class_offset;
+}
+
+/**
+ * clutter_kawase_blur_effect_set_cpu_threads:
+ * @self: a #ClutterKawaseBlurEffect
+ * @n_threads: the number of threads, or 0 for one per processor
+ *
+ * Sets the number of threads the software fallback distributes the blur
+ * over. It has no effect when the blur runs on the GPU.
+ */
+void
+clutter_kawase_blur_effect_set_cpu_threads (ClutterKawaseBlurEffect *self,
+                                            gint                     n_threads)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (n_threads >= 0);
+
+  self->cpu_threads = n_threads;
+  if (self->cpu != NULL)
+    clutter_kawase_blur_cpu_set_n_threads (self->cpu, n_threads);
+}
+
+/**
+ * clutter_kawase_blur_effect_invalidate:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Drops the cached blur result, forcing the whole down- and upsample
+ * chain to run on the next paint. The effect takes care of this by itself
+ * whenever the actor is redrawn or the blur strength changes; this is only
+ * needed when the content changes behind the effect's back.
+ */
+void
+clutter_kawase_blur_effect_invalidate (ClutterKawaseBlurEffect *self)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  self->blur_valid = FALSE;
+  self->chain_complete = FALSE;
+
+  // Only the blur needs to be redone, the actor's offscreen image is still valid
+  clutter_effect_queue_repaint (CLUTTER_EFFECT (self));
+}
+
+/*
+ * Size of the pyramid in video memory, computed from the levels that are
+ * actually allocated. The copy of the backdrop counts as well, it is
+ * freed along with the levels.
+ */
+static guint64
+clutter_kawase_blur_effect_get_pyramid_bytes (ClutterKawaseBlurEffect *self)
+{
+  guint64 bytes = 0;
+
+  for(int i=0; i<2*DOWNSAMPLE_STEPS-1; i++)
+    {
+      if (self->offscreen_textures[i] != NULL)
+        bytes += (guint64) cogl_texture_get_width (self->offscreen_textures[i])
+               * cogl_texture_get_height (self->offscreen_textures[i])
+               * kawase_blur_format_get_bpp (self->level_formats[i]);
+    }
+
+  for(int i=0; i<GAUSSIAN_MAX_LEVEL+2; i++)
+    {
+      if (self->gaussian_textures[i] != NULL)
+        bytes += (guint64) cogl_texture_get_width (self->gaussian_textures[i])
+               * cogl_texture_get_height (self->gaussian_textures[i])
+               * FRAMEBUFFER_BPP;
+    }
+
+  if (self->cpu_texture != NULL)
+    bytes += (guint64) self->cpu_width * self->cpu_height * 4;
+
+  if (self->backdrop_texture != NULL)
+    bytes += (guint64) self->backdrop_rect.width * self->backdrop_rect.height * FRAMEBUFFER_BPP;
+
+  return bytes;
+}
+
+/*
+ * Size of the texture the actor is rendered into, if it exists.
+ */
+static guint64
+clutter_kawase_blur_effect_get_offscreen_bytes (ClutterKawaseBlurEffect *self)
+{
+  CoglHandle texture =
+    clutter_offscreen_effect_get_texture (CLUTTER_OFFSCREEN_EFFECT (self));
+
+  if (texture == NULL)
+    return 0;
+
+  return (guint64) cogl_texture_get_width (texture)
+       * cogl_texture_get_height (texture)
+       * 4;
+}
+
+/**
+ * clutter_kawase_blur_effect_get_stats:
+ * @self: a #ClutterKawaseBlurEffect
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Retrieves the runtime statistics of the effect. The counters accumulate
+ * from the creation of the effect or the last call to
+ * clutter_kawase_blur_effect_reset_stats(), the pyramid size reflects the
+ * current state.
+ */
+void
+clutter_kawase_blur_effect_get_stats (ClutterKawaseBlurEffect      *self,
+                                      ClutterKawaseBlurEffectStats *stats)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+  g_return_if_fail (stats != NULL);
+
+  *stats = self->stats;
+  stats->pyramid_bytes = clutter_kawase_blur_effect_get_pyramid_bytes (self);
+  stats->offscreen_bytes = clutter_kawase_blur_effect_get_offscreen_bytes (self);
+}
+
+/**
+ * clutter_kawase_blur_effect_reset_stats:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Resets all the counters returned by clutter_kawase_blur_effect_get_stats()
+ * to zero.
+ */
+void
+clutter_kawase_blur_effect_reset_stats (ClutterKawaseBlurEffect *self)
+{
+  g_return_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self));
+
+  memset (&self->stats, 0, sizeof (ClutterKawaseBlurEffectStats));
+}
+
+/**
+ * clutter_kawase_blur_effect_get_texture_allocations:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the number of intermediate textures the effect allocated so
+ * far, or since the last call to clutter_kawase_blur_effect_reset_stats().
+ * Once the pyramid has been built this value stays constant as long as the
+ * size of the actor and the blur strength don't change.
+ *
+ * Return value: the number of texture allocations
+ */
+guint
+clutter_kawase_blur_effect_get_texture_allocations (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return self->stats.textures_allocated;
+}
+
+/**
+ * clutter_kawase_blur_effect_get_passes:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the number of draws the effect issued so far, counting every
+ * down- and upsample pass as well as the final draw onto the actor's
+ * framebuffer.
+ *
+ * Return value: the number of passes
+ */
+guint64
+clutter_kawase_blur_effect_get_passes (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return self->stats.passes_executed;
+}
+
+/**
+ * clutter_kawase_blur_effect_get_framebuffer_allocations:
+ * @self: a #ClutterKawaseBlurEffect
+ *
+ * Retrieves the number of offscreen framebuffers the effect created so
+ * far. Framebuffers are only created together with their textures.
+ *
+ * Return value: the number of framebuffer allocations
+ */
+guint
+clutter_kawase_blur_effect_get_framebuffer_allocations (ClutterKawaseBlurEffect *self)
+{
+  g_return_val_if_fail (CLUTTER_IS_KAWASE_BLUR_EFFECT (self), 0);
+
+  return self->stats.framebuffers_allocated;
+}
+
+/*
+ * The paint volume also determines the size of the offscreen texture. With
+ * clip rectangles it is reduced to their bounding box, grown by the
+ * expand_size of the current iteration count so that everything the chain
+ * samples for the rectangles is still rendered. Isolated rectangles only
+ * sample themselves, so their bounding box is enough. The volume is in
+ * actor coordinates, so this holds for scaled and rotated actors as well,
+ * only the clip region of the chain needs an untransformed actor, see
+ * clutter_kawase_blur_effect_update_clip_region(). In blur-behind mode
+ * nothing is rendered offscreen, the volume covers the backdrop the chain
+ * samples instead.
+ */
+static gboolean
+clutter_kawase_blur_effect_get_paint_volume (ClutterEffect      *effect,
+                                      ClutterPaintVolume *volume)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
+  
+  gfloat cur_width, cur_height;
+  ClutterVertex origin;
+
+  clutter_paint_volume_get_origin (volume, &origin);
+  cur_width = clutter_paint_volume_get_width (volume);
+  cur_height = clutter_paint_volume_get_height (volume);
+
+  // Changes within the reach of the chain behind the actor affect its backdrop
+  if (self->blur_behind)
+    {
+      ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+      gint margin = klass->expand_sizes[self->iterations-1];
+
+      origin.x -= margin;
+      origin.y -= margin;
+      clutter_paint_volume_set_origin (volume, &origin);
+      clutter_paint_volume_set_width (volume, cur_width + 2 * margin);
+      clutter_paint_volume_set_height (volume, cur_height + 2 * margin);
+
+      return TRUE;
+    }
+
+  origin.x -= self->offset;
+  origin.y -= self->offset;
+  cur_width += 2 * self->offset;
+  cur_height += 2 * self->offset;
+
+  if (self->clip_rects != NULL)
+    {
+      ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+      // Isolated rectangles never sample outside of themselves
+      gint expand = clutter_kawase_blur_effect_can_isolate (self)
+                  ? 0
+                  : klass->expand_sizes[self->iterations-1];
+      gfloat x1 = G_MAXFLOAT, y1 = G_MAXFLOAT;
+      gfloat x2 = -G_MAXFLOAT, y2 = -G_MAXFLOAT;
+
+      for(guint i=0; i<self->clip_rects->len; i++)
+        {
+          cairo_rectangle_int_t *rect =
+            &g_array_index (self->clip_rects, cairo_rectangle_int_t, i);
+
+          x1 = MIN (x1, rect->x - expand);
+          y1 = MIN (y1, rect->y - expand);
+          x2 = MAX (x2, rect->x + rect->width + expand);
+          y2 = MAX (y2, rect->y + rect->height + expand);
+        }
+
+      x1 = MAX (x1, origin.x);
+      y1 = MAX (y1, origin.y);
+      x2 = MIN (x2, origin.x + cur_width);
+      y2 = MIN (y2, origin.y + cur_height);
+
+      origin.x = x1;
+      origin.y = y1;
+      cur_width = MAX (x2 - x1, 0);
+      cur_height = MAX (y2 - y1, 0);
+    }
+
+  clutter_paint_volume_set_origin (volume, &origin);
+  clutter_paint_volume_set_width (volume, cur_width);
+  clutter_paint_volume_set_height (volume, cur_height);
+ 
+  return TRUE;
+}
+
+static void
+clutter_kawase_blur_effect_set_property (GObject      *gobject,
+                                         guint         prop_id,
+                                         const GValue *value,
+                                         GParamSpec   *pspec)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (gobject);
+
+  switch (prop_id)
+    {
+    case PROP_STRENGTH:
+      clutter_kawase_blur_effect_set_strength (self, g_value_get_float (value));
+      break;
+
+    case PROP_SHARED_PYRAMID:
+      clutter_kawase_blur_effect_set_shared_pyramid (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_SPECIALIZED_SHADERS:
+      clutter_kawase_blur_effect_set_specialized_shaders (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_DOWNSAMPLE_SOURCE:
+      clutter_kawase_blur_effect_set_downsample_source (self, g_value_get_object (value));
+      break;
+
+    case PROP_ADAPTIVE_QUALITY:
+      clutter_kawase_blur_effect_set_adaptive_quality (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_FRAME_BUDGET:
+      clutter_kawase_blur_effect_set_frame_budget (self, g_value_get_float (value));
+      break;
+
+    case PROP_OFFSCREEN_DOWNSCALE:
+      clutter_kawase_blur_effect_set_offscreen_downscale (self, g_value_get_int (value));
+      break;
+
+    case PROP_DAMAGE_THRESHOLD:
+      clutter_kawase_blur_effect_set_damage_threshold (self, g_value_get_float (value));
+      break;
+
+    case PROP_INTERMEDIATE_FORMAT:
+      clutter_kawase_blur_effect_set_intermediate_format (self, g_value_get_enum (value));
+      break;
+
+    case PROP_MODE:
+      clutter_kawase_blur_effect_set_mode (self, g_value_get_enum (value));
+      break;
+
+    case PROP_TRIM_TIMEOUT:
+      clutter_kawase_blur_effect_set_trim_timeout (self, g_value_get_uint (value));
+      break;
+
+    case PROP_ISOLATE_RECTS:
+      clutter_kawase_blur_effect_set_isolate_rects (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_BLUR_BEHIND:
+      clutter_kawase_blur_effect_set_blur_behind (self, g_value_get_boolean (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+clutter_kawase_blur_effect_get_property (GObject    *gobject,
+                                         guint       prop_id,
+                                         GValue     *value,
+                                         GParamSpec *pspec)
+{
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (gobject);
+
+  switch (prop_id)
+    {
+    case PROP_STRENGTH:
+      g_value_set_float (value, self->strength);
+      break;
+
+    case PROP_SHARED_PYRAMID:
+      g_value_set_boolean (value, self->shared_pyramid);
+      break;
 
-  /* a back pointer to our actor, so that we can query it */
-  ClutterActor *actor;
+    case PROP_SPECIALIZED_SHADERS:
+      g_value_set_boolean (value, self->specialized_shaders);
+      break;
 
-  gint strength;
+    case PROP_DOWNSAMPLE_SOURCE:
+      g_value_set_object (value, self->downsample_source);
+      break;
 
-  gfloat offset;
-  gint iterations;
+    case PROP_ADAPTIVE_QUALITY:
+      g_value_set_boolean (value, self->adaptive_quality);
+      break;
 
-  gint offset_uniforms[2*DOWNSAMPLE_STEPS];
-  gint halfpixel_uniforms[2*DOWNSAMPLE_STEPS];
+    case PROP_FRAME_BUDGET:
+      g_value_set_float (value, self->frame_budget);
+      break;
 
-  CoglHandle offscreen_textures[2*DOWNSAMPLE_STEPS-1];
-  CoglFramebuffer *offscreenbuffers[2*DOWNSAMPLE_STEPS-1];
+    case PROP_EFFECTIVE_QUALITY:
+      g_value_set_int (value, self->quality);
+      break;
 
-  gint tex_width;
-  gint tex_height;
+    case PROP_OFFSCREEN_DOWNSCALE:
+      g_value_set_int (value, self->downscale);
+      break;
 
-  CoglPipeline *pipeline_stack[2*DOWNSAMPLE_STEPS];
-};
+    case PROP_DAMAGE_THRESHOLD:
+      g_value_set_float (value, self->damage_threshold);
+      break;
 
-struct _ClutterKawaseBlurEffectClass
-{
-  ClutterOffscreenEffectClass parent_class;
+    case PROP_INTERMEDIATE_FORMAT:
+      g_value_set_enum (value, self->intermediate_format);
+      break;
 
-  gfloat offsets[BLUR_STEPS];
-  gint iterations[BLUR_STEPS];
+    case PROP_MODE:
+      g_value_set_enum (value, self->mode);
+      break;
 
-  CoglPipeline *downsample_base_pipeline;
-  CoglPipeline *upsample_base_pipeline;
-};
+    case PROP_TRIM_TIMEOUT:
+      g_value_set_uint (value, self->trim_timeout);
+      break;
 
-G_DEFINE_TYPE (ClutterKawaseBlurEffect,
-               clutter_kawase_blur_effect,
-               CLUTTER_TYPE_OFFSCREEN_EFFECT);
+    case PROP_ISOLATE_RECTS:
+      g_value_set_boolean (value, self->isolate_rects);
+      break;
 
-static gboolean
-clutter_kawase_blur_effect_pre_paint (ClutterEffect *effect)
-{
-  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
-  ClutterEffectClass *parent_class;
+    case PROP_BLUR_BEHIND:
+      g_value_set_boolean (value, self->blur_behind);
+      break;
 
-  if (!clutter_actor_meta_get_enabled (CLUTTER_ACTOR_META (effect)))
-    return FALSE;
+    case PROP_FRAMES_BLURRED:
+      g_value_set_uint64 (value, self->stats.frames_blurred);
+      break;
 
-  self->actor = clutter_actor_meta_get_actor (CLUTTER_ACTOR_META (effect));
-  if (self->actor == NULL)
-    return FALSE;
+    case PROP_PASSES_EXECUTED:
+      g_value_set_uint64 (value, self->stats.passes_executed);
+      break;
 
-  if (!clutter_feature_available (CLUTTER_FEATURE_SHADERS_GLSL))
-    {
-      /* if we don't have support for GLSL shaders then we
-       * forcibly disable the ActorMeta
-       */
-      g_warning ("Unable to use the ShaderEffect: the graphics hardware "
-                 "or the current GL driver does not implement support "
-                 "for the GLSL shading language.");
-      clutter_actor_meta_set_enabled (CLUTTER_ACTOR_META (effect), FALSE);
-      return FALSE;
-    }
+    case PROP_PIXELS_RASTERIZED:
+      g_value_set_uint64 (value, self->stats.pixels_rasterized);
+      break;
 
-  parent_class = CLUTTER_EFFECT_CLASS (clutter_kawase_blur_effect_parent_class);
-  if (parent_class->pre_paint (effect))
-    {
-      ClutterOffscreenEffect *offscreen_effect =
-        CLUTTER_OFFSCREEN_EFFECT (effect);
-      CoglHandle texture;
+    case PROP_CACHE_HITS:
+      g_value_set_uint64 (value, self->stats.cache_hits);
+      break;
 
-      texture = clutter_offscreen_effect_get_texture (offscreen_effect);
-      self->tex_width = cogl_texture_get_width (texture);
-      self->tex_height = cogl_texture_get_height (texture);
+    case PROP_INCREMENTAL_FRAMES:
+      g_value_set_uint64 (value, self->stats.incremental_frames);
+      break;
 
-      gfloat halfpixel[2];
-      halfpixel[0] = 0.5f / self->tex_width;
-      halfpixel[1] = 0.5f / self->tex_height;
+    case PROP_TEXTURES_ALLOCATED:
+      g_value_set_uint (value, self->stats.textures_allocated);
+      break;
 
-      gfloat offset[2];
-      offset[0] = self->offset;
-      offset[1] = self->offset;
+    case PROP_FRAMEBUFFERS_ALLOCATED:
+      g_value_set_uint (value, self->stats.framebuffers_allocated);
+      break;
 
-      for(int i=0; i<2*self->iterations; i++)
-        {
-          if (self->offset_uniforms[i] > -1 && self->halfpixel_uniforms[i] > -1)
-            {
-              cogl_pipeline_set_uniform_float (self->pipeline_stack[i],
-                                              self->offset_uniforms[i],
-                                              2, /* n_components */
-                                              1, /* count */
-                                              offset);
-
-              cogl_pipeline_set_uniform_float (self->pipeline_stack[i],
-                                              self->halfpixel_uniforms[i],
-                                              2, /* n_components */
-                                              1, /* count */
-                                              halfpixel);
-            }        
-        }
-      // The first pipeline receives the original texture derived from the clutter actor
-      cogl_pipeline_set_layer_texture (self->pipeline_stack[0], 0, texture);
-      // All subsequent pipelines receive the offscreen texture as their input,
-      // so that we can chain the output of one to the input of the next pipeline.
-      CoglContext *ctx =
-        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+    case PROP_PYRAMID_BYTES:
+      g_value_set_uint64 (value, clutter_kawase_blur_effect_get_pyramid_bytes (self));
+      break;
 
-      // Create offscreen textures with appropriate resolutions
-      for(int i=0; i<self->iterations-1; i++)
-        {
-          gint subdiv = (1<<(i+1));
-          if (self->offscreen_textures[i] != NULL)
-            {
-              cogl_object_unref(self->offscreen_textures[i]);
-            }
-          if (self->offscreen_textures[2*self->iterations-2-i] != NULL)
-            {
-              cogl_object_unref(self->offscreen_textures[2*self->iterations-2-i]);
-            }
-          self->offscreen_textures[i] = 
-            cogl_texture_2d_new_with_size (ctx, self->tex_width/subdiv, self->tex_width/subdiv);
-          self->offscreen_textures[2*self->iterations-2-i] = 
-            cogl_texture_2d_new_with_size (ctx, self->tex_width/subdiv, self->tex_width/subdiv);
-        }
+    case PROP_OFFSCREEN_BYTES:
+      g_value_set_uint64 (value, clutter_kawase_blur_effect_get_offscreen_bytes (self));
+      break;
 
-      if (self->offscreen_textures[self->iterations-1] != NULL)
-        {
-          cogl_object_unref(self->offscreen_textures[self->iterations-1]);
-        }
-      self->offscreen_textures[self->iterations-1] = 
-        cogl_texture_2d_new_with_size (ctx, self->tex_width/(1<<self->iterations), self->tex_width/(1<<self->iterations));
+    case PROP_OFFSCREEN_PIXELS:
+      g_value_set_uint64 (value, self->stats.offscreen_pixels);
+      break;
 
+    case PROP_BACKDROP_PIXELS:
+      g_value_set_uint64 (value, self->stats.backdrop_pixels);
+      break;
 
-      for(int i=1; i<2*self->iterations; i++)
-        {
-          cogl_pipeline_set_layer_texture (self->pipeline_stack[i], 0, self->offscreen_textures[i-1]);
-        }
-      return TRUE;
+    case PROP_BACKDROP_READBACKS:
+      g_value_set_uint (value, self->stats.backdrop_readbacks);
+      break;
+
+    case PROP_BYTES_MOVED:
+      g_value_set_uint64 (value, self->stats.bytes_moved);
+      break;
+
+    case PROP_BYTES_RECLAIMED:
+      g_value_set_uint64 (value, self->stats.bytes_reclaimed);
+      break;
+
+    case PROP_TRIMS:
+      g_value_set_uint (value, self->stats.trims);
+      break;
+
+    case PROP_PRE_PAINT_TIME:
+      g_value_set_int64 (value, self->stats.pre_paint_time);
+      break;
+
+    case PROP_PAINT_TARGET_TIME:
+      g_value_set_int64 (value, self->stats.paint_target_time);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
+      break;
     }
-  else
-    return FALSE;
 }
 
 static void
-clutter_kawase_blur_effect_paint_target (ClutterOffscreenEffect *effect)
+clutter_kawase_blur_effect_dispose (GObject *gobject)
 {
-  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
-  CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (gobject);
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
 
-  /*
-   * cogl_offscreen_new_with_texture creates a buffer tightly bound to the 
-   * texture it is based on. So any change to the buffer directly changes
-   * the content of the texture. This is handy for chaining the pipelines,
-   * because cogl_framebuffer_draw_rectangle only wants to output to
-   * framebuffers but the cogl pipelines only work with textures. Using
-   * the aforementioned cogl_offscreen_new_with_texture call ties those two 
-   * objects together.
-   */
-  for(int i=0; i<2*self->iterations-1; i++)
-    {
-      self->offscreenbuffers[i] = 
-        cogl_offscreen_new_with_texture (self->offscreen_textures[i]);
-    }
-
-  // Set the basic color of the pipelines
-  // guint8 paint_opacity;
-  // paint_opacity = clutter_actor_get_paint_opacity (self->actor);
-  // for(int i=0; i<2*self->iterations; i++)
-  //   {
-  //     cogl_pipeline_set_color4ub (self->pipeline_stack[i],
-  //                                 paint_opacity,
-  //                                 paint_opacity,
-  //                                 paint_opacity,
-  //                                 paint_opacity);
-  //   }
-
-  // Downsampling and Upsampling
-  for(int i=0; i<2*self->iterations-1; i++)
-    {
-      cogl_framebuffer_draw_rectangle (self->offscreenbuffers[i],
-                                      self->pipeline_stack[i],
-                                      -1.0, -1.0,
-                                      1.0, 1.0);
+  if (self->idle_timeout_id != 0)
+    {
+      g_source_remove (self->idle_timeout_id);
+      self->idle_timeout_id = 0;
+    }
 
-      cogl_framebuffer_finish(self->offscreenbuffers[i]);
+  if (self->trim_timeout_id != 0)
+    {
+      g_source_remove (self->trim_timeout_id);
+      self->trim_timeout_id = 0;
     }
-  
-  // Draw the final image on the onscreen framebuffer (I don't know
-  // why we need to swap the xy coordinates like this to get an upright image...)
-  cogl_framebuffer_draw_rectangle (framebuffer,
-                                  self->pipeline_stack[2*self->iterations-1],
-                                  0, self->tex_height,
-                                  self->tex_width, 0);
+  clutter_kawase_blur_effect_disconnect_actor (self);
 
-  // Unref the offscreen buffers to free up memory
-  for(int i=0; i<2*self->iterations-1; i++)
+  if (self->backdrop_redraw_id != 0)
     {
-      cogl_object_unref(self->offscreenbuffers[i]);
+      g_source_remove (self->backdrop_redraw_id);
+      self->backdrop_redraw_id = 0;
     }
-                                   
-}
 
-void
-clutter_kawase_blur_effect_update_blur_strength(ClutterKawaseBlurEffect *self, gint strength) 
-{
-  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
-  if(strength < 0)
-  {
-    strength = 0;
-  }
-  if(strength >= BLUR_STEPS)
-  {
-    strength = BLUR_STEPS;
-  }
-  self->iterations = klass->iterations[strength];
-  self->offset = klass->offsets[strength];
+  klass->instances = g_list_remove (klass->instances, self);
 
-  clutter_actor_queue_redraw(self->actor);
-}
+  // Deleting a pending query is fine, reading it would wait for the GPU
+  clutter_kawase_blur_effect_drop_sample (self);
 
-static gboolean
-clutter_kawase_blur_effect_get_paint_volume (ClutterEffect      *effect,
-                                      ClutterPaintVolume *volume)
-{
-  // When is this function actually called? I just replaced BLUR_PADDING
-  // with blur_offset, but I don't know if it actually does anything.
-  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (effect);
-  
-  gfloat cur_width, cur_height;
-  ClutterVertex origin;
+  if (self->downsample_source != NULL)
+    {
+      if (self->downsample_source->downsample_consumers != NULL)
+        g_ptr_array_remove (self->downsample_source->downsample_consumers, self);
+      g_clear_object (&self->downsample_source);
+    }
 
-  clutter_paint_volume_get_origin (volume, &origin);
-  cur_width = clutter_paint_volume_get_width (volume);
-  cur_height = clutter_paint_volume_get_height (volume);
+  // Consumers hold a reference, so normally there are none left here
+  g_clear_pointer (&self->downsample_consumers, g_ptr_array_unref);
 
-  origin.x -= self->offset;
-  origin.y -= self->offset;
-  cur_width += 2 * self->offset;
-  cur_height += 2 * self->offset;
-  clutter_paint_volume_set_origin (volume, &origin);
-  clutter_paint_volume_set_width (volume, cur_width);
-  clutter_paint_volume_set_height (volume, cur_height);
- 
-  return TRUE;
-}
+  for(guint i=0; i<G_N_ELEMENTS (kawase_blur_engines); i++)
+    kawase_blur_engines[i]->clear (self);
+  clutter_kawase_blur_effect_clear_software (self);
+  clutter_kawase_blur_effect_clear_backdrop (self);
+  g_clear_pointer (&self->pipeline_stacks, g_hash_table_unref);
 
-static void
-clutter_kawase_blur_effect_dispose (GObject *gobject)
-{
-  ClutterKawaseBlurEffect *self = CLUTTER_KAWASE_BLUR_EFFECT (gobject);
+  g_clear_pointer (&self->clip_rects, g_array_unref);
+  g_clear_pointer (&self->clip_region, cairo_region_destroy);
+  g_clear_pointer (&self->damage, cairo_region_destroy);
+  g_clear_pointer (&self->frame_damage, cairo_region_destroy);
 
-  for(int i=0; i<2*DOWNSAMPLE_STEPS; i++)
+  if (self->cpu_pipeline != NULL)
     {
-      if (self->pipeline_stack[i] != NULL)
-        {
-          cogl_object_unref (self->pipeline_stack[i]);
-          self->pipeline_stack[i] = NULL;
-        }
+      cogl_object_unref (self->cpu_pipeline);
+      self->cpu_pipeline = NULL;
     }
 
+  g_clear_pointer (&self->cpu, clutter_kawase_blur_cpu_free);
+
   G_OBJECT_CLASS (clutter_kawase_blur_effect_parent_class)->dispose (gobject);
 }
 
@@ -357,15 +3228,474 @@ clutter_kawase_blur_effect_class_init (ClutterKawaseBlurEffectClass *klass)
 {
   ClutterEffectClass *effect_class = CLUTTER_EFFECT_CLASS (klass);
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  ClutterActorMetaClass *meta_class = CLUTTER_ACTOR_META_CLASS (klass);
   ClutterOffscreenEffectClass *offscreen_class;
+  const gchar *trace_file;
 
+  gobject_class->set_property = clutter_kawase_blur_effect_set_property;
+  gobject_class->get_property = clutter_kawase_blur_effect_get_property;
   gobject_class->dispose = clutter_kawase_blur_effect_dispose;
 
+  meta_class->set_actor = clutter_kawase_blur_effect_set_actor;
+
   effect_class->pre_paint = clutter_kawase_blur_effect_pre_paint;
+  effect_class->paint = clutter_kawase_blur_effect_paint;
   effect_class->get_paint_volume = clutter_kawase_blur_effect_get_paint_volume;
 
   offscreen_class = CLUTTER_OFFSCREEN_EFFECT_CLASS (klass);
   offscreen_class->paint_target = clutter_kawase_blur_effect_paint_target;
+  offscreen_class->create_texture = clutter_kawase_blur_effect_create_texture;
+
+  /**
+   * ClutterKawaseBlurEffect:strength:
+   *
+   * The strength of the blur, between 0.0 and 14.0. Values in between the
+   * integer steps are interpolated, so the property can be animated, e.g.
+   * with a #ClutterPropertyTransition on "@effects.<name>.strength" of the
+   * actor the effect is attached to.
+   */
+  obj_props[PROP_STRENGTH] =
+    g_param_spec_float ("strength",
+                        "Strength",
+                        "The strength of the blur",
+                        0.0f, BLUR_STEPS - 1, BLUR_STEPS - 1,
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_STRINGS |
+                        G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:shared-pyramid:
+   *
+   * Whether the intermediate textures are borrowed from the pool shared
+   * by all the effects, see clutter_kawase_blur_effect_set_shared_pyramid().
+   */
+  obj_props[PROP_SHARED_PYRAMID] =
+    g_param_spec_boolean ("shared-pyramid",
+                          "Shared Pyramid",
+                          "Whether to borrow the intermediate textures from the shared pool",
+                          FALSE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_STRINGS |
+                          G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:specialized-shaders:
+   *
+   * Whether the shaders generated for the integer strengths are used, see
+   * clutter_kawase_blur_effect_set_specialized_shaders().
+   */
+  obj_props[PROP_SPECIALIZED_SHADERS] =
+    g_param_spec_boolean ("specialized-shaders",
+                          "Specialized Shaders",
+                          "Whether to use the shaders generated for the strength",
+                          FALSE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_STRINGS |
+                          G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:downsample-source:
+   *
+   * The effect whose downsample chain this effect reuses, see
+   * clutter_kawase_blur_effect_set_downsample_source().
+   */
+  obj_props[PROP_DOWNSAMPLE_SOURCE] =
+    g_param_spec_object ("downsample-source",
+                         "Downsample Source",
+                         "The effect whose downsample levels are reused",
+                         CLUTTER_TYPE_KAWASE_BLUR_EFFECT,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS |
+                         G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:adaptive-quality:
+   *
+   * Whether the effect lowers its quality to stay within
+   * #ClutterKawaseBlurEffect:frame-budget, see
+   * clutter_kawase_blur_effect_set_adaptive_quality().
+   */
+  obj_props[PROP_ADAPTIVE_QUALITY] =
+    g_param_spec_boolean ("adaptive-quality",
+                          "Adaptive Quality",
+                          "Whether to lower the quality to stay within the frame budget",
+                          FALSE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_STRINGS |
+                          G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:frame-budget:
+   *
+   * The GPU time recomputing the blur may take per frame with the adaptive
+   * quality, in milliseconds.
+   */
+  obj_props[PROP_FRAME_BUDGET] =
+    g_param_spec_float ("frame-budget",
+                        "Frame Budget",
+                        "GPU time the blur may take per frame, in milliseconds",
+                        0.01f, G_MAXFLOAT, DEFAULT_FRAME_BUDGET,
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_STRINGS |
+                        G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:effective-quality:
+   *
+   * The quality the effect currently blurs with, from 0 to 5, see
+   * clutter_kawase_blur_effect_get_effective_quality(). It is always 5
+   * unless #ClutterKawaseBlurEffect:adaptive-quality is set.
+   */
+  obj_props[PROP_EFFECTIVE_QUALITY] =
+    g_param_spec_int ("effective-quality",
+                      "Effective Quality",
+                      "The quality the effect currently blurs with",
+                      0, QUALITY_FULL, QUALITY_FULL,
+                      G_PARAM_READABLE |
+                      G_PARAM_STATIC_STRINGS |
+                      G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:offscreen-downscale:
+   *
+   * How often the actor's offscreen image is halved before the blur, see
+   * clutter_kawase_blur_effect_set_offscreen_downscale().
+   */
+  obj_props[PROP_OFFSCREEN_DOWNSCALE] =
+    g_param_spec_int ("offscreen-downscale",
+                      "Offscreen Downscale",
+                      "How often the actor's offscreen image is halved",
+                      0, MAX_OFFSCREEN_DOWNSCALE, 0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_STATIC_STRINGS |
+                      G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:damage-threshold:
+   *
+   * Up to which part of the actor's area damage is updated incrementally,
+   * see clutter_kawase_blur_effect_add_damage().
+   */
+  obj_props[PROP_DAMAGE_THRESHOLD] =
+    g_param_spec_float ("damage-threshold",
+                        "Damage Threshold",
+                        "Up to which part of the actor's area damage is updated incrementally",
+                        0.0f, 1.0f, DEFAULT_DAMAGE_THRESHOLD,
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_STRINGS |
+                        G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:intermediate-format:
+   *
+   * The storage format of the intermediate textures, see
+   * clutter_kawase_blur_effect_set_intermediate_format().
+   */
+  obj_props[PROP_INTERMEDIATE_FORMAT] =
+    g_param_spec_enum ("intermediate-format",
+                       "Intermediate Format",
+                       "The storage format of the intermediate textures",
+                       CLUTTER_TYPE_KAWASE_BLUR_FORMAT,
+                       CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888,
+                       G_PARAM_READWRITE |
+                       G_PARAM_STATIC_STRINGS |
+                       G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:mode:
+   *
+   * The blur algorithm, see clutter_kawase_blur_effect_set_mode().
+   */
+  obj_props[PROP_MODE] =
+    g_param_spec_enum ("mode",
+                       "Mode",
+                       "The blur algorithm",
+                       CLUTTER_TYPE_KAWASE_BLUR_MODE,
+                       CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE,
+                       G_PARAM_READWRITE |
+                       G_PARAM_STATIC_STRINGS |
+                       G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:trim-timeout:
+   *
+   * After how many milliseconds of the actor being unmapped or the effect
+   * being disabled the intermediate textures are freed, 0 to keep them, see
+   * clutter_kawase_blur_effect_set_trim_timeout().
+   */
+  obj_props[PROP_TRIM_TIMEOUT] =
+    g_param_spec_uint ("trim-timeout",
+                       "Trim Timeout",
+                       "Milliseconds after the actor was hidden or the effect disabled until the intermediate textures are freed",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE |
+                       G_PARAM_STATIC_STRINGS |
+                       G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:isolate-rects:
+   *
+   * Whether every clip rectangle is blurred on its own, see
+   * clutter_kawase_blur_effect_set_isolate_rects().
+   */
+  obj_props[PROP_ISOLATE_RECTS] =
+    g_param_spec_boolean ("isolate-rects",
+                          "Isolate Rectangles",
+                          "Whether every clip rectangle is blurred on its own",
+                          FALSE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_STRINGS |
+                          G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ClutterKawaseBlurEffect:blur-behind:
+   *
+   * Whether the effect blurs what is behind the actor instead of the actor
+   * itself, see clutter_kawase_blur_effect_set_blur_behind().
+   */
+  obj_props[PROP_BLUR_BEHIND] =
+    g_param_spec_boolean ("blur-behind",
+                          "Blur Behind",
+                          "Whether to blur what is behind the actor instead of the actor",
+                          FALSE,
+                          G_PARAM_READWRITE |
+                          G_PARAM_STATIC_STRINGS |
+                          G_PARAM_EXPLICIT_NOTIFY);
+
+  /*
+   * The statistics are exposed as read-only properties so that tools can
+   * poll them. They change on every paint, so no notifications are emitted.
+   */
+
+  /**
+   * ClutterKawaseBlurEffect:frames-blurred:
+   *
+   * The number of paints that ran the whole down- and upsample chain.
+   */
+  obj_props[PROP_FRAMES_BLURRED] =
+    g_param_spec_uint64 ("frames-blurred",
+                         "Frames Blurred",
+                         "Number of paints that ran the blur chain",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:passes-executed:
+   *
+   * The number of draws issued by the effect, including the final draw
+   * onto the actor's framebuffer.
+   */
+  obj_props[PROP_PASSES_EXECUTED] =
+    g_param_spec_uint64 ("passes-executed",
+                         "Passes Executed",
+                         "Number of draws issued by the effect",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:pixels-rasterized:
+   *
+   * The number of pixels written by all the draws of the effect.
+   */
+  obj_props[PROP_PIXELS_RASTERIZED] =
+    g_param_spec_uint64 ("pixels-rasterized",
+                         "Pixels Rasterized",
+                         "Number of pixels written by the effect",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:cache-hits:
+   *
+   * The number of paints that reused the cached blur result.
+   */
+  obj_props[PROP_CACHE_HITS] =
+    g_param_spec_uint64 ("cache-hits",
+                         "Cache Hits",
+                         "Number of paints that reused the cached blur",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:incremental-frames:
+   *
+   * The number of blurred paints that only rendered the parts of the levels
+   * reached by the reported damage, see clutter_kawase_blur_effect_add_damage().
+   */
+  obj_props[PROP_INCREMENTAL_FRAMES] =
+    g_param_spec_uint64 ("incremental-frames",
+                         "Incremental Frames",
+                         "Number of paints that only updated the damaged parts",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:textures-allocated:
+   *
+   * The number of intermediate textures the effect allocated.
+   */
+  obj_props[PROP_TEXTURES_ALLOCATED] =
+    g_param_spec_uint ("textures-allocated",
+                       "Textures Allocated",
+                       "Number of intermediate textures allocated",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:framebuffers-allocated:
+   *
+   * The number of offscreen framebuffers the effect created.
+   */
+  obj_props[PROP_FRAMEBUFFERS_ALLOCATED] =
+    g_param_spec_uint ("framebuffers-allocated",
+                       "Framebuffers Allocated",
+                       "Number of offscreen framebuffers created",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:pyramid-bytes:
+   *
+   * The amount of video memory currently held by the texture pyramid.
+   */
+  obj_props[PROP_PYRAMID_BYTES] =
+    g_param_spec_uint64 ("pyramid-bytes",
+                         "Pyramid Bytes",
+                         "Video memory held by the texture pyramid",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:offscreen-bytes:
+   *
+   * The amount of video memory of the texture the actor is rendered into,
+   * see #ClutterKawaseBlurEffect:offscreen-downscale.
+   */
+  obj_props[PROP_OFFSCREEN_BYTES] =
+    g_param_spec_uint64 ("offscreen-bytes",
+                         "Offscreen Bytes",
+                         "Video memory of the texture the actor is rendered into",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:offscreen-pixels:
+   *
+   * The number of pixels of the actor rendered into its offscreen texture.
+   */
+  obj_props[PROP_OFFSCREEN_PIXELS] =
+    g_param_spec_uint64 ("offscreen-pixels",
+                         "Offscreen Pixels",
+                         "Number of pixels of the actor rendered offscreen",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:backdrop-pixels:
+   *
+   * The number of pixels copied from the framebuffer in blur-behind mode,
+   * see #ClutterKawaseBlurEffect:blur-behind.
+   */
+  obj_props[PROP_BACKDROP_PIXELS] =
+    g_param_spec_uint64 ("backdrop-pixels",
+                         "Backdrop Pixels",
+                         "Number of pixels copied from the framebuffer in blur-behind mode",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:backdrop-readbacks:
+   *
+   * The number of backdrop copies that were read back into system memory
+   * because the driver can't blit between framebuffers.
+   */
+  obj_props[PROP_BACKDROP_READBACKS] =
+    g_param_spec_uint ("backdrop-readbacks",
+                       "Backdrop Readbacks",
+                       "Number of backdrop copies read back into system memory",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:bytes-moved:
+   *
+   * The estimated video memory traffic of the passes, reads and writes,
+   * see #ClutterKawaseBlurEffect:intermediate-format.
+   */
+  obj_props[PROP_BYTES_MOVED] =
+    g_param_spec_uint64 ("bytes-moved",
+                         "Bytes Moved",
+                         "Estimated video memory traffic of the passes",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:bytes-reclaimed:
+   *
+   * The video memory freed by trimming the texture pyramid, see
+   * #ClutterKawaseBlurEffect:trim-timeout.
+   */
+  obj_props[PROP_BYTES_RECLAIMED] =
+    g_param_spec_uint64 ("bytes-reclaimed",
+                         "Bytes Reclaimed",
+                         "Video memory freed by trimming the texture pyramid",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:trims:
+   *
+   * The number of times the texture pyramid was trimmed.
+   */
+  obj_props[PROP_TRIMS] =
+    g_param_spec_uint ("trims",
+                       "Trims",
+                       "Number of times the texture pyramid was trimmed",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:pre-paint-time:
+   *
+   * The CPU time spent in pre_paint, in microseconds.
+   */
+  obj_props[PROP_PRE_PAINT_TIME] =
+    g_param_spec_int64 ("pre-paint-time",
+                        "Pre Paint Time",
+                        "CPU time spent in pre_paint, in microseconds",
+                        0, G_MAXINT64, 0,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * ClutterKawaseBlurEffect:paint-target-time:
+   *
+   * The CPU time spent in paint_target, in microseconds.
+   */
+  obj_props[PROP_PAINT_TARGET_TIME] =
+    g_param_spec_int64 ("paint-target-time",
+                        "Paint Target Time",
+                        "CPU time spent in paint_target, in microseconds",
+                        0, G_MAXINT64, 0,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class, PROP_LAST, obj_props);
+
+  g_queue_init (&klass->texture_pool.idle);
+  klass->texture_pool.limit = DEFAULT_POOL_LIMIT;
+
+  kawase_blur_debug_flags =
+    g_parse_debug_string (g_getenv ("CLUTTER_KAWASE_BLUR_DEBUG"),
+                          kawase_blur_debug_keys,
+                          G_N_ELEMENTS (kawase_blur_debug_keys));
+
+  // CLUTTER_KAWASE_BLUR_TRACE=trace.json records the whole run
+  trace_file = g_getenv ("CLUTTER_KAWASE_BLUR_TRACE");
+  if (trace_file != NULL && *trace_file != '\0')
+    {
+      kawase_blur_trace_filename = g_strdup (trace_file);
+      clutter_kawase_blur_trace_start ();
+      atexit (clutter_kawase_blur_effect_write_trace_at_exit);
+    }
 
   /*
    * Here we create an array of blur strength values that are evenly distributed
@@ -384,11 +3714,9 @@ clutter_kawase_blur_effect_class_init (ClutterKawaseBlurEffectClass *klass)
    *
    * The expand_size value is the minimum value for an iteration before we reach the end
    * of a texture in the shader and sample outside of the area that was copied into the
-   * texture from the screen.
+   * texture from the screen. It is how far the paint volume reaches beyond the clip
+   * rectangles, see clutter_kawase_blur_effect_set_clip_rects.
    */
-
-  // TODO: Actually use expand_size in the code. 
-  //       I don't quite understand the function of expand_size yet.
   struct blur_offset blur_offsets[DOWNSAMPLE_STEPS] = {
     {1.0f, 2.0f, 10},   // Down sample size / 2
     {2.0f, 3.0f, 20},   // Down sample size / 4
@@ -419,77 +3747,284 @@ clutter_kawase_blur_effect_class_init (ClutterKawaseBlurEffectClass *klass)
 
       gfloat offset_difference = blur_offsets[i].max_offset - blur_offsets[i].min_offset;
 
+      klass->expand_sizes[i] = blur_offsets[i].expand_size;
+
       for (gint j = 1; j <= iteration_number; j++) 
         {
           klass->offsets[index] = 
             blur_offsets[i].min_offset + (offset_difference / iteration_number) * j;
           klass->iterations[index] = i+1;
+          klass->min_offsets[index] = blur_offsets[i].min_offset;
+          // The Gaussian reaches about three sigmas, as far as expand_size at the top of the band
+          klass->gaussian_sigmas[index] =
+            blur_offsets[i].expand_size / 3.0f * klass->offsets[index] / blur_offsets[i].max_offset;
           index++;
         }
     }
+
+  for (gint i = 0; i < BLUR_STEPS; i++)
+    {
+      klass->specialized_downsample_shaders[i] =
+        kawase_blur_generate_downsample_shader (klass->offsets[i]);
+      klass->specialized_upsample_shaders[i] =
+        kawase_blur_generate_upsample_shader (klass->offsets[i]);
+    }
+}
+
+static CoglPipeline *
+kawase_blur_create_base_pipeline (CoglContext *ctx,
+                                  const gchar *declarations,
+                                  const gchar *shader)
+{
+  CoglPipeline *pipeline = cogl_pipeline_new (ctx);
+  CoglSnippet *snippet;
+
+  snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_TEXTURE_LOOKUP,
+                              declarations,
+                              NULL);
+  cogl_snippet_set_replace (snippet, shader);
+
+  cogl_pipeline_add_layer_snippet (pipeline, 0, snippet);
+
+  cogl_pipeline_set_layer_null_texture (pipeline,
+                                        0, /* layer number */
+                                        COGL_TEXTURE_TYPE_2D);
+
+  cogl_object_unref (snippet);
+
+  return pipeline;
+}
+
+/*
+ * Copies of the same base pipeline share their GLSL program, Cogl only
+ * compiles it once.
+ */
+static void
+kawase_blur_pipeline_stack_init (KawaseBlurPipelineStack *stack,
+                                 CoglPipeline            *downsample_base_pipeline,
+                                 CoglPipeline            *upsample_base_pipeline)
+{
+  for(gint i=0; i<DOWNSAMPLE_STEPS; i++)
+    {
+      stack->pipelines[i] = cogl_pipeline_copy (downsample_base_pipeline);
+      stack->pipelines[i+DOWNSAMPLE_STEPS] = cogl_pipeline_copy (upsample_base_pipeline);
+    }
+    
+  // Get uniform locations
+  for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
+    {
+      stack->offset_uniforms[i] =
+        cogl_pipeline_get_uniform_location (stack->pipelines[i], "offset");
+      stack->halfpixel_uniforms[i] =
+        cogl_pipeline_get_uniform_location (stack->pipelines[i], "halfpixel");
+    }
 }
 
+/*
+ * The pipelines need a Cogl context, which doesn't exist yet when the class
+ * is initialized by a user that never initializes Clutter, e.g. to query
+ * clutter_kawase_blur_effect_get_strength_parameters(). So they are created
+ * by the first instance or by clutter_kawase_blur_effect_class_warm_up().
+ */
 static void
-clutter_kawase_blur_effect_init (ClutterKawaseBlurEffect *self)
+clutter_kawase_blur_effect_class_ensure_pipelines (ClutterKawaseBlurEffectClass *klass)
 {
-  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
-  self->strength = 14;
-  self->offset = klass->offsets[self->strength];
-  self->iterations = klass->iterations[self->strength];
-  if (G_UNLIKELY (klass->downsample_base_pipeline == NULL))
+  CoglContext *ctx;
+  CoglPipeline *downsample_base_pipeline;
+  CoglPipeline *upsample_base_pipeline;
+
+  if (G_LIKELY (klass->downsample_base_pipeline != NULL))
+    return;
+
+  ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+  klass->downsample_base_pipeline =
+    kawase_blur_create_base_pipeline (ctx, glsl_declarations, glsl_downsample_shader);
+  klass->upsample_base_pipeline =
+    kawase_blur_create_base_pipeline (ctx, glsl_declarations, glsl_upsample_shader);
+
+  kawase_blur_pipeline_stack_init (&klass->pipeline_stack,
+                                   klass->downsample_base_pipeline,
+                                   klass->upsample_base_pipeline);
+
+  // The color carries the clamp rectangle, it must not tint the result
+  downsample_base_pipeline =
+    kawase_blur_create_base_pipeline (ctx, glsl_clamped_declarations, glsl_clamped_downsample_shader);
+  upsample_base_pipeline =
+    kawase_blur_create_base_pipeline (ctx, glsl_clamped_declarations, glsl_clamped_upsample_shader);
+  cogl_pipeline_set_layer_combine (downsample_base_pipeline, 0, "RGBA = REPLACE (TEXTURE)", NULL);
+  cogl_pipeline_set_layer_combine (upsample_base_pipeline, 0, "RGBA = REPLACE (TEXTURE)", NULL);
+
+  kawase_blur_pipeline_stack_init (&klass->clamped_stack,
+                                   downsample_base_pipeline,
+                                   upsample_base_pipeline);
+
+  cogl_object_unref (downsample_base_pipeline);
+  cogl_object_unref (upsample_base_pipeline);
+
+  klass->gaussian_base_pipeline =
+    kawase_blur_create_base_pipeline (ctx, glsl_gaussian_declarations, glsl_gaussian_shader);
+  klass->direction_uniform =
+    cogl_pipeline_get_uniform_location (klass->gaussian_base_pipeline, "direction");
+  klass->tap_offsets_uniform =
+    cogl_pipeline_get_uniform_location (klass->gaussian_base_pipeline, "tap_offsets");
+  klass->tap_weights_uniform =
+    cogl_pipeline_get_uniform_location (klass->gaussian_base_pipeline, "tap_weights");
+
+  // Overwrites the target, whatever the alpha of the actor's image
+  klass->copy_base_pipeline = cogl_pipeline_new (ctx);
+  cogl_pipeline_set_layer_null_texture (klass->copy_base_pipeline,
+                                        0, /* layer number */
+                                        COGL_TEXTURE_TYPE_2D);
+  cogl_pipeline_set_blend (klass->copy_base_pipeline, "RGBA = ADD (SRC_COLOR, 0)", NULL);
+}
+
+KawaseBlurPipelineStack *
+clutter_kawase_blur_effect_class_get_specialized_stack (ClutterKawaseBlurEffectClass *klass,
+                                                        gint                          strength)
+{
+  if (klass->specialized_stacks[strength] == NULL)
     {
       CoglContext *ctx =
         clutter_backend_get_cogl_context (clutter_get_default_backend ());
+      CoglPipeline *downsample_base_pipeline;
+      CoglPipeline *upsample_base_pipeline;
+
+      downsample_base_pipeline =
+        kawase_blur_create_base_pipeline (ctx,
+                                          glsl_specialized_declarations,
+                                          klass->specialized_downsample_shaders[strength]);
+      upsample_base_pipeline =
+        kawase_blur_create_base_pipeline (ctx,
+                                          glsl_specialized_declarations,
+                                          klass->specialized_upsample_shaders[strength]);
+
+      klass->specialized_stacks[strength] = g_new0 (KawaseBlurPipelineStack, 1);
+      kawase_blur_pipeline_stack_init (klass->specialized_stacks[strength],
+                                       downsample_base_pipeline,
+                                       upsample_base_pipeline);
+
+      cogl_object_unref (downsample_base_pipeline);
+      cogl_object_unref (upsample_base_pipeline);
+    }
+
+  return klass->specialized_stacks[strength];
+}
+
+static gboolean
+kawase_blur_count_frame (gpointer user_data)
+{
+  ClutterKawaseBlurEffectClass *klass = user_data;
 
-      klass->downsample_base_pipeline = cogl_pipeline_new (ctx);
-      klass->upsample_base_pipeline = cogl_pipeline_new (ctx);
+  klass->frame++;
 
-      CoglSnippet * downsample_snippet;
-      CoglSnippet * upsample_snippet;
+  return TRUE;
+}
 
-      downsample_snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_TEXTURE_LOOKUP,
-                                            glsl_declarations,
-                                            NULL);
-      cogl_snippet_set_replace (downsample_snippet, glsl_downsample_shader);
+static void
+clutter_kawase_blur_effect_init (ClutterKawaseBlurEffect *self)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+  self->strength = BLUR_STEPS - 1;
+  self->offset = klass->offsets[BLUR_STEPS - 1];
+  self->iterations = klass->iterations[BLUR_STEPS - 1];
+  self->strength_iterations = self->iterations;
 
-      upsample_snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_TEXTURE_LOOKUP,
-                                          glsl_declarations,
-                                          NULL);
+  self->quality = QUALITY_FULL;
+  self->frame_budget = DEFAULT_FRAME_BUDGET;
+  self->average_cost = -1.0;
 
-      cogl_snippet_set_replace (upsample_snippet, glsl_upsample_shader);
+  self->damage_threshold = DEFAULT_DAMAGE_THRESHOLD;
 
-      cogl_pipeline_add_layer_snippet (klass->downsample_base_pipeline, 0, 
-                                      downsample_snippet);
+  klass->instances = g_list_prepend (klass->instances, self);
 
-      cogl_pipeline_add_layer_snippet (klass->upsample_base_pipeline, 0, 
-                                      upsample_snippet);
+  g_signal_connect (self, "notify::enabled",
+                    G_CALLBACK (clutter_kawase_blur_effect_active_changed),
+                    self);
 
-      cogl_pipeline_set_layer_null_texture (klass->downsample_base_pipeline,
-                                            0, /* layer number */
-                                            COGL_TEXTURE_TYPE_2D);
+  if (klass->frame_counter_id == 0)
+    klass->frame_counter_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+                                             kawase_blur_count_frame,
+                                             klass,
+                                             NULL);
 
-      cogl_pipeline_set_layer_null_texture (klass->upsample_base_pipeline,
-                                            0, /* layer number */
-                                            COGL_TEXTURE_TYPE_2D);
-      
-      cogl_object_unref (downsample_snippet);
-      cogl_object_unref (upsample_snippet);
-    }
+  clutter_kawase_blur_effect_class_ensure_pipelines (klass);
+}
 
-  for(gint i=0; i<DOWNSAMPLE_STEPS; i++)
+/*
+ * Drawing with a pipeline is what makes Cogl generate and link its
+ * program. Every pipeline of the stack gets a draw, so that the programs
+ * are in Cogl's cache for whatever state the chain ends up with.
+ */
+static void
+kawase_blur_pipeline_stack_warm_up (KawaseBlurPipelineStack *stack,
+                                    CoglFramebuffer         *framebuffer,
+                                    CoglHandle               source)
+{
+  for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
     {
-      self->pipeline_stack[i] = cogl_pipeline_copy (klass->downsample_base_pipeline);
-      self->pipeline_stack[i+DOWNSAMPLE_STEPS] = cogl_pipeline_copy (klass->upsample_base_pipeline);
+      cogl_pipeline_set_layer_texture (stack->pipelines[i], 0, source);
+      cogl_framebuffer_draw_rectangle (framebuffer,
+                                      stack->pipelines[i],
+                                      -1.0, -1.0,
+                                      1.0, 1.0);
     }
-    
-  // Get uniform locations
-  for(gint i=0; i<2*DOWNSAMPLE_STEPS; i++)
+
+  // The driver may defer the compilation until the draws are executed
+  cogl_framebuffer_finish (framebuffer);
+
+  // Don't keep the dummy texture alive through the class' pipelines
+  kawase_blur_pipeline_stack_release (stack);
+}
+
+/**
+ * clutter_kawase_blur_effect_class_warm_up:
+ *
+ * Compiles and links the shaders of every down- and upsample pass ahead
+ * of time, including the specialized ones. Without this, the GL driver
+ * compiles them the first time a blur is painted, which makes that frame
+ * stutter. Call it after Clutter has been initialized, e.g. while the
+ * application starts up.
+ */
+void
+clutter_kawase_blur_effect_class_warm_up (void)
+{
+  ClutterKawaseBlurEffectClass *klass;
+  CoglContext *ctx;
+  CoglHandle source, target;
+  CoglFramebuffer *framebuffer;
+
+  klass = g_type_class_ref (CLUTTER_TYPE_KAWASE_BLUR_EFFECT);
+  clutter_kawase_blur_effect_class_ensure_pipelines (klass);
+
+  if (!clutter_feature_available (CLUTTER_FEATURE_SHADERS_GLSL))
     {
-      self->offset_uniforms[i] =
-        cogl_pipeline_get_uniform_location (self->pipeline_stack[i], "offset");
-      self->halfpixel_uniforms[i] =
-        cogl_pipeline_get_uniform_location (self->pipeline_stack[i], "halfpixel");
+      g_type_class_unref (klass);
+      return;
     }
+
+  ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  source = cogl_texture_2d_new_with_size (ctx, 8, 8);
+  target = cogl_texture_2d_new_with_size (ctx, 8, 8);
+  framebuffer = cogl_offscreen_new_with_texture (target);
+
+  kawase_blur_pipeline_stack_warm_up (&klass->pipeline_stack, framebuffer, source);
+  kawase_blur_pipeline_stack_warm_up (&klass->clamped_stack, framebuffer, source);
+  for(gint i=0; i<BLUR_STEPS; i++)
+    kawase_blur_pipeline_stack_warm_up (clutter_kawase_blur_effect_class_get_specialized_stack (klass, i),
+                                        framebuffer,
+                                        source);
+
+  cogl_pipeline_set_layer_texture (klass->gaussian_base_pipeline, 0, source);
+  cogl_framebuffer_draw_rectangle (framebuffer, klass->gaussian_base_pipeline, -1.0, -1.0, 1.0, 1.0);
+  cogl_pipeline_set_layer_null_texture (klass->gaussian_base_pipeline, 0, COGL_TEXTURE_TYPE_2D);
+
+  cogl_object_unref (framebuffer);
+  cogl_object_unref (target);
+  cogl_object_unref (source);
+
+  g_type_class_unref (klass);
 }
 
 /**
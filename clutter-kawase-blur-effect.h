@@ -50,16 +50,292 @@ G_BEGIN_DECLS
  */
 typedef struct _ClutterKawaseBlurEffect       ClutterKawaseBlurEffect;
 typedef struct _ClutterKawaseBlurEffectClass  ClutterKawaseBlurEffectClass;
+typedef struct _ClutterKawaseBlurEffectStats  ClutterKawaseBlurEffectStats;
+typedef struct _ClutterKawaseBlurPoolStats    ClutterKawaseBlurPoolStats;
+
+#define CLUTTER_TYPE_KAWASE_BLUR_FORMAT        (clutter_kawase_blur_format_get_type ())
+
+/**
+ * ClutterKawaseBlurFormat:
+ * @CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888: 32 bits per texel, the default
+ * @CLUTTER_KAWASE_BLUR_FORMAT_RGB888: 24 bits per texel, without the alpha
+ *   channel the blur doesn't use; drivers may pad it to 32 bits
+ * @CLUTTER_KAWASE_BLUR_FORMAT_RGB565: 16 bits per texel, which shows as
+ *   banding in smooth gradients
+ * @CLUTTER_KAWASE_BLUR_FORMAT_AUTO: RGB565 for the downsample levels and
+ *   RGB888 for the upsample levels
+ *
+ * Storage formats of the intermediate textures, see
+ * clutter_kawase_blur_effect_set_intermediate_format().
+ */
+typedef enum {
+  CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888,
+  CLUTTER_KAWASE_BLUR_FORMAT_RGB888,
+  CLUTTER_KAWASE_BLUR_FORMAT_RGB565,
+  CLUTTER_KAWASE_BLUR_FORMAT_AUTO
+} ClutterKawaseBlurFormat;
+
+#define CLUTTER_TYPE_KAWASE_BLUR_MODE          (clutter_kawase_blur_mode_get_type ())
+
+/**
+ * ClutterKawaseBlurMode:
+ * @CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE: the dual Kawase chain, the default
+ * @CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN: a separable Gaussian at a reduced
+ *   resolution
+ *
+ * Blur algorithms, see clutter_kawase_blur_effect_set_mode().
+ */
+typedef enum {
+  CLUTTER_KAWASE_BLUR_MODE_DUAL_KAWASE,
+  CLUTTER_KAWASE_BLUR_MODE_GAUSSIAN
+} ClutterKawaseBlurMode;
+
+/**
+ * ClutterKawaseBlurEffectStats:
+ * @frames_blurred: number of paints that ran the whole blur chain
+ * @passes_executed: number of draws, including the final one
+ * @pixels_rasterized: number of pixels written by all the draws
+ * @cache_hits: number of paints that reused the cached blur result
+ * @incremental_frames: number of blurred paints that only rendered the
+ *   parts of the levels reached by the reported damage
+ * @textures_allocated: number of intermediate textures allocated
+ * @framebuffers_allocated: number of offscreen framebuffers created
+ * @pyramid_bytes: video memory currently held by the texture pyramid
+ * @offscreen_bytes: video memory of the texture the actor is rendered into
+ * @offscreen_pixels: number of pixels of the actor rendered into that texture
+ * @backdrop_pixels: number of pixels copied from the framebuffer in
+ *   blur-behind mode, see clutter_kawase_blur_effect_set_blur_behind()
+ * @backdrop_readbacks: number of those copies that were read back into
+ *   system memory because the driver can't blit between framebuffers;
+ *   each of them waits for the GPU
+ * @bytes_moved: estimated video memory traffic of the passes, reads and
+ *   writes, depending on the intermediate format
+ * @bytes_reclaimed: video memory freed by trimming the pyramid, see
+ *   clutter_kawase_blur_effect_set_trim_timeout()
+ * @trims: number of times the pyramid was trimmed
+ * @pre_paint_time: CPU time spent in pre_paint, in microseconds
+ * @paint_target_time: CPU time spent in paint_target, in microseconds
+ *
+ * Runtime statistics of a #ClutterKawaseBlurEffect, see
+ * clutter_kawase_blur_effect_get_stats().
+ */
+struct _ClutterKawaseBlurEffectStats
+{
+  guint64 frames_blurred;
+  guint64 passes_executed;
+  guint64 pixels_rasterized;
+  guint64 cache_hits;
+  guint64 incremental_frames;
+  guint textures_allocated;
+  guint framebuffers_allocated;
+  guint64 pyramid_bytes;
+  guint64 offscreen_bytes;
+  guint64 offscreen_pixels;
+  guint64 backdrop_pixels;
+  guint backdrop_readbacks;
+  guint64 bytes_moved;
+  guint64 bytes_reclaimed;
+  guint trims;
+  gint64 pre_paint_time;
+  gint64 paint_target_time;
+};
+
+/**
+ * ClutterKawaseBlurPoolStats:
+ * @bytes: video memory held by the pool, idle and borrowed textures
+ * @peak_bytes: the highest value @bytes reached
+ * @limit: the memory cap for idle textures
+ * @idle_textures: number of textures that are not borrowed
+ * @textures_allocated: number of textures the pool created
+ * @borrows: number of textures handed out to effects
+ * @evictions: number of idle textures freed to respect the limit
+ *
+ * State of the texture pool shared by all #ClutterKawaseBlurEffect
+ * instances, see clutter_kawase_blur_effect_class_get_pool_stats().
+ */
+struct _ClutterKawaseBlurPoolStats
+{
+  guint64 bytes;
+  guint64 peak_bytes;
+  guint64 limit;
+  guint idle_textures;
+  guint textures_allocated;
+  guint64 borrows;
+  guint64 evictions;
+};
 
 CLUTTER_AVAILABLE_IN_1_4
 GType clutter_kawase_blur_effect_get_type (void) G_GNUC_CONST;
 
+CLUTTER_AVAILABLE_IN_1_4
+GType clutter_kawase_blur_format_get_type (void) G_GNUC_CONST;
+
+CLUTTER_AVAILABLE_IN_1_4
+GType clutter_kawase_blur_mode_get_type (void) G_GNUC_CONST;
+
 CLUTTER_AVAILABLE_IN_1_4
 ClutterEffect *clutter_kawase_blur_effect_new (void);
 
 CLUTTER_AVAILABLE_IN_1_4
 void clutter_kawase_blur_effect_update_blur_strength(ClutterKawaseBlurEffect *self, gint strength);
 
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_strength (ClutterKawaseBlurEffect *self,
+                                              gfloat                   strength);
+
+CLUTTER_AVAILABLE_IN_1_4
+gfloat clutter_kawase_blur_effect_get_strength (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_shared_pyramid (ClutterKawaseBlurEffect *self,
+                                                    gboolean                 shared);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_get_shared_pyramid (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_specialized_shaders (ClutterKawaseBlurEffect *self,
+                                                         gboolean                 specialized);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_get_specialized_shaders (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_downsample_source (ClutterKawaseBlurEffect *self,
+                                                       ClutterKawaseBlurEffect *source);
+
+CLUTTER_AVAILABLE_IN_1_4
+ClutterKawaseBlurEffect *clutter_kawase_blur_effect_get_downsample_source (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_offscreen_downscale (ClutterKawaseBlurEffect *self,
+                                                         gint                     downscale);
+
+CLUTTER_AVAILABLE_IN_1_4
+gint clutter_kawase_blur_effect_get_offscreen_downscale (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_adaptive_quality (ClutterKawaseBlurEffect *self,
+                                                      gboolean                 adaptive);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_get_adaptive_quality (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_frame_budget (ClutterKawaseBlurEffect *self,
+                                                  gfloat                   budget);
+
+CLUTTER_AVAILABLE_IN_1_4
+gfloat clutter_kawase_blur_effect_get_frame_budget (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+gint clutter_kawase_blur_effect_get_effective_quality (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_class_warm_up (void);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_class_set_pool_limit (guint64 max_bytes);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_class_trim_pool (void);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint64 clutter_kawase_blur_effect_class_trim_memory (void);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_class_get_pool_stats (ClutterKawaseBlurPoolStats *stats);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_class_start_trace (void);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_class_stop_trace (const gchar  *filename,
+                                                      GError      **error);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_get_strength_parameters (gint    strength,
+                                                         gint   *iterations,
+                                                         gfloat *offset);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_invalidate (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_clip_rects (ClutterKawaseBlurEffect     *self,
+                                                const cairo_rectangle_int_t *rects,
+                                                gint                         n_rects);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_isolate_rects (ClutterKawaseBlurEffect *self,
+                                                   gboolean                 isolate);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_get_isolate_rects (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_blur_behind (ClutterKawaseBlurEffect *self,
+                                                 gboolean                 behind);
+
+CLUTTER_AVAILABLE_IN_1_4
+gboolean clutter_kawase_blur_effect_get_blur_behind (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_add_damage (ClutterKawaseBlurEffect     *self,
+                                            const cairo_rectangle_int_t *rects,
+                                            gint                         n_rects);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_damage_threshold (ClutterKawaseBlurEffect *self,
+                                                      gfloat                   threshold);
+
+CLUTTER_AVAILABLE_IN_1_4
+gfloat clutter_kawase_blur_effect_get_damage_threshold (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_intermediate_format (ClutterKawaseBlurEffect *self,
+                                                         ClutterKawaseBlurFormat  format);
+
+CLUTTER_AVAILABLE_IN_1_4
+ClutterKawaseBlurFormat clutter_kawase_blur_effect_get_intermediate_format (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_mode (ClutterKawaseBlurEffect *self,
+                                          ClutterKawaseBlurMode    mode);
+
+CLUTTER_AVAILABLE_IN_1_4
+ClutterKawaseBlurMode clutter_kawase_blur_effect_get_mode (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_trim_timeout (ClutterKawaseBlurEffect *self,
+                                                  guint                    timeout);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint clutter_kawase_blur_effect_get_trim_timeout (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint64 clutter_kawase_blur_effect_trim (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_set_cpu_threads (ClutterKawaseBlurEffect *self,
+                                                 gint                     n_threads);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint clutter_kawase_blur_effect_get_texture_allocations (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint clutter_kawase_blur_effect_get_framebuffer_allocations (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+guint64 clutter_kawase_blur_effect_get_passes (ClutterKawaseBlurEffect *self);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_get_stats (ClutterKawaseBlurEffect      *self,
+                                           ClutterKawaseBlurEffectStats *stats);
+
+CLUTTER_AVAILABLE_IN_1_4
+void clutter_kawase_blur_effect_reset_stats (ClutterKawaseBlurEffect *self);
+
 G_END_DECLS
 
 #endif /* __CLUTTER_KAWASE_BLUR_EFFECT_H__ */
@@ -0,0 +1,336 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * The Gaussian engine: a separable Gaussian blur on a halved copy of the
+ * actor's image, see clutter_kawase_blur_effect_gaussian_run().
+ */
+
+#include "clutter-kawase-blur-effect-private.h"
+
+#include <math.h>
+
+static void
+clutter_kawase_blur_effect_drop_gaussian_level (ClutterKawaseBlurEffect *self,
+                                                gint                     index)
+{
+  if (self->gaussian_framebuffers[index] != NULL)
+    {
+      cogl_object_unref (self->gaussian_framebuffers[index]);
+      self->gaussian_framebuffers[index] = NULL;
+    }
+  if (self->gaussian_textures[index] != NULL)
+    {
+      cogl_object_unref (self->gaussian_textures[index]);
+      self->gaussian_textures[index] = NULL;
+    }
+}
+
+static void
+clutter_kawase_blur_effect_clear_gaussian (ClutterKawaseBlurEffect *self)
+{
+  for(gint i=0; i<GAUSSIAN_MAX_LEVEL+2; i++)
+    clutter_kawase_blur_effect_drop_gaussian_level (self, i);
+
+  // The pipelines hold on to the textures they sampled last
+  for(gint i=0; i<GAUSSIAN_MAX_LEVEL+3; i++)
+    {
+      if (self->gaussian_pipelines[i] != NULL)
+        {
+          cogl_object_unref (self->gaussian_pipelines[i]);
+          self->gaussian_pipelines[i] = NULL;
+        }
+    }
+
+  self->gaussian_width = 0;
+  self->gaussian_height = 0;
+  self->gaussian_level = 0;
+}
+
+/*
+ * The sigma of the current strength in pixels of the full resolution
+ * image, interpolated between the strength steps.
+ */
+static gfloat
+clutter_kawase_blur_effect_get_gaussian_sigma (ClutterKawaseBlurEffect *self)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+  gint lower = (gint) floorf (self->strength);
+  gint upper = MIN (lower + 1, BLUR_STEPS - 1);
+  gfloat t = self->strength - lower;
+
+  return klass->gaussian_sigmas[lower] + (klass->gaussian_sigmas[upper] - klass->gaussian_sigmas[lower]) * t;
+}
+
+/*
+ * Picks how often the image is halved for the given sigma, and returns the
+ * sigma that is left to blur at that level, in its texels. Every halving
+ * averages two texels of the level above in both directions, which
+ * already blurs with a variance of a quarter of their size squared.
+ */
+static gint
+clutter_kawase_blur_effect_get_gaussian_level (ClutterKawaseBlurEffect *self,
+                                               gfloat                   sigma,
+                                               gfloat                  *level_sigma)
+{
+  gint level = self->source_downscale;
+  gfloat prefilter;
+
+  while (level < GAUSSIAN_MAX_LEVEL && sigma / (1 << level) > GAUSSIAN_MAX_SIGMA)
+    level++;
+
+  prefilter = ((1 << (2 * level)) - 1) / 12.0f;
+  *level_sigma = sqrtf (MAX (sigma * sigma - prefilter, 0.0f)) / (1 << level);
+
+  return level;
+}
+
+/*
+ * Folds the discrete Gaussian kernel into GAUSSIAN_TAPS bilinear taps: the
+ * center texel, and pairs of neighbouring texels sampled at their weighted
+ * center, where the bilinear filter blends them in the right proportion.
+ */
+static void
+kawase_blur_gaussian_kernel (gfloat  sigma,
+                             gfloat *offsets,
+                             gfloat *weights)
+{
+  gfloat discrete[2*GAUSSIAN_TAPS-1];
+  gint radius = MIN ((gint) ceilf (3.0f * sigma), 2*(GAUSSIAN_TAPS-1));
+  gfloat sum = 0.0f;
+
+  for(gint j=0; j<2*GAUSSIAN_TAPS-1; j++)
+    {
+      if (j == 0)
+        discrete[j] = 1.0f;
+      else if (j <= radius)
+        discrete[j] = expf (-(gfloat) (j * j) / (2.0f * sigma * sigma));
+      else
+        discrete[j] = 0.0f;
+
+      sum += (j == 0) ? discrete[j] : 2.0f * discrete[j];
+    }
+
+  offsets[0] = 0.0f;
+  weights[0] = discrete[0] / sum;
+
+  for(gint i=1; i<GAUSSIAN_TAPS; i++)
+    {
+      gfloat inner = discrete[2*i-1] / sum;
+      gfloat outer = discrete[2*i] / sum;
+
+      weights[i] = inner + outer;
+      offsets[i] = (weights[i] > 0.0f)
+                 ? ((2*i-1) * inner + 2*i * outer) / weights[i]
+                 : 0.0f;
+    }
+}
+
+static void
+clutter_kawase_blur_effect_ensure_gaussian_level (ClutterKawaseBlurEffect *self,
+                                                  CoglContext             *ctx,
+                                                  gint                     index,
+                                                  gint                     level)
+{
+  ClutterKawaseBlurFormat format = CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888;
+  ClutterKawaseBlurTraceSpan span;
+  gint width = MAX (self->tex_width >> level, 1);
+  gint height = MAX (self->tex_height >> level, 1);
+
+  if (self->gaussian_textures[index] != NULL)
+    return;
+
+  span = clutter_kawase_blur_trace_begin ("allocate");
+
+  self->gaussian_framebuffers[index] =
+    kawase_blur_level_new (ctx, width, height, &format, &self->gaussian_textures[index]);
+  self->stats.textures_allocated++;
+  self->stats.framebuffers_allocated++;
+
+  clutter_kawase_blur_trace_end (span, level, width, height, self->strength);
+}
+
+/*
+ * Makes sure the textures and pipelines for blurring at the given level
+ * exist. The halved images only depend on the size of the actor, the
+ * targets of the Gaussian passes also on the level.
+ */
+static void
+clutter_kawase_blur_effect_ensure_gaussian (ClutterKawaseBlurEffect *self,
+                                            gint                     level)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+  CoglContext *ctx =
+    clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+  if (self->gaussian_width != self->tex_width ||
+      self->gaussian_height != self->tex_height)
+    {
+      clutter_kawase_blur_effect_clear_gaussian (self);
+      self->gaussian_width = self->tex_width;
+      self->gaussian_height = self->tex_height;
+      self->gaussian_level = level;
+    }
+  else if (self->gaussian_level != level)
+    {
+      clutter_kawase_blur_effect_drop_gaussian_level (self, GAUSSIAN_HORIZONTAL);
+      clutter_kawase_blur_effect_drop_gaussian_level (self, GAUSSIAN_VERTICAL);
+      self->gaussian_level = level;
+    }
+
+  for(gint i=self->source_downscale+1; i<=level; i++)
+    clutter_kawase_blur_effect_ensure_gaussian_level (self, ctx, i-1, i);
+  clutter_kawase_blur_effect_ensure_gaussian_level (self, ctx, GAUSSIAN_HORIZONTAL, level);
+  clutter_kawase_blur_effect_ensure_gaussian_level (self, ctx, GAUSSIAN_VERTICAL, level);
+
+  for(gint i=0; i<GAUSSIAN_MAX_LEVEL+3; i++)
+    {
+      if (self->gaussian_pipelines[i] == NULL)
+        self->gaussian_pipelines[i] =
+          cogl_pipeline_copy ((i == GAUSSIAN_HORIZONTAL || i == GAUSSIAN_VERTICAL)
+                              ? klass->gaussian_base_pipeline
+                              : klass->copy_base_pipeline);
+    }
+}
+
+/*
+ * The Gaussian engine: halves the actor's image until the blur that is
+ * left fits the kernel, then blurs it horizontally and vertically at that
+ * resolution. Its cost hardly grows with the radius, since larger radii
+ * only add halvings of ever smaller images, and unlike the dual Kawase
+ * chain the radius isn't limited by DOWNSAMPLE_STEPS. Clip regions and
+ * damage only limit the final draw.
+ */
+static void
+clutter_kawase_blur_effect_gaussian_run (ClutterKawaseBlurEffect *self,
+                                         CoglHandle               texture)
+{
+  ClutterKawaseBlurEffectClass *klass = CLUTTER_KAWASE_BLUR_EFFECT_GET_CLASS (self);
+  gfloat offsets[GAUSSIAN_TAPS], weights[GAUSSIAN_TAPS];
+  gfloat level_sigma;
+  gint level;
+  gint width, height;
+  CoglHandle source = texture;
+
+  level = clutter_kawase_blur_effect_get_gaussian_level (self,
+                                                         clutter_kawase_blur_effect_get_gaussian_sigma (self),
+                                                         &level_sigma);
+  width = MAX (self->tex_width >> level, 1);
+  height = MAX (self->tex_height >> level, 1);
+
+  clutter_kawase_blur_effect_ensure_gaussian (self, level);
+  kawase_blur_gaussian_kernel (level_sigma, offsets, weights);
+
+  // Halving
+  for(gint i=self->source_downscale+1; i<=level; i++)
+    {
+      CoglFramebuffer *target = self->gaussian_framebuffers[i-1];
+      gint level_width = MAX (self->tex_width >> i, 1);
+      gint level_height = MAX (self->tex_height >> i, 1);
+      guint64 pixels = self->stats.pixels_rasterized;
+      KawaseBlurGpuSpan span;
+
+      cogl_pipeline_set_layer_texture (self->gaussian_pipelines[i-1], 0, source);
+
+      kawase_blur_gpu_span_begin (&span, "downsample");
+      clutter_kawase_blur_effect_draw_pass (self, target, self->gaussian_pipelines[i-1],
+                                            NULL, level_width, level_height);
+      clutter_kawase_blur_effect_end_pass (target);
+      kawase_blur_gpu_span_end (&span, i, level_width, level_height, self->strength);
+
+      clutter_kawase_blur_effect_count_traffic (self,
+                                                self->stats.pixels_rasterized - pixels,
+                                                level_width, level_height, FRAMEBUFFER_BPP,
+                                                level_width * 2, level_height * 2, FRAMEBUFFER_BPP);
+
+      source = self->gaussian_textures[i-1];
+    }
+
+  // Horizontal, then vertical pass
+  for(gint pass=GAUSSIAN_HORIZONTAL; pass<=GAUSSIAN_VERTICAL; pass++)
+    {
+      CoglPipeline *pipeline = self->gaussian_pipelines[pass];
+      CoglFramebuffer *target = self->gaussian_framebuffers[pass];
+      guint64 pixels = self->stats.pixels_rasterized;
+      gfloat direction[2];
+      KawaseBlurGpuSpan span;
+
+      direction[0] = (pass == GAUSSIAN_HORIZONTAL) ? 1.0f / width : 0.0f;
+      direction[1] = (pass == GAUSSIAN_HORIZONTAL) ? 0.0f : 1.0f / height;
+
+      cogl_pipeline_set_uniform_float (pipeline, klass->direction_uniform, 2, 1, direction);
+      cogl_pipeline_set_uniform_float (pipeline, klass->tap_offsets_uniform, 1, GAUSSIAN_TAPS, offsets);
+      cogl_pipeline_set_uniform_float (pipeline, klass->tap_weights_uniform, 1, GAUSSIAN_TAPS, weights);
+      cogl_pipeline_set_layer_texture (pipeline, 0, source);
+
+      kawase_blur_gpu_span_begin (&span, "gaussian");
+      clutter_kawase_blur_effect_draw_pass (self, target, pipeline, NULL, width, height);
+      clutter_kawase_blur_effect_end_pass (target);
+      kawase_blur_gpu_span_end (&span, level, width, height, self->strength);
+
+      clutter_kawase_blur_effect_count_traffic (self,
+                                                self->stats.pixels_rasterized - pixels,
+                                                width, height, FRAMEBUFFER_BPP,
+                                                width, height, FRAMEBUFFER_BPP);
+
+      source = self->gaussian_textures[pass];
+    }
+
+  self->gaussian_passes = level - self->source_downscale + 2;
+  self->stats.passes_executed += self->gaussian_passes;
+}
+
+static void
+clutter_kawase_blur_effect_gaussian_composite (ClutterKawaseBlurEffect *self,
+                                               CoglFramebuffer         *framebuffer)
+{
+  CoglPipeline *pipeline = self->gaussian_pipelines[GAUSSIAN_COMPOSITE];
+  guint64 pixels = self->stats.pixels_rasterized;
+  KawaseBlurGpuSpan composite;
+
+  cogl_pipeline_set_layer_texture (pipeline, 0, self->gaussian_textures[GAUSSIAN_VERTICAL]);
+
+  // Every pass flipped the image vertically, see kawase_composite
+  kawase_blur_gpu_span_begin (&composite, "composite");
+  clutter_kawase_blur_effect_draw_final (self, framebuffer, pipeline,
+                                         self->gaussian_passes % 2 == 1);
+  kawase_blur_gpu_span_end (&composite, 0,
+                            self->tex_width, self->tex_height,
+                            self->strength);
+  self->stats.passes_executed++;
+
+  clutter_kawase_blur_effect_count_traffic (self,
+                                            self->stats.pixels_rasterized - pixels,
+                                            self->tex_width, self->tex_height, FRAMEBUFFER_BPP,
+                                            MAX (self->tex_width >> self->gaussian_level, 1),
+                                            MAX (self->tex_height >> self->gaussian_level, 1),
+                                            FRAMEBUFFER_BPP);
+}
+
+const KawaseBlurEngine kawase_blur_gaussian_engine = {
+  FALSE,
+  clutter_kawase_blur_effect_gaussian_run,
+  clutter_kawase_blur_effect_gaussian_composite,
+  clutter_kawase_blur_effect_clear_gaussian
+};
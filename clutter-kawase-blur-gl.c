@@ -0,0 +1,207 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * The GL entry points the blur needs beyond what Cogl wraps: timer
+ * queries for tracing and for the adaptive quality, and the framebuffer
+ * blit of blur-behind. They are looked up through Cogl on first use.
+ */
+
+#define COGL_ENABLE_EXPERIMENTAL_API
+
+#include "clutter-kawase-blur-gl.h"
+
+#include <cogl/cogl.h>
+#include <stdio.h>
+#include <string.h>
+
+KawaseBlurGpuTimer kawase_blur_gpu_timer = { FALSE, };
+
+KawaseBlurGlBlit kawase_blur_gl_blit = { FALSE, };
+
+#define KAWASE_GL_LOOKUP(timer, function) \
+  ((timer)->function = (gpointer) cogl_get_proc_address ("gl" #function))
+
+/*
+ * Looks up the timer query entry points. This needs the GL context Clutter
+ * paints with to be current, so it happens when the first pass is traced.
+ */
+void
+kawase_blur_gpu_timer_probe (KawaseBlurGpuTimer *timer)
+{
+  const gchar *version, *extensions;
+  gint major = 0, minor = 0;
+  gint64 gpu_now;
+
+  timer->probed = TRUE;
+  timer->pending = g_array_new (FALSE, FALSE, sizeof (KawaseBlurGpuSpan));
+
+  if (KAWASE_GL_LOOKUP (timer, GetString) == NULL ||
+      KAWASE_GL_LOOKUP (timer, GenQueries) == NULL ||
+      KAWASE_GL_LOOKUP (timer, DeleteQueries) == NULL ||
+      KAWASE_GL_LOOKUP (timer, QueryCounter) == NULL ||
+      KAWASE_GL_LOOKUP (timer, GetQueryObjectiv) == NULL ||
+      KAWASE_GL_LOOKUP (timer, GetQueryObjectui64v) == NULL ||
+      KAWASE_GL_LOOKUP (timer, GetInteger64v) == NULL)
+    return;
+
+  // Timer queries are core since OpenGL 3.3, GLES strings don't parse here
+  version = (const gchar *) timer->GetString (KAWASE_GL_VERSION);
+  extensions = (const gchar *) timer->GetString (KAWASE_GL_EXTENSIONS);
+  if (version == NULL || sscanf (version, "%d.%d", &major, &minor) != 2)
+    return;
+  if (major * 10 + minor < 33 &&
+      (extensions == NULL || strstr (extensions, "GL_ARB_timer_query") == NULL))
+    return;
+
+  timer->GetInteger64v (KAWASE_GL_TIMESTAMP, &gpu_now);
+  timer->gpu_offset = g_get_monotonic_time () - gpu_now / 1000;
+  timer->available = TRUE;
+}
+
+/*
+ * Looks up the framebuffer blit, core since OpenGL 3.0. Like the timer
+ * queries, this needs the GL context to be current.
+ */
+void
+kawase_blur_gl_blit_probe (KawaseBlurGlBlit *blit)
+{
+  const gchar *version, *extensions;
+  gint major = 0, minor = 0;
+
+  blit->probed = TRUE;
+
+  if (KAWASE_GL_LOOKUP (blit, GetString) == NULL ||
+      KAWASE_GL_LOOKUP (blit, GetError) == NULL ||
+      KAWASE_GL_LOOKUP (blit, GetIntegerv) == NULL ||
+      KAWASE_GL_LOOKUP (blit, IsEnabled) == NULL ||
+      KAWASE_GL_LOOKUP (blit, Enable) == NULL ||
+      KAWASE_GL_LOOKUP (blit, Disable) == NULL ||
+      KAWASE_GL_LOOKUP (blit, GenFramebuffers) == NULL ||
+      KAWASE_GL_LOOKUP (blit, DeleteFramebuffers) == NULL ||
+      KAWASE_GL_LOOKUP (blit, BindFramebuffer) == NULL ||
+      KAWASE_GL_LOOKUP (blit, FramebufferTexture2D) == NULL ||
+      KAWASE_GL_LOOKUP (blit, CheckFramebufferStatus) == NULL ||
+      KAWASE_GL_LOOKUP (blit, BlitFramebuffer) == NULL)
+    return;
+
+  version = (const gchar *) blit->GetString (KAWASE_GL_VERSION);
+  extensions = (const gchar *) blit->GetString (KAWASE_GL_EXTENSIONS);
+  if (version == NULL || sscanf (version, "%d.%d", &major, &minor) != 2)
+    return;
+  if (major < 3 &&
+      (extensions == NULL || strstr (extensions, "GL_ARB_framebuffer_object") == NULL))
+    return;
+
+  blit->available = TRUE;
+}
+
+#undef KAWASE_GL_LOOKUP
+
+/*
+ * Opens a span for GPU work. Without timer queries it only records how
+ * long submitting the work took on the CPU. Cogl batches draws in the
+ * journal of each framebuffer, so it is flushed before each timestamp;
+ * that changes the batching a bit, but only while tracing.
+ */
+void
+kawase_blur_gpu_span_begin (KawaseBlurGpuSpan *gpu,
+                            const gchar       *name)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+
+  gpu->span = clutter_kawase_blur_trace_begin (name);
+  gpu->queries[0] = 0;
+  gpu->queries[1] = 0;
+
+  if (gpu->span.event == NULL)
+    return;
+
+  if (!timer->probed)
+    kawase_blur_gpu_timer_probe (timer);
+  if (!timer->available)
+    return;
+
+  cogl_flush ();
+  timer->GenQueries (2, gpu->queries);
+  timer->QueryCounter (gpu->queries[0], KAWASE_GL_TIMESTAMP);
+}
+
+void
+kawase_blur_gpu_span_end (KawaseBlurGpuSpan *gpu,
+                          gint               level,
+                          gint               width,
+                          gint               height,
+                          gfloat             strength)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+
+  if (gpu->queries[0] != 0)
+    {
+      cogl_flush ();
+      timer->QueryCounter (gpu->queries[1], KAWASE_GL_TIMESTAMP);
+      g_array_append_val (timer->pending, *gpu);
+    }
+
+  clutter_kawase_blur_trace_end (gpu->span, level, width, height, strength);
+}
+
+/*
+ * Hands the GPU times of finished spans to the trace, oldest first. Unless
+ * wait is set, it stops at the first span the GPU isn't done with yet.
+ */
+void
+kawase_blur_gpu_resolve_spans (gboolean wait)
+{
+  KawaseBlurGpuTimer *timer = &kawase_blur_gpu_timer;
+  guint resolved;
+
+  if (!timer->available)
+    return;
+
+  for(resolved=0; resolved<timer->pending->len; resolved++)
+    {
+      KawaseBlurGpuSpan *gpu =
+        &g_array_index (timer->pending, KawaseBlurGpuSpan, resolved);
+      guint64 begin, end;
+
+      if (!wait)
+        {
+          gint available = 0;
+
+          timer->GetQueryObjectiv (gpu->queries[1], KAWASE_GL_QUERY_RESULT_AVAILABLE, &available);
+          if (!available)
+            break;
+        }
+
+      timer->GetQueryObjectui64v (gpu->queries[0], KAWASE_GL_QUERY_RESULT, &begin);
+      timer->GetQueryObjectui64v (gpu->queries[1], KAWASE_GL_QUERY_RESULT, &end);
+      clutter_kawase_blur_trace_set_gpu_time (gpu->span,
+                                              (gint64) (begin / 1000) + timer->gpu_offset,
+                                              (gint64) (end / 1000) + timer->gpu_offset);
+      timer->DeleteQueries (2, gpu->queries);
+    }
+
+  g_array_remove_range (timer->pending, 0, resolved);
+}
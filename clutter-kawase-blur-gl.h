@@ -0,0 +1,124 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __CLUTTER_KAWASE_BLUR_GL_H__
+#define __CLUTTER_KAWASE_BLUR_GL_H__
+
+#include "clutter-kawase-blur-trace.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Tracing, see clutter_kawase_blur_effect_class_start_trace(). Passes and
+ * the final draw are timed on the GPU with GL_ARB_timer_query, which Cogl
+ * doesn't wrap, so the entry points are looked up through Cogl the first
+ * time a pass is traced. A timestamp is written into the GL command stream
+ * before and after the pass; the results are collected a few frames later,
+ * once the GPU got there, and converted to g_get_monotonic_time() units
+ * with gpu_offset, measured when the queries are set up.
+ */
+#define KAWASE_GL_QUERY_RESULT 0x8866
+#define KAWASE_GL_QUERY_RESULT_AVAILABLE 0x8867
+#define KAWASE_GL_TIMESTAMP 0x8E28
+#define KAWASE_GL_VERSION 0x1F02
+#define KAWASE_GL_EXTENSIONS 0x1F03
+
+typedef struct {
+  ClutterKawaseBlurTraceSpan span;
+  guint queries[2];
+} KawaseBlurGpuSpan;
+
+typedef struct {
+  gboolean probed;
+  gboolean available;
+  gint64 gpu_offset;
+  /* KawaseBlurGpuSpan, oldest first */
+  GArray *pending;
+
+  const guint8 *(* GetString) (guint name);
+  void (* GenQueries) (gint n, guint *ids);
+  void (* DeleteQueries) (gint n, const guint *ids);
+  void (* QueryCounter) (guint id, guint target);
+  void (* GetQueryObjectiv) (guint id, guint pname, gint *params);
+  void (* GetQueryObjectui64v) (guint id, guint pname, guint64 *params);
+  void (* GetInteger64v) (guint pname, gint64 *data);
+} KawaseBlurGpuTimer;
+
+extern KawaseBlurGpuTimer kawase_blur_gpu_timer;
+
+/*
+ * Blur-behind copies the backdrop with glBlitFramebuffer, which Cogl
+ * doesn't wrap either. Cogl caches the GL state it set, so everything the
+ * copy changes is put back afterwards.
+ */
+#define KAWASE_GL_TEXTURE_2D 0x0DE1
+#define KAWASE_GL_SCISSOR_TEST 0x0C11
+#define KAWASE_GL_NO_ERROR 0
+#define KAWASE_GL_COLOR_BUFFER_BIT 0x4000
+#define KAWASE_GL_NEAREST 0x2600
+#define KAWASE_GL_READ_FRAMEBUFFER 0x8CA8
+#define KAWASE_GL_DRAW_FRAMEBUFFER 0x8CA9
+#define KAWASE_GL_DRAW_FRAMEBUFFER_BINDING 0x8CA6
+#define KAWASE_GL_READ_FRAMEBUFFER_BINDING 0x8CAA
+#define KAWASE_GL_COLOR_ATTACHMENT0 0x8CE0
+#define KAWASE_GL_FRAMEBUFFER_COMPLETE 0x8CD5
+
+typedef struct {
+  gboolean probed;
+  gboolean available;
+
+  const guint8 *(* GetString) (guint name);
+  guint (* GetError) (void);
+  void (* GetIntegerv) (guint pname, gint *data);
+  guint8 (* IsEnabled) (guint cap);
+  void (* Enable) (guint cap);
+  void (* Disable) (guint cap);
+  void (* GenFramebuffers) (gint n, guint *ids);
+  void (* DeleteFramebuffers) (gint n, const guint *ids);
+  void (* BindFramebuffer) (guint target, guint framebuffer);
+  void (* FramebufferTexture2D) (guint target, guint attachment, guint textarget,
+                                 guint texture, gint level);
+  guint (* CheckFramebufferStatus) (guint target);
+  void (* BlitFramebuffer) (gint src_x0, gint src_y0, gint src_x1, gint src_y1,
+                            gint dst_x0, gint dst_y0, gint dst_x1, gint dst_y1,
+                            guint mask, guint filter);
+} KawaseBlurGlBlit;
+
+extern KawaseBlurGlBlit kawase_blur_gl_blit;
+
+void kawase_blur_gpu_timer_probe (KawaseBlurGpuTimer *timer);
+void kawase_blur_gl_blit_probe (KawaseBlurGlBlit *blit);
+
+void kawase_blur_gpu_span_begin (KawaseBlurGpuSpan *gpu,
+                                 const gchar       *name);
+void kawase_blur_gpu_span_end (KawaseBlurGpuSpan *gpu,
+                               gint               level,
+                               gint               width,
+                               gint               height,
+                               gfloat             strength);
+void kawase_blur_gpu_resolve_spans (gboolean wait);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_KAWASE_BLUR_GL_H__ */
@@ -0,0 +1,188 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * The intermediate textures of the blur, and the pool that effects with a
+ * shared pyramid borrow them from, see
+ * clutter_kawase_blur_effect_set_shared_pyramid().
+ */
+
+#define COGL_ENABLE_EXPERIMENTAL_API
+#define CLUTTER_ENABLE_EXPERIMENTAL_API
+
+#include "clutter-kawase-blur-pool.h"
+
+/* Whether a format has already fallen back to RGBA8888, to warn only once */
+static gboolean kawase_blur_format_fallback_warned = FALSE;
+
+/*
+ * Creates a texture of the given format together with the framebuffer
+ * rendering into it. Cogl picks the storage of a texture created with
+ * only a size from its components, which makes RGB888 out of any RGB
+ * format, so RGB565 textures are created from a black 565 image instead:
+ * their storage follows the format of the data. Not every driver can
+ * render into every format, GLES 2 without OES_rgb8_rgba8 can't render
+ * into RGB888 for example; format is changed to RGBA8888 then.
+ */
+CoglFramebuffer *
+kawase_blur_level_new (CoglContext             *ctx,
+                       gint                     width,
+                       gint                     height,
+                       ClutterKawaseBlurFormat *format,
+                       CoglHandle              *texture)
+{
+  CoglTexture2D *texture_2d = NULL;
+  CoglFramebuffer *framebuffer;
+  GError *error = NULL;
+
+  if (*format == CLUTTER_KAWASE_BLUR_FORMAT_RGB565)
+    {
+      guint8 *black = g_malloc0 ((gsize) width * height * 2);
+
+      texture_2d = cogl_texture_2d_new_from_data (ctx, width, height,
+                                                  COGL_PIXEL_FORMAT_RGB_565,
+                                                  width * 2, black, NULL);
+      g_free (black);
+
+      if (texture_2d == NULL)
+        *format = CLUTTER_KAWASE_BLUR_FORMAT_RGB888;
+    }
+
+  if (texture_2d == NULL)
+    {
+      texture_2d = cogl_texture_2d_new_with_size (ctx, width, height);
+      cogl_texture_set_components (texture_2d,
+                                   *format == CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888
+                                   ? COGL_TEXTURE_COMPONENTS_RGBA
+                                   : COGL_TEXTURE_COMPONENTS_RGB);
+    }
+
+  framebuffer = cogl_offscreen_new_with_texture (texture_2d);
+
+  // RGBA8888 is always renderable, its completeness check is left to the first draw
+  if (*format != CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888 &&
+      !cogl_framebuffer_allocate (framebuffer, &error))
+    {
+      if (!kawase_blur_format_fallback_warned)
+        g_warning ("Unable to render into the intermediate texture format, "
+                   "using RGBA8888 instead: %s", error->message);
+      kawase_blur_format_fallback_warned = TRUE;
+      g_error_free (error);
+
+      cogl_object_unref (framebuffer);
+      cogl_object_unref (texture_2d);
+
+      *format = CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888;
+      return kawase_blur_level_new (ctx, width, height, format, texture);
+    }
+
+  *texture = texture_2d;
+  return framebuffer;
+}
+
+static void
+kawase_blur_pool_entry_free (KawaseBlurPoolEntry *entry)
+{
+  cogl_object_unref (entry->framebuffer);
+  cogl_object_unref (entry->texture);
+  g_slice_free (KawaseBlurPoolEntry, entry);
+}
+
+/*
+ * Frees idle entries, least recently used first, until the pool fits into
+ * max_bytes. Borrowed entries are never evicted, so the pool may exceed
+ * its limit while they are in use.
+ */
+void
+kawase_blur_pool_trim (KawaseBlurTexturePool *pool,
+                       guint64                max_bytes)
+{
+  while (pool->bytes > max_bytes && !g_queue_is_empty (&pool->idle))
+    {
+      KawaseBlurPoolEntry *entry = g_queue_pop_tail (&pool->idle);
+
+      pool->bytes -= entry->bytes;
+      pool->evictions++;
+      kawase_blur_pool_entry_free (entry);
+    }
+}
+
+/*
+ * Hands out an idle texture of the given size and format, the most
+ * recently used one if there are several, or allocates a new one. Sets
+ * allocated to whether a new texture had to be created.
+ */
+KawaseBlurPoolEntry *
+kawase_blur_pool_borrow (KawaseBlurTexturePool   *pool,
+                         CoglContext             *ctx,
+                         gint                     width,
+                         gint                     height,
+                         ClutterKawaseBlurFormat  format,
+                         gboolean                *allocated)
+{
+  KawaseBlurPoolEntry *entry;
+
+  pool->borrows++;
+
+  for(GList *l=pool->idle.head; l!=NULL; l=l->next)
+    {
+      entry = l->data;
+
+      if (entry->width == width &&
+          entry->height == height &&
+          entry->requested_format == format)
+        {
+          g_queue_delete_link (&pool->idle, l);
+          *allocated = FALSE;
+          return entry;
+        }
+    }
+
+  entry = g_slice_new (KawaseBlurPoolEntry);
+  entry->width = width;
+  entry->height = height;
+  entry->requested_format = format;
+  entry->format = format;
+  entry->framebuffer = kawase_blur_level_new (ctx, width, height,
+                                              &entry->format, &entry->texture);
+  entry->bytes = (guint64) width * height * kawase_blur_format_get_bpp (entry->format);
+
+  pool->bytes += entry->bytes;
+  pool->peak_bytes = MAX (pool->peak_bytes, pool->bytes);
+  pool->textures_allocated++;
+  *allocated = TRUE;
+
+  // Make room for the new texture among the idle ones
+  kawase_blur_pool_trim (pool, pool->limit);
+
+  return entry;
+}
+
+void
+kawase_blur_pool_release (KawaseBlurTexturePool *pool,
+                          KawaseBlurPoolEntry   *entry)
+{
+  g_queue_push_head (&pool->idle, entry);
+  kawase_blur_pool_trim (pool, pool->limit);
+}
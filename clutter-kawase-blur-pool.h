@@ -0,0 +1,102 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __CLUTTER_KAWASE_BLUR_POOL_H__
+#define __CLUTTER_KAWASE_BLUR_POOL_H__
+
+#include "clutter-kawase-blur-effect.h"
+
+G_BEGIN_DECLS
+
+/*
+ * An intermediate texture of the shared pool together with the offscreen
+ * framebuffer rendering into it. Entries are owned by the pool; while an
+ * effect borrows one, it is not part of the idle queue.
+ */
+typedef struct {
+  CoglHandle texture;
+  CoglFramebuffer *framebuffer;
+  gint width;
+  gint height;
+  /* the format that was asked for, and the one the texture ended up with */
+  ClutterKawaseBlurFormat requested_format;
+  ClutterKawaseBlurFormat format;
+  guint64 bytes;
+} KawaseBlurPoolEntry;
+
+/*
+ * Textures shared by all the effects that use the shared pyramid. Idle
+ * entries are kept in least recently used order, the most recently
+ * returned one at the head. bytes covers idle and borrowed entries.
+ */
+typedef struct {
+  GQueue idle;
+  guint64 limit;
+  guint64 bytes;
+  guint64 peak_bytes;
+  guint textures_allocated;
+  guint64 borrows;
+  guint64 evictions;
+} KawaseBlurTexturePool;
+
+/*
+ * Bytes a texel of the given format is meant to take. Drivers are free to
+ * pad RGB888 to four bytes, so for RGB888 this is a lower bound.
+ */
+static inline gint
+kawase_blur_format_get_bpp (ClutterKawaseBlurFormat format)
+{
+  switch (format)
+    {
+    case CLUTTER_KAWASE_BLUR_FORMAT_RGB888:
+      return 3;
+
+    case CLUTTER_KAWASE_BLUR_FORMAT_RGB565:
+      return 2;
+
+    default:
+      return 4;
+    }
+}
+
+CoglFramebuffer *kawase_blur_level_new (CoglContext             *ctx,
+                                        gint                     width,
+                                        gint                     height,
+                                        ClutterKawaseBlurFormat *format,
+                                        CoglHandle              *texture);
+
+KawaseBlurPoolEntry *kawase_blur_pool_borrow (KawaseBlurTexturePool   *pool,
+                                              CoglContext             *ctx,
+                                              gint                     width,
+                                              gint                     height,
+                                              ClutterKawaseBlurFormat  format,
+                                              gboolean                *allocated);
+void kawase_blur_pool_release (KawaseBlurTexturePool *pool,
+                               KawaseBlurPoolEntry   *entry);
+void kawase_blur_pool_trim (KawaseBlurTexturePool *pool,
+                            guint64                max_bytes);
+
+G_END_DECLS
+
+#endif /* __CLUTTER_KAWASE_BLUR_POOL_H__ */
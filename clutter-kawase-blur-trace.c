@@ -0,0 +1,348 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+/*
+ * Timeline recording of the blur, written as a Chrome trace-event JSON
+ * file that chrome://tracing and Perfetto can open.
+ *
+ * Every thread records into a ring buffer of its own, so recording a span
+ * takes neither a lock nor an allocation; the lock is only taken when a
+ * thread records its first span and when the trace is written. Once a
+ * buffer is full, the oldest spans are overwritten. Buffers of threads
+ * that exited are handed to the next new thread, which keeps the memory
+ * bounded with thread pools that come and go.
+ *
+ * Spans are recorded in CPU time. A span can additionally carry the time
+ * the GPU spent on it, which the effect measures with timer queries where
+ * the driver supports them; those spans show up a second time on a
+ * separate "GPU" track.
+ */
+
+#include "clutter-kawase-blur-trace.h"
+
+/* Number of spans every thread keeps, about 1 MiB per thread */
+#define TRACE_BUFFER_EVENTS 16384
+
+/* Track the GPU spans are written to */
+#define TRACE_GPU_TID 0
+
+typedef struct {
+  guint64 serial;
+  guint epoch;
+  const gchar *name;
+  gint64 begin;
+  /* 0 as long as the span is open */
+  gint64 end;
+  /* 0 without a GPU time */
+  gint64 gpu_begin;
+  gint64 gpu_end;
+  gint level;
+  gint width;
+  gint height;
+  gfloat strength;
+} KawaseTraceEvent;
+
+typedef struct {
+  KawaseTraceEvent *events;
+  /* serial of the last recorded span, spans are numbered from 1 */
+  guint64 serial;
+  gint tid;
+  gboolean main_thread;
+  gboolean retired;
+} KawaseTraceBuffer;
+
+gint clutter_kawase_blur_trace_active = 0;
+
+/* Spans recorded before the last clutter_kawase_blur_trace_start() are ignored */
+static guint trace_epoch = 0;
+
+static GMutex trace_lock;
+static GPtrArray *trace_buffers = NULL;
+
+static void
+kawase_trace_buffer_retire (gpointer data)
+{
+  KawaseTraceBuffer *buffer = data;
+
+  g_mutex_lock (&trace_lock);
+  buffer->retired = TRUE;
+  g_mutex_unlock (&trace_lock);
+}
+
+static GPrivate trace_buffer_key = G_PRIVATE_INIT (kawase_trace_buffer_retire);
+
+static KawaseTraceBuffer *
+kawase_trace_get_buffer (void)
+{
+  KawaseTraceBuffer *buffer = g_private_get (&trace_buffer_key);
+
+  if (G_LIKELY (buffer != NULL))
+    return buffer;
+
+  g_mutex_lock (&trace_lock);
+
+  if (trace_buffers == NULL)
+    trace_buffers = g_ptr_array_new ();
+
+  for(guint i=0; i<trace_buffers->len; i++)
+    {
+      KawaseTraceBuffer *candidate = g_ptr_array_index (trace_buffers, i);
+
+      if (candidate->retired)
+        {
+          buffer = candidate;
+          buffer->retired = FALSE;
+          break;
+        }
+    }
+
+  if (buffer == NULL)
+    {
+      buffer = g_new0 (KawaseTraceBuffer, 1);
+      buffer->events = g_new0 (KawaseTraceEvent, TRACE_BUFFER_EVENTS);
+      buffer->tid = trace_buffers->len + 1;
+      g_ptr_array_add (trace_buffers, buffer);
+    }
+
+  // Clutter paints from the thread that runs the default main context
+  buffer->main_thread = g_main_context_is_owner (g_main_context_default ());
+
+  g_mutex_unlock (&trace_lock);
+
+  g_private_set (&trace_buffer_key, buffer);
+
+  return buffer;
+}
+
+/**
+ * clutter_kawase_blur_trace_start:
+ *
+ * Starts recording spans. Spans recorded by an earlier trace are
+ * discarded.
+ */
+void
+clutter_kawase_blur_trace_start (void)
+{
+  g_mutex_lock (&trace_lock);
+  trace_epoch++;
+  g_mutex_unlock (&trace_lock);
+
+  g_atomic_int_set (&clutter_kawase_blur_trace_active, 1);
+}
+
+/**
+ * clutter_kawase_blur_trace_stop:
+ *
+ * Stops recording spans. The recorded spans are kept until the next
+ * clutter_kawase_blur_trace_start().
+ */
+void
+clutter_kawase_blur_trace_stop (void)
+{
+  g_atomic_int_set (&clutter_kawase_blur_trace_active, 0);
+}
+
+/**
+ * clutter_kawase_blur_trace_begin_span:
+ * @name: a static string naming the span
+ *
+ * Opens a span on the calling thread. Use clutter_kawase_blur_trace_begin(),
+ * which skips the call while tracing is disabled.
+ *
+ * Return value: the handle to pass to clutter_kawase_blur_trace_end()
+ */
+ClutterKawaseBlurTraceSpan
+clutter_kawase_blur_trace_begin_span (const gchar *name)
+{
+  KawaseTraceBuffer *buffer = kawase_trace_get_buffer ();
+  ClutterKawaseBlurTraceSpan span;
+  KawaseTraceEvent *event;
+
+  // Only this thread writes the buffer, so a plain increment is enough
+  span.serial = ++buffer->serial;
+  event = &buffer->events[span.serial % TRACE_BUFFER_EVENTS];
+
+  event->serial = span.serial;
+  event->epoch = trace_epoch;
+  event->name = name;
+  event->end = 0;
+  event->gpu_begin = 0;
+  event->gpu_end = 0;
+  event->begin = g_get_monotonic_time ();
+
+  span.event = event;
+
+  return span;
+}
+
+/**
+ * clutter_kawase_blur_trace_end_span:
+ * @span: a span returned by clutter_kawase_blur_trace_begin()
+ * @level: the pyramid level the span worked on, or -1
+ * @width: the width of the image the span worked on, or 0
+ * @height: the height of that image, or 0
+ * @strength: the blur strength, or a negative value
+ *
+ * Closes a span and attaches its arguments. Use
+ * clutter_kawase_blur_trace_end().
+ */
+void
+clutter_kawase_blur_trace_end_span (ClutterKawaseBlurTraceSpan span,
+                                    gint                       level,
+                                    gint                       width,
+                                    gint                       height,
+                                    gfloat                     strength)
+{
+  KawaseTraceEvent *event = span.event;
+  gint64 end = g_get_monotonic_time ();
+
+  if (event->serial != span.serial)
+    return;
+
+  event->level = level;
+  event->width = width;
+  event->height = height;
+  event->strength = strength;
+  // A span that took no measurable time must still count as closed
+  event->end = MAX (end, event->begin + 1);
+}
+
+/**
+ * clutter_kawase_blur_trace_set_gpu_time:
+ * @span: a span returned by clutter_kawase_blur_trace_begin()
+ * @begin: when the GPU started on the span, in g_get_monotonic_time() units
+ * @end: when the GPU was done with it
+ *
+ * Attaches the time the GPU spent on a span, which may only be known a
+ * few frames after the span was closed. Must be called from the thread
+ * that recorded the span. Nothing happens if its slot has been reused
+ * since.
+ */
+void
+clutter_kawase_blur_trace_set_gpu_time (ClutterKawaseBlurTraceSpan span,
+                                        gint64                     begin,
+                                        gint64                     end)
+{
+  KawaseTraceEvent *event = span.event;
+
+  if (event == NULL || event->serial != span.serial)
+    return;
+
+  event->gpu_begin = begin;
+  event->gpu_end = MAX (end, begin + 1);
+}
+
+static void
+kawase_trace_append_event (GString                *json,
+                           const KawaseTraceEvent *event,
+                           gint                    tid,
+                           gint64                  begin,
+                           gint64                  end)
+{
+  gchar strength[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (json,
+                          ",\n    { \"name\": \"%s\", \"cat\": \"blur\", \"ph\": \"X\", "
+                          "\"pid\": 1, \"tid\": %d, "
+                          "\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT ", \"args\": {",
+                          event->name, tid, begin, end - begin);
+
+  if (event->level >= 0)
+    g_string_append_printf (json, " \"level\": %d,", event->level);
+  if (event->width > 0)
+    g_string_append_printf (json, " \"width\": %d, \"height\": %d,", event->width, event->height);
+  if (event->strength >= 0.0f)
+    g_string_append_printf (json, " \"strength\": %s,",
+                            g_ascii_formatd (strength, sizeof (strength), "%.2f", event->strength));
+
+  // Drop the trailing comma of the last argument
+  if (json->str[json->len - 1] == ',')
+    g_string_truncate (json, json->len - 1);
+
+  g_string_append (json, " } }");
+}
+
+/**
+ * clutter_kawase_blur_trace_write:
+ * @filename: the file to write to
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the spans recorded since the last clutter_kawase_blur_trace_start()
+ * as Chrome trace-event JSON. Spans that are still open are left out.
+ * Should be called after clutter_kawase_blur_trace_stop(), spans recorded
+ * concurrently may be torn.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+clutter_kawase_blur_trace_write (const gchar  *filename,
+                                 GError      **error)
+{
+  GString *json = g_string_new (NULL);
+  gboolean success;
+
+  g_string_append_printf (json,
+                          "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n"
+                          "    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                          "\"tid\": %d, \"args\": { \"name\": \"GPU\" } }",
+                          TRACE_GPU_TID);
+
+  g_mutex_lock (&trace_lock);
+
+  for(guint i=0; trace_buffers != NULL && i<trace_buffers->len; i++)
+    {
+      KawaseTraceBuffer *buffer = g_ptr_array_index (trace_buffers, i);
+      guint64 first = buffer->serial > TRACE_BUFFER_EVENTS
+                    ? buffer->serial - TRACE_BUFFER_EVENTS + 1
+                    : 1;
+
+      g_string_append_printf (json,
+                              ",\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                              "\"tid\": %d, \"args\": { \"name\": \"%s %d\" } }",
+                              buffer->tid,
+                              buffer->main_thread ? "main" : "worker",
+                              buffer->tid);
+
+      for(guint64 serial=first; serial<=buffer->serial; serial++)
+        {
+          const KawaseTraceEvent *event = &buffer->events[serial % TRACE_BUFFER_EVENTS];
+
+          if (event->serial != serial || event->epoch != trace_epoch || event->end == 0)
+            continue;
+
+          kawase_trace_append_event (json, event, buffer->tid, event->begin, event->end);
+          if (event->gpu_end != 0)
+            kawase_trace_append_event (json, event, TRACE_GPU_TID, event->gpu_begin, event->gpu_end);
+        }
+    }
+
+  g_mutex_unlock (&trace_lock);
+
+  g_string_append (json, "\n  ]\n}\n");
+
+  success = g_file_set_contents (filename, json->str, json->len, error);
+  g_string_free (json, TRUE);
+
+  return success;
+}
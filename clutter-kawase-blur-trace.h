@@ -0,0 +1,101 @@
+/*
+ * Clutter.
+ *
+ * An OpenGL based 'interactive canvas' library.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __CLUTTER_KAWASE_BLUR_TRACE_H__
+#define __CLUTTER_KAWASE_BLUR_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ClutterKawaseBlurTraceSpan:
+ * @event: the recorded event, %NULL while tracing is disabled
+ * @serial: the serial of the event, to detect that its slot was reused
+ *
+ * A handle to a span that has been opened with
+ * clutter_kawase_blur_trace_begin(). It stays valid until the ring buffer
+ * of its thread wraps around.
+ */
+typedef struct _ClutterKawaseBlurTraceSpan ClutterKawaseBlurTraceSpan;
+
+struct _ClutterKawaseBlurTraceSpan
+{
+  gpointer event;
+  guint64 serial;
+};
+
+/* Non-zero while spans are recorded, read with clutter_kawase_blur_trace_is_active() */
+extern gint clutter_kawase_blur_trace_active;
+
+static inline gboolean
+clutter_kawase_blur_trace_is_active (void)
+{
+  return G_UNLIKELY (g_atomic_int_get (&clutter_kawase_blur_trace_active));
+}
+
+void clutter_kawase_blur_trace_start (void);
+void clutter_kawase_blur_trace_stop (void);
+gboolean clutter_kawase_blur_trace_write (const gchar  *filename,
+                                          GError      **error);
+
+ClutterKawaseBlurTraceSpan clutter_kawase_blur_trace_begin_span (const gchar *name);
+void clutter_kawase_blur_trace_end_span (ClutterKawaseBlurTraceSpan span,
+                                         gint                       level,
+                                         gint                       width,
+                                         gint                       height,
+                                         gfloat                     strength);
+void clutter_kawase_blur_trace_set_gpu_time (ClutterKawaseBlurTraceSpan span,
+                                             gint64                     begin,
+                                             gint64                     end);
+
+/*
+ * The inline wrappers keep the cost of a disabled trace down to one atomic
+ * read. name must be a static string, it is stored as is.
+ */
+static inline ClutterKawaseBlurTraceSpan
+clutter_kawase_blur_trace_begin (const gchar *name)
+{
+  ClutterKawaseBlurTraceSpan span = { NULL, 0 };
+
+  if (clutter_kawase_blur_trace_is_active ())
+    span = clutter_kawase_blur_trace_begin_span (name);
+
+  return span;
+}
+
+static inline void
+clutter_kawase_blur_trace_end (ClutterKawaseBlurTraceSpan span,
+                               gint                       level,
+                               gint                       width,
+                               gint                       height,
+                               gfloat                     strength)
+{
+  if (G_UNLIKELY (span.event != NULL))
+    clutter_kawase_blur_trace_end_span (span, level, width, height, strength);
+}
+
+G_END_DECLS
+
+#endif /* __CLUTTER_KAWASE_BLUR_TRACE_H__ */
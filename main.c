@@ -37,8 +37,8 @@ static void
 scale_moved (GtkRange *range,
             gpointer  user_data)
 {
-   gint pos = (gint) gtk_range_get_value (range);
-   clutter_kawase_blur_effect_update_blur_strength(CLUTTER_KAWASE_BLUR_EFFECT(user_data), pos);
+   gfloat pos = (gfloat) gtk_range_get_value (range);
+   clutter_kawase_blur_effect_set_strength(CLUTTER_KAWASE_BLUR_EFFECT(user_data), pos);
 }
 
 static void
@@ -55,7 +55,7 @@ activate (GtkApplication *app,
     gint initial_strength = 7;
 
     box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 8);
-    scale = gtk_scale_new_with_range (GTK_ORIENTATION_HORIZONTAL, 0, 14, 1);
+    scale = gtk_scale_new_with_range (GTK_ORIENTATION_HORIZONTAL, 0, 14, 0.1);
     gtk_range_set_value(GTK_RANGE(scale), initial_strength);
 
     window = gtk_application_window_new (app);
@@ -0,0 +1,297 @@
+/*
+ * Dual Kawase Blur Damage Test.
+ *
+ * Blurs an image (the bundled baboon.tiff in the test suite) with a small
+ * square on top that moves and changes its color in every step. The old
+ * and the new place of the square are reported as damage (see
+ * clutter_kawase_blur_effect_add_damage()), so the effect only updates the
+ * parts of the pyramid the change reaches. Every such frame is read back
+ * and compared with a full re-blur of the same content. The test fails
+ * when a frame wasn't updated incrementally, or its PSNR against the full
+ * blur drops below --min-psnr or a single channel differs by more than
+ * --max-error.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench-common.h"
+#include "test-common.h"
+#include "clutter-kawase-blur-effect.h"
+
+#define SQUARE_SIZE 32
+
+/* A weak, a medium and the strongest blur, their damage grows differently */
+static const gint test_strengths[] = { 3, 8, 14 };
+
+static gchar *image_path = NULL;
+static gint n_steps = 4;
+static gdouble min_psnr = 40.0;
+static gint max_error = 8;
+static gboolean hardware = FALSE;
+
+static GOptionEntry entries[] = {
+    { "image", 'i', 0, G_OPTION_ARG_FILENAME, &image_path,
+      "The image to blur", "FILE" },
+    { "steps", 'n', 0, G_OPTION_ARG_INT, &n_steps,
+      "Number of moves of the square per strength", "N" },
+    { "min-psnr", 0, 0, G_OPTION_ARG_DOUBLE, &min_psnr,
+      "Lowest PSNR in dB an incremental frame may reach against the full blur", "DB" },
+    { "max-error", 0, 0, G_OPTION_ARG_INT, &max_error,
+      "Largest difference of a single channel to the full blur", "VALUE" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { NULL }
+};
+
+typedef enum {
+    /* the first frame of a strength runs the whole chain anyway */
+    PHASE_PRIME,
+    PHASE_INCREMENTAL,
+    PHASE_FULL,
+} Phase;
+
+typedef struct {
+    TestStage stage;
+    ClutterActor *square;
+    ClutterKawaseBlurEffect *effect;
+    gint width;
+    gint height;
+
+    guint strength_index;
+    gint step;
+    Phase phase;
+    guint64 incremental_frames;
+
+    /* the stage contents after the damaged frame, and after the full blur */
+    guint8 *incremental;
+    guint8 *result;
+
+    gint failures;
+} Test;
+
+static guint64
+test_get_incremental_frames (Test *test)
+{
+    ClutterKawaseBlurEffectStats stats;
+
+    clutter_kawase_blur_effect_get_stats (test->effect, &stats);
+
+    return stats.incremental_frames;
+}
+
+static void
+test_get_square_rect (Test                  *test,
+                      cairo_rectangle_int_t *rect)
+{
+    rect->x = (gint) clutter_actor_get_x (test->square);
+    rect->y = (gint) clutter_actor_get_y (test->square);
+    rect->width = SQUARE_SIZE;
+    rect->height = SQUARE_SIZE;
+}
+
+static void
+test_check_frame (Test *test)
+{
+    gint strength = test_strengths[test->strength_index];
+    gint max_difference;
+    gdouble psnr;
+
+    if (test_get_incremental_frames (test) != test->incremental_frames)
+      {
+        g_print ("strength %d, step %d: FAIL, the full blur was done incrementally\n",
+                 strength, test->step);
+        test->failures++;
+        return;
+      }
+
+    psnr = test_compare_images (test->incremental, test->result,
+                                test->width, test->height, test->width * 4, 4,
+                                &max_difference);
+
+    if (psnr < min_psnr || max_difference > max_error)
+      {
+        g_print ("strength %d, step %d: FAIL, PSNR %.2f dB, max error %d\n",
+                 strength, test->step, psnr, max_difference);
+        test->failures++;
+      }
+    else
+        g_print ("strength %d, step %d: ok, PSNR %.2f dB, max error %d\n",
+                 strength, test->step, psnr, max_difference);
+}
+
+/* Blurs the same content again, without the pyramid of the damaged frame */
+static gboolean
+test_full_blur (gpointer user_data)
+{
+    Test *test = user_data;
+
+    test->phase = PHASE_FULL;
+    test_stage_wait (&test->stage);
+    test->incremental_frames = test_get_incremental_frames (test);
+    clutter_kawase_blur_effect_invalidate (test->effect);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Moves the square, or advances to the next strength, from outside of the paint cycle */
+static gboolean
+test_next_step (gpointer user_data)
+{
+    Test *test = user_data;
+    cairo_rectangle_int_t damage[2];
+    ClutterColor color;
+
+    if (test->step == n_steps)
+      {
+        if (++test->strength_index == G_N_ELEMENTS (test_strengths))
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+
+        test->step = 0;
+        test->phase = PHASE_PRIME;
+        test_stage_wait (&test->stage);
+        clutter_kawase_blur_effect_update_blur_strength (test->effect,
+                                                         test_strengths[test->strength_index]);
+        return G_SOURCE_REMOVE;
+      }
+
+    // Deterministic places and colors that differ from step to step
+    test_get_square_rect (test, &damage[0]);
+    clutter_actor_set_position (test->square,
+                                (test->step * 97 + 40) % (test->width - SQUARE_SIZE),
+                                (test->step * 61 + 80) % (test->height - SQUARE_SIZE));
+    test_get_square_rect (test, &damage[1]);
+
+    color.red = test->step * 53;
+    color.green = 200 - test->step * 29;
+    color.blue = 255 - test->step * 37;
+    color.alpha = 255;
+    clutter_actor_set_background_color (test->square, &color);
+
+    // Changing the child queues the redraw of the blurred actor
+    clutter_kawase_blur_effect_add_damage (test->effect, damage, 2);
+
+    test->phase = PHASE_INCREMENTAL;
+    test_stage_wait (&test->stage);
+    test->incremental_frames = test_get_incremental_frames (test);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_paint_done (TestStage       *stage,
+                 CoglFramebuffer *framebuffer,
+                 gpointer         user_data)
+{
+    Test *test = user_data;
+
+    switch (test->phase)
+      {
+      case PHASE_PRIME:
+        g_idle_add (test_next_step, test);
+        break;
+
+      case PHASE_INCREMENTAL:
+        test_stage_read_pixels (stage, framebuffer, test->incremental);
+
+        if (test_get_incremental_frames (test) == test->incremental_frames)
+          {
+            g_print ("strength %d, step %d: FAIL, the damaged frame ran the whole chain\n",
+                     test_strengths[test->strength_index], test->step);
+            test->failures++;
+          }
+
+        g_idle_add (test_full_blur, test);
+        break;
+
+      case PHASE_FULL:
+        test_stage_read_pixels (stage, framebuffer, test->result);
+        test_check_frame (test);
+
+        test->step++;
+        g_idle_add (test_next_step, test);
+        break;
+      }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Test test = { 0, };
+    GdkPixbuf *pixbuf;
+    ClutterActor *actor;
+    ClutterColor white = { 0xff, 0xff, 0xff, 0xff };
+
+    context = g_option_context_new ("- compare incremental updates of the blur with a full blur");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    if (image_path == NULL)
+      {
+        g_printerr ("--image is required\n");
+        return EXIT_FAILURE;
+      }
+
+    n_steps = MAX (n_steps, 1);
+
+    pixbuf = test_load_image (image_path);
+    if (pixbuf == NULL)
+        return EXIT_FAILURE;
+
+    bench_init (&argc, &argv, hardware);
+
+    test.width = gdk_pixbuf_get_width (pixbuf);
+    test.height = gdk_pixbuf_get_height (pixbuf);
+    test.incremental = g_malloc ((gsize) test.width * test.height * 4);
+    test.result = g_malloc ((gsize) test.width * test.height * 4);
+    test.phase = PHASE_PRIME;
+
+    actor = test_create_image_actor (pixbuf);
+    test.square = clutter_actor_new ();
+    clutter_actor_set_size (test.square, SQUARE_SIZE, SQUARE_SIZE);
+    clutter_actor_set_background_color (test.square, &white);
+    clutter_actor_add_child (actor, test.square);
+
+    test.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_update_blur_strength (test.effect, test_strengths[0]);
+    clutter_actor_add_effect_with_name (actor, "blur", CLUTTER_EFFECT (test.effect));
+
+    test_stage_init (&test.stage, actor, test_paint_done, &test);
+
+    clutter_main ();
+
+    g_free (test.incremental);
+    g_free (test.result);
+    g_object_unref (pixbuf);
+    clutter_actor_destroy (test.stage.stage);
+
+    return test.failures > 0 || test.stage.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/*
+ * Dual Kawase Blur Intermediate Format Test.
+ *
+ * Blurs an image (the bundled baboon.tiff in the test suite) at all 15
+ * blur strengths with every intermediate texture format (see
+ * clutter_kawase_blur_effect_set_intermediate_format()) and compares every
+ * result with the RGBA8888 one of the same strength. The test fails when
+ * RGB888 differs beyond rounding, or the PSNR of RGB565 or auto drops
+ * below --min-psnr.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench-common.h"
+#include "test-common.h"
+#include "clutter-kawase-blur-effect.h"
+
+#define N_STRENGTHS 15
+#define N_FORMATS 4
+
+/* Lowest PSNR of the formats that have the precision of RGBA8888 */
+#define LOSSLESS_PSNR 50.0
+
+static gchar *image_path = NULL;
+static gdouble min_psnr = 30.0;
+static gboolean hardware = FALSE;
+
+static GOptionEntry entries[] = {
+    { "image", 'i', 0, G_OPTION_ARG_FILENAME, &image_path,
+      "The image to blur", "FILE" },
+    { "min-psnr", 0, 0, G_OPTION_ARG_DOUBLE, &min_psnr,
+      "Lowest PSNR in dB RGB565 and auto may reach against RGBA8888", "DB" },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { NULL }
+};
+
+/* RGBA8888 comes first, it is the reference for the others */
+static const struct {
+    ClutterKawaseBlurFormat format;
+    const gchar *name;
+    /* whether the format has the precision of the reference */
+    gboolean lossless;
+} formats[N_FORMATS] = {
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGBA8888, "rgba8888", TRUE },
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGB888, "rgb888", TRUE },
+    { CLUTTER_KAWASE_BLUR_FORMAT_RGB565, "rgb565", FALSE },
+    { CLUTTER_KAWASE_BLUR_FORMAT_AUTO, "auto", FALSE },
+};
+
+typedef struct {
+    TestStage stage;
+    ClutterKawaseBlurEffect *effect;
+    gint width;
+    gint height;
+
+    gint strength;
+    gint format;
+
+    /* the stage contents of the current format, and those of RGBA8888 */
+    guint8 *result;
+    guint8 *reference;
+
+    gint failures;
+} Test;
+
+static void
+test_check_format (Test *test)
+{
+    gdouble limit = formats[test->format].lossless ? LOSSLESS_PSNR : min_psnr;
+    gint max_difference;
+    gdouble psnr;
+
+    psnr = test_compare_images (test->result, test->reference,
+                                test->width, test->height, test->width * 4, 4,
+                                &max_difference);
+
+    if (psnr < limit)
+      {
+        g_print ("strength %d, %s: FAIL, PSNR %.2f dB\n",
+                 test->strength, formats[test->format].name, psnr);
+        test->failures++;
+      }
+    else
+        g_print ("strength %d, %s: ok, PSNR %.2f dB\n",
+                 test->strength, formats[test->format].name, psnr);
+}
+
+/* Advances to the next format, then strength, from outside of the paint cycle */
+static gboolean
+test_next_config (gpointer user_data)
+{
+    Test *test = user_data;
+
+    if (++test->format == N_FORMATS)
+      {
+        test->format = 0;
+        if (++test->strength == N_STRENGTHS)
+          {
+            clutter_main_quit ();
+            return G_SOURCE_REMOVE;
+          }
+      }
+
+    clutter_kawase_blur_effect_update_blur_strength (test->effect, test->strength);
+    clutter_kawase_blur_effect_set_intermediate_format (test->effect,
+                                                        formats[test->format].format);
+    clutter_actor_queue_redraw (test->stage.actor);
+    test_stage_wait (&test->stage);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_paint_done (TestStage       *stage,
+                 CoglFramebuffer *framebuffer,
+                 gpointer         user_data)
+{
+    Test *test = user_data;
+
+    test_stage_read_pixels (stage, framebuffer,
+                            test->format == 0 ? test->reference : test->result);
+
+    if (test->format > 0)
+        test_check_format (test);
+
+    g_idle_add (test_next_config, test);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Test test = { 0, };
+    GdkPixbuf *pixbuf;
+    ClutterActor *actor;
+
+    context = g_option_context_new ("- compare the intermediate formats with RGBA8888");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    if (image_path == NULL)
+      {
+        g_printerr ("--image is required\n");
+        return EXIT_FAILURE;
+      }
+
+    pixbuf = test_load_image (image_path);
+    if (pixbuf == NULL)
+        return EXIT_FAILURE;
+
+    bench_init (&argc, &argv, hardware);
+
+    test.width = gdk_pixbuf_get_width (pixbuf);
+    test.height = gdk_pixbuf_get_height (pixbuf);
+    test.result = g_malloc ((gsize) test.width * test.height * 4);
+    test.reference = g_malloc ((gsize) test.width * test.height * 4);
+
+    actor = test_create_image_actor (pixbuf);
+    test.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_update_blur_strength (test.effect, 0);
+    clutter_kawase_blur_effect_set_intermediate_format (test.effect, formats[0].format);
+    clutter_actor_add_effect_with_name (actor, "blur", CLUTTER_EFFECT (test.effect));
+
+    test_stage_init (&test.stage, actor, test_paint_done, &test);
+
+    clutter_main ();
+
+    g_free (test.result);
+    g_free (test.reference);
+    g_object_unref (pixbuf);
+    clutter_actor_destroy (test.stage.stage);
+
+    return test.failures > 0 || test.stage.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,327 @@
+/*
+ * Dual Kawase Blur Output Test.
+ *
+ * Blurs an image (the bundled baboon.tiff in the test suite) at all 15
+ * blur strengths and compares every result with the CPU engine, which runs
+ * the same passes as the shaders, and with a reference image that was
+ * rendered the same way on Mesa's llvmpipe. The test fails when the PSNR
+ * of a result drops below --min-psnr or a single channel differs by more
+ * than --max-error (--cpu-min-psnr and --cpu-max-error against the CPU
+ * engine). Missing references only leave out that comparison; --update
+ * (re)writes them instead of comparing.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench-common.h"
+#include "test-common.h"
+#include "clutter-kawase-blur-effect.h"
+#include "clutter-kawase-blur-cpu.h"
+
+#define N_STRENGTHS 15
+
+static gchar *image_path = NULL;
+static gchar *references = NULL;
+static gdouble min_psnr = 40.0;
+static gint max_error = 16;
+static gdouble cpu_min_psnr = 45.0;
+static gint cpu_max_error = 6;
+static gboolean update = FALSE;
+static gboolean hardware = FALSE;
+
+static GOptionEntry entries[] = {
+    { "image", 'i', 0, G_OPTION_ARG_FILENAME, &image_path,
+      "The image to blur", "FILE" },
+    { "references", 'r', 0, G_OPTION_ARG_FILENAME, &references,
+      "Directory holding the reference images", "DIR" },
+    { "min-psnr", 0, 0, G_OPTION_ARG_DOUBLE, &min_psnr,
+      "Lowest PSNR in dB a result may reach against its reference", "DB" },
+    { "max-error", 0, 0, G_OPTION_ARG_INT, &max_error,
+      "Largest difference of a single channel to the reference", "VALUE" },
+    { "cpu-min-psnr", 0, 0, G_OPTION_ARG_DOUBLE, &cpu_min_psnr,
+      "Lowest PSNR in dB a result may reach against the CPU engine", "DB" },
+    { "cpu-max-error", 0, 0, G_OPTION_ARG_INT, &cpu_max_error,
+      "Largest difference of a single channel to the CPU engine", "VALUE" },
+    { "update", 'u', 0, G_OPTION_ARG_NONE, &update,
+      "Write the reference images instead of comparing with them", NULL },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { NULL }
+};
+
+typedef struct {
+    TestStage stage;
+    ClutterKawaseBlurEffect *effect;
+    gint width;
+    gint height;
+
+    gint strength;
+    guint8 *result;
+
+    /* the source image and the CPU engine's blur of it */
+    ClutterKawaseBlurCpu *cpu;
+    ClutterKawaseBlurCpuImage source;
+    ClutterKawaseBlurCpuImage expected;
+
+    gint failures;
+    gint missing;
+} Test;
+
+static gchar *
+reference_path (gint strength)
+{
+    gchar *name = g_strdup_printf ("baboon-%02d.png", strength);
+    gchar *path = g_build_filename (references, name, NULL);
+
+    g_free (name);
+
+    return path;
+}
+
+static void
+test_write_reference (Test *test)
+{
+    gchar *path = reference_path (test->strength);
+    GError *error = NULL;
+    GdkPixbuf *pixbuf;
+
+    pixbuf = gdk_pixbuf_new_from_data (test->result, GDK_COLORSPACE_RGB, TRUE, 8,
+                                       test->width, test->height, test->width * 4,
+                                       NULL, NULL);
+
+    if (!gdk_pixbuf_save (pixbuf, path, "png", &error, NULL))
+      {
+        g_printerr ("Unable to write %s: %s\n", path, error->message);
+        g_error_free (error);
+        test->failures++;
+      }
+    else
+        g_print ("wrote %s\n", path);
+
+    g_object_unref (pixbuf);
+    g_free (path);
+}
+
+static void
+test_check_reference (Test *test)
+{
+    gchar *path = reference_path (test->strength);
+    GError *error = NULL;
+    GdkPixbuf *reference;
+    gdouble psnr;
+    gint max_difference;
+
+    if (!g_file_test (path, G_FILE_TEST_EXISTS))
+      {
+        g_print ("strength %d: no reference %s\n", test->strength, path);
+        test->missing++;
+        g_free (path);
+        return;
+      }
+
+    reference = gdk_pixbuf_new_from_file (path, &error);
+    if (reference == NULL)
+      {
+        g_printerr ("Unable to read %s: %s\n", path, error->message);
+        g_error_free (error);
+        test->failures++;
+        g_free (path);
+        return;
+      }
+
+    if (gdk_pixbuf_get_width (reference) != test->width ||
+        gdk_pixbuf_get_height (reference) != test->height)
+      {
+        g_printerr ("strength %d: %s is %dx%d, the result %dx%d\n",
+                    test->strength, path,
+                    gdk_pixbuf_get_width (reference), gdk_pixbuf_get_height (reference),
+                    test->width, test->height);
+        test->failures++;
+      }
+    else
+      {
+        psnr = test_compare_images (test->result,
+                                    gdk_pixbuf_get_pixels (reference),
+                                    test->width, test->height,
+                                    gdk_pixbuf_get_rowstride (reference),
+                                    gdk_pixbuf_get_n_channels (reference),
+                                    &max_difference);
+
+        if (psnr < min_psnr || max_difference > max_error)
+          {
+            g_print ("strength %d: FAIL, PSNR %.2f dB, max error %d against %s\n",
+                     test->strength, psnr, max_difference, path);
+            test->failures++;
+          }
+        else
+            g_print ("strength %d: ok, PSNR %.2f dB, max error %d against %s\n",
+                     test->strength, psnr, max_difference, path);
+      }
+
+    g_object_unref (reference);
+    g_free (path);
+}
+
+/*
+ * The CPU engine runs the same chain as the shaders, so the result only
+ * differs by the precision of the driver's texture filtering. This needs
+ * no stored data and always runs.
+ */
+static void
+test_check_cpu (Test *test)
+{
+    gdouble psnr;
+    gint iterations, max_difference;
+    gfloat offset;
+
+    clutter_kawase_blur_effect_get_strength_parameters (test->strength, &iterations, &offset);
+    clutter_kawase_blur_cpu_run (test->cpu, &test->source, &test->expected, iterations, offset);
+
+    psnr = test_compare_images (test->result,
+                                test->expected.data,
+                                test->width, test->height,
+                                test->expected.rowstride,
+                                4,
+                                &max_difference);
+
+    if (psnr < cpu_min_psnr || max_difference > cpu_max_error)
+      {
+        g_print ("strength %d: FAIL, PSNR %.2f dB, max error %d against the CPU engine\n",
+                 test->strength, psnr, max_difference);
+        test->failures++;
+      }
+    else
+        g_print ("strength %d: ok, PSNR %.2f dB, max error %d against the CPU engine\n",
+                 test->strength, psnr, max_difference);
+}
+
+/* Advances to the next strength from outside of the paint cycle */
+static gboolean
+test_next_strength (gpointer user_data)
+{
+    Test *test = user_data;
+
+    if (++test->strength == N_STRENGTHS)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    clutter_kawase_blur_effect_update_blur_strength (test->effect, test->strength);
+    clutter_actor_queue_redraw (test->stage.actor);
+    test_stage_wait (&test->stage);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_paint_done (TestStage       *stage,
+                 CoglFramebuffer *framebuffer,
+                 gpointer         user_data)
+{
+    Test *test = user_data;
+
+    test_stage_read_pixels (stage, framebuffer, test->result);
+
+    if (update)
+        test_write_reference (test);
+    else
+      {
+        test_check_cpu (test);
+        test_check_reference (test);
+      }
+
+    g_idle_add (test_next_strength, test);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Test test = { 0, };
+    GdkPixbuf *pixbuf;
+    ClutterActor *actor;
+
+    context = g_option_context_new ("- compare the blur with reference images");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    if (image_path == NULL || references == NULL)
+      {
+        g_printerr ("--image and --references are required\n");
+        return EXIT_FAILURE;
+      }
+
+    pixbuf = test_load_image (image_path);
+    if (pixbuf == NULL)
+        return EXIT_FAILURE;
+
+    if (update && g_mkdir_with_parents (references, 0755) != 0)
+      {
+        g_printerr ("Unable to create %s\n", references);
+        return EXIT_FAILURE;
+      }
+
+    // The references are only valid for the driver they were rendered with
+    bench_init (&argc, &argv, hardware);
+
+    test.width = gdk_pixbuf_get_width (pixbuf);
+    test.height = gdk_pixbuf_get_height (pixbuf);
+    test.result = g_malloc ((gsize) test.width * test.height * 4);
+
+    // Opaque, so premultiplying in the effect doesn't change the pixels
+    test.cpu = clutter_kawase_blur_cpu_new ();
+    test.source.data = gdk_pixbuf_get_pixels (pixbuf);
+    test.source.width = test.width;
+    test.source.height = test.height;
+    test.source.rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    test.expected = test.source;
+    test.expected.rowstride = test.width * 4;
+    test.expected.data = g_malloc ((gsize) test.expected.rowstride * test.height);
+
+    actor = test_create_image_actor (pixbuf);
+    test.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_kawase_blur_effect_update_blur_strength (test.effect, 0);
+    clutter_actor_add_effect_with_name (actor, "blur", CLUTTER_EFFECT (test.effect));
+
+    test_stage_init (&test.stage, actor, test_paint_done, &test);
+
+    clutter_main ();
+
+    g_free (test.result);
+    g_free (test.expected.data);
+    clutter_kawase_blur_cpu_free (test.cpu);
+    g_object_unref (pixbuf);
+    clutter_actor_destroy (test.stage.stage);
+
+    if (test.missing > 0)
+        g_print ("%d of %d references are missing, run 'ninja update-references' to create them\n",
+                 test.missing, N_STRENGTHS);
+
+    return test.failures > 0 || test.stage.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/*
+ * Dual Kawase Blur Performance Regression Test.
+ *
+ * Blurs an image (the bundled baboon.tiff in the test suite) whose actor is
+ * redrawn on every frame at all 15 blur strengths. Every frame has to run
+ * exactly the passes of its strength without allocating textures or
+ * framebuffers. The time, the passes and the allocations per frame are
+ * also compared with a baseline that was recorded on the same machine;
+ * the test fails when the time grows by more than --time-tolerance or the
+ * counts grow at all. Without a baseline only the counts are checked;
+ * --update records one instead of comparing.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench-common.h"
+#include "test-common.h"
+#include "clutter-kawase-blur-effect.h"
+
+#define N_STRENGTHS 15
+
+static gchar *image_path = NULL;
+static gchar *baseline = NULL;
+static gint n_frames = 30;
+static gint n_warmup = 5;
+static gdouble time_tolerance = 0.25;
+static gboolean update = FALSE;
+static gboolean hardware = FALSE;
+
+static GOptionEntry entries[] = {
+    { "image", 'i', 0, G_OPTION_ARG_FILENAME, &image_path,
+      "The image to blur", "FILE" },
+    { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline,
+      "The baseline to compare with", "FILE" },
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of measured frames per strength", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &n_warmup,
+      "Number of frames to skip before measuring", "N" },
+    { "time-tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &time_tolerance,
+      "Fraction by which the time per frame may exceed the baseline", "FRACTION" },
+    { "update", 'u', 0, G_OPTION_ARG_NONE, &update,
+      "Record the baseline instead of comparing with it", NULL },
+    { "hardware", 0, 0, G_OPTION_ARG_NONE, &hardware,
+      "Use the hardware GL driver instead of llvmpipe", NULL },
+    { NULL }
+};
+
+/* Measured per strength; the counts are deterministic, the time isn't */
+static const struct {
+    const gchar *key;
+    gboolean timing;
+} metrics[] = {
+    { "mean_ms", TRUE },
+    { "passes_per_frame", FALSE },
+    { "textures_per_frame", FALSE },
+    { "framebuffers_per_frame", FALSE },
+};
+
+#define N_METRICS G_N_ELEMENTS (metrics)
+
+typedef struct {
+    BenchLoop loop;
+    ClutterActor *actor;
+    ClutterKawaseBlurEffect *effect;
+
+    gint strength;
+    gdouble total_ms;
+
+    GKeyFile *results;
+    GKeyFile *baseline;
+    gint regressions;
+} Test;
+
+static void
+test_setup (Test *test)
+{
+    test->loop.frame = -n_warmup;
+    test->total_ms = 0.0;
+
+    clutter_kawase_blur_effect_update_blur_strength (test->effect, test->strength);
+}
+
+/*
+ * Every measured frame redraws the actor, so it runs the whole chain of
+ * the strength: its downsample passes, one upsample pass less and the
+ * final draw. The textures and framebuffers were all allocated during
+ * the warm-up. Unlike the time, this doesn't depend on the machine.
+ */
+static void
+test_check_counts (Test                         *test,
+                   ClutterKawaseBlurEffectStats *stats)
+{
+    gint iterations;
+    guint64 passes;
+
+    clutter_kawase_blur_effect_get_strength_parameters (test->strength, &iterations, NULL);
+    passes = (guint64) 2 * iterations * n_frames;
+
+    if (stats->passes_executed != passes)
+      {
+        g_print ("strength %d: FAIL, %" G_GUINT64_FORMAT " passes in %d frames, expected %"
+                 G_GUINT64_FORMAT "\n",
+                 test->strength, stats->passes_executed, n_frames, passes);
+        test->regressions++;
+      }
+
+    if (stats->textures_allocated > 0 || stats->framebuffers_allocated > 0)
+      {
+        g_print ("strength %d: FAIL, %u textures and %u framebuffers allocated after the warm-up\n",
+                 test->strength, stats->textures_allocated, stats->framebuffers_allocated);
+        test->regressions++;
+      }
+}
+
+static void
+test_record (Test *test)
+{
+    ClutterKawaseBlurEffectStats stats;
+    gchar *group = g_strdup_printf ("strength %d", test->strength);
+    gdouble values[N_METRICS];
+
+    clutter_kawase_blur_effect_get_stats (test->effect, &stats);
+
+    values[0] = test->total_ms / n_frames;
+    values[1] = (gdouble) stats.passes_executed / n_frames;
+    values[2] = (gdouble) stats.textures_allocated / n_frames;
+    values[3] = (gdouble) stats.framebuffers_allocated / n_frames;
+
+    for (guint i = 0; i < N_METRICS; i++)
+      {
+        gdouble reference, limit;
+
+        g_key_file_set_double (test->results, group, metrics[i].key, values[i]);
+
+        if (test->baseline == NULL)
+            continue;
+
+        reference = g_key_file_get_double (test->baseline, group, metrics[i].key, NULL);
+        // The counts are averages over the frames, allow for their rounding in the file
+        limit = metrics[i].timing ? reference * (1.0 + time_tolerance) : reference + 0.001;
+
+        if (values[i] > limit)
+          {
+            g_print ("strength %d: FAIL, %s is %.3f, the baseline %.3f\n",
+                     test->strength, metrics[i].key, values[i], reference);
+            test->regressions++;
+          }
+      }
+
+    g_print ("strength %d: %.3f ms, %.2f passes per frame\n",
+             test->strength, values[0], values[1]);
+
+    test_check_counts (test, &stats);
+
+    g_free (group);
+}
+
+/* Advances to the next frame from outside of the paint cycle */
+static gboolean
+test_next_frame (gpointer user_data)
+{
+    Test *test = user_data;
+
+    if (test->loop.frame < n_frames)
+      {
+        // Redraw the actor, so that every frame runs the whole chain
+        clutter_actor_queue_redraw (test->actor);
+        return G_SOURCE_REMOVE;
+      }
+
+    test_record (test);
+
+    if (++test->strength == N_STRENGTHS)
+      {
+        clutter_main_quit ();
+        return G_SOURCE_REMOVE;
+      }
+
+    test_setup (test);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+test_frame_done (BenchLoop *loop,
+                 gdouble    elapsed_ms,
+                 gpointer   user_data)
+{
+    Test *test = user_data;
+
+    if (loop->frame == -1)
+        clutter_kawase_blur_effect_reset_stats (test->effect);
+    else if (loop->frame >= 0)
+        test->total_ms += elapsed_ms;
+
+    return TRUE;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    Test test = { 0, };
+    GdkPixbuf *pixbuf;
+    ClutterActor *stage;
+
+    context = g_option_context_new ("- compare the cost of the blur with a baseline");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+      }
+    g_option_context_free (context);
+
+    if (image_path == NULL || baseline == NULL)
+      {
+        g_printerr ("--image and --baseline are required\n");
+        return EXIT_FAILURE;
+      }
+
+    n_frames = MAX (n_frames, 1);
+    n_warmup = MAX (n_warmup, 1);
+
+    if (!update)
+      {
+        test.baseline = g_key_file_new ();
+        if (!g_key_file_load_from_file (test.baseline, baseline, G_KEY_FILE_NONE, &error))
+          {
+            g_print ("No baseline in %s (%s), only checking the counts; "
+                     "run 'ninja update-perf-baseline' to record one\n",
+                     baseline, error->message);
+            g_clear_error (&error);
+            g_clear_pointer (&test.baseline, g_key_file_free);
+          }
+      }
+
+    pixbuf = test_load_image (image_path);
+    if (pixbuf == NULL)
+        return EXIT_FAILURE;
+
+    bench_init (&argc, &argv, hardware);
+
+    test.results = g_key_file_new ();
+    test.actor = test_create_image_actor (pixbuf);
+    g_object_unref (pixbuf);
+
+    test.effect = CLUTTER_KAWASE_BLUR_EFFECT (clutter_kawase_blur_effect_new ());
+    clutter_actor_add_effect_with_name (test.actor, "blur", CLUTTER_EFFECT (test.effect));
+
+    // Only timed, never read back, so the size of the window doesn't matter
+    stage = clutter_stage_new ();
+    clutter_actor_add_child (stage, test.actor);
+    clutter_actor_set_size (stage,
+                            clutter_actor_get_width (test.actor),
+                            clutter_actor_get_height (test.actor));
+    bench_loop_init (&test.loop, stage, test_frame_done, test_next_frame, &test);
+
+    test_setup (&test);
+    clutter_actor_show (stage);
+
+    clutter_main ();
+
+    clutter_actor_destroy (stage);
+
+    if (update)
+      {
+        if (!g_key_file_save_to_file (test.results, baseline, &error))
+          {
+            g_printerr ("Unable to write %s: %s\n", baseline, error->message);
+            return EXIT_FAILURE;
+          }
+        g_print ("wrote %s\n", baseline);
+      }
+
+    g_key_file_free (test.results);
+    if (test.baseline != NULL)
+        g_key_file_free (test.baseline);
+
+    return test.regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
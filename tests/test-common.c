@@ -0,0 +1,201 @@
+/*
+ * Shared parts of the effect tests.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#include <math.h>
+#include "test-common.h"
+
+/* With an alpha channel, as the tests read the stage back as RGBA */
+GdkPixbuf *
+test_load_image (const gchar *path)
+{
+    GError *error = NULL;
+    GdkPixbuf *loaded, *pixbuf;
+
+    loaded = gdk_pixbuf_new_from_file (path, &error);
+    if (loaded == NULL)
+      {
+        g_printerr ("Unable to read %s: %s\n", path, error->message);
+        g_error_free (error);
+        return NULL;
+      }
+
+    pixbuf = gdk_pixbuf_add_alpha (loaded, FALSE, 0, 0, 0);
+    g_object_unref (loaded);
+
+    return pixbuf;
+}
+
+/* An actor of the size of the image, showing it */
+ClutterActor *
+test_create_image_actor (GdkPixbuf *pixbuf)
+{
+    ClutterContent *image = clutter_image_new ();
+    ClutterActor *actor = clutter_actor_new ();
+
+    clutter_image_set_data (CLUTTER_IMAGE (image),
+                            gdk_pixbuf_get_pixels (pixbuf),
+                            COGL_PIXEL_FORMAT_RGBA_8888,
+                            gdk_pixbuf_get_width (pixbuf),
+                            gdk_pixbuf_get_height (pixbuf),
+                            gdk_pixbuf_get_rowstride (pixbuf),
+                            NULL);
+
+    clutter_actor_set_content (actor, image);
+    clutter_actor_set_size (actor,
+                            gdk_pixbuf_get_width (pixbuf),
+                            gdk_pixbuf_get_height (pixbuf));
+    g_object_unref (image);
+
+    return actor;
+}
+
+/*
+ * Peak signal-to-noise ratio of the color channels in dB, and the largest
+ * difference. result is tightly packed RGBA as read back from the stage,
+ * pixels may have any rowstride and 3 or 4 channels.
+ */
+gdouble
+test_compare_images (const guint8 *result,
+                     const guint8 *pixels,
+                     gint          width,
+                     gint          height,
+                     gint          rowstride,
+                     gint          channels,
+                     gint         *max_difference)
+{
+    gdouble sum = 0.0;
+    gdouble mse;
+
+    *max_difference = 0;
+
+    for (gint y = 0; y < height; y++)
+      {
+        for (gint x = 0; x < width; x++)
+          {
+            for (gint c = 0; c < 3; c++)
+              {
+                gint d = (gint) result[(y * width + x) * 4 + c] - pixels[y * rowstride + x * channels + c];
+
+                sum += (gdouble) d * d;
+                *max_difference = MAX (*max_difference, ABS (d));
+              }
+          }
+      }
+
+    mse = sum / ((gdouble) width * height * 3.0);
+    if (mse == 0.0)
+        return TEST_PSNR_IDENTICAL;
+
+    return MIN (10.0 * log10 (255.0 * 255.0 / mse), TEST_PSNR_IDENTICAL);
+}
+
+static gboolean
+test_stage_retry (gpointer user_data)
+{
+    TestStage *stage = user_data;
+
+    clutter_actor_queue_redraw (stage->actor);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_stage_paint_end (ClutterActor *actor,
+                      TestStage    *stage)
+{
+    CoglFramebuffer *framebuffer = cogl_get_draw_framebuffer ();
+    gint width = cogl_framebuffer_get_width (framebuffer);
+    gint height = cogl_framebuffer_get_height (framebuffer);
+
+    if (!stage->pending || stage->failed)
+        return;
+
+    // The window of the stage may not have its final size in the first frames
+    if (width < stage->width || height < stage->height)
+      {
+        if (stage->retries++ < TEST_MAX_RETRIES)
+          {
+            g_idle_add (test_stage_retry, stage);
+            return;
+          }
+
+        // E.g. larger than the window manager lets the window become
+        g_printerr ("Unable to read the stage back: it is %dx%d, the image %dx%d\n",
+                    width, height, stage->width, stage->height);
+        stage->failed = TRUE;
+        clutter_main_quit ();
+        return;
+      }
+
+    stage->pending = FALSE;
+    stage->paint_done (stage, framebuffer, stage->user_data);
+}
+
+/*
+ * Puts actor on a new stage of its size and shows it. The first paint is
+ * waited for, paint_done is called once it has the size of the actor.
+ */
+void
+test_stage_init (TestStage     *stage,
+                 ClutterActor  *actor,
+                 TestPaintFunc  paint_done,
+                 gpointer       user_data)
+{
+    gfloat width, height;
+
+    clutter_actor_get_size (actor, &width, &height);
+
+    stage->stage = clutter_stage_new ();
+    stage->actor = actor;
+    stage->width = (gint) width;
+    stage->height = (gint) height;
+    stage->pending = TRUE;
+    stage->retries = 0;
+    stage->failed = FALSE;
+    stage->paint_done = paint_done;
+    stage->user_data = user_data;
+
+    clutter_actor_add_child (stage->stage, actor);
+    clutter_actor_set_size (stage->stage, width, height);
+    g_signal_connect_after (stage->stage, "paint", G_CALLBACK (test_stage_paint_end), stage);
+    clutter_actor_show (stage->stage);
+}
+
+/* Waits for the next paint, queue the redraw that causes it as needed */
+void
+test_stage_wait (TestStage *stage)
+{
+    stage->pending = TRUE;
+}
+
+/* Reads the part of the stage the image covers, as tightly packed RGBA */
+void
+test_stage_read_pixels (TestStage       *stage,
+                        CoglFramebuffer *framebuffer,
+                        guint8          *pixels)
+{
+    cogl_framebuffer_read_pixels (framebuffer,
+                                  0, 0,
+                                  stage->width, stage->height,
+                                  COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                  pixels);
+}
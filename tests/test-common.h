@@ -0,0 +1,91 @@
+/*
+ * Shared parts of the effect tests: the test image, the comparison of
+ * images and the stage whose contents are read back once its window has
+ * the size of the image.
+ *
+ * Copyright (C) 2019  Julius Piso
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Julius Piso <julius@piso.at>
+ */
+
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+/* Reported instead of an infinite PSNR for identical images */
+#define TEST_PSNR_IDENTICAL 99.0
+
+/* Frames to wait for the window of the stage to grow to the size of the image */
+#define TEST_MAX_RETRIES 60
+
+typedef struct _TestStage TestStage;
+
+/*
+ * Called from the end of the paint the test waits for, with the
+ * framebuffer of the stage, which is at least as large as the image.
+ */
+typedef void (* TestPaintFunc) (TestStage       *stage,
+                                CoglFramebuffer *framebuffer,
+                                gpointer         user_data);
+
+struct _TestStage {
+    ClutterActor *stage;
+    /* shows the image, redrawn while the window grows */
+    ClutterActor *actor;
+    gint width;
+    gint height;
+
+    /* whether the next paint is the one the test waits for */
+    gboolean pending;
+    gint retries;
+    /* the window never got the size of the image */
+    gboolean failed;
+
+    TestPaintFunc paint_done;
+    gpointer user_data;
+};
+
+GdkPixbuf *test_load_image (const gchar *path);
+
+ClutterActor *test_create_image_actor (GdkPixbuf *pixbuf);
+
+gdouble test_compare_images (const guint8 *result,
+                             const guint8 *pixels,
+                             gint          width,
+                             gint          height,
+                             gint          rowstride,
+                             gint          channels,
+                             gint         *max_difference);
+
+void test_stage_init (TestStage     *stage,
+                      ClutterActor  *actor,
+                      TestPaintFunc  paint_done,
+                      gpointer       user_data);
+
+void test_stage_wait (TestStage *stage);
+
+void test_stage_read_pixels (TestStage       *stage,
+                             CoglFramebuffer *framebuffer,
+                             guint8          *pixels);
+
+G_END_DECLS
+
+#endif /* __TEST_COMMON_H__ */